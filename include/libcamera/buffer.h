@@ -38,6 +38,7 @@ class FrameBuffer final
 public:
 	struct Plane {
 		FileDescriptor fd;
+		unsigned int offset = 0;
 		unsigned int length;
 	};
 
@@ -60,7 +61,8 @@ public:
 
 	int copyFrom(const FrameBuffer *src);
 private:
-	friend class Request; /* Needed to update request_. */
+	friend class Request; /* Needed to update request_ and metadata_. */
+	friend class PipelineHandlerVirtual; /* Needed to update metadata_. */
 	friend class V4L2VideoDevice; /* Needed to update metadata_. */
 
 	std::vector<Plane> planes_;
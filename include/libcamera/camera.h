@@ -7,6 +7,8 @@
 #ifndef __LIBCAMERA_CAMERA_H__
 #define __LIBCAMERA_CAMERA_H__
 
+#include <chrono>
+#include <map>
 #include <memory>
 #include <set>
 #include <stdint.h>
@@ -16,10 +18,12 @@
 #include <libcamera/object.h>
 #include <libcamera/request.h>
 #include <libcamera/signal.h>
+#include <libcamera/span.h>
 #include <libcamera/stream.h>
 
 namespace libcamera {
 
+class CompletionQueue;
 class FrameBuffer;
 class FrameBufferAllocator;
 class PipelineHandler;
@@ -67,9 +71,49 @@ protected:
 	std::vector<StreamConfiguration> config_;
 };
 
+struct CameraStatistics {
+	struct Latency {
+		std::chrono::nanoseconds min;
+		std::chrono::nanoseconds average;
+		std::chrono::nanoseconds max;
+		uint64_t samples;
+	};
+
+	struct StreamStatistics {
+		uint64_t framesCaptured;
+		uint64_t framesFailed;
+		uint64_t framesCancelled;
+		uint64_t framesDropped;
+	};
+
+	uint64_t requestsQueued;
+	uint64_t requestsCompleted;
+	uint64_t requestsCancelled;
+	uint64_t requestsDropped;
+	unsigned int queueDepth;
+
+	Latency completionLatency;
+	Latency ipaLatency;
+
+	uint64_t bufferCacheHits;
+	uint64_t bufferCacheMisses;
+
+	std::map<const Stream *, StreamStatistics> streams;
+};
+
 class Camera final : public Object, public std::enable_shared_from_this<Camera>
 {
 public:
+	enum CompletionOrder {
+		CompletionInOrder,
+		CompletionOutOfOrder,
+	};
+
+	enum QueueingPolicy {
+		QueueingFifo,
+		QueueingDropOldest,
+	};
+
 	static std::shared_ptr<Camera> create(PipelineHandler *pipe,
 					      const std::string &id,
 					      const std::set<Stream *> &streams);
@@ -93,8 +137,19 @@ public:
 	std::unique_ptr<CameraConfiguration> generateConfiguration(const StreamRoles &roles = {});
 	int configure(CameraConfiguration *config);
 
+	int setCompletionOrder(CompletionOrder order);
+	CompletionOrder completionOrder() const;
+
+	int setQueueingPolicy(QueueingPolicy policy);
+	QueueingPolicy queueingPolicy() const;
+
+	int setCompletionQueue(CompletionQueue *queue);
+
+	CameraStatistics statistics() const;
+
 	Request *createRequest(uint64_t cookie = 0);
 	int queueRequest(Request *request);
+	int queueRequests(Span<Request *const> requests);
 
 	int start();
 	int stop();
@@ -109,9 +164,11 @@ private:
 
 	friend class PipelineHandler;
 	void disconnect();
-	void requestComplete(Request *request);
+	bool isRunning() const;
+	Request *requestComplete(Request *request);
 
 	friend class FrameBufferAllocator;
+	int validateAllocation(Stream *stream) const;
 	int exportFrameBuffers(Stream *stream,
 			       std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 };
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * completion_queue.h - Request completion queue
+ */
+#ifndef __LIBCAMERA_COMPLETION_QUEUE_H__
+#define __LIBCAMERA_COMPLETION_QUEUE_H__
+
+#include <memory>
+#include <stddef.h>
+#include <vector>
+
+namespace libcamera {
+
+class Camera;
+class Request;
+
+class CompletionQueue
+{
+public:
+	CompletionQueue(unsigned int size = 64);
+	CompletionQueue(const CompletionQueue &) = delete;
+	CompletionQueue &operator=(const CompletionQueue &) = delete;
+
+	~CompletionQueue();
+
+	bool isValid() const;
+	int fd() const;
+
+	size_t reap(std::vector<Request *> *requests);
+
+private:
+	friend class Camera;
+
+	void push(Request *request);
+	Request *replace(const Camera *camera, Request *request);
+
+	class Private;
+	std::unique_ptr<Private> p_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_COMPLETION_QUEUE_H__ */
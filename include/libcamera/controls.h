@@ -12,6 +12,7 @@
 #include <stdint.h>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <libcamera/geometry.h>
 #include <libcamera/span.h>
@@ -92,6 +93,8 @@ struct control_type<Span<T, N>> : public control_type<std::remove_cv_t<T>> {
 class ControlValue
 {
 public:
+	static constexpr std::size_t kInlineStorageSize = 64;
+
 	ControlValue();
 
 #ifndef __DOXYGEN__
@@ -122,6 +125,8 @@ public:
 
 	ControlValue(const ControlValue &other);
 	ControlValue &operator=(const ControlValue &other);
+	ControlValue(ControlValue &&other) noexcept;
+	ControlValue &operator=(ControlValue &&other) noexcept;
 
 	ControlType type() const { return type_; }
 	bool isNone() const { return type_ == ControlTypeNone; }
@@ -196,11 +201,12 @@ private:
 	bool isArray_;
 	std::size_t numElements_ : 32;
 	union {
-		uint64_t value_;
+		alignas(uint64_t) uint8_t value_[kInlineStorageSize];
 		void *storage_;
 	};
 
 	void release();
+	void moveFrom(ControlValue &other);
 	void set(ControlType type, bool isArray, const void *data,
 		 std::size_t numElements, std::size_t elementSize);
 };
@@ -299,11 +305,11 @@ public:
 	using Map = std::unordered_map<const ControlId *, ControlInfo>;
 
 	ControlInfoMap() = default;
-	ControlInfoMap(const ControlInfoMap &other) = default;
+	ControlInfoMap(const ControlInfoMap &other);
 	ControlInfoMap(std::initializer_list<Map::value_type> init);
 	ControlInfoMap(Map &&info);
 
-	ControlInfoMap &operator=(const ControlInfoMap &other) = default;
+	ControlInfoMap &operator=(const ControlInfoMap &other);
 	ControlInfoMap &operator=(std::initializer_list<Map::value_type> init);
 	ControlInfoMap &operator=(Map &&info);
 
@@ -334,8 +340,13 @@ public:
 
 private:
 	void generateIdmap();
+	void generateIndex();
+	iterator lookup(unsigned int id);
 
 	ControlIdMap idmap_;
+
+	unsigned int indexBase_ = 0;
+	std::vector<iterator> index_;
 };
 
 class ControlList
@@ -14,13 +14,20 @@
 namespace libcamera {
 
 class Camera;
+class DmaBufPool;
 class FrameBuffer;
 class Stream;
 
 class FrameBufferAllocator
 {
 public:
-	FrameBufferAllocator(std::shared_ptr<Camera> camera);
+	enum Backend {
+		BackendDevice,
+		BackendDmaHeap,
+	};
+
+	FrameBufferAllocator(std::shared_ptr<Camera> camera,
+			     Backend backend = BackendDevice);
 	FrameBufferAllocator(const Camera &) = delete;
 	FrameBufferAllocator &operator=(const Camera &) = delete;
 
@@ -32,8 +39,16 @@ public:
 	bool allocated() const { return !buffers_.empty(); }
 	const std::vector<std::unique_ptr<FrameBuffer>> &buffers(Stream *stream) const;
 
+	Backend backend() const { return backend_; }
+
 private:
+	int allocateFromPool(Stream *stream,
+			     std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+	void releaseToPool(std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+
 	std::shared_ptr<Camera> camera_;
+	Backend backend_;
+	std::shared_ptr<DmaBufPool> pool_;
 	std::map<Stream *, std::vector<std::unique_ptr<FrameBuffer>>> buffers_;
 };
 
@@ -28,18 +28,42 @@ public:
 	bool isValid() const { return error_ == 0; }
 	int error() const { return error_; }
 	const std::vector<Plane> &maps() const { return maps_; }
+	const std::vector<Plane> &planes() const { return planes_; }
 
 protected:
 	MappedBuffer();
 
 	int error_;
 	std::vector<Plane> maps_;
+	std::vector<Plane> planes_;
 };
 
 class MappedFrameBuffer : public MappedBuffer
 {
 public:
+	enum SyncFlag {
+		SyncRead = (1 << 0),
+		SyncWrite = (1 << 1),
+		SyncReadWrite = SyncRead | SyncWrite,
+	};
+
 	MappedFrameBuffer(const FrameBuffer *buffer, int flags);
+	~MappedFrameBuffer();
+
+	MappedFrameBuffer(MappedFrameBuffer &&other);
+	MappedFrameBuffer &operator=(MappedFrameBuffer &&other);
+
+	int beginAccess(unsigned int flags);
+	int beginAccess(unsigned int flags, unsigned int plane);
+	int endAccess();
+
+private:
+	int beginMapAccess(unsigned int map, unsigned int flags);
+	int sync(unsigned int map, uint64_t flags);
+
+	std::vector<FileDescriptor> dmabufs_;
+	std::vector<unsigned int> planeMaps_;
+	std::vector<unsigned int> accessFlags_;
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * camera_statistics.h - Camera runtime statistics collection
+ */
+#ifndef __LIBCAMERA_INTERNAL_CAMERA_STATISTICS_H__
+#define __LIBCAMERA_INTERNAL_CAMERA_STATISTICS_H__
+
+#include <atomic>
+#include <map>
+#include <set>
+#include <stdint.h>
+
+#include <libcamera/camera.h>
+
+#include "libcamera/internal/utils.h"
+
+namespace libcamera {
+
+class Stream;
+struct FrameMetadata;
+
+class LatencyCounter
+{
+public:
+	LatencyCounter();
+
+	void add(utils::duration latency);
+	void reset();
+
+	CameraStatistics::Latency snapshot() const;
+
+private:
+	std::atomic<int64_t> min_;
+	std::atomic<int64_t> max_;
+	std::atomic<int64_t> sum_;
+	std::atomic<uint64_t> samples_;
+};
+
+class CameraStatisticsCollector
+{
+public:
+	CameraStatisticsCollector();
+
+	void reset(const std::set<const Stream *> &streams);
+
+	void requestQueued(unsigned int queueDepth);
+	void requestCompleted(bool cancelled, utils::duration latency,
+			      unsigned int cacheHits, unsigned int cacheMisses);
+	void requestDropped();
+	void setQueueDepth(unsigned int queueDepth);
+	void bufferCompleted(const Stream *stream, const FrameMetadata &metadata);
+	void ipaCompleted(utils::duration latency);
+
+	CameraStatistics snapshot() const;
+
+private:
+	struct StreamCounters {
+		std::atomic<uint64_t> framesCaptured;
+		std::atomic<uint64_t> framesFailed;
+		std::atomic<uint64_t> framesCancelled;
+		std::atomic<uint64_t> framesDropped;
+
+		/* Only accessed from the pipeline handler thread. */
+		bool sequenceValid;
+		unsigned int lastSequence;
+	};
+
+	std::atomic<uint64_t> requestsQueued_;
+	std::atomic<uint64_t> requestsCompleted_;
+	std::atomic<uint64_t> requestsCancelled_;
+	std::atomic<uint64_t> requestsDropped_;
+	std::atomic<unsigned int> queueDepth_;
+
+	LatencyCounter completionLatency_;
+	LatencyCounter ipaLatency_;
+
+	std::atomic<uint64_t> bufferCacheHits_;
+	std::atomic<uint64_t> bufferCacheMisses_;
+
+	std::map<const Stream *, StreamCounters> streams_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_CAMERA_STATISTICS_H__ */
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * control_id_tables.h - Dense control and property ID tables
+ */
+#ifndef __LIBCAMERA_INTERNAL_CONTROL_ID_TABLES_H__
+#define __LIBCAMERA_INTERNAL_CONTROL_ID_TABLES_H__
+
+#include <libcamera/controls.h>
+#include <libcamera/span.h>
+
+namespace libcamera {
+
+namespace controls {
+
+extern const Span<const ControlId *const> idTable;
+
+} /* namespace controls */
+
+namespace properties {
+
+extern const Span<const ControlId *const> idTable;
+
+} /* namespace properties */
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_CONTROL_ID_TABLES_H__ */
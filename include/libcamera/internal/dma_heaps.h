@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Limited
+ *
+ * dma_heaps.h - Helper class for dma-heap allocations.
+ */
+#ifndef __LIBCAMERA_INTERNAL_DMA_HEAPS_H__
+#define __LIBCAMERA_INTERNAL_DMA_HEAPS_H__
+
+#include <map>
+#include <memory>
+#include <stddef.h>
+
+#include <libcamera/file_descriptor.h>
+
+#include "libcamera/internal/thread.h"
+
+namespace libcamera {
+
+class DmaHeap
+{
+public:
+	enum DmaHeapFlag {
+		DmaHeapFlagCma = (1 << 0),
+		DmaHeapFlagSystem = (1 << 1),
+		DmaHeapFlagUDmaBuf = (1 << 2),
+	};
+
+	DmaHeap(unsigned int flags = DmaHeapFlagCma);
+	~DmaHeap();
+
+	bool isValid() const { return dmaHeapHandle_ > -1 || udmabufHandle_ > -1; }
+	FileDescriptor alloc(const char *name, std::size_t size);
+
+private:
+	FileDescriptor allocFromHeap(const char *name, std::size_t size);
+	FileDescriptor allocFromUDmaBuf(const char *name, std::size_t size);
+
+	int dmaHeapHandle_;
+	int udmabufHandle_;
+};
+
+class DmaBufPool
+{
+public:
+	static std::shared_ptr<DmaBufPool> instance();
+
+	DmaBufPool();
+	~DmaBufPool();
+
+	bool isValid() const { return heap_.isValid(); }
+
+	FileDescriptor alloc(const char *name, std::size_t size);
+	void release(const FileDescriptor &fd);
+
+	std::size_t cachedBuffers();
+	void trim();
+
+private:
+	DmaHeap heap_;
+
+	Mutex mutex_;
+	std::multimap<std::size_t, FileDescriptor> freeBuffers_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_DMA_HEAPS_H__ */
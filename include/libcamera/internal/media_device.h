@@ -51,6 +51,14 @@ public:
 			const MediaEntity *sink, unsigned int sinkIdx);
 	MediaLink *link(const MediaPad *source, const MediaPad *sink);
 	int disableLinks();
+	int setupLinks(const std::vector<MediaLink *> &links);
+
+	struct LinkCounters {
+		unsigned int applied;
+		unsigned int skipped;
+	};
+
+	const LinkCounters &linkCounters() const { return linkCounters_; }
 
 	Signal<MediaDevice *> disconnected;
 
@@ -71,6 +79,8 @@ private:
 	bool populatePads(const struct media_v2_topology &topology);
 	bool populateLinks(const struct media_v2_topology &topology);
 	void fixupEntityFlags(struct media_v2_entity *entity);
+	int syncLinks();
+	int applyLinks(const std::vector<MediaLink *> &links);
 
 	friend int MediaLink::setEnabled(bool enable);
 	int setupLink(const MediaLink *link, unsigned int flags);
@@ -84,6 +94,8 @@ private:
 	bool valid_;
 	bool acquired_;
 	bool lockOwner_;
+	bool linksSynced_;
+	LinkCounters linkCounters_;
 
 	std::map<unsigned int, MediaObject *> objects_;
 	std::vector<MediaEntity *> entities_;
@@ -7,7 +7,7 @@
 #ifndef __LIBCAMERA_INTERNAL_PIPELINE_HANDLER_H__
 #define __LIBCAMERA_INTERNAL_PIPELINE_HANDLER_H__
 
-#include <list>
+#include <deque>
 #include <map>
 #include <memory>
 #include <set>
@@ -17,8 +17,10 @@
 
 #include <libcamera/controls.h>
 #include <libcamera/object.h>
+#include <libcamera/span.h>
 #include <libcamera/stream.h>
 
+#include "libcamera/internal/camera_statistics.h"
 #include "libcamera/internal/ipa_proxy.h"
 
 namespace libcamera {
@@ -37,17 +39,21 @@ class CameraData
 {
 public:
 	explicit CameraData(PipelineHandler *pipe)
-		: pipe_(pipe)
+		: pipe_(pipe), requestSequence_(0), deliveredSequence_(0)
 	{
 	}
 	virtual ~CameraData() {}
 
 	Camera *camera_;
 	PipelineHandler *pipe_;
-	std::list<Request *> queuedRequests_;
+	std::deque<Request *> queuedRequests_;
+	std::deque<Request *> recycledRequests_;
+	uint32_t requestSequence_;
+	uint32_t deliveredSequence_;
 	ControlInfoMap controlInfo_;
 	ControlList properties_;
 	std::unique_ptr<IPAProxy> ipa_;
+	CameraStatisticsCollector statistics_;
 
 private:
 	CameraData(const CameraData &) = delete;
@@ -71,6 +77,10 @@ public:
 	const ControlInfoMap &controls(const Camera *camera) const;
 	const ControlList &properties(const Camera *camera) const;
 
+	CameraStatistics statistics(const Camera *camera) const;
+	void resetStatistics(const Camera *camera,
+			     const std::set<const Stream *> &streams);
+
 	virtual CameraConfiguration *generateConfiguration(Camera *camera,
 		const StreamRoles &roles) = 0;
 	virtual int configure(Camera *camera, CameraConfiguration *config) = 0;
@@ -82,6 +92,8 @@ public:
 	virtual void stop(Camera *camera) = 0;
 
 	int queueRequest(Camera *camera, Request *request);
+	void queueRequests(Camera *camera, const std::vector<Request *> &requests);
+	void requeueRequests(Camera *camera);
 
 	bool completeBuffer(Camera *camera, Request *request,
 			    FrameBuffer *buffer);
@@ -95,6 +107,8 @@ protected:
 	void hotplugMediaDevice(MediaDevice *media);
 
 	virtual int queueRequestDevice(Camera *camera, Request *request) = 0;
+	virtual unsigned int queueRequestsDevice(Camera *camera,
+						 Span<Request *const> requests);
 
 	CameraData *cameraData(const Camera *camera);
 	const CameraData *cameraData(const Camera *camera) const;
@@ -102,6 +116,9 @@ protected:
 	CameraManager *manager_;
 
 private:
+	void deliverRequest(Camera *camera, Request *request);
+	void recycleRequest(Camera *camera, Request *request);
+
 	void mediaDeviceDisconnected(MediaDevice *media);
 	virtual void disconnect();
 
@@ -9,8 +9,10 @@
 
 #include <memory>
 #include <mutex>
+#include <string>
 #include <sys/types.h>
 #include <thread>
+#include <vector>
 
 #include <libcamera/signal.h>
 
@@ -28,6 +30,32 @@ class ThreadMain;
 using Mutex = std::mutex;
 using MutexLocker = std::unique_lock<std::mutex>;
 
+class ThreadPolicy
+{
+public:
+	enum Role {
+		RoleDefault,
+		RolePipeline,
+		RoleIPA,
+		RoleIPAWorker,
+		RolePostProcessing,
+	};
+
+	ThreadPolicy();
+
+	bool isDefault() const;
+	int parse(const std::string &options);
+
+	static ThreadPolicy get(Role role);
+	static void set(Role role, const ThreadPolicy &policy);
+	static void apply(Role role);
+
+	std::vector<unsigned int> cpus;
+	bool realtime;
+	int priority;
+	int nice;
+};
+
 class Thread
 {
 public:
@@ -40,6 +68,8 @@ public:
 
 	bool isRunning();
 
+	void setRole(ThreadPolicy::Role role);
+
 	Signal<Thread *> finished;
 
 	static Thread *current();
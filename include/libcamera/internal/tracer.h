@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * tracer.h - Request lifecycle tracing
+ */
+#ifndef __LIBCAMERA_INTERNAL_TRACER_H__
+#define __LIBCAMERA_INTERNAL_TRACER_H__
+
+#include <ostream>
+#include <string>
+
+namespace libcamera {
+
+class Request;
+class Stream;
+
+class Tracer
+{
+public:
+	enum Phase {
+		PhaseInstant = 'i',
+		PhaseAsyncBegin = 'b',
+		PhaseAsyncEnd = 'e',
+	};
+
+	static bool enabled() { return enabled_; }
+
+	static void instant(const char *name, const Request *request = nullptr,
+			    const Stream *stream = nullptr)
+	{
+		if (enabled_)
+			record(PhaseInstant, name, request, stream);
+	}
+
+	static void begin(const char *name, const Request *request)
+	{
+		if (enabled_)
+			record(PhaseAsyncBegin, name, request, nullptr);
+	}
+
+	static void end(const char *name, const Request *request)
+	{
+		if (enabled_)
+			record(PhaseAsyncEnd, name, request, nullptr);
+	}
+
+	static void dump();
+	static void dump(std::ostream &stream);
+
+private:
+	static bool initialize();
+	static void record(Phase phase, const char *name,
+			   const Request *request, const Stream *stream);
+
+	static bool enabled_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_TRACER_H__ */
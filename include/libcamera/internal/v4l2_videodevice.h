@@ -115,7 +115,7 @@ public:
 	V4L2BufferCache(const std::vector<std::unique_ptr<FrameBuffer>> &buffers);
 	~V4L2BufferCache();
 
-	int get(const FrameBuffer &buffer);
+	int get(const FrameBuffer &buffer, bool *hit = nullptr);
 	void put(unsigned int index);
 
 private:
@@ -133,11 +133,13 @@ private:
 	private:
 		struct Plane {
 			Plane(const FrameBuffer::Plane &plane)
-				: fd(plane.fd.fd()), length(plane.length)
+				: fd(plane.fd.fd()), offset(plane.offset),
+				  length(plane.length)
 			{
 			}
 
 			int fd;
+			unsigned int offset;
 			unsigned int length;
 		};
 
@@ -146,7 +148,6 @@ private:
 
 	std::atomic<uint64_t> lastUsedCounter_;
 	std::vector<Entry> cache_;
-	/* \todo Expose the miss counter through an instrumentation API. */
 	unsigned int missCounter_;
 };
 
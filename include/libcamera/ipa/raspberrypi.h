@@ -26,6 +26,7 @@ enum RPiOperations {
 	RPI_IPA_EVENT_SIGNAL_STAT_READY,
 	RPI_IPA_EVENT_SIGNAL_ISP_PREPARE,
 	RPI_IPA_EVENT_QUEUE_REQUEST,
+	RPI_IPA_ACTION_STATS_RELEASE,
 };
 
 enum RPiIpaMask {
@@ -7,6 +7,7 @@
 #ifndef __LIBCAMERA_REQUEST_H__
 #define __LIBCAMERA_REQUEST_H__
 
+#include <chrono>
 #include <map>
 #include <memory>
 #include <stdint.h>
@@ -45,14 +46,18 @@ public:
 	FrameBuffer *findBuffer(const Stream *stream) const;
 
 	uint64_t cookie() const { return cookie_; }
+	uint32_t sequence() const { return sequence_; }
 	Status status() const { return status_; }
 
 	bool hasPendingBuffers() const { return !pending_.empty(); }
 
 private:
 	friend class PipelineHandler;
+	friend class V4L2VideoDevice;
 
 	void complete();
+	void reuse();
+	void cancel();
 
 	bool completeBuffer(FrameBuffer *buffer);
 
@@ -64,8 +69,13 @@ private:
 	std::unordered_set<FrameBuffer *> pending_;
 
 	const uint64_t cookie_;
+	uint32_t sequence_;
 	Status status_;
 	bool cancelled_;
+
+	std::chrono::steady_clock::time_point queueTime_;
+	unsigned int bufferCacheHits_;
+	unsigned int bufferCacheMisses_;
 };
 
 } /* namespace libcamera */
@@ -7,8 +7,8 @@
 #ifndef __LIBCAMERA_SIGNAL_H__
 #define __LIBCAMERA_SIGNAL_H__
 
+#include <atomic>
 #include <functional>
-#include <list>
 #include <type_traits>
 #include <vector>
 
@@ -23,15 +23,38 @@ public:
 	void disconnect(Object *object);
 
 protected:
-	using SlotList = std::list<BoundMethodBase *>;
+	using SlotList = std::vector<BoundMethodBase *>;
+
+	SignalBase();
+	~SignalBase();
 
 	void connect(BoundMethodBase *slot);
-	void disconnect(std::function<bool(SlotList::iterator &)> match);
+	void disconnect(std::function<bool(BoundMethodBase *)> match);
+
+	const SlotList *acquireSlots()
+	{
+		readers_.fetch_add(1, std::memory_order_seq_cst);
+		return slots_.load(std::memory_order_seq_cst);
+	}
 
-	SlotList slots();
+	void releaseSlots()
+	{
+		if (readers_.fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+		    reclaimPending_.load(std::memory_order_seq_cst))
+			reclaim();
+	}
 
 private:
-	SlotList slots_;
+	void update(SlotList *slots, SlotList &&removed);
+	void reclaim();
+	void freeRetired();
+
+	std::atomic<SlotList *> slots_;
+	std::atomic<unsigned int> readers_;
+
+	std::atomic<bool> reclaimPending_;
+	std::vector<SlotList *> retiredLists_;
+	SlotList retiredSlots_;
 };
 
 template<typename... Args>
@@ -70,7 +93,7 @@ public:
 
 	void disconnect()
 	{
-		SignalBase::disconnect([]([[maybe_unused]] SlotList::iterator &iter) {
+		SignalBase::disconnect([]([[maybe_unused]] BoundMethodBase *slot) {
 			return true;
 		});
 	}
@@ -78,17 +101,17 @@ public:
 	template<typename T>
 	void disconnect(T *obj)
 	{
-		SignalBase::disconnect([obj](SlotList::iterator &iter) {
-			return (*iter)->match(obj);
+		SignalBase::disconnect([obj](BoundMethodBase *slot) {
+			return slot->match(obj);
 		});
 	}
 
 	template<typename T, typename R>
 	void disconnect(T *obj, R (T::*func)(Args...))
 	{
-		SignalBase::disconnect([obj, func](SlotList::iterator &iter) {
+		SignalBase::disconnect([obj, func](BoundMethodBase *base) {
 			BoundMethodArgs<R, Args...> *slot =
-				static_cast<BoundMethodArgs<R, Args...> *>(*iter);
+				static_cast<BoundMethodArgs<R, Args...> *>(base);
 
 			if (!slot->match(obj))
 				return false;
@@ -106,9 +129,9 @@ public:
 	template<typename R>
 	void disconnect(R (*func)(Args...))
 	{
-		SignalBase::disconnect([func](SlotList::iterator &iter) {
+		SignalBase::disconnect([func](BoundMethodBase *base) {
 			BoundMethodArgs<R, Args...> *slot =
-				static_cast<BoundMethodArgs<R, Args...> *>(*iter);
+				static_cast<BoundMethodArgs<R, Args...> *>(base);
 
 			if (!slot->match(nullptr))
 				return false;
@@ -120,11 +143,16 @@ public:
 	void emit(Args... args)
 	{
 		/*
-		 * Make a copy of the slots list as the slot could call the
-		 * disconnect operation, invalidating the iterator.
+		 * Take a reference to the current slots list. The list is never
+		 * modified once published, and it stays valid until released
+		 * even if a slot connects or disconnects the signal.
 		 */
-		for (BoundMethodBase *slot : slots())
-			static_cast<BoundMethodArgs<void, Args...> *>(slot)->activate(args...);
+		const SlotList *slots = SignalBase::acquireSlots();
+		if (slots) {
+			for (BoundMethodBase *slot : *slots)
+				static_cast<BoundMethodArgs<void, Args...> *>(slot)->activate(args...);
+		}
+		SignalBase::releaseSlots();
 	}
 };
 
@@ -8,7 +8,9 @@
 #include "camera_device.h"
 #include "camera_ops.h"
 
+#include <algorithm>
 #include <sys/mman.h>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -166,17 +168,19 @@ MappedCamera3Buffer::MappedCamera3Buffer(const buffer_handle_t camera3buffer,
 
 		maps_.emplace_back(static_cast<uint8_t *>(address),
 				   static_cast<size_t>(length));
+		planes_.emplace_back(maps_.back());
 	}
 }
 
 CameraStream::CameraStream(PixelFormat f, Size s)
-	: index(-1), format(f), size(s), jpeg(nullptr)
+	: index(-1), format(f), size(s), jpeg(nullptr), scaler(nullptr)
 {
 }
 
 CameraStream::~CameraStream()
 {
 	delete jpeg;
+	delete scaler;
 };
 
 /*
@@ -188,7 +192,8 @@ CameraStream::~CameraStream()
 
 CameraDevice::Camera3RequestDescriptor::Camera3RequestDescriptor(
 		unsigned int frameNumber, unsigned int numBuffers)
-	: frameNumber(frameNumber), numBuffers(numBuffers)
+	: frameNumber(frameNumber), numBuffers(numBuffers),
+	  sourceBuffers(numBuffers, nullptr)
 {
 	buffers = new camera3_stream_buffer_t[numBuffers];
 	frameBuffers.reserve(numBuffers);
@@ -214,7 +219,7 @@ CameraDevice::Camera3RequestDescriptor::~Camera3RequestDescriptor()
 
 CameraDevice::CameraDevice(unsigned int id, const std::shared_ptr<Camera> &camera)
 	: id_(id), running_(false), camera_(camera), staticMetadata_(nullptr),
-	  facing_(CAMERA_FACING_FRONT), orientation_(0)
+	  gralloc_(nullptr), facing_(CAMERA_FACING_FRONT), orientation_(0)
 {
 	camera_->requestCompleted.connect(this, &CameraDevice::requestComplete);
 
@@ -223,10 +228,19 @@ CameraDevice::CameraDevice(unsigned int id, const std::shared_ptr<Camera> &camer
 	 *  streamConfiguration.
 	 */
 	maxJpegBufferSize_ = 13 << 20; /* 13631488 from USB HAL */
+
+	postProcessor_ = std::make_unique<PostProcessor>(this);
+	postProcessor_->moveToThread(&postProcessorThread_);
+	postProcessorThread_.setRole(ThreadPolicy::RolePostProcessing);
+	postProcessorThread_.start();
 }
 
 CameraDevice::~CameraDevice()
 {
+	postProcessorThread_.exit();
+	postProcessorThread_.wait();
+	postProcessor_.reset();
+
 	if (staticMetadata_)
 		delete staticMetadata_;
 
@@ -471,6 +485,14 @@ int CameraDevice::open(const hw_module_t *hardwareModule)
 void CameraDevice::close()
 {
 	camera_->stop();
+
+	/* Wait for the completion of all software scaling operations. */
+	postProcessor_->invokeMethod(&PostProcessor::flush,
+				     ConnectionTypeBlocking);
+
+	allocator_.reset();
+	internalBuffers_.clear();
+
 	camera_->release();
 
 	running_ = false;
@@ -1101,10 +1123,11 @@ PixelFormat CameraDevice::toPixelFormat(int format)
 }
 
 /*
- * Inspect the stream_list to produce a list of StreamConfiguration to
- * be use to configure the Camera.
+ * Generate a camera configuration with a StreamConfiguration for each
+ * camera3_stream that is neither produced by JPEG encoding nor by software
+ * scaling, and for the libcamera streams that JPEG streams are encoded from.
  */
-int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
+int CameraDevice::generateStreamConfigurations(camera3_stream_configuration_t *stream_list)
 {
 	/*
 	 * Generate an empty configuration, and construct a StreamConfiguration
@@ -1116,14 +1139,6 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 		return -EINVAL;
 	}
 
-	/*
-	 * Clear and remove any existing configuration from previous calls, and
-	 * ensure the required entries are available without further
-	 * reallocation.
-	 */
-	streams_.clear();
-	streams_.reserve(stream_list->num_streams);
-
 	/*
 	 * Track actually created streams, as there may not be a 1:1 mapping of
 	 * camera3 streams to libcamera streams.
@@ -1132,36 +1147,24 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 
 	/* First handle all non-MJPEG streams. */
 	for (unsigned int i = 0; i < stream_list->num_streams; ++i) {
-		camera3_stream_t *stream = stream_list->streams[i];
-		Size size(stream->width, stream->height);
-
-		PixelFormat format = toPixelFormat(stream->format);
-
-		LOG(HAL, Info) << "Stream #" << i
-			       << ", direction: " << stream->stream_type
-			       << ", width: " << stream->width
-			       << ", height: " << stream->height
-			       << ", format: " << utils::hex(stream->format)
-			       << " (" << format.toString() << ")";
-
-		if (!format.isValid())
-			return -EINVAL;
-
-		streams_.emplace_back(format, size);
-		stream->priv = static_cast<void *>(&streams_[i]);
+		CameraStream *cameraStream = &streams_[i];
 
-		/* Defer handling of MJPEG streams until all others are known. */
-		if (format == formats::MJPEG)
+		/*
+		 * Defer handling of MJPEG streams until all others are known,
+		 * and skip streams derived by software scaling.
+		 */
+		if (cameraStream->format == formats::MJPEG ||
+		    cameraStream->scaler)
 			continue;
 
 		StreamConfiguration streamConfiguration;
 
-		streamConfiguration.size = size;
-		streamConfiguration.pixelFormat = format;
+		streamConfiguration.size = cameraStream->size;
+		streamConfiguration.pixelFormat = cameraStream->format;
 
 		config_->addConfiguration(streamConfiguration);
 
-		streams_[i].index = streamIndex++;
+		cameraStream->index = streamIndex++;
 	}
 
 	/* Now handle MJPEG streams, adding a new stream if required. */
@@ -1214,7 +1217,184 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 		}
 	}
 
-	switch (config_->validate()) {
+	return 0;
+}
+
+/*
+ * Allocate internal buffers for the libcamera streams that scaled streams are
+ * produced from, as capture requests may not contain the source stream. JPEG
+ * streams only need internal buffers when no framework stream provides
+ * buffers for their source, which is the case for streams added for JPEG
+ * support.
+ */
+int CameraDevice::allocateInternalBuffers()
+{
+	allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+
+	for (const CameraStream &cameraStream : streams_) {
+		if (cameraStream.format != formats::MJPEG && !cameraStream.scaler)
+			continue;
+
+		Stream *stream = config_->at(cameraStream.index).stream();
+		if (internalBuffers_.count(stream))
+			continue;
+
+		bool required = std::any_of(streams_.begin(), streams_.end(),
+			[&](const CameraStream &other) {
+				return other.scaler &&
+				       other.index == cameraStream.index;
+			});
+		bool provided = std::any_of(streams_.begin(), streams_.end(),
+			[&](const CameraStream &other) {
+				return other.format != formats::MJPEG &&
+				       !other.scaler &&
+				       other.index == cameraStream.index;
+			});
+		if (!required && provided)
+			continue;
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0) {
+			if (!required) {
+				LOG(HAL, Warning) << "Failed to allocate internal buffers";
+				continue;
+			}
+
+			LOG(HAL, Error) << "Failed to allocate internal buffers";
+			return ret;
+		}
+
+		std::vector<FrameBuffer *> &buffers = internalBuffers_[stream];
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream))
+			buffers.push_back(buffer.get());
+	}
+
+	return 0;
+}
+
+/*
+ * Retrieve the gralloc module, used to lock the buffers of derived streams.
+ * Return nullptr if the module isn't available or doesn't support locking
+ * YCbCr buffers.
+ */
+const gralloc_module_t *CameraDevice::grallocModule()
+{
+#ifdef HAVE_LIBHARDWARE
+	if (!gralloc_) {
+		const hw_module_t *module;
+		int ret = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module);
+		if (ret) {
+			LOG(HAL, Warning) << "Failed to get gralloc module";
+			return nullptr;
+		}
+
+		gralloc_ = reinterpret_cast<const gralloc_module_t *>(module);
+	}
+#endif
+
+	if (!gralloc_ ||
+	    gralloc_->common.module_api_version < GRALLOC_MODULE_API_VERSION_0_2 ||
+	    !gralloc_->lock_ycbcr)
+		return nullptr;
+
+	return gralloc_;
+}
+
+/*
+ * Inspect the stream_list to produce a list of StreamConfiguration to
+ * be use to configure the Camera.
+ */
+int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
+{
+	/*
+	 * Clear and remove any existing configuration from previous calls, and
+	 * ensure the required entries are available without further
+	 * reallocation.
+	 */
+	allocator_.reset();
+	internalBuffers_.clear();
+	streams_.clear();
+	streams_.reserve(stream_list->num_streams);
+
+	for (unsigned int i = 0; i < stream_list->num_streams; ++i) {
+		camera3_stream_t *stream = stream_list->streams[i];
+		Size size(stream->width, stream->height);
+
+		PixelFormat format = toPixelFormat(stream->format);
+
+		LOG(HAL, Info) << "Stream #" << i
+			       << ", direction: " << stream->stream_type
+			       << ", width: " << stream->width
+			       << ", height: " << stream->height
+			       << ", format: " << utils::hex(stream->format)
+			       << " (" << format.toString() << ")";
+
+		if (!format.isValid())
+			return -EINVAL;
+
+		streams_.emplace_back(format, size);
+		stream->priv = static_cast<void *>(&streams_[i]);
+	}
+
+	/*
+	 * Try to produce all the YUV streams with the camera first. If the
+	 * camera can't satisfy the configuration, derive the smallest YUV
+	 * stream for which a larger one exists by scaling in software, and
+	 * try again.
+	 */
+	CameraConfiguration::Status status;
+
+	while (true) {
+		int ret = generateStreamConfigurations(stream_list);
+		if (ret)
+			return ret;
+
+		status = config_->validate();
+		if (status == CameraConfiguration::Valid)
+			break;
+
+		CameraStream *derived = nullptr;
+
+		for (CameraStream &cameraStream : streams_) {
+			const Size &size = cameraStream.size;
+
+			if (cameraStream.format != formats::NV12 ||
+			    cameraStream.scaler)
+				continue;
+
+			bool hasSource = std::any_of(streams_.begin(), streams_.end(),
+				[&](const CameraStream &source) {
+					return &source != &cameraStream &&
+					       source.format == formats::NV12 &&
+					       !source.scaler &&
+					       source.size.width >= size.width &&
+					       source.size.height >= size.height;
+				});
+			if (!hasSource)
+				continue;
+
+			if (!derived ||
+			    size.width * size.height <
+			    derived->size.width * derived->size.height)
+				derived = &cameraStream;
+		}
+
+		if (!derived)
+			break;
+
+		if (!grallocModule()) {
+			LOG(HAL, Info)
+				<< "Can't derive streams without gralloc YCbCr support";
+			break;
+		}
+
+		LOG(HAL, Info) << "Deriving " << derived->size.toString()
+			       << " stream by software scaling";
+
+		derived->scaler = new ScalerNV12();
+	}
+
+	switch (status) {
 	case CameraConfiguration::Valid:
 		break;
 	case CameraConfiguration::Adjusted:
@@ -1231,6 +1411,37 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 		return -EINVAL;
 	}
 
+	/*
+	 * Scale the derived streams from the smallest libcamera stream large
+	 * enough, to minimize the memory bandwidth.
+	 */
+	for (unsigned int i = 0; i < stream_list->num_streams; ++i) {
+		CameraStream *cameraStream = &streams_[i];
+		const StreamConfiguration *source = nullptr;
+
+		if (!cameraStream->scaler)
+			continue;
+
+		for (unsigned int j = 0; j < config_->size(); j++) {
+			const StreamConfiguration &cfg = config_->at(j);
+
+			if (cfg.pixelFormat != formats::NV12 ||
+			    cfg.size.width < cameraStream->size.width ||
+			    cfg.size.height < cameraStream->size.height)
+				continue;
+
+			if (!source ||
+			    cfg.size.width * cfg.size.height <
+			    source->size.width * source->size.height) {
+				source = &cfg;
+				cameraStream->index = j;
+			}
+		}
+
+		LOG(HAL, Info) << "Stream " << i << " scaled from libcamera stream "
+			       << cameraStream->index;
+	}
+
 	for (unsigned int i = 0; i < stream_list->num_streams; ++i) {
 		camera3_stream_t *stream = stream_list->streams[i];
 		CameraStream *cameraStream = &streams_[i];
@@ -1251,6 +1462,34 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 					<< "Failed to configure encoder";
 				return ret;
 			}
+
+			/*
+			 * Generate the EXIF data once for the stream. Only the
+			 * timestamp changes from frame to frame, it is patched
+			 * in each encoded image.
+			 */
+			Exif exif;
+			/* \todo Set Make and Model from external vendor tags. */
+			exif.setMake("libcamera");
+			exif.setModel("cameraModel");
+			exif.setOrientation(orientation_);
+			exif.setSize(cameraStream->size);
+			exif.setTimestamp(0);
+			if (exif.generate() != 0 ||
+			    cameraStream->exif.create(exif.data()) != 0)
+				LOG(HAL, Error) << "Failed to generate valid EXIF data";
+		}
+
+		if (cameraStream->scaler) {
+			unsigned int threads = std::min(std::thread::hardware_concurrency(), 4U);
+
+			int ret = cameraStream->scaler->configure(cfg.size,
+								  cameraStream->size,
+								  threads);
+			if (ret) {
+				LOG(HAL, Error) << "Failed to configure scaler";
+				return ret;
+			}
 		}
 	}
 
@@ -1265,7 +1504,7 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 		return ret;
 	}
 
-	return 0;
+	return allocateInternalBuffers();
 }
 
 FrameBuffer *CameraDevice::createFrameBuffer(const buffer_handle_t camera3buffer)
@@ -1347,7 +1586,8 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 		descriptor->buffers[i].buffer = camera3Buffers[i].buffer;
 
 		/* Software streams are handled after hardware streams complete. */
-		if (cameraStream->format == formats::MJPEG)
+		if (cameraStream->format == formats::MJPEG ||
+		    cameraStream->scaler)
 			continue;
 
 		/*
@@ -1371,9 +1611,53 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 		request->addBuffer(stream, buffer);
 	}
 
+	/*
+	 * Software streams are produced from the buffer of their source
+	 * stream. Use an internal buffer if the request doesn't contain one.
+	 */
+	for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
+		CameraStream *cameraStream =
+			static_cast<CameraStream *>(camera3Buffers[i].stream->priv);
+
+		if (cameraStream->format != formats::MJPEG &&
+		    !cameraStream->scaler)
+			continue;
+
+		StreamConfiguration *streamConfiguration = &config_->at(cameraStream->index);
+		Stream *stream = streamConfiguration->stream();
+		if (request->findBuffer(stream))
+			continue;
+
+		FrameBuffer *buffer = nullptr;
+		{
+			MutexLocker locker(internalBuffersMutex_);
+			auto iter = internalBuffers_.find(stream);
+			if (iter == internalBuffers_.end())
+				continue;
+
+			std::vector<FrameBuffer *> &buffers = iter->second;
+			if (!buffers.empty()) {
+				buffer = buffers.back();
+				buffers.pop_back();
+			}
+		}
+
+		if (!buffer) {
+			LOG(HAL, Error) << "No internal buffer available";
+			returnInternalBuffers(descriptor);
+			delete request;
+			delete descriptor;
+			return -ENOMEM;
+		}
+
+		descriptor->internalBuffers[stream] = buffer;
+		request->addBuffer(stream, buffer);
+	}
+
 	int ret = camera_->queueRequest(request);
 	if (ret) {
 		LOG(HAL, Error) << "Failed to queue request";
+		returnInternalBuffers(descriptor);
 		delete request;
 		delete descriptor;
 		return ret;
@@ -1402,9 +1686,8 @@ void CameraDevice::requestComplete(Request *request)
 	 * It might be appropriate to return a 'correct' (as determined by
 	 * pipeline handlers) timestamp in the Request itself.
 	 */
-	FrameBuffer *buffer = buffers.begin()->second;
-	resultMetadata = getResultMetadata(descriptor->frameNumber,
-					   buffer->metadata().timestamp);
+	uint64_t timestamp = buffers.begin()->second->metadata().timestamp;
+	resultMetadata = getResultMetadata(descriptor->frameNumber, timestamp);
 
 	/* Handle any JPEG compression. */
 	for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
@@ -1440,29 +1723,25 @@ void CameraDevice::requestComplete(Request *request)
 			continue;
 		}
 
-		/* Set EXIF metadata for various tags. */
-		Exif exif;
-		/* \todo Set Make and Model from external vendor tags. */
-		exif.setMake("libcamera");
-		exif.setModel("cameraModel");
-		exif.setOrientation(orientation_);
-		exif.setSize(cameraStream->size);
-		/*
-		 * We set the frame's EXIF timestamp as the time of encode.
-		 * Since the precision we need for EXIF timestamp is only one
-		 * second, it is good enough.
-		 */
-		exif.setTimestamp(std::time(nullptr));
-		if (exif.generate() != 0)
-			LOG(HAL, Error) << "Failed to generate valid EXIF data";
-
-		int jpeg_size = encoder->encode(buffer, mapped.maps()[0], exif.data());
+		const ExifTemplate &exif = cameraStream->exif;
+		int jpeg_size = encoder->encode(buffer, mapped.planes()[0], exif.data());
 		if (jpeg_size < 0) {
 			LOG(HAL, Error) << "Failed to encode stream image";
 			status = CAMERA3_BUFFER_STATUS_ERROR;
 			continue;
 		}
 
+		/*
+		 * We set the frame's EXIF timestamp as the time of encode.
+		 * Since the precision we need for EXIF timestamp is only one
+		 * second, it is good enough.
+		 */
+		if (exif.isValid() &&
+		    exif.patch({ mapped.planes()[0].data(),
+				 static_cast<size_t>(jpeg_size) },
+			       std::time(nullptr)) != 0)
+			LOG(HAL, Error) << "Failed to set EXIF timestamp";
+
 		/*
 		 * Fill in the JPEG blob header.
 		 *
@@ -1475,7 +1754,7 @@ void CameraDevice::requestComplete(Request *request)
 		 * \todo Investigate if the buffer size mismatch is an issue or
 		 * expected behaviour.
 		 */
-		uint8_t *resultPtr = mapped.maps()[0].data() +
+		uint8_t *resultPtr = mapped.planes()[0].data() +
 				     maxJpegBufferSize_ -
 				     sizeof(struct camera3_jpeg_blob);
 		auto *blob = reinterpret_cast<struct camera3_jpeg_blob *>(resultPtr);
@@ -1495,6 +1774,138 @@ void CameraDevice::requestComplete(Request *request)
 					 &jpeg_orientation, 1);
 	}
 
+	/*
+	 * Scale the derived streams in the post-processing thread. All requests
+	 * are then completed by that thread to preserve their order.
+	 */
+	for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
+		CameraStream *cameraStream =
+			static_cast<CameraStream *>(descriptor->buffers[i].stream->priv);
+
+		if (!cameraStream->scaler)
+			continue;
+
+		StreamConfiguration *streamConfiguration = &config_->at(cameraStream->index);
+		descriptor->sourceBuffers[i] =
+			request->findBuffer(streamConfiguration->stream());
+	}
+
+	bool scaling = std::any_of(streams_.begin(), streams_.end(),
+				   [](const CameraStream &cameraStream) {
+					   return cameraStream.scaler != nullptr;
+				   });
+
+	if (scaling) {
+		postProcessor_->invokeMethod(&PostProcessor::process,
+					     ConnectionTypeQueued, descriptor,
+					     status, timestamp,
+					     resultMetadata.release());
+		return;
+	}
+
+	completeDescriptor(descriptor, status, timestamp,
+			   std::move(resultMetadata));
+}
+
+void CameraDevice::PostProcessor::process(Camera3RequestDescriptor *descriptor,
+					  camera3_buffer_status status,
+					  uint64_t timestamp,
+					  CameraMetadata *resultMetadata)
+{
+	device_->scaleStreams(descriptor, status, timestamp,
+			      std::unique_ptr<CameraMetadata>(resultMetadata));
+}
+
+/*
+ * Produce the derived streams of a completed request by scaling their source
+ * stream. This runs in the post-processing thread, as scaling an image takes
+ * too long to be performed in the camera event loop.
+ */
+void CameraDevice::scaleStreams(Camera3RequestDescriptor *descriptor,
+				camera3_buffer_status status, uint64_t timestamp,
+				std::unique_ptr<CameraMetadata> resultMetadata)
+{
+	for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
+		CameraStream *cameraStream =
+			static_cast<CameraStream *>(descriptor->buffers[i].stream->priv);
+
+		if (!cameraStream->scaler || status != CAMERA3_BUFFER_STATUS_OK)
+			continue;
+
+		FrameBuffer *source = descriptor->sourceBuffers[i];
+		if (!source) {
+			LOG(HAL, Error) << "Failed to find a source stream buffer";
+			status = CAMERA3_BUFFER_STATUS_ERROR;
+			continue;
+		}
+
+		const StreamConfiguration &cfg = config_->at(cameraStream->index);
+		unsigned int stride = cfg.stride ? cfg.stride : cfg.size.width;
+		ScalerNV12::Image input;
+
+		MappedFrameBuffer mapped(source, PROT_READ);
+		if (!mapped.isValid() ||
+		    ScalerNV12::mapImage(mapped, stride, cfg.size.height, &input)) {
+			LOG(HAL, Error) << "Failed to map source stream buffer";
+			status = CAMERA3_BUFFER_STATUS_ERROR;
+			continue;
+		}
+
+		/*
+		 * The layout of the framework buffer is only known to gralloc,
+		 * lock it to retrieve the address and stride of its planes.
+		 */
+		buffer_handle_t handle = *descriptor->buffers[i].buffer;
+		const Size &size = cameraStream->size;
+		struct android_ycbcr ycbcr = {};
+
+		int ret = gralloc_->lock_ycbcr(gralloc_, handle,
+					       GRALLOC_USAGE_SW_WRITE_OFTEN,
+					       0, 0, size.width, size.height,
+					       &ycbcr);
+		if (ret) {
+			LOG(HAL, Error) << "Failed to lock stream buffer";
+			status = CAMERA3_BUFFER_STATUS_ERROR;
+			continue;
+		}
+
+		uint8_t *cb = static_cast<uint8_t *>(ycbcr.cb);
+		uint8_t *cr = static_cast<uint8_t *>(ycbcr.cr);
+
+		if (ycbcr.chroma_step == 2 && cr == cb + 1) {
+			ScalerNV12::Image output = {
+				static_cast<uint8_t *>(ycbcr.y), cb,
+				static_cast<unsigned int>(ycbcr.ystride),
+				static_cast<unsigned int>(ycbcr.cstride),
+			};
+
+			mapped.beginAccess(MappedFrameBuffer::SyncRead);
+			ret = cameraStream->scaler->scale(input, output);
+			mapped.endAccess();
+		} else {
+			LOG(HAL, Error) << "Stream buffer layout is not NV12";
+			ret = -EINVAL;
+		}
+
+		gralloc_->unlock(gralloc_, handle);
+
+		if (ret) {
+			LOG(HAL, Error) << "Failed to scale stream image";
+			status = CAMERA3_BUFFER_STATUS_ERROR;
+		}
+	}
+
+	completeDescriptor(descriptor, status, timestamp,
+			   std::move(resultMetadata));
+}
+
+void CameraDevice::completeDescriptor(Camera3RequestDescriptor *descriptor,
+				      camera3_buffer_status status,
+				      uint64_t timestamp,
+				      std::unique_ptr<CameraMetadata> resultMetadata)
+{
+	returnInternalBuffers(descriptor);
+
 	/* Prepare to call back the Android camera stack. */
 	camera3_capture_result_t captureResult = {};
 	captureResult.frame_number = descriptor->frameNumber;
@@ -1509,8 +1920,7 @@ void CameraDevice::requestComplete(Request *request)
 
 
 	if (status == CAMERA3_BUFFER_STATUS_OK) {
-		notifyShutter(descriptor->frameNumber,
-			      buffer->metadata().timestamp);
+		notifyShutter(descriptor->frameNumber, timestamp);
 
 		captureResult.partial_result = 1;
 		captureResult.result = resultMetadata->get();
@@ -1532,6 +1942,16 @@ void CameraDevice::requestComplete(Request *request)
 	delete descriptor;
 }
 
+void CameraDevice::returnInternalBuffers(Camera3RequestDescriptor *descriptor)
+{
+	MutexLocker locker(internalBuffersMutex_);
+
+	for (const auto &[stream, buffer] : descriptor->internalBuffers)
+		internalBuffers_[stream].push_back(buffer);
+
+	descriptor->internalBuffers.clear();
+}
+
 std::string CameraDevice::logPrefix() const
 {
 	return "'" + camera_->id() + "'";
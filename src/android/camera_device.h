@@ -13,17 +13,23 @@
 #include <vector>
 
 #include <hardware/camera3.h>
+#include <hardware/gralloc.h>
 
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
+#include <libcamera/framebuffer_allocator.h>
 #include <libcamera/geometry.h>
+#include <libcamera/object.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/message.h"
+#include "libcamera/internal/thread.h"
 
 #include "jpeg/encoder.h"
+#include "jpeg/exif_template.h"
+#include "yuv/scaler_nv12.h"
 
 class CameraMetadata;
 
@@ -42,6 +48,13 @@ struct CameraStream {
 	libcamera::Size size;
 
 	Encoder *jpeg;
+	ExifTemplate exif;
+
+	/*
+	 * The scaler for streams that can't be produced by the camera, and are
+	 * derived from a larger libcamera stream.
+	 */
+	ScalerNV12 *scaler;
 };
 
 class CameraDevice : protected libcamera::Loggable
@@ -85,6 +98,25 @@ private:
 		uint32_t numBuffers;
 		camera3_stream_buffer_t *buffers;
 		std::vector<std::unique_ptr<libcamera::FrameBuffer>> frameBuffers;
+		std::vector<libcamera::FrameBuffer *> sourceBuffers;
+		std::map<libcamera::Stream *, libcamera::FrameBuffer *> internalBuffers;
+	};
+
+	class PostProcessor : public libcamera::Object
+	{
+	public:
+		PostProcessor(CameraDevice *device)
+			: device_(device)
+		{
+		}
+
+		void process(Camera3RequestDescriptor *descriptor,
+			     camera3_buffer_status status, uint64_t timestamp,
+			     CameraMetadata *resultMetadata);
+		void flush() {}
+
+	private:
+		CameraDevice *device_;
 	};
 
 	struct Camera3StreamConfiguration {
@@ -93,14 +125,24 @@ private:
 	};
 
 	int initializeStreamConfigurations();
+	int generateStreamConfigurations(camera3_stream_configuration_t *stream_list);
+	int allocateInternalBuffers();
 	std::tuple<uint32_t, uint32_t> calculateStaticMetadataSize();
 	libcamera::FrameBuffer *createFrameBuffer(const buffer_handle_t camera3buffer);
 	void notifyShutter(uint32_t frameNumber, uint64_t timestamp);
 	void notifyError(uint32_t frameNumber, camera3_stream_t *stream);
 	CameraMetadata *requestTemplatePreview();
 	libcamera::PixelFormat toPixelFormat(int format);
+	const gralloc_module_t *grallocModule();
 	std::unique_ptr<CameraMetadata> getResultMetadata(int frame_number,
 							  int64_t timestamp);
+	void scaleStreams(Camera3RequestDescriptor *descriptor,
+			  camera3_buffer_status status, uint64_t timestamp,
+			  std::unique_ptr<CameraMetadata> resultMetadata);
+	void completeDescriptor(Camera3RequestDescriptor *descriptor,
+				camera3_buffer_status status, uint64_t timestamp,
+				std::unique_ptr<CameraMetadata> resultMetadata);
+	void returnInternalBuffers(Camera3RequestDescriptor *descriptor);
 
 	unsigned int id_;
 	camera3_device_t camera3Device_;
@@ -117,6 +159,14 @@ private:
 	std::map<int, libcamera::PixelFormat> formatsMap_;
 	std::vector<CameraStream> streams_;
 
+	std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
+	libcamera::Mutex internalBuffersMutex_;
+	std::map<libcamera::Stream *, std::vector<libcamera::FrameBuffer *>> internalBuffers_;
+
+	const gralloc_module_t *gralloc_;
+	libcamera::Thread postProcessorThread_;
+	std::unique_ptr<PostProcessor> postProcessor_;
+
 	int facing_;
 	int orientation_;
 
@@ -106,7 +106,7 @@ int EncoderLibJpeg::configure(const StreamConfiguration &cfg)
 
 void EncoderLibJpeg::compressRGB(const libcamera::MappedBuffer *frame)
 {
-	unsigned char *src = static_cast<unsigned char *>(frame->maps()[0].data());
+	unsigned char *src = static_cast<unsigned char *>(frame->planes()[0].data());
 	/* \todo Stride information should come from buffer configuration. */
 	unsigned int stride = pixelFormatInfo_->stride(compress_.image_width, 0);
 
@@ -144,8 +144,10 @@ void EncoderLibJpeg::compressNV(const libcamera::MappedBuffer *frame)
 	unsigned int cb_pos = nvSwap_ ? 1 : 0;
 	unsigned int cr_pos = nvSwap_ ? 0 : 1;
 
-	const unsigned char *src = static_cast<unsigned char *>(frame->maps()[0].data());
-	const unsigned char *src_c = src + y_stride * compress_.image_height;
+	const unsigned char *src = static_cast<unsigned char *>(frame->planes()[0].data());
+	const unsigned char *src_c = frame->planes().size() > 1 ?
+				     frame->planes()[1].data() :
+				     src + y_stride * compress_.image_height;
 
 	JSAMPROW row_pointer[1];
 	row_pointer[0] = &tmprowbuf[0];
@@ -214,11 +216,15 @@ int EncoderLibJpeg::encode(const FrameBuffer *source,
 	LOG(JPEG, Debug) << "JPEG Encode Starting:" << compress_.image_width
 			 << "x" << compress_.image_height;
 
+	frame.beginAccess(MappedFrameBuffer::SyncRead);
+
 	if (nv_)
 		compressNV(&frame);
 	else
 		compressRGB(&frame);
 
+	frame.endAccess();
+
 	jpeg_finish_compress(&compress_);
 
 	return size;
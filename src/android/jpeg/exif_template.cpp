@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * exif_template.cpp - Precomputed EXIF data with per-frame field patching
+ */
+
+#include "exif_template.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "libcamera/internal/log.h"
+
+using namespace libcamera;
+
+LOG_DECLARE_CATEGORY(EXIF)
+
+namespace {
+
+/* The EXIF header that precedes the TIFF structure in the APP1 segment. */
+constexpr uint8_t kExifHeader[] = { 'E', 'x', 'i', 'f', 0, 0 };
+constexpr size_t kTiffOffset = sizeof(kExifHeader);
+
+constexpr uint16_t kTagDateTime = 0x0132;
+constexpr uint16_t kTagExifIfdPointer = 0x8769;
+constexpr uint16_t kTagDateTimeOriginal = 0x9003;
+constexpr uint16_t kTagDateTimeDigitized = 0x9004;
+
+constexpr uint16_t kFormatAscii = 2;
+
+/* "YYYY:MM:DD HH:MM:SS" and the terminating null character. */
+constexpr size_t kTimestampSize = 20;
+
+constexpr uint8_t kMarkerSOI = 0xd8;
+constexpr uint8_t kMarkerAPP1 = 0xe1;
+constexpr uint8_t kMarkerSOS = 0xda;
+
+} /* namespace */
+
+uint16_t ExifTemplate::read16(size_t offset) const
+{
+	return data_[offset] | data_[offset + 1] << 8;
+}
+
+uint32_t ExifTemplate::read32(size_t offset) const
+{
+	return data_[offset] | data_[offset + 1] << 8 |
+	       data_[offset + 2] << 16 | static_cast<uint32_t>(data_[offset + 3]) << 24;
+}
+
+/*
+ * Walk the IFD located at \a offset from the TIFF header, and record the
+ * location of the timestamp values. The EXIF sub-IFD is parsed recursively.
+ */
+bool ExifTemplate::parseIfd(size_t offset, unsigned int depth)
+{
+	size_t ifd = kTiffOffset + offset;
+	if (depth > 1 || ifd + 2 > data_.size())
+		return false;
+
+	unsigned int count = read16(ifd);
+	if (ifd + 2 + count * 12 > data_.size())
+		return false;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		size_t entry = ifd + 2 + i * 12;
+		uint16_t tag = read16(entry);
+		uint16_t format = read16(entry + 2);
+		uint32_t components = read32(entry + 4);
+		uint32_t value = read32(entry + 8);
+
+		switch (tag) {
+		case kTagExifIfdPointer:
+			if (!parseIfd(value, depth + 1))
+				return false;
+			break;
+
+		case kTagDateTime:
+		case kTagDateTimeOriginal:
+		case kTagDateTimeDigitized:
+			if (format != kFormatAscii || components != kTimestampSize ||
+			    kTiffOffset + value + kTimestampSize > data_.size())
+				return false;
+
+			timestampOffsets_.push_back(kTiffOffset + value);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * The ExifTemplate stores EXIF data generated once per stream configuration
+ * by the Exif class, along with the location of the fields that change with
+ * every frame. The template is written to the JPEG APP1 segment by the
+ * encoder, and the per-frame fields are then patched directly in the encoded
+ * JPEG image with patch(), without generating new EXIF data.
+ *
+ * Create the template from EXIF data generated by the Exif class. The EXIF
+ * data shall contain all the per-frame fields, with placeholder values. Only
+ * the little-endian byte order used by the Exif class is supported.
+ *
+ * Return 0 on success or a negative error code otherwise.
+ */
+int ExifTemplate::create(Span<const uint8_t> exifData)
+{
+	data_.assign(exifData.begin(), exifData.end());
+	timestampOffsets_.clear();
+
+	if (data_.size() < kTiffOffset + 8 ||
+	    memcmp(data_.data(), kExifHeader, sizeof(kExifHeader)) ||
+	    data_[kTiffOffset] != 'I' || data_[kTiffOffset + 1] != 'I' ||
+	    read16(kTiffOffset + 2) != 42 ||
+	    !parseIfd(read32(kTiffOffset + 4), 0) ||
+	    timestampOffsets_.empty()) {
+		LOG(EXIF, Error) << "Unsupported EXIF data layout";
+		data_.clear();
+		timestampOffsets_.clear();
+		return -EINVAL;
+	}
+
+	LOG(EXIF, Debug)
+		<< "Created EXIF template (" << data_.size() << " bytes, "
+		<< timestampOffsets_.size() << " timestamps)";
+
+	return 0;
+}
+
+/*
+ * Patch the per-frame fields in the EXIF data of an encoded \a jpeg image. The
+ * APP1 segment written by the encoder from data() is located by walking the
+ * JPEG markers preceding the image data, which only takes a few steps as the
+ * segment is written right after the image header.
+ *
+ * Return 0 on success or a negative error code if the EXIF data can't be
+ * found in the image.
+ */
+int ExifTemplate::patch(Span<uint8_t> jpeg, time_t timestamp) const
+{
+	if (!isValid())
+		return -EINVAL;
+
+	if (jpeg.size() < 2 || jpeg[0] != 0xff || jpeg[1] != kMarkerSOI)
+		return -EINVAL;
+
+	uint8_t *exif = nullptr;
+	size_t pos = 2;
+
+	while (pos + 4 <= jpeg.size()) {
+		if (jpeg[pos] != 0xff || jpeg[pos + 1] == kMarkerSOS)
+			break;
+
+		uint8_t marker = jpeg[pos + 1];
+		size_t length = jpeg[pos + 2] << 8 | jpeg[pos + 3];
+
+		if (marker == kMarkerAPP1 && length == data_.size() + 2 &&
+		    pos + 2 + length <= jpeg.size() &&
+		    !memcmp(&jpeg[pos + 4], kExifHeader, sizeof(kExifHeader))) {
+			exif = &jpeg[pos + 4];
+			break;
+		}
+
+		pos += 2 + length;
+	}
+
+	if (!exif) {
+		LOG(EXIF, Error) << "EXIF data not found in JPEG image";
+		return -EINVAL;
+	}
+
+	struct tm tm;
+	char str[kTimestampSize] = {};
+	std::strftime(str, sizeof(str), "%Y:%m:%d %H:%M:%S",
+		      localtime_r(&timestamp, &tm));
+
+	for (size_t offset : timestampOffsets_)
+		memcpy(exif + offset, str, sizeof(str));
+
+	return 0;
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * exif_template.h - Precomputed EXIF data with per-frame field patching
+ */
+#ifndef __ANDROID_JPEG_EXIF_TEMPLATE_H__
+#define __ANDROID_JPEG_EXIF_TEMPLATE_H__
+
+#include <ctime>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/span.h>
+
+class ExifTemplate
+{
+public:
+	[[nodiscard]] int create(libcamera::Span<const uint8_t> exifData);
+
+	bool isValid() const { return !data_.empty(); }
+	libcamera::Span<const uint8_t> data() const { return data_; }
+
+	[[nodiscard]] int patch(libcamera::Span<uint8_t> jpeg, time_t timestamp) const;
+
+private:
+	bool parseIfd(size_t offset, unsigned int depth);
+	uint16_t read16(size_t offset) const;
+	uint32_t read32(size_t offset) const;
+
+	std::vector<uint8_t> data_;
+	std::vector<size_t> timestampOffsets_;
+};
+
+#endif /* __ANDROID_JPEG_EXIF_TEMPLATE_H__ */
@@ -0,0 +1,372 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * scaler_nv12.cpp - Multi-threaded NV12 crop and downscale
+ */
+
+#include "scaler_nv12.h"
+
+#include <algorithm>
+#include <errno.h>
+
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/thread.h"
+
+using namespace libcamera;
+
+LOG_DEFINE_CATEGORY(Scaler)
+
+/*
+ * The ScalerNV12 produces an NV12 image from a larger NV12 image, for streams
+ * that the camera can't produce natively. The input is first cropped to the
+ * aspect ratio of the output, centered, and then downscaled with a bilinear
+ * filter.
+ *
+ * The filter is separable. Each output row is interpolated vertically between
+ * two input rows that have been filtered horizontally, and the horizontally
+ * filtered rows are reused for consecutive output rows. The filter
+ * coefficients are computed once at configuration time, and all computations
+ * use 8-bit fixed-point weights. The vertical pass, which processes complete
+ * rows without any data-dependent indexing, is written to be vectorized by
+ * the compiler.
+ *
+ * The output image is split in horizontal bands that are scaled concurrently
+ * by a pool of threads, created at configuration time, and by the thread that
+ * calls scale().
+ *
+ * \todo Downscaling by more than a factor of two skips input pixels, and
+ * introduces aliasing. Add a box filter for large downscaling factors.
+ */
+
+ScalerNV12::ScalerNV12()
+	: generation_(0), bands_(0), nextBand_(0), completedBands_(0),
+	  exit_(false)
+{
+}
+
+ScalerNV12::~ScalerNV12()
+{
+	stopThreads();
+}
+
+void ScalerNV12::stopThreads()
+{
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		exit_ = true;
+	}
+	cond_.notify_all();
+
+	for (std::thread &thread : threads_)
+		thread.join();
+
+	threads_.clear();
+	exit_ = false;
+}
+
+/*
+ * Compute the input samples and weights for each output sample along one
+ * dimension. Output samples are centered on the corresponding input area, and
+ * interpolated between the input sample at the tap offset and the next one.
+ */
+std::vector<ScalerNV12::Tap> ScalerNV12::computeTaps(unsigned int inputOffset,
+						     unsigned int inputSize,
+						     unsigned int outputSize,
+						     unsigned int step)
+{
+	std::vector<Tap> taps(outputSize);
+	uint64_t scale = (static_cast<uint64_t>(inputSize) << 16) / outputSize;
+
+	for (unsigned int i = 0; i < outputSize; ++i) {
+		int64_t pos = i * scale + scale / 2 - (1 << 15);
+		pos = std::max<int64_t>(pos, 0);
+
+		unsigned int index = pos >> 16;
+		unsigned int weight = (pos >> 8) & 0xff;
+
+		if (index >= inputSize - 1) {
+			index = inputSize - 2;
+			weight = 256;
+		}
+
+		taps[i].offset = (inputOffset + index) * step;
+		taps[i].weight = weight;
+	}
+
+	return taps;
+}
+
+/*
+ * Configure the scaler to scale \a inputSize images to \a outputSize. The
+ * images are scaled by \a threads threads, including the caller of scale().
+ *
+ * Return 0 on success or a negative error code if the sizes are not
+ * supported.
+ */
+int ScalerNV12::configure(const Size &inputSize, const Size &outputSize,
+			  unsigned int threads)
+{
+	stopThreads();
+
+	if (inputSize.width < 4 || inputSize.height < 4 ||
+	    outputSize.width < 2 || outputSize.height < 2 ||
+	    inputSize.width % 2 || inputSize.height % 2 ||
+	    outputSize.width % 2 || outputSize.height % 2 ||
+	    outputSize.width > inputSize.width ||
+	    outputSize.height > inputSize.height) {
+		LOG(Scaler, Error)
+			<< "Unsupported scaling from " << inputSize.toString()
+			<< " to " << outputSize.toString();
+		return -EINVAL;
+	}
+
+	inputSize_ = inputSize;
+	outputSize_ = outputSize;
+
+	/* Crop the input to the output aspect ratio, aligned to chroma samples. */
+	Size cropSize = inputSize;
+	uint64_t inputRatio = static_cast<uint64_t>(inputSize.width) * outputSize.height;
+	uint64_t outputRatio = static_cast<uint64_t>(outputSize.width) * inputSize.height;
+
+	if (inputRatio > outputRatio)
+		cropSize.width = (static_cast<uint64_t>(inputSize.height) *
+				  outputSize.width / outputSize.height) & ~1U;
+	else if (inputRatio < outputRatio)
+		cropSize.height = (static_cast<uint64_t>(inputSize.width) *
+				   outputSize.height / outputSize.width) & ~1U;
+
+	crop_ = Rectangle(((inputSize.width - cropSize.width) / 2) & ~1U,
+			  ((inputSize.height - cropSize.height) / 2) & ~1U,
+			  cropSize);
+
+	luma_.outputWidth = outputSize.width;
+	luma_.components = 1;
+	luma_.horizontal = computeTaps(crop_.x, crop_.width, outputSize.width, 1);
+	luma_.vertical = computeTaps(crop_.y, crop_.height, outputSize.height, 1);
+
+	chroma_.outputWidth = outputSize.width / 2;
+	chroma_.components = 2;
+	chroma_.horizontal = computeTaps(crop_.x / 2, crop_.width / 2,
+					 outputSize.width / 2, 2);
+	chroma_.vertical = computeTaps(crop_.y / 2, crop_.height / 2,
+				       outputSize.height / 2, 1);
+
+	threads = std::max(threads, 1U);
+
+	/* Use more bands than threads to balance the load. */
+	bands_ = std::min(threads * 2, outputSize.height / 2);
+
+	scratch_.resize(threads);
+	for (Scratch &scratch : scratch_) {
+		scratch.rows[0].resize(outputSize.width);
+		scratch.rows[1].resize(outputSize.width);
+	}
+
+	for (unsigned int i = 1; i < threads; ++i)
+		threads_.emplace_back(&ScalerNV12::worker, this, i);
+
+	LOG(Scaler, Debug)
+		<< "Scaling " << inputSize.toString() << " to "
+		<< outputSize.toString() << ", crop " << crop_.toString()
+		<< ", " << threads << " threads";
+
+	return 0;
+}
+
+/*
+ * Describe the NV12 image stored in a mapped \a buffer, with \a stride bytes
+ * per line for both planes. The chroma plane is stored in the second plane if
+ * the buffer has multiple planes, or right after the luma plane otherwise.
+ *
+ * Return 0 on success or a negative error code if the buffer is too small.
+ */
+int ScalerNV12::mapImage(const MappedBuffer &buffer, unsigned int stride,
+			 unsigned int height, Image *image)
+{
+	const std::vector<MappedBuffer::Plane> &planes = buffer.planes();
+	size_t lumaSize = static_cast<size_t>(stride) * height;
+	size_t chromaSize = lumaSize / 2;
+
+	if (planes.empty() || planes[0].size() < lumaSize)
+		return -EINVAL;
+
+	image->luma = planes[0].data();
+	image->lumaStride = stride;
+	image->chromaStride = stride;
+
+	if (planes.size() > 1) {
+		if (planes[1].size() < chromaSize)
+			return -EINVAL;
+
+		image->chroma = planes[1].data();
+	} else {
+		if (planes[0].size() < lumaSize + chromaSize)
+			return -EINVAL;
+
+		image->chroma = planes[0].data() + lumaSize;
+	}
+
+	return 0;
+}
+
+/*
+ * Scale the \a input image to the \a output image. The function returns once
+ * the whole image has been scaled.
+ *
+ * Return 0 on success or a negative error code if the image strides are too
+ * small for the configured sizes.
+ */
+int ScalerNV12::scale(const Image &input, const Image &output)
+{
+	if (!bands_)
+		return -EINVAL;
+
+	if (input.lumaStride < inputSize_.width ||
+	    input.chromaStride < inputSize_.width ||
+	    output.lumaStride < outputSize_.width ||
+	    output.chromaStride < outputSize_.width) {
+		LOG(Scaler, Error) << "Invalid strides for NV12 scaling";
+		return -EINVAL;
+	}
+
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+
+		luma_.input = input.luma;
+		luma_.output = output.luma;
+		luma_.inputStride = input.lumaStride;
+		luma_.outputStride = output.lumaStride;
+		chroma_.input = input.chroma;
+		chroma_.output = output.chroma;
+		chroma_.inputStride = input.chromaStride;
+		chroma_.outputStride = output.chromaStride;
+
+		nextBand_ = 0;
+		completedBands_ = 0;
+		generation_++;
+	}
+	cond_.notify_all();
+
+	processBands(0);
+
+	std::unique_lock<std::mutex> locker(mutex_);
+	done_.wait(locker, [&]() { return completedBands_ == bands_; });
+
+	return 0;
+}
+
+void ScalerNV12::worker(unsigned int index)
+{
+	unsigned int generation = 0;
+
+	ThreadPolicy::apply(ThreadPolicy::RolePostProcessing);
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> locker(mutex_);
+			cond_.wait(locker, [&]() {
+				return exit_ || generation_ != generation;
+			});
+			if (exit_)
+				return;
+
+			generation = generation_;
+		}
+
+		processBands(index);
+	}
+}
+
+void ScalerNV12::processBands(unsigned int index)
+{
+	Scratch &scratch = scratch_[index];
+	unsigned int chromaHeight = outputSize_.height / 2;
+
+	while (true) {
+		unsigned int band;
+
+		{
+			std::lock_guard<std::mutex> locker(mutex_);
+			if (nextBand_ >= bands_)
+				return;
+
+			band = nextBand_++;
+		}
+
+		/* Split the chroma rows, and the corresponding pairs of luma rows. */
+		unsigned int begin = band * chromaHeight / bands_;
+		unsigned int end = (band + 1) * chromaHeight / bands_;
+
+		scaleRows(luma_, scratch, begin * 2, end * 2);
+		scaleRows(chroma_, scratch, begin, end);
+
+		{
+			std::lock_guard<std::mutex> locker(mutex_);
+			if (++completedBands_ == bands_)
+				done_.notify_all();
+		}
+	}
+}
+
+void ScalerNV12::filterRow(const Plane &plane, unsigned int row,
+			   uint16_t *output) const
+{
+	const uint8_t *input = plane.input + static_cast<size_t>(row) * plane.inputStride;
+	const Tap *taps = plane.horizontal.data();
+
+	if (plane.components == 1) {
+		for (unsigned int x = 0; x < plane.outputWidth; ++x) {
+			const uint8_t *in = input + taps[x].offset;
+			unsigned int w = taps[x].weight;
+
+			output[x] = in[0] * (256 - w) + in[1] * w;
+		}
+	} else {
+		for (unsigned int x = 0; x < plane.outputWidth; ++x) {
+			const uint8_t *in = input + taps[x].offset;
+			unsigned int w = taps[x].weight;
+
+			output[2 * x] = in[0] * (256 - w) + in[2] * w;
+			output[2 * x + 1] = in[1] * (256 - w) + in[3] * w;
+		}
+	}
+}
+
+void ScalerNV12::scaleRows(const Plane &plane, Scratch &scratch,
+			   unsigned int begin, unsigned int end) const
+{
+	unsigned int width = plane.outputWidth * plane.components;
+
+	/* The cached rows may belong to the other plane, invalidate them. */
+	scratch.index[0] = -1;
+	scratch.index[1] = -1;
+
+	/* Retrieve a horizontally filtered row, keeping the row to preserve. */
+	auto filtered = [&](int row, int preserve) -> const uint16_t * {
+		for (unsigned int i = 0; i < 2; ++i) {
+			if (scratch.index[i] == row)
+				return scratch.rows[i].data();
+		}
+
+		unsigned int i = scratch.index[0] == preserve ? 1 : 0;
+		filterRow(plane, row, scratch.rows[i].data());
+		scratch.index[i] = row;
+
+		return scratch.rows[i].data();
+	};
+
+	for (unsigned int y = begin; y < end; ++y) {
+		const Tap &tap = plane.vertical[y];
+		int row = tap.offset;
+
+		const uint16_t *top = filtered(row, row + 1);
+		const uint16_t *bottom = filtered(row + 1, row);
+		uint32_t wb = tap.weight;
+		uint32_t wt = 256 - wb;
+
+		uint8_t *out = plane.output + static_cast<size_t>(y) * plane.outputStride;
+		for (unsigned int x = 0; x < width; ++x)
+			out[x] = (top[x] * wt + bottom[x] * wb + (1 << 15)) >> 16;
+	}
+}
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * scaler_nv12.h - Multi-threaded NV12 crop and downscale
+ */
+#ifndef __ANDROID_YUV_SCALER_NV12_H__
+#define __ANDROID_YUV_SCALER_NV12_H__
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include <libcamera/geometry.h>
+
+#include "libcamera/internal/buffer.h"
+
+class ScalerNV12
+{
+public:
+	struct Image {
+		uint8_t *luma;
+		uint8_t *chroma;
+		unsigned int lumaStride;
+		unsigned int chromaStride;
+	};
+
+	ScalerNV12();
+	~ScalerNV12();
+
+	static int mapImage(const libcamera::MappedBuffer &buffer,
+			    unsigned int stride, unsigned int height,
+			    Image *image);
+
+	int configure(const libcamera::Size &inputSize,
+		      const libcamera::Size &outputSize, unsigned int threads);
+	int scale(const Image &input, const Image &output);
+
+	const libcamera::Rectangle &crop() const { return crop_; }
+
+private:
+	struct Tap {
+		uint32_t offset;
+		uint32_t weight;
+	};
+
+	struct Plane {
+		const uint8_t *input;
+		uint8_t *output;
+		unsigned int inputStride;
+		unsigned int outputStride;
+		unsigned int outputWidth;
+		unsigned int components;
+		std::vector<Tap> horizontal;
+		std::vector<Tap> vertical;
+	};
+
+	struct Scratch {
+		std::vector<uint16_t> rows[2];
+		int index[2];
+	};
+
+	static std::vector<Tap> computeTaps(unsigned int inputOffset,
+					    unsigned int inputSize,
+					    unsigned int outputSize,
+					    unsigned int step);
+
+	void stopThreads();
+	void worker(unsigned int index);
+	void processBands(unsigned int index);
+	void scaleRows(const Plane &plane, Scratch &scratch,
+		       unsigned int begin, unsigned int end) const;
+	void filterRow(const Plane &plane, unsigned int row,
+		       uint16_t *output) const;
+
+	libcamera::Size inputSize_;
+	libcamera::Size outputSize_;
+	libcamera::Rectangle crop_;
+
+	Plane luma_;
+	Plane chroma_;
+	std::vector<Scratch> scratch_;
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::condition_variable done_;
+	unsigned int generation_;
+	unsigned int bands_;
+	unsigned int nextBand_;
+	unsigned int completedBands_;
+	bool exit_;
+};
+
+#endif /* __ANDROID_YUV_SCALER_NV12_H__ */
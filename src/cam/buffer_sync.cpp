@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * buffer_sync.cpp - cam - CPU access synchronization for frame buffers
+ */
+
+#include "buffer_sync.h"
+
+#include <set>
+#include <sys/ioctl.h>
+
+using namespace libcamera;
+
+/*
+ * Bracket CPU reads from the dmabufs backing \a buffer with DMA_BUF_SYNC_START
+ * and DMA_BUF_SYNC_END \a flags, to let exporters provide cached mappings.
+ * Each dmabuf is synchronized once, even if it backs multiple planes. Errors
+ * are ignored, as buffers that are not dmabufs need no synchronization.
+ */
+void syncBuffer(const FrameBuffer *buffer, uint64_t flags)
+{
+	std::set<int> dmabufs;
+	for (const FrameBuffer::Plane &plane : buffer->planes())
+		dmabufs.insert(plane.fd.fd());
+
+	for (int dmabuf : dmabufs) {
+		struct dma_buf_sync sync = {};
+		sync.flags = flags | DMA_BUF_SYNC_READ;
+		ioctl(dmabuf, DMA_BUF_IOCTL_SYNC, &sync);
+	}
+}
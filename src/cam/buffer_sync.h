@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * buffer_sync.h - cam - CPU access synchronization for frame buffers
+ */
+#ifndef __CAM_BUFFER_SYNC_H__
+#define __CAM_BUFFER_SYNC_H__
+
+#include <linux/dma-buf.h>
+#include <stdint.h>
+
+#include <libcamera/buffer.h>
+
+void syncBuffer(const libcamera::FrameBuffer *buffer, uint64_t flags);
+
+#endif /* __CAM_BUFFER_SYNC_H__ */
@@ -5,14 +5,17 @@
  * buffer_writer.cpp - Buffer writer
  */
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include "buffer_sync.h"
 #include "buffer_writer.h"
 
 using namespace libcamera;
@@ -34,12 +37,19 @@ BufferWriter::~BufferWriter()
 
 void BufferWriter::mapBuffer(FrameBuffer *buffer)
 {
+	/* Map each dmabuf once, covering all the planes it stores. */
+	std::map<int, unsigned int> lengths;
 	for (const FrameBuffer::Plane &plane : buffer->planes()) {
-		void *memory = mmap(NULL, plane.length, PROT_READ, MAP_SHARED,
-				    plane.fd.fd(), 0);
+		unsigned int &length = lengths[plane.fd.fd()];
+		length = std::max(length, plane.offset + plane.length);
+	}
+
+	for (const auto &iter : lengths) {
+		void *memory = mmap(NULL, iter.second, PROT_READ, MAP_SHARED,
+				    iter.first, 0);
 
-		mappedBuffers_[plane.fd.fd()] =
-			std::make_pair(memory, plane.length);
+		mappedBuffers_[iter.first] =
+			std::make_pair(memory, iter.second);
 	}
 }
 
@@ -64,11 +74,14 @@ int BufferWriter::write(FrameBuffer *buffer, const std::string &streamName)
 	if (fd == -1)
 		return -errno;
 
+	syncBuffer(buffer, DMA_BUF_SYNC_START);
+
 	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
 		const FrameBuffer::Plane &plane = buffer->planes()[i];
 		const FrameMetadata::Plane &meta = buffer->metadata().planes[i];
 
-		void *data = mappedBuffers_[plane.fd.fd()].first;
+		uint8_t *data = static_cast<uint8_t *>(mappedBuffers_[plane.fd.fd()].first)
+			      + plane.offset;
 		unsigned int length = std::min(meta.bytesused, plane.length);
 
 		if (meta.bytesused > plane.length)
@@ -90,6 +103,8 @@ int BufferWriter::write(FrameBuffer *buffer, const std::string &streamName)
 		}
 	}
 
+	syncBuffer(buffer, DMA_BUF_SYNC_END);
+
 	close(fd);
 
 	return ret;
@@ -16,18 +16,30 @@
 using namespace libcamera;
 
 Capture::Capture(std::shared_ptr<Camera> camera, CameraConfiguration *config,
-		 EventLoop *loop)
-	: camera_(camera), config_(config), writer_(nullptr), loop_(loop),
-	  captureCount_(0), captureLimit_(0)
+		 const std::string &name)
+	: camera_(camera), config_(config), name_(name), writer_(nullptr),
+	  last_(0), captureCount_(0), captureLimit_(0), statsInterval_(0)
 {
 }
 
-int Capture::run(const OptionsParser::Options &options)
+Capture::~Capture()
+{
+	delete writer_;
+}
+
+int Capture::start(const OptionsParser::Options &options)
 {
 	int ret;
 
 	captureCount_ = 0;
 	captureLimit_ = options[OptCapture].toInteger();
+	last_ = 0;
+
+	statsInterval_ = std::chrono::seconds(0);
+	if (options.isSet(OptStatistics)) {
+		int interval = options[OptStatistics].toInteger();
+		statsInterval_ = std::chrono::seconds(interval > 0 ? interval : 1);
+	}
 
 	if (!camera_) {
 		std::cout << "Can't capture without a camera" << std::endl;
@@ -40,13 +52,31 @@ int Capture::run(const OptionsParser::Options &options)
 		return ret;
 	}
 
+	/*
+	 * Prefix the stream names with the capture name, if any, to tell
+	 * apart the streams of different cameras.
+	 */
 	streamName_.clear();
 	for (unsigned int index = 0; index < config_->size(); ++index) {
 		StreamConfiguration &cfg = config_->at(index);
-		streamName_[cfg.stream()] = "stream" + std::to_string(index);
+		std::string name = "stream" + std::to_string(index);
+		streamName_[cfg.stream()] = name_.empty() ? name : name_ + "-" + name;
 	}
 
-	camera_->requestCompleted.connect(this, &Capture::requestComplete);
+	/*
+	 * Retrieve completed requests through a completion queue, to process
+	 * them in the event loop thread.
+	 */
+	if (!queue_.isValid()) {
+		std::cout << "Failed to create completion queue" << std::endl;
+		return -ENOMEM;
+	}
+
+	ret = camera_->setCompletionQueue(&queue_);
+	if (ret < 0) {
+		std::cout << "Failed to set completion queue" << std::endl;
+		return ret;
+	}
 
 	if (options.isSet(OptFile)) {
 		if (!options[OptFile].toString().empty())
@@ -55,35 +85,29 @@ int Capture::run(const OptionsParser::Options &options)
 			writer_ = new BufferWriter();
 	}
 
+	if (options.isSet(OptShm)) {
+		std::string shmName = options[OptShm].toString();
+		if (shmName.empty())
+			shmName = "cam";
+		if (!name_.empty())
+			shmName += "-" + name_;
 
-	FrameBufferAllocator *allocator = new FrameBufferAllocator(camera_);
-
-	ret = capture(allocator);
-
-	if (options.isSet(OptFile)) {
-		delete writer_;
-		writer_ = nullptr;
+		shm_ = std::make_unique<ShmSink>(shmName);
+		shm_->configure(*config_);
 	}
 
-	delete allocator;
-
-	return ret;
-}
-
-int Capture::capture(FrameBufferAllocator *allocator)
-{
-	int ret;
+	allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
 
 	/* Identify the stream with the least number of buffers. */
 	unsigned int nbuffers = UINT_MAX;
 	for (StreamConfiguration &cfg : *config_) {
-		ret = allocator->allocate(cfg.stream());
+		ret = allocator_->allocate(cfg.stream());
 		if (ret < 0) {
 			std::cerr << "Can't allocate buffers" << std::endl;
 			return -ENOMEM;
 		}
 
-		unsigned int allocated = allocator->buffers(cfg.stream()).size();
+		unsigned int allocated = allocator_->buffers(cfg.stream()).size();
 		nbuffers = std::min(nbuffers, allocated);
 	}
 
@@ -103,7 +127,7 @@ int Capture::capture(FrameBufferAllocator *allocator)
 		for (StreamConfiguration &cfg : *config_) {
 			Stream *stream = cfg.stream();
 			const std::vector<std::unique_ptr<FrameBuffer>> &buffers =
-				allocator->buffers(stream);
+				allocator_->buffers(stream);
 			const std::unique_ptr<FrameBuffer> &buffer = buffers[i];
 
 			ret = request->addBuffer(stream, buffer.get());
@@ -115,43 +139,83 @@ int Capture::capture(FrameBufferAllocator *allocator)
 
 			if (writer_)
 				writer_->mapBuffer(buffer.get());
+			if (shm_)
+				shm_->mapBuffer(buffer.get());
 		}
 
 		requests.push_back(request);
 	}
 
+	if (shm_) {
+		ret = shm_->create();
+		if (ret < 0)
+			return ret;
+	}
+
 	ret = camera_->start();
 	if (ret) {
 		std::cout << "Failed to start capture" << std::endl;
 		return ret;
 	}
 
-	for (Request *request : requests) {
-		ret = camera_->queueRequest(request);
-		if (ret < 0) {
-			std::cerr << "Can't queue request" << std::endl;
-			camera_->stop();
-			return ret;
-		}
+	startTime_ = std::chrono::steady_clock::now();
+	stopTime_ = startTime_;
+	statsLast_ = startTime_;
+
+	ret = camera_->queueRequests(requests);
+	if (ret < 0) {
+		std::cerr << "Can't queue requests" << std::endl;
+		camera_->stop();
+		return ret;
 	}
 
-	if (captureLimit_)
-		std::cout << "Capture " << captureLimit_ << " frames" << std::endl;
-	else
-		std::cout << "Capture until user interrupts by SIGINT" << std::endl;
+	notifier_ = std::make_unique<EventNotifier>(queue_.fd(), EventNotifier::Read);
+	notifier_->activated.connect(this, &Capture::reapRequests);
 
-	ret = loop_->exec();
-	if (ret)
-		std::cout << "Failed to run capture loop" << std::endl;
+	return 0;
+}
 
-	ret = camera_->stop();
+int Capture::stop()
+{
+	notifier_.reset();
+
+	int ret = camera_->stop();
 	if (ret)
 		std::cout << "Failed to stop capture" << std::endl;
 
+	/* Delete the requests cancelled by stop() and those not processed. */
+	std::vector<Request *> completed;
+	queue_.reap(&completed);
+	for (Request *request : completed)
+		delete request;
+
+	camera_->setCompletionQueue(nullptr);
+
+	delete writer_;
+	writer_ = nullptr;
+
+	shm_.reset();
+	allocator_.reset();
+
+	if (statsInterval_.count())
+		printStatistics();
+
 	return ret;
 }
 
-void Capture::requestComplete(Request *request)
+void Capture::reapRequests([[maybe_unused]] EventNotifier *notifier)
+{
+	completed_.clear();
+	queue_.reap(&completed_);
+
+	for (Request *request : completed_) {
+		if (!captureLimit_ || captureCount_ < captureLimit_)
+			processRequest(request);
+		delete request;
+	}
+}
+
+void Capture::processRequest(Request *request)
 {
 	if (request->status() == Request::RequestCancelled)
 		return;
@@ -192,13 +256,29 @@ void Capture::requestComplete(Request *request)
 
 		if (writer_)
 			writer_->write(buffer, name);
+		if (shm_)
+			shm_->write(buffer, stream);
 	}
 
 	std::cout << info.str() << std::endl;
 
+	if (statsInterval_.count()) {
+		auto now = std::chrono::steady_clock::now();
+		if (now - statsLast_ >= statsInterval_) {
+			printStatistics();
+			statsLast_ = now;
+		}
+	}
+
+	/*
+	 * Record the completion time of the last frame, as cameras that reach
+	 * their capture limit early are only stopped once all cameras are done.
+	 */
 	captureCount_++;
+	stopTime_ = std::chrono::steady_clock::now();
+
 	if (captureLimit_ && captureCount_ >= captureLimit_) {
-		loop_->exit(0);
+		captureDone.emit(this);
 		return;
 	}
 
@@ -221,3 +301,67 @@ void Capture::requestComplete(Request *request)
 
 	camera_->queueRequest(request);
 }
+
+void Capture::printStatistics()
+{
+	const CameraStatistics stats = camera_->statistics();
+
+	auto latency = [](const CameraStatistics::Latency &l) {
+		std::stringstream out;
+		out << std::fixed << std::setprecision(2)
+		    << l.min.count() / 1000000.0 << "/"
+		    << l.average.count() / 1000000.0 << "/"
+		    << l.max.count() / 1000000.0 << " ms";
+		return out.str();
+	};
+
+	std::cout << "Statistics";
+	if (!name_.empty())
+		std::cout << " for " << name_;
+	std::cout << ": requests queued " << stats.requestsQueued
+		  << " completed " << stats.requestsCompleted
+		  << " cancelled " << stats.requestsCancelled
+		  << " dropped " << stats.requestsDropped
+		  << " in flight " << stats.queueDepth << std::endl;
+
+	std::cout << "  completion latency min/avg/max "
+		  << latency(stats.completionLatency) << std::endl;
+	if (stats.ipaLatency.samples)
+		std::cout << "  IPA latency min/avg/max "
+			  << latency(stats.ipaLatency) << std::endl;
+
+	std::cout << "  buffer cache hits " << stats.bufferCacheHits
+		  << " misses " << stats.bufferCacheMisses << std::endl;
+
+	for (const auto &it : stats.streams) {
+		const CameraStatistics::StreamStatistics &stream = it.second;
+
+		std::cout << "  " << streamName_[it.first]
+			  << ": captured " << stream.framesCaptured
+			  << " failed " << stream.framesFailed
+			  << " cancelled " << stream.framesCancelled
+			  << " dropped " << stream.framesDropped << std::endl;
+	}
+}
+
+void Capture::printSummary()
+{
+	const CameraStatistics stats = camera_->statistics();
+
+	double duration = std::chrono::duration<double>(stopTime_ - startTime_).count();
+	double fps = duration > 0 ? captureCount_ / duration : 0.0;
+
+	uint64_t dropped = 0;
+	for (const auto &it : stats.streams)
+		dropped += it.second.framesDropped;
+
+	std::cout << "Camera " << camera_->id();
+	if (!name_.empty())
+		std::cout << " (" << name_ << ")";
+	std::cout << ": " << captureCount_ << " frames in "
+		  << std::fixed << std::setprecision(2) << duration << " s ("
+		  << fps << " fps), " << dropped << " dropped, completion latency avg/max "
+		  << stats.completionLatency.average.count() / 1000000.0 << "/"
+		  << stats.completionLatency.max.count() / 1000000.0 << " ms"
+		  << std::endl;
+}
@@ -7,42 +7,67 @@
 #ifndef __CAM_CAPTURE_H__
 #define __CAM_CAPTURE_H__
 
+#include <chrono>
 #include <memory>
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
+#include <libcamera/completion_queue.h>
+#include <libcamera/event_notifier.h>
 #include <libcamera/framebuffer_allocator.h>
 #include <libcamera/request.h>
+#include <libcamera/signal.h>
 #include <libcamera/stream.h>
 
 #include "buffer_writer.h"
-#include "event_loop.h"
 #include "options.h"
+#include "shm_sink.h"
 
 class Capture
 {
 public:
 	Capture(std::shared_ptr<libcamera::Camera> camera,
 		libcamera::CameraConfiguration *config,
-		EventLoop *loop);
+		const std::string &name = "");
+	~Capture();
 
-	int run(const OptionsParser::Options &options);
-private:
-	int capture(libcamera::FrameBufferAllocator *allocator);
+	int start(const OptionsParser::Options &options);
+	int stop();
+
+	void printStatistics();
+	void printSummary();
 
-	void requestComplete(libcamera::Request *request);
+	libcamera::Signal<Capture *> captureDone;
+
+private:
+	void reapRequests(libcamera::EventNotifier *notifier);
+	void processRequest(libcamera::Request *request);
 
 	std::shared_ptr<libcamera::Camera> camera_;
 	libcamera::CameraConfiguration *config_;
+	std::string name_;
+
+	libcamera::CompletionQueue queue_;
+	std::vector<libcamera::Request *> completed_;
+	std::unique_ptr<libcamera::EventNotifier> notifier_;
+	std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
 
 	std::map<const libcamera::Stream *, std::string> streamName_;
 	BufferWriter *writer_;
+	std::unique_ptr<ShmSink> shm_;
 	uint64_t last_;
 
-	EventLoop *loop_;
 	unsigned int captureCount_;
 	unsigned int captureLimit_;
+
+	std::chrono::steady_clock::time_point startTime_;
+	std::chrono::steady_clock::time_point stopTime_;
+
+	std::chrono::seconds statsInterval_;
+	std::chrono::steady_clock::time_point statsLast_;
 };
 
 #endif /* __CAM_CAPTURE_H__ */
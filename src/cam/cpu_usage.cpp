@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * cpu_usage.cpp - cam - Per-thread CPU usage
+ */
+
+#include <dirent.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cpu_usage.h"
+
+/*
+ * The CPU time of the threads of the process is retrieved from
+ * /proc/self/task/<tid>/stat. The libcamera threads are all the threads but
+ * the main thread, which runs the cam event loop.
+ */
+std::map<pid_t, CpuUsage::ThreadTimes> CpuUsage::sample()
+{
+	std::map<pid_t, ThreadTimes> threads;
+
+	DIR *dir = opendir("/proc/self/task");
+	if (!dir)
+		return threads;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != nullptr) {
+		pid_t tid = atoi(ent->d_name);
+		if (!tid)
+			continue;
+
+		std::ifstream file("/proc/self/task/" + std::string(ent->d_name) + "/stat");
+		std::string line;
+		if (!std::getline(file, line))
+			continue;
+
+		/*
+		 * The thread name is enclosed in parentheses and may contain
+		 * spaces, parse the fields that follow it.
+		 */
+		size_t open = line.find('(');
+		size_t close = line.rfind(')');
+		if (open == std::string::npos || close == std::string::npos)
+			continue;
+
+		ThreadTimes times;
+		times.name = line.substr(open + 1, close - open - 1);
+
+		/* utime and stime are the 12th and 13th fields after the name. */
+		std::istringstream fields(line.substr(close + 2));
+		std::string field;
+		for (unsigned int i = 0; i < 11; ++i)
+			fields >> field;
+
+		fields >> times.user >> times.system;
+		if (!fields)
+			continue;
+
+		threads[tid] = times;
+	}
+
+	closedir(dir);
+
+	return threads;
+}
+
+void CpuUsage::start()
+{
+	start_ = sample();
+}
+
+void CpuUsage::stop()
+{
+	stop_ = sample();
+}
+
+void CpuUsage::print() const
+{
+	double tick = 1000.0 / sysconf(_SC_CLK_TCK);
+	pid_t pid = getpid();
+	unsigned long totalUser = 0;
+	unsigned long totalSystem = 0;
+
+	std::cout << "CPU time per thread (user/system):" << std::endl;
+
+	for (const auto &it : stop_) {
+		ThreadTimes times = it.second;
+
+		/* Threads started during capture have no start sample. */
+		auto first = start_.find(it.first);
+		if (first != start_.end()) {
+			times.user -= first->second.user;
+			times.system -= first->second.system;
+		}
+
+		if (it.first != pid) {
+			totalUser += times.user;
+			totalSystem += times.system;
+		}
+
+		std::cout << "  " << it.first << " " << times.name
+			  << (it.first == pid ? " (main)" : "") << ": "
+			  << std::fixed << std::setprecision(0)
+			  << times.user * tick << "/" << times.system * tick
+			  << " ms" << std::endl;
+	}
+
+	std::cout << "  libcamera threads: " << std::fixed << std::setprecision(0)
+		  << totalUser * tick << "/" << totalSystem * tick << " ms"
+		  << std::endl;
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * cpu_usage.h - cam - Per-thread CPU usage
+ */
+#ifndef __CAM_CPU_USAGE_H__
+#define __CAM_CPU_USAGE_H__
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+
+class CpuUsage
+{
+public:
+	void start();
+	void stop();
+
+	void print() const;
+
+private:
+	struct ThreadTimes {
+		std::string name;
+		unsigned long user;
+		unsigned long system;
+	};
+
+	static std::map<pid_t, ThreadTimes> sample();
+
+	std::map<pid_t, ThreadTimes> start_;
+	std::map<pid_t, ThreadTimes> stop_;
+};
+
+#endif /* __CAM_CPU_USAGE_H__ */
@@ -14,6 +14,7 @@
 #include <libcamera/property_ids.h>
 
 #include "capture.h"
+#include "cpu_usage.h"
 #include "event_loop.h"
 #include "main.h"
 #include "options.h"
@@ -39,17 +40,20 @@ private:
 	void cameraAdded(std::shared_ptr<Camera> cam);
 	void cameraRemoved(std::shared_ptr<Camera> cam);
 	int parseOptions(int argc, char *argv[]);
-	int prepareConfig();
+	int prepareConfig(unsigned int index);
 	int listControls();
 	int listProperties();
 	int infoConfiguration();
+	int capture();
+	void captureDone(Capture *capture);
 	int run();
 
 	static CamApp *app_;
 	OptionsParser::Options options_;
 	CameraManager *cm_;
-	std::shared_ptr<Camera> camera_;
-	std::unique_ptr<libcamera::CameraConfiguration> config_;
+	std::vector<std::shared_ptr<Camera>> cameras_;
+	std::vector<std::unique_ptr<libcamera::CameraConfiguration>> configs_;
+	unsigned int capturesDone_;
 	EventLoop *loop_;
 
 	bool strictFormats_;
@@ -58,8 +62,7 @@ private:
 CamApp *CamApp::app_ = nullptr;
 
 CamApp::CamApp()
-	: cm_(nullptr), camera_(nullptr), config_(nullptr), loop_(nullptr),
-	  strictFormats_(false)
+	: cm_(nullptr), capturesDone_(0), loop_(nullptr), strictFormats_(false)
 {
 	CamApp::app_ = this;
 }
@@ -94,32 +97,35 @@ int CamApp::init(int argc, char **argv)
 		return ret;
 	}
 
-	if (options_.isSet(OptCamera)) {
-		const std::string &cameraId = options_[OptCamera];
+	for (const OptionValue &value : options_[OptCamera].toArray()) {
+		const std::string &cameraId = value.toString();
+		std::shared_ptr<Camera> camera;
 		char *endptr;
 		unsigned long index = strtoul(cameraId.c_str(), &endptr, 10);
 		if (*endptr == '\0' && index > 0 && index <= cm_->cameras().size())
-			camera_ = cm_->cameras()[index - 1];
+			camera = cm_->cameras()[index - 1];
 		else
-			camera_ = cm_->get(cameraId);
+			camera = cm_->get(cameraId);
 
-		if (!camera_) {
-			std::cout << "Camera "
-				  << std::string(options_[OptCamera])
-				  << " not found" << std::endl;
+		if (!camera) {
+			std::cout << "Camera " << cameraId << " not found"
+				  << std::endl;
 			cleanup();
 			return -ENODEV;
 		}
 
-		if (camera_->acquire()) {
-			std::cout << "Failed to acquire camera" << std::endl;
+		if (camera->acquire()) {
+			std::cout << "Failed to acquire camera " << camera->id()
+				  << std::endl;
 			cleanup();
 			return -EINVAL;
 		}
 
-		std::cout << "Using camera " << camera_->id() << std::endl;
+		std::cout << "Using camera " << camera->id() << std::endl;
+
+		cameras_.push_back(camera);
 
-		ret = prepareConfig();
+		ret = prepareConfig(cameras_.size() - 1);
 		if (ret) {
 			cleanup();
 			return ret;
@@ -142,12 +148,11 @@ void CamApp::cleanup()
 	delete loop_;
 	loop_ = nullptr;
 
-	if (camera_) {
-		camera_->release();
-		camera_.reset();
-	}
+	for (std::shared_ptr<Camera> &camera : cameras_)
+		camera->release();
 
-	config_.reset();
+	cameras_.clear();
+	configs_.clear();
 
 	cm_->stop();
 }
@@ -174,8 +179,9 @@ int CamApp::parseOptions(int argc, char *argv[])
 
 	OptionsParser parser;
 	parser.addOption(OptCamera, OptionString,
-			 "Specify which camera to operate on, by id or by index", "camera",
-			 ArgumentRequired, "camera");
+			 "Specify which camera to operate on, by id or by index\n"
+			 "The option may be repeated to capture from multiple cameras concurrently.",
+			 "camera", ArgumentRequired, "camera", true);
 	parser.addOption(OptCapture, OptionInteger,
 			 "Capture until interrupted by user or until <count> frames captured",
 			 "capture", ArgumentOptional, "count");
@@ -198,9 +204,18 @@ int CamApp::parseOptions(int argc, char *argv[])
 	parser.addOption(OptMonitor, OptionNone,
 			 "Monitor for hotplug and unplug camera events",
 			 "monitor");
+	parser.addOption(OptShm, OptionString,
+			 "Publish captured frames to a shared memory ring for other processes\n"
+			 "The default ring name is 'cam', it is suffixed with the camera index when capturing from multiple cameras.\n"
+			 "Frames can be read with the cam-shm-reader tool.",
+			 "shm", ArgumentOptional, "name");
 	parser.addOption(OptStrictFormats, OptionNone,
 			 "Do not allow requested stream format(s) to be adjusted",
 			 "strict-formats");
+	parser.addOption(OptStatistics, OptionInteger,
+			 "Print camera statistics during capture every <interval> seconds (default 1),\n"
+			 "and the CPU time used by each thread when the capture completes",
+			 "stats", ArgumentOptional, "interval");
 
 	options_ = parser.parse(argc, argv);
 	if (!options_.valid())
@@ -214,39 +229,40 @@ int CamApp::parseOptions(int argc, char *argv[])
 	return 0;
 }
 
-int CamApp::prepareConfig()
+int CamApp::prepareConfig(unsigned int index)
 {
-	StreamRoles roles = StreamKeyValueParser::roles(options_[OptStream]);
-
-	config_ = camera_->generateConfiguration(roles);
-	if (!config_ || config_->size() != roles.size()) {
+	std::shared_ptr<Camera> camera = cameras_[index];
+	OptionValue streams =
+		StreamKeyValueParser::cameraStreams(options_[OptStream], index);
+	StreamRoles roles = StreamKeyValueParser::roles(streams);
+
+	configs_.push_back(camera->generateConfiguration(roles));
+	std::unique_ptr<CameraConfiguration> &config = configs_.back();
+	if (!config || config->size() != roles.size()) {
 		std::cerr << "Failed to get default stream configuration"
 			  << std::endl;
 		return -EINVAL;
 	}
 
 	/* Apply configuration if explicitly requested. */
-	if (StreamKeyValueParser::updateConfiguration(config_.get(),
-						      options_[OptStream])) {
+	if (StreamKeyValueParser::updateConfiguration(config.get(), streams)) {
 		std::cerr << "Failed to update configuration" << std::endl;
 		return -EINVAL;
 	}
 
-	switch (config_->validate()) {
+	switch (config->validate()) {
 	case CameraConfiguration::Valid:
 		break;
 	case CameraConfiguration::Adjusted:
 		if (strictFormats_) {
 			std::cout << "Adjusting camera configuration disallowed by --strict-formats argument"
 				  << std::endl;
-			config_.reset();
 			return -EINVAL;
 		}
 		std::cout << "Camera configuration adjusted" << std::endl;
 		break;
 	case CameraConfiguration::Invalid:
 		std::cout << "Camera configuration invalid" << std::endl;
-		config_.reset();
 		return -EINVAL;
 	}
 
@@ -255,18 +271,23 @@ int CamApp::prepareConfig()
 
 int CamApp::listControls()
 {
-	if (!camera_) {
+	if (cameras_.empty()) {
 		std::cout << "Cannot list controls without a camera"
 			  << std::endl;
 		return -EINVAL;
 	}
 
-	for (const auto &ctrl : camera_->controls()) {
-		const ControlId *id = ctrl.first;
-		const ControlInfo &info = ctrl.second;
+	for (const std::shared_ptr<Camera> &camera : cameras_) {
+		if (cameras_.size() > 1)
+			std::cout << "Camera " << camera->id() << ":" << std::endl;
+
+		for (const auto &ctrl : camera->controls()) {
+			const ControlId *id = ctrl.first;
+			const ControlInfo &info = ctrl.second;
 
-		std::cout << "Control: " << id->name() << ": "
-			  << info.toString() << std::endl;
+			std::cout << "Control: " << id->name() << ": "
+				  << info.toString() << std::endl;
+		}
 	}
 
 	return 0;
@@ -274,18 +295,23 @@ int CamApp::listControls()
 
 int CamApp::listProperties()
 {
-	if (!camera_) {
+	if (cameras_.empty()) {
 		std::cout << "Cannot list properties without a camera"
 			  << std::endl;
 		return -EINVAL;
 	}
 
-	for (const auto &prop : camera_->properties()) {
-		const ControlId *id = properties::properties.at(prop.first);
-		const ControlValue &value = prop.second;
+	for (const std::shared_ptr<Camera> &camera : cameras_) {
+		if (cameras_.size() > 1)
+			std::cout << "Camera " << camera->id() << ":" << std::endl;
+
+		for (const auto &prop : camera->properties()) {
+			const ControlId *id = properties::byId.at(prop.first);
+			const ControlValue &value = prop.second;
 
-		std::cout << "Property: " << id->name() << " = "
-			  << value.toString() << std::endl;
+			std::cout << "Property: " << id->name() << " = "
+				  << value.toString() << std::endl;
+		}
 	}
 
 	return 0;
@@ -293,29 +319,34 @@ int CamApp::listProperties()
 
 int CamApp::infoConfiguration()
 {
-	if (!config_) {
+	if (configs_.empty()) {
 		std::cout << "Cannot print stream information without a camera"
 			  << std::endl;
 		return -EINVAL;
 	}
 
-	unsigned int index = 0;
-	for (const StreamConfiguration &cfg : *config_) {
-		std::cout << index << ": " << cfg.toString() << std::endl;
+	for (unsigned int i = 0; i < configs_.size(); ++i) {
+		if (configs_.size() > 1)
+			std::cout << "Camera " << cameras_[i]->id() << ":" << std::endl;
 
-		const StreamFormats &formats = cfg.formats();
-		for (PixelFormat pixelformat : formats.pixelformats()) {
-			std::cout << " * Pixelformat: "
-				  << pixelformat.toString() << " "
-				  << formats.range(pixelformat).toString()
-				  << std::endl;
+		unsigned int index = 0;
+		for (const StreamConfiguration &cfg : *configs_[i]) {
+			std::cout << index << ": " << cfg.toString() << std::endl;
 
-			for (const Size &size : formats.sizes(pixelformat))
-				std::cout << "  - " << size.toString()
+			const StreamFormats &formats = cfg.formats();
+			for (PixelFormat pixelformat : formats.pixelformats()) {
+				std::cout << " * Pixelformat: "
+					  << pixelformat.toString() << " "
+					  << formats.range(pixelformat).toString()
 					  << std::endl;
-		}
 
-		index++;
+				for (const Size &size : formats.sizes(pixelformat))
+					std::cout << "  - " << size.toString()
+						  << std::endl;
+			}
+
+			index++;
+		}
 	}
 
 	return 0;
@@ -331,6 +362,77 @@ void CamApp::cameraRemoved(std::shared_ptr<Camera> cam)
 	std::cout << "Camera Removed: " << cam->id() << std::endl;
 }
 
+int CamApp::capture()
+{
+	if (cameras_.empty()) {
+		std::cout << "Can't capture without a camera" << std::endl;
+		return -ENODEV;
+	}
+
+	/*
+	 * Capture from all cameras concurrently, processing completed requests
+	 * from the same event loop. The stream names are prefixed with the
+	 * camera index when capturing from multiple cameras.
+	 */
+	std::vector<std::unique_ptr<Capture>> captures;
+	for (unsigned int i = 0; i < cameras_.size(); ++i) {
+		std::string name = cameras_.size() > 1 ? "cam" + std::to_string(i) : "";
+		captures.push_back(std::make_unique<Capture>(cameras_[i],
+							     configs_[i].get(),
+							     name));
+		captures.back()->captureDone.connect(this, &CamApp::captureDone);
+	}
+
+	CpuUsage usage;
+	usage.start();
+
+	int ret = 0;
+	unsigned int started;
+	for (started = 0; started < captures.size(); ++started) {
+		ret = captures[started]->start(options_);
+		if (ret)
+			break;
+	}
+
+	if (!ret) {
+		unsigned int count = options_[OptCapture].toInteger();
+		if (count)
+			std::cout << "Capture " << count << " frames" << std::endl;
+		else
+			std::cout << "Capture until user interrupts by SIGINT" << std::endl;
+
+		capturesDone_ = 0;
+		ret = loop_->exec();
+		if (ret)
+			std::cout << "Failed to run capture loop" << std::endl;
+	}
+
+	for (unsigned int i = 0; i < started; ++i) {
+		int err = captures[i]->stop();
+		if (!ret)
+			ret = err;
+	}
+
+	usage.stop();
+
+	if (!started)
+		return ret;
+
+	for (unsigned int i = 0; i < started; ++i)
+		captures[i]->printSummary();
+
+	if (options_.isSet(OptStatistics))
+		usage.print();
+
+	return ret;
+}
+
+void CamApp::captureDone([[maybe_unused]] Capture *capture)
+{
+	if (++capturesDone_ == cameras_.size())
+		loop_->exit(0);
+}
+
 int CamApp::run()
 {
 	int ret;
@@ -363,10 +465,8 @@ int CamApp::run()
 			return ret;
 	}
 
-	if (options_.isSet(OptCapture)) {
-		Capture capture(camera_, config_.get(), loop_);
-		return capture.run(options_);
-	}
+	if (options_.isSet(OptCapture))
+		return capture();
 
 	if (options_.isSet(OptMonitor)) {
 		std::cout << "Press Ctrl-C to interrupt" << std::endl;
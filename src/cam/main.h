@@ -19,6 +19,8 @@ enum {
 	OptStream = 's',
 	OptListControls = 256,
 	OptStrictFormats = 257,
+	OptStatistics = 258,
+	OptShm = 259,
 };
 
 #endif /* __CAM_MAIN_H__ */
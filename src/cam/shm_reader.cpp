@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * shm_reader.cpp - cam - Shared memory frame reader example and benchmark
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+
+/*
+ * Subscribe to the frames published by cam --shm, and report the frame rate,
+ * the publication to consumption latency and the number of dropped frames.
+ * Frames are consumed in place in the shared memory ring, without any copy.
+ */
+
+namespace {
+
+std::atomic<bool> running{ true };
+
+void signalHandler([[maybe_unused]] int signal)
+{
+	running = false;
+}
+
+struct Stats {
+	Stats()
+		: frames(0), torn(0), latencyMin(UINT64_MAX), latencyMax(0),
+		  latencySum(0)
+	{
+	}
+
+	void add(uint64_t latency)
+	{
+		frames++;
+		latencyMin = std::min(latencyMin, latency);
+		latencyMax = std::max(latencyMax, latency);
+		latencySum += latency;
+	}
+
+	void print(const char *label, double seconds, uint64_t dropped) const
+	{
+		std::cout << label << ": " << frames << " frames ("
+			  << std::fixed << std::setprecision(2)
+			  << (seconds > 0 ? frames / seconds : 0.0) << " fps), "
+			  << dropped << " dropped, " << torn << " torn";
+
+		if (frames)
+			std::cout << ", latency min/avg/max "
+				  << latencyMin / 1000.0 << "/"
+				  << latencySum / frames / 1000.0 << "/"
+				  << latencyMax / 1000.0 << " us";
+
+		std::cout << std::endl;
+	}
+
+	uint64_t frames;
+	uint64_t torn;
+	uint64_t latencyMin;
+	uint64_t latencyMax;
+	uint64_t latencySum;
+};
+
+/* Compute a checksum over the frame, to touch all the data. */
+uint32_t checksum(const uint8_t *data, size_t size)
+{
+	uint32_t sum = 0;
+	for (size_t i = 0; i < size; i += sizeof(uint32_t)) {
+		uint32_t value = 0;
+		memcpy(&value, data + i, std::min(sizeof(value), size - i));
+		sum ^= value;
+	}
+
+	return sum;
+}
+
+ShmRingHeader *mapRing(const std::string &name, size_t *size)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if (fd < 0) {
+		std::cerr << "Failed to open shared memory " << name << ": "
+			  << strerror(errno) << std::endl;
+		return nullptr;
+	}
+
+	void *memory = mmap(NULL, sizeof(ShmRingHeader), PROT_READ, MAP_SHARED,
+			    fd, 0);
+	if (memory == MAP_FAILED) {
+		close(fd);
+		return nullptr;
+	}
+
+	const ShmRingHeader *header = static_cast<const ShmRingHeader *>(memory);
+	if (header->magic != kShmRingMagic || header->version != kShmRingVersion) {
+		std::cerr << "Invalid or uninitialized ring " << name << std::endl;
+		munmap(memory, sizeof(ShmRingHeader));
+		close(fd);
+		return nullptr;
+	}
+
+	*size = ((sizeof(ShmRingHeader) + 63) & ~63) +
+		static_cast<size_t>(header->slotCount) * header->slotSize;
+	munmap(memory, sizeof(ShmRingHeader));
+
+	memory = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (memory == MAP_FAILED)
+		return nullptr;
+
+	return static_cast<ShmRingHeader *>(memory);
+}
+
+ShmSubscriber *subscribe(ShmRingHeader *header)
+{
+	pid_t pid = getpid();
+
+	for (ShmSubscriber &sub : header->subscribers) {
+		int32_t owner = sub.pid.load(std::memory_order_relaxed);
+
+		/* Reclaim entries left by subscribers that have died. */
+		if (owner == kShmSubscriberClaiming ||
+		    (owner && (kill(owner, 0) == 0 || errno != ESRCH)))
+			continue;
+
+		/*
+		 * Claim the entry, and initialize it before publishing the PID,
+		 * to prevent the producer from accounting drops against a stale
+		 * cursor.
+		 */
+		if (!sub.pid.compare_exchange_strong(owner, kShmSubscriberClaiming,
+						     std::memory_order_acquire))
+			continue;
+
+		sub.cursor.store(header->head.load(std::memory_order_acquire),
+				 std::memory_order_relaxed);
+		sub.dropped.store(0, std::memory_order_relaxed);
+		sub.pid.store(pid, std::memory_order_release);
+		return &sub;
+	}
+
+	return nullptr;
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		std::cout << "Usage: " << argv[0] << " <name> [frames]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::string name = argv[1][0] == '/' ? argv[1] : std::string("/") + argv[1];
+	uint64_t limit = argc > 2 ? strtoull(argv[2], nullptr, 10) : 0;
+
+	size_t size;
+	ShmRingHeader *header = mapRing(name, &size);
+	if (!header)
+		return EXIT_FAILURE;
+
+	ShmSubscriber *sub = subscribe(header);
+	if (!sub) {
+		std::cerr << "Too many subscribers" << std::endl;
+		munmap(header, size);
+		return EXIT_FAILURE;
+	}
+
+	struct sigaction sa = {};
+	sa.sa_handler = &signalHandler;
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+
+	uint8_t *slots = reinterpret_cast<uint8_t *>(header) +
+			 ((sizeof(ShmRingHeader) + 63) & ~63);
+
+	Stats total;
+	Stats period;
+	uint64_t periodDropped = 0;
+	uint64_t start = shmRingTime();
+	uint64_t periodStart = start;
+	uint32_t sum = 0;
+
+	while (running && (!limit || total.frames < limit)) {
+		uint32_t futex = header->futex.load(std::memory_order_acquire);
+		uint64_t cursor = sub->cursor.load(std::memory_order_acquire);
+
+		if (cursor == header->head.load(std::memory_order_acquire)) {
+			/* Wait for the next frame, with a timeout to report stats. */
+			struct timespec timeout = { 0, 100000000 };
+			shmRingWait(header, futex, &timeout);
+			continue;
+		}
+
+		uint8_t *slot = slots + (cursor % header->slotCount) * header->slotSize;
+		ShmSlotHeader *slotHeader = reinterpret_cast<ShmSlotHeader *>(slot);
+
+		uint64_t sequence = slotHeader->sequence.load(std::memory_order_acquire);
+		if (sequence == cursor + 1) {
+			uint64_t published = slotHeader->published;
+			sum ^= checksum(slot + sizeof(ShmSlotHeader),
+					std::min<size_t>(slotHeader->bytesused,
+							 header->slotSize - sizeof(ShmSlotHeader)));
+
+			/* Check that the frame hasn't been overwritten meanwhile. */
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slotHeader->sequence.load(std::memory_order_relaxed) == sequence) {
+				uint64_t latency = shmRingTime() - published;
+				total.add(latency);
+				period.add(latency);
+			} else {
+				total.torn++;
+				period.torn++;
+			}
+		}
+
+		/*
+		 * Move to the next frame, unless the producer has already moved
+		 * the cursor past an overwritten frame.
+		 */
+		sub->cursor.compare_exchange_strong(cursor, cursor + 1);
+
+		uint64_t now = shmRingTime();
+		if (now - periodStart >= 1000000000ULL) {
+			uint64_t dropped = sub->dropped.load(std::memory_order_relaxed);
+			period.print("Last second", (now - periodStart) / 1e9,
+				     dropped - periodDropped);
+			period = Stats();
+			periodDropped = dropped;
+			periodStart = now;
+		}
+	}
+
+	total.print("Total", (shmRingTime() - start) / 1e9,
+		    sub->dropped.load(std::memory_order_relaxed));
+	std::cout << "Checksum " << std::hex << sum << std::endl;
+
+	sub->pid.store(0, std::memory_order_release);
+	munmap(header, size);
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * shm_ring.h - cam - Shared memory frame ring layout
+ */
+#ifndef __CAM_SHM_RING_H__
+#define __CAM_SHM_RING_H__
+
+#include <atomic>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The ring is stored in a POSIX shared memory object, made of a ShmRingHeader
+ * followed by slotCount slots of slotSize bytes. Each slot starts with a
+ * ShmSlotHeader followed by the frame data, with all planes stored
+ * contiguously.
+ *
+ * The single producer publishes frame n in slot n % slotCount. It never waits
+ * for subscribers: when it overwrites a frame that a subscriber hasn't read
+ * yet, it moves the subscriber cursor past the overwritten frame and accounts
+ * for the drop. Subscribers access frame data in place, and detect frames
+ * overwritten while they were reading them by checking the slot sequence
+ * again once done.
+ */
+
+static constexpr uint32_t kShmRingMagic = 0x6d616363; /* "ccam" */
+static constexpr uint32_t kShmRingVersion = 1;
+static constexpr unsigned int kShmRingMaxSubscribers = 8;
+static constexpr int32_t kShmSubscriberClaiming = -1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+	      "Shared memory ring requires lock-free 64-bit atomics");
+
+struct ShmSubscriber {
+	/*
+	 * PID of the subscriber process, 0 if the entry is free, or
+	 * kShmSubscriberClaiming while a subscriber initializes the entry.
+	 */
+	std::atomic<int32_t> pid;
+	uint32_t reserved;
+	/* Number of the next frame to be read by the subscriber. */
+	std::atomic<uint64_t> cursor;
+	/* Number of frames overwritten before the subscriber read them. */
+	std::atomic<uint64_t> dropped;
+};
+
+struct ShmRingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t slotSize;
+
+	/* Number of frames published so far. */
+	std::atomic<uint64_t> head;
+	/* Futex word incremented on every publication, to wake subscribers. */
+	std::atomic<uint32_t> futex;
+	uint32_t reserved;
+
+	ShmSubscriber subscribers[kShmRingMaxSubscribers];
+};
+
+struct ShmSlotHeader {
+	/* Frame number plus one once the slot is valid, 0 while written. */
+	std::atomic<uint64_t> sequence;
+
+	/* Frame timestamp, and CLOCK_MONOTONIC time of publication (ns). */
+	uint64_t timestamp;
+	uint64_t published;
+
+	uint32_t stream;
+	uint32_t frameSequence;
+	uint32_t fourcc;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t bytesused;
+	uint32_t reserved;
+};
+
+static inline uint64_t shmRingTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void shmRingWake(ShmRingHeader *header)
+{
+	header->futex.fetch_add(1, std::memory_order_release);
+	syscall(SYS_futex, &header->futex, FUTEX_WAKE, INT_MAX, nullptr,
+		nullptr, 0);
+}
+
+static inline void shmRingWait(ShmRingHeader *header, uint32_t value,
+			       const struct timespec *timeout)
+{
+	syscall(SYS_futex, &header->futex, FUTEX_WAIT, value, timeout,
+		nullptr, 0);
+}
+
+#endif /* __CAM_SHM_RING_H__ */
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * shm_sink.cpp - cam - Shared memory frame sink
+ */
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "buffer_sync.h"
+#include "shm_ring.h"
+#include "shm_sink.h"
+
+using namespace libcamera;
+
+namespace {
+
+constexpr size_t alignSize(size_t size)
+{
+	return (size + 63) & ~static_cast<size_t>(63);
+}
+
+} /* namespace */
+
+ShmSink::ShmSink(const std::string &name, unsigned int slots)
+	: name_(name[0] == '/' ? name : "/" + name), slotCount_(slots),
+	  slotSize_(0), header_(nullptr), size_(0)
+{
+}
+
+ShmSink::~ShmSink()
+{
+	for (auto &iter : mappedBuffers_)
+		munmap(iter.second.first, iter.second.second);
+	mappedBuffers_.clear();
+
+	if (header_) {
+		munmap(header_, size_);
+		shm_unlink(name_.c_str());
+	}
+}
+
+int ShmSink::configure(const CameraConfiguration &config)
+{
+	streams_.clear();
+	for (unsigned int i = 0; i < config.size(); ++i)
+		streams_[config.at(i).stream()] = i;
+
+	return 0;
+}
+
+void ShmSink::mapBuffer(FrameBuffer *buffer)
+{
+	std::map<int, unsigned int> lengths;
+	size_t payload = 0;
+
+	for (const FrameBuffer::Plane &plane : buffer->planes()) {
+		unsigned int &length = lengths[plane.fd.fd()];
+		length = std::max(length, plane.offset + plane.length);
+		payload += plane.length;
+	}
+
+	for (const auto &iter : lengths) {
+		void *memory = mmap(NULL, iter.second, PROT_READ, MAP_SHARED,
+				    iter.first, 0);
+
+		mappedBuffers_[iter.first] =
+			std::make_pair(memory, iter.second);
+	}
+
+	slotSize_ = std::max(slotSize_, alignSize(sizeof(ShmSlotHeader) + payload));
+}
+
+/*
+ * Create the shared memory ring. This must be called after all buffers have
+ * been mapped, as the slots are sized to hold the largest buffer.
+ */
+int ShmSink::create()
+{
+	if (header_ || !slotSize_)
+		return -EINVAL;
+
+	/* Replace any stale ring left by a previous run. */
+	shm_unlink(name_.c_str());
+
+	int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		int ret = -errno;
+		std::cerr << "Failed to create shared memory " << name_
+			  << ": " << strerror(-ret) << std::endl;
+		return ret;
+	}
+
+	size_ = alignSize(sizeof(ShmRingHeader)) + slotCount_ * slotSize_;
+
+	int ret = ftruncate(fd, size_);
+	if (ret < 0) {
+		ret = -errno;
+		close(fd);
+		shm_unlink(name_.c_str());
+		std::cerr << "Failed to size shared memory: " << strerror(-ret)
+			  << std::endl;
+		return ret;
+	}
+
+	void *memory = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+			    fd, 0);
+	close(fd);
+
+	if (memory == MAP_FAILED) {
+		ret = -errno;
+		shm_unlink(name_.c_str());
+		std::cerr << "Failed to map shared memory: " << strerror(-ret)
+			  << std::endl;
+		return ret;
+	}
+
+	/*
+	 * The object is zero-filled by ftruncate(). Publish the magic last, as
+	 * subscribers use it to check that the ring is initialized.
+	 */
+	header_ = new (memory) ShmRingHeader();
+	header_->version = kShmRingVersion;
+	header_->slotCount = slotCount_;
+	header_->slotSize = slotSize_;
+	std::atomic_thread_fence(std::memory_order_release);
+	header_->magic = kShmRingMagic;
+
+	std::cout << "Publishing frames to shared memory " << name_ << " ("
+		  << slotCount_ << " slots of " << slotSize_ << " bytes)"
+		  << std::endl;
+
+	return 0;
+}
+
+int ShmSink::write(FrameBuffer *buffer, const Stream *stream)
+{
+	if (!header_)
+		return -ENODEV;
+
+	uint64_t frame = header_->head.load(std::memory_order_relaxed);
+
+	/*
+	 * Drop the oldest frame for the subscribers that haven't read it yet,
+	 * as it is about to be overwritten.
+	 */
+	if (frame >= slotCount_) {
+		uint64_t oldest = frame - slotCount_ + 1;
+
+		for (ShmSubscriber &sub : header_->subscribers) {
+			if (sub.pid.load(std::memory_order_acquire) <= 0)
+				continue;
+
+			uint64_t cursor = sub.cursor.load(std::memory_order_relaxed);
+			while (cursor < oldest) {
+				if (sub.cursor.compare_exchange_weak(cursor, oldest,
+								     std::memory_order_relaxed)) {
+					sub.dropped.fetch_add(oldest - cursor,
+							      std::memory_order_relaxed);
+					break;
+				}
+			}
+		}
+	}
+
+	uint8_t *slot = reinterpret_cast<uint8_t *>(header_) +
+			alignSize(sizeof(ShmRingHeader)) +
+			(frame % slotCount_) * slotSize_;
+	ShmSlotHeader *slotHeader = reinterpret_cast<ShmSlotHeader *>(slot);
+
+	/* Invalidate the slot before overwriting its content. */
+	slotHeader->sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const FrameMetadata &metadata = buffer->metadata();
+	const StreamConfiguration &cfg = stream->configuration();
+
+	slotHeader->timestamp = metadata.timestamp;
+	slotHeader->stream = streams_[stream];
+	slotHeader->frameSequence = metadata.sequence;
+	slotHeader->fourcc = cfg.pixelFormat.fourcc();
+	slotHeader->width = cfg.size.width;
+	slotHeader->height = cfg.size.height;
+	slotHeader->stride = cfg.stride;
+
+	syncBuffer(buffer, DMA_BUF_SYNC_START);
+
+	uint8_t *data = slot + sizeof(ShmSlotHeader);
+	size_t available = slotSize_ - sizeof(ShmSlotHeader);
+	size_t bytesused = 0;
+
+	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
+		const FrameBuffer::Plane &plane = buffer->planes()[i];
+		const FrameMetadata::Plane &meta = metadata.planes[i];
+
+		const uint8_t *src = static_cast<uint8_t *>(mappedBuffers_[plane.fd.fd()].first)
+				   + plane.offset;
+		size_t length = std::min<size_t>({ meta.bytesused, plane.length,
+						   available - bytesused });
+
+		memcpy(data + bytesused, src, length);
+		bytesused += length;
+	}
+
+	syncBuffer(buffer, DMA_BUF_SYNC_END);
+
+	slotHeader->bytesused = bytesused;
+	slotHeader->published = shmRingTime();
+
+	slotHeader->sequence.store(frame + 1, std::memory_order_release);
+	header_->head.store(frame + 1, std::memory_order_release);
+
+	shmRingWake(header_);
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * shm_sink.h - cam - Shared memory frame sink
+ */
+#ifndef __CAM_SHM_SINK_H__
+#define __CAM_SHM_SINK_H__
+
+#include <map>
+#include <string>
+
+#include <libcamera/buffer.h>
+#include <libcamera/camera.h>
+#include <libcamera/stream.h>
+
+struct ShmRingHeader;
+
+class ShmSink
+{
+public:
+	ShmSink(const std::string &name, unsigned int slots = 8);
+	~ShmSink();
+
+	int configure(const libcamera::CameraConfiguration &config);
+
+	void mapBuffer(libcamera::FrameBuffer *buffer);
+	int create();
+
+	int write(libcamera::FrameBuffer *buffer,
+		  const libcamera::Stream *stream);
+
+private:
+	std::string name_;
+	unsigned int slotCount_;
+	size_t slotSize_;
+
+	ShmRingHeader *header_;
+	size_t size_;
+
+	std::map<const libcamera::Stream *, unsigned int> streams_;
+	std::map<int, std::pair<void *, unsigned int>> mappedBuffers_;
+};
+
+#endif /* __CAM_SHM_SINK_H__ */
@@ -21,6 +21,9 @@ StreamKeyValueParser::StreamKeyValueParser()
 		  ArgumentRequired);
 	addOption("pixelformat", OptionString, "Pixel format name",
 		  ArgumentRequired);
+	addOption("camera", OptionInteger,
+		  "Index of the camera the stream applies to, in the order of the camera options (default: all cameras)",
+		  ArgumentRequired);
 }
 
 KeyValueParser::Options StreamKeyValueParser::parse(const char *arguments)
@@ -38,6 +41,22 @@ KeyValueParser::Options StreamKeyValueParser::parse(const char *arguments)
 	return options;
 }
 
+OptionValue StreamKeyValueParser::cameraStreams(const OptionValue &values,
+						unsigned int camera)
+{
+	OptionValue streams;
+
+	for (auto const &value : values.toArray()) {
+		KeyValueParser::Options opts = value.toKeyValues();
+
+		if (!opts.isSet("camera") ||
+		    static_cast<unsigned int>(opts["camera"].toInteger()) == camera)
+			streams.addValue(value);
+	}
+
+	return streams;
+}
+
 StreamRoles StreamKeyValueParser::roles(const OptionValue &values)
 {
 	const std::vector<OptionValue> &streamParameters = values.toArray();
@@ -20,6 +20,8 @@ public:
 
 	KeyValueParser::Options parse(const char *arguments) override;
 
+	static OptionValue cameraStreams(const OptionValue &values,
+					 unsigned int camera);
 	static StreamRoles roles(const OptionValue &values);
 	static int updateConfiguration(CameraConfiguration *config,
 				       const OptionValue &values);
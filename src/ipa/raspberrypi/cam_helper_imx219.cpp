@@ -115,41 +115,11 @@ MdParserImx219::MdParserImx219()
 
 MdParser::Status MdParserImx219::Parse(void *data)
 {
-	bool try_again = false;
-
-	if (reset_) {
-		/*
-		 * Search again through the metadata for the gain and exposure
-		 * registers.
-		 */
-		assert(bits_per_pixel_);
-		assert(num_lines_ || buffer_size_bytes_);
-		/* Need to be ordered */
-		uint32_t regs[3] = { GAIN_REG, EXPHI_REG, EXPLO_REG };
-		reg_offsets_[0] = reg_offsets_[1] = reg_offsets_[2] = -1;
-		int ret = static_cast<int>(findRegs(static_cast<uint8_t *>(data),
-						    regs, reg_offsets_, 3));
-		/*
-		 * > 0 means "worked partially but parse again next time",
-		 * < 0 means "hard error".
-		 */
-		if (ret > 0)
-			try_again = true;
-		else if (ret < 0)
-			return ERROR;
-	}
-
-	for (int i = 0; i < 3; i++) {
-		if (reg_offsets_[i] == -1)
-			continue;
-
-		reg_values_[i] = static_cast<uint8_t *>(data)[reg_offsets_[i]];
-	}
-
-	/* Re-parse next time if we were unhappy in some way. */
-	reset_ = try_again;
+	/* Need to be ordered */
+	uint32_t regs[3] = { GAIN_REG, EXPHI_REG, EXPLO_REG };
 
-	return OK;
+	return parseRegs(static_cast<uint8_t *>(data), regs, reg_offsets_,
+			 reg_values_, 3);
 }
 
 MdParser::Status MdParserImx219::GetExposureLines(unsigned int &lines)
@@ -92,46 +92,16 @@ MdParserImx477::MdParserImx477()
 
 MdParser::Status MdParserImx477::Parse(void *data)
 {
-	bool try_again = false;
-
-	if (reset_) {
-		/*
-		 * Search again through the metadata for the gain and exposure
-		 * registers.
-		 */
-		assert(bits_per_pixel_);
-		assert(num_lines_ || buffer_size_bytes_);
-		/* Need to be ordered */
-		uint32_t regs[4] = {
-			EXPHI_REG,
-			EXPLO_REG,
-			GAINHI_REG,
-			GAINLO_REG
-		};
-		reg_offsets_[0] = reg_offsets_[1] = reg_offsets_[2] = reg_offsets_[3] = -1;
-		int ret = static_cast<int>(findRegs(static_cast<uint8_t *>(data),
-						    regs, reg_offsets_, 4));
-		/*
-		 * > 0 means "worked partially but parse again next time",
-		 * < 0 means "hard error".
-		 */
-		if (ret > 0)
-			try_again = true;
-		else if (ret < 0)
-			return ERROR;
-	}
-
-	for (int i = 0; i < 4; i++) {
-		if (reg_offsets_[i] == -1)
-			continue;
-
-		reg_values_[i] = static_cast<uint8_t *>(data)[reg_offsets_[i]];
-	}
-
-	/* Re-parse next time if we were unhappy in some way. */
-	reset_ = try_again;
-
-	return OK;
+	/* Need to be ordered */
+	uint32_t regs[4] = {
+		EXPHI_REG,
+		EXPLO_REG,
+		GAINHI_REG,
+		GAINLO_REG
+	};
+
+	return parseRegs(static_cast<uint8_t *>(data), regs, reg_offsets_,
+			 reg_values_, 4);
 }
 
 MdParser::Status MdParserImx477::GetExposureLines(unsigned int &lines)
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Limited
+ *
+ * md_parser_status.h - embedded data parser status
+ */
+#pragma once
+
+// Time taken to parse the sensor embedded data of the frame, and whether the
+// register offsets cached from a previous frame could be used, or a full scan
+// of the embedded data was needed.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct MdParserStatus {
+	// parse time, in microseconds
+	double parse_time;
+	int cached;
+};
+
+#ifdef __cplusplus
+}
+#endif
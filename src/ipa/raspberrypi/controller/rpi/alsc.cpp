@@ -6,6 +6,8 @@
  */
 #include <math.h>
 
+#include "libcamera/internal/thread.h"
+
 #include "../awb_status.h"
 #include "alsc.hpp"
 
@@ -359,6 +361,8 @@ void Alsc::Process(StatisticsPtr &stats, Metadata *image_metadata)
 
 void Alsc::asyncFunc()
 {
+	libcamera::ThreadPolicy::apply(libcamera::ThreadPolicy::RoleIPAWorker);
+
 	while (true) {
 		{
 			std::unique_lock<std::mutex> lock(mutex_);
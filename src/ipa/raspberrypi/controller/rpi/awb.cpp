@@ -5,6 +5,8 @@
  * awb.cpp - AWB control algorithm
  */
 
+#include "libcamera/internal/thread.h"
+
 #include "../logging.hpp"
 #include "../lux_status.h"
 
@@ -273,6 +275,8 @@ void Awb::Process(StatisticsPtr &stats, Metadata *image_metadata)
 
 void Awb::asyncFunc()
 {
+	libcamera::ThreadPolicy::apply(libcamera::ThreadPolicy::RoleIPAWorker);
+
 	while (true) {
 		{
 			std::unique_lock<std::mutex> lock(mutex_);
@@ -5,6 +5,7 @@
  * md_parser.cpp - image sensor metadata parsers
  */
 
+#include <algorithm>
 #include <assert.h>
 #include <map>
 #include <string.h>
@@ -27,9 +28,13 @@ using namespace RPi;
 #define REG_VALUE 0x5a
 #define REG_SKIP 0x55
 
+// If tag_offsets is given, the offset of the tag preceding each value is also
+// stored there, for the benefit of findRegsCached.
+
 MdParserSmia::ParseStatus MdParserSmia::findRegs(unsigned char *data,
 						 uint32_t regs[], int offsets[],
-						 unsigned int num_regs)
+						 unsigned int num_regs,
+						 int tag_offsets[])
 {
 	assert(num_regs > 0);
 	if (data[0] != LINE_START)
@@ -40,6 +45,7 @@ MdParserSmia::ParseStatus MdParserSmia::findRegs(unsigned char *data,
 	unsigned int reg_num = 0, first_reg = 0;
 	ParseStatus retcode = PARSE_OK;
 	while (1) {
+		unsigned int tag_offset = current_offset;
 		int tag = data[current_offset++];
 		if ((bits_per_pixel_ == 10 &&
 		     (current_offset + 1 - current_line_start) % 5 == 0) ||
@@ -87,9 +93,13 @@ MdParserSmia::ParseStatus MdParserSmia::findRegs(unsigned char *data,
 				while (reg_num >=
 				       // assumes registers are in order...
 				       regs[first_reg]) {
-					if (reg_num == regs[first_reg])
+					if (reg_num == regs[first_reg]) {
 						offsets[first_reg] =
 							current_offset - 1;
+						if (tag_offsets)
+							tag_offsets[first_reg] =
+								tag_offset;
+					}
 					if (++first_reg == num_regs)
 						return retcode;
 				}
@@ -99,3 +109,94 @@ MdParserSmia::ParseStatus MdParserSmia::findRegs(unsigned char *data,
 		}
 	}
 }
+
+// Find the register offsets as findRegs does, but start by trying the offsets
+// found previously for the same embedded data layout. They are used if the
+// line start and the tags preceding each value are still in place, which
+// avoids walking the whole embedded data on every frame.
+
+MdParserSmia::ParseStatus MdParserSmia::findRegsCached(unsigned char *data,
+						       uint32_t regs[],
+						       int offsets[],
+						       unsigned int num_regs)
+{
+	if (reset_) {
+		cache_.clear();
+		reset_ = false;
+	}
+
+	Layout layout(bits_per_pixel_, line_length_bytes_, num_lines_,
+		      buffer_size_bytes_);
+	auto it = cache_.find(layout);
+	if (it != cache_.end() && it->second.offsets.size() == num_regs &&
+	    checkCachedOffsets(data, it->second)) {
+		std::copy(it->second.offsets.begin(), it->second.offsets.end(),
+			  offsets);
+		cached_ = true;
+		return PARSE_OK;
+	}
+
+	cached_ = false;
+
+	std::vector<int> tag_offsets(num_regs, -1);
+	std::fill(offsets, offsets + num_regs, -1);
+	ParseStatus ret = findRegs(data, regs, offsets, num_regs,
+				   tag_offsets.data());
+
+	// Only remember complete results, partial ones get parsed again.
+	if (ret == PARSE_OK)
+		cache_[layout] = { std::vector<int>(offsets, offsets + num_regs),
+				   tag_offsets };
+	else
+		cache_.erase(layout);
+
+	return ret;
+}
+
+// Look up the registers, at the offsets found in a previous frame when the
+// embedded data layout hasn't changed, and read their values. The offsets of
+// registers that are not found are set to -1, and their values are left
+// untouched.
+
+MdParser::Status MdParserSmia::parseRegs(unsigned char *data, uint32_t regs[],
+					 int offsets[], int values[],
+					 unsigned int num_regs)
+{
+	assert(bits_per_pixel_);
+	assert(num_lines_ || buffer_size_bytes_);
+
+	// > 0 means "worked partially but parse again next time",
+	// < 0 means "hard error".
+	if (findRegsCached(data, regs, offsets, num_regs) < 0)
+		return ERROR;
+
+	for (unsigned int i = 0; i < num_regs; i++) {
+		if (offsets[i] == -1)
+			continue;
+
+		values[i] = data[offsets[i]];
+	}
+
+	return OK;
+}
+
+bool MdParserSmia::checkCachedOffsets(unsigned char *data,
+				      CachedOffsets const &cached) const
+{
+	if (data[0] != LINE_START)
+		return false;
+
+	for (unsigned int i = 0; i < cached.offsets.size(); i++) {
+		int tag_offset = cached.tag_offsets[i];
+		if (tag_offset == -1)
+			continue;
+
+		if (buffer_size_bytes_ &&
+		    static_cast<unsigned int>(cached.offsets[i]) >= buffer_size_bytes_)
+			return false;
+		if (data[tag_offset] != REG_VALUE)
+			return false;
+	}
+
+	return true;
+}
@@ -6,7 +6,10 @@
  */
 #pragma once
 
+#include <map>
 #include <stdint.h>
+#include <tuple>
+#include <vector>
 
 /* Camera metadata parser class. Usage as shown below.
 
@@ -48,7 +51,11 @@ then:
 
 parser->Reset();
 
-before calling Parse again. */
+before calling Parse again.
+
+Parsers may remember where they found the values in a previous frame with the
+same layout, and read them directly from there. UsedCachedOffsets() tells
+whether the last Parse call did so. */
 
 namespace RPi {
 
@@ -66,9 +73,14 @@ public:
 		NOTFOUND = 1,
 		ERROR = 2
 	};
-	MdParser() : reset_(true) {}
+	MdParser()
+		: reset_(true), cached_(false), bits_per_pixel_(0), num_lines_(0),
+		  line_length_bytes_(0), buffer_size_bytes_(0)
+	{
+	}
 	virtual ~MdParser() {}
 	void Reset() { reset_ = true; }
+	bool UsedCachedOffsets() const { return cached_; }
 	void SetBitsPerPixel(int bpp) { bits_per_pixel_ = bpp; }
 	void SetNumLines(unsigned int num_lines) { num_lines_ = num_lines; }
 	void SetLineLengthBytes(unsigned int num_bytes)
@@ -85,6 +97,7 @@ public:
 
 protected:
 	bool reset_;
+	bool cached_;
 	int bits_per_pixel_;
 	unsigned int num_lines_;
 	unsigned int line_length_bytes_;
@@ -95,6 +108,13 @@ protected:
 // however, it does provide the findRegs method which will prove useful and make
 // it easier to implement parsers for other SMIA-like sensors (see
 // md_parser_imx219.cpp for an example).
+//
+// The findRegsCached method remembers the register offsets found for each
+// embedded data layout (bits per pixel, line length, number of lines and
+// buffer size). On later frames with the same layout it only checks that the
+// tags at the remembered positions still match, and falls back to a full scan
+// otherwise. The parseRegs method wraps it for the common case of parsers
+// that read the values of a fixed list of registers on every frame.
 
 class MdParserSmia : public MdParser
 {
@@ -117,7 +137,22 @@ protected:
 		BAD_PADDING   = -5
 	};
 	ParseStatus findRegs(unsigned char *data, uint32_t regs[],
-			     int offsets[], unsigned int num_regs);
+			     int offsets[], unsigned int num_regs,
+			     int tag_offsets[] = nullptr);
+	ParseStatus findRegsCached(unsigned char *data, uint32_t regs[],
+				   int offsets[], unsigned int num_regs);
+	Status parseRegs(unsigned char *data, uint32_t regs[], int offsets[],
+			 int values[], unsigned int num_regs);
+
+private:
+	typedef std::tuple<int, unsigned int, unsigned int, unsigned int> Layout;
+	struct CachedOffsets {
+		std::vector<int> offsets;
+		std::vector<int> tag_offsets;
+	};
+	bool checkCachedOffsets(unsigned char *data,
+				CachedOffsets const &cached) const;
+	std::map<Layout, CachedOffsets> cache_;
 };
 
 } // namespace RPi
@@ -6,8 +6,10 @@
  */
 
 #include <algorithm>
+#include <condition_variable>
 #include <fcntl.h>
 #include <math.h>
+#include <mutex>
 #include <stdint.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -46,6 +48,7 @@
 #include "focus_status.h"
 #include "geq_status.h"
 #include "lux_status.h"
+#include "md_parser_status.h"
 #include "metadata.hpp"
 #include "noise_status.h"
 #include "sdn_status.h"
@@ -54,6 +57,13 @@
 
 namespace libcamera {
 
+/*
+ * Maximum number of statistics buffers handed to the control algorithms that
+ * they can hold past the processing of their frame. The statistics are copied
+ * when the limit is reached, to avoid starving the ISP of statistics buffers.
+ */
+#define MAX_HELD_STATS 1
+
 /* Configure the sensor with these values initially. */
 #define DEFAULT_ANALOGUE_GAIN 1.0
 #define DEFAULT_EXPOSURE_TIME 20000
@@ -68,6 +78,7 @@ public:
 		  frame_count_(0), check_count_(0), hide_count_(0),
 		  mistrust_count_(0), lsTable_(nullptr)
 	{
+		statsCounters_ = {};
 	}
 
 	~IPARPi()
@@ -78,7 +89,7 @@ public:
 
 	int init(const IPASettings &settings) override;
 	int start() override { return 0; }
-	void stop() override {}
+	void stop() override;
 
 	void configure(const CameraSensorInfo &sensorInfo,
 		       const std::map<unsigned int, IPAStream> &streamConfig,
@@ -95,8 +106,13 @@ private:
 	void returnEmbeddedBuffer(unsigned int bufferId);
 	void prepareISP(unsigned int bufferId);
 	void reportMetadata();
-	bool parseEmbeddedData(unsigned int bufferId, struct DeviceStatus &deviceStatus);
-	void processStats(unsigned int bufferId);
+	bool parseEmbeddedData(unsigned int bufferId, struct DeviceStatus &deviceStatus,
+			       struct MdParserStatus &parserStatus);
+	bool processStats(unsigned int bufferId);
+	RPi::StatisticsPtr shareStats(unsigned int bufferId,
+				      bcm2835_isp_stats *stats);
+	void releaseStats(unsigned int bufferId, void *memory);
+	void returnStats();
 	void applyAGC(const struct AgcStatus *agcStatus, ControlList &ctrls);
 	void applyAWB(const struct AwbStatus *awbStatus, ControlList &ctrls);
 	void applyDG(const struct AgcStatus *dgStatus, ControlList &ctrls);
@@ -113,6 +129,36 @@ private:
 	std::map<unsigned int, FrameBuffer> buffers_;
 	std::map<unsigned int, void *> buffersMemory_;
 
+	/*
+	 * Statistics buffers shared with the control algorithms, which may
+	 * release them from their own threads. The members must outlive the
+	 * controller.
+	 */
+	struct HeldStats {
+		utils::time_point start;
+		bool deferred;
+	};
+
+	struct StatsCounters {
+		uint64_t frames;
+		uint64_t deferred;
+		uint64_t copies;
+		utils::duration holdTime;
+		utils::duration maxHoldTime;
+	};
+
+	std::mutex statsMutex_;
+	std::condition_variable statsReleased_;
+	std::map<unsigned int, HeldStats> statsHeld_;
+	/*
+	 * Statistics buffers still held when stopping, indexed by address. The
+	 * value is the length to unmap once released, or 0 if still mapped.
+	 */
+	std::map<void *, size_t> statsOrphaned_;
+	std::vector<unsigned int> statsReturned_;
+	std::vector<std::unique_ptr<bcm2835_isp_stats>> statsPool_;
+	StatsCounters statsCounters_;
+
 	ControlInfoMap unicam_ctrls_;
 	ControlInfoMap isp_ctrls_;
 	ControlList libcameraMetadata_;
@@ -303,6 +349,50 @@ void IPARPi::configure(const CameraSensorInfo &sensorInfo,
 	}
 }
 
+void IPARPi::stop()
+{
+	std::unique_lock<std::mutex> lock(statsMutex_);
+
+	/*
+	 * The statistics buffers are freed when the pipeline handler stops.
+	 * Wait for the control algorithms to release the ones they hold, and
+	 * drop the pending releases as all buffers are queued again at start
+	 * time.
+	 */
+	if (!statsReleased_.wait_for(lock, std::chrono::seconds(1),
+				     [&]() { return statsHeld_.empty(); })) {
+		LOG(IPARPI, Error)
+			<< statsHeld_.size() << " statistics buffers still in use";
+
+		/*
+		 * Keep the buffers still referenced by the algorithms mapped,
+		 * they will be unmapped when released.
+		 */
+		for (const auto &held : statsHeld_)
+			statsOrphaned_[buffersMemory_[held.first]] = 0;
+	}
+
+	statsHeld_.clear();
+	statsReturned_.clear();
+
+	const StatsCounters &counters = statsCounters_;
+	uint64_t shared = counters.frames - counters.copies;
+	if (shared) {
+		auto us = [](utils::duration d) {
+			return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+		};
+
+		LOG(IPARPI, Debug)
+			<< "Statistics: " << counters.frames << " frames, "
+			<< counters.deferred << " held past processing, "
+			<< counters.copies << " copied, hold time avg "
+			<< us(counters.holdTime) / static_cast<int64_t>(shared)
+			<< "us max " << us(counters.maxHoldTime) << "us";
+	}
+
+	statsCounters_ = {};
+}
+
 void IPARPi::mapBuffers(const std::vector<IPABuffer> &buffers)
 {
 	for (const IPABuffer &buffer : buffers) {
@@ -329,7 +419,23 @@ void IPARPi::unmapBuffers(const std::vector<unsigned int> &ids)
 		if (fb == buffers_.end())
 			continue;
 
-		munmap(buffersMemory_[id], fb->second.planes()[0].length);
+		void *memory = buffersMemory_[id];
+		size_t length = fb->second.planes()[0].length;
+		bool held = false;
+
+		{
+			std::lock_guard<std::mutex> lock(statsMutex_);
+
+			auto orphan = statsOrphaned_.find(memory);
+			if (orphan != statsOrphaned_.end()) {
+				orphan->second = length;
+				held = true;
+			}
+		}
+
+		if (!held)
+			munmap(memory, length);
+
 		buffersMemory_.erase(id);
 		buffers_.erase(id);
 	}
@@ -340,19 +446,26 @@ void IPARPi::processEvent(const IPAOperationData &event)
 	switch (event.operation) {
 	case RPI_IPA_EVENT_SIGNAL_STAT_READY: {
 		unsigned int bufferId = event.data[0];
+		bool released = true;
 
 		if (++check_count_ != frame_count_) /* assert here? */
 			LOG(IPARPI, Error) << "WARNING: Prepare/Process mismatch!!!";
 		if (frame_count_ > mistrust_count_)
-			processStats(bufferId);
+			released = processStats(bufferId);
 
 		reportMetadata();
 
+		/*
+		 * Return the statistics buffer along with the metadata, unless
+		 * an algorithm still holds it.
+		 */
 		IPAOperationData op;
 		op.operation = RPI_IPA_ACTION_STATS_METADATA_COMPLETE;
-		op.data = { bufferId & RPiIpaMask::ID };
+		op.data = { bufferId & RPiIpaMask::ID, released };
 		op.controls = { libcameraMetadata_ };
 		queueFrameAction.emit(0, op);
+
+		returnStats();
 		break;
 	}
 
@@ -360,6 +473,8 @@ void IPARPi::processEvent(const IPAOperationData &event)
 		unsigned int embeddedbufferId = event.data[0];
 		unsigned int bayerbufferId = event.data[1];
 
+		returnStats();
+
 		/*
 		 * At start-up, or after a mode-switch, we may want to
 		 * avoid running the control algos for a few frames in case
@@ -491,7 +606,7 @@ void IPARPi::queueRequest(const ControlList &controls)
 
 	for (auto const &ctrl : controls) {
 		LOG(IPARPI, Info) << "Request ctrl: "
-				  << controls::controls.at(ctrl.first)->name()
+				  << controls::byId.at(ctrl.first)->name()
 				  << " = " << ctrl.second.toString();
 
 		switch (ctrl.first) {
@@ -689,7 +804,7 @@ void IPARPi::queueRequest(const ControlList &controls)
 
 		default:
 			LOG(IPARPI, Warning)
-				<< "Ctrl " << controls::controls.at(ctrl.first)->name()
+				<< "Ctrl " << controls::byId.at(ctrl.first)->name()
 				<< " is not handled.";
 			break;
 		}
@@ -707,7 +822,8 @@ void IPARPi::returnEmbeddedBuffer(unsigned int bufferId)
 void IPARPi::prepareISP(unsigned int bufferId)
 {
 	struct DeviceStatus deviceStatus = {};
-	bool success = parseEmbeddedData(bufferId, deviceStatus);
+	struct MdParserStatus parserStatus = {};
+	bool success = parseEmbeddedData(bufferId, deviceStatus, parserStatus);
 
 	/* Done with embedded data now, return to pipeline handler asap. */
 	returnEmbeddedBuffer(bufferId);
@@ -717,6 +833,7 @@ void IPARPi::prepareISP(unsigned int bufferId)
 
 		rpiMetadata_.Clear();
 		rpiMetadata_.Set("device.status", deviceStatus);
+		rpiMetadata_.Set("md_parser.status", parserStatus);
 		controller_.Prepare(&rpiMetadata_);
 
 		/* Lock the metadata buffer to avoid constant locks/unlocks. */
@@ -771,7 +888,8 @@ void IPARPi::prepareISP(unsigned int bufferId)
 	}
 }
 
-bool IPARPi::parseEmbeddedData(unsigned int bufferId, struct DeviceStatus &deviceStatus)
+bool IPARPi::parseEmbeddedData(unsigned int bufferId, struct DeviceStatus &deviceStatus,
+			       struct MdParserStatus &parserStatus)
 {
 	auto it = buffersMemory_.find(bufferId);
 	if (it == buffersMemory_.end()) {
@@ -781,7 +899,15 @@ bool IPARPi::parseEmbeddedData(unsigned int bufferId, struct DeviceStatus &devic
 
 	int size = buffers_.find(bufferId)->second.planes()[0].length;
 	helper_->Parser().SetBufferSize(size);
+
+	utils::time_point start = utils::clock::now();
 	RPi::MdParser::Status status = helper_->Parser().Parse(it->second);
+	utils::duration parseTime = utils::clock::now() - start;
+
+	parserStatus.parse_time =
+		std::chrono::duration<double, std::micro>(parseTime).count();
+	parserStatus.cached = helper_->Parser().UsedCachedOffsets();
+
 	if (status != RPi::MdParser::Status::OK) {
 		LOG(IPARPI, Error) << "Embedded Buffer parsing failed, error " << status;
 	} else {
@@ -800,23 +926,45 @@ bool IPARPi::parseEmbeddedData(unsigned int bufferId, struct DeviceStatus &devic
 		deviceStatus.analogue_gain = helper_->Gain(gain_code);
 		LOG(IPARPI, Debug) << "Metadata - Exposure : "
 				   << deviceStatus.shutter_speed << " Gain : "
-				   << deviceStatus.analogue_gain;
+				   << deviceStatus.analogue_gain << " parsed in "
+				   << parserStatus.parse_time << "us"
+				   << (parserStatus.cached ? " (cached)" : "");
 	}
 
 	return true;
 }
 
-void IPARPi::processStats(unsigned int bufferId)
+/*
+ * Run the control algorithms on the statistics, and return true if the
+ * statistics buffer can be returned to the pipeline handler, or false if an
+ * algorithm still holds it. The buffer is then returned by returnStats() once
+ * released.
+ */
+bool IPARPi::processStats(unsigned int bufferId)
 {
 	auto it = buffersMemory_.find(bufferId);
 	if (it == buffersMemory_.end()) {
 		LOG(IPARPI, Error) << "Could not find stats buffer!";
-		return;
+		return true;
 	}
 
 	bcm2835_isp_stats *stats = static_cast<bcm2835_isp_stats *>(it->second);
-	RPi::StatisticsPtr statistics = std::make_shared<bcm2835_isp_stats>(*stats);
+	RPi::StatisticsPtr statistics = shareStats(bufferId, stats);
 	controller_.Process(statistics, &rpiMetadata_);
+	statistics.reset();
+
+	bool released = true;
+
+	{
+		std::lock_guard<std::mutex> lock(statsMutex_);
+
+		auto held = statsHeld_.find(bufferId);
+		if (held != statsHeld_.end()) {
+			held->second.deferred = true;
+			statsCounters_.deferred++;
+			released = false;
+		}
+	}
 
 	struct AgcStatus agcStatus;
 	if (rpiMetadata_.Get("agc.status", agcStatus) == 0) {
@@ -828,6 +976,97 @@ void IPARPi::processStats(unsigned int bufferId)
 		op.controls.push_back(ctrls);
 		queueFrameAction.emit(0, op);
 	}
+
+	return released;
+}
+
+/*
+ * Wrap the mapped statistics buffer in a StatisticsPtr without copying it.
+ * The buffer is released when the last reference is dropped, which may happen
+ * in an algorithm thread. If too many buffers are held already, copy the
+ * statistics to a recycled buffer instead.
+ */
+RPi::StatisticsPtr IPARPi::shareStats(unsigned int bufferId,
+				      bcm2835_isp_stats *stats)
+{
+	std::lock_guard<std::mutex> lock(statsMutex_);
+
+	statsCounters_.frames++;
+
+	if (statsHeld_.size() >= MAX_HELD_STATS) {
+		std::unique_ptr<bcm2835_isp_stats> copy;
+		if (!statsPool_.empty()) {
+			copy = std::move(statsPool_.back());
+			statsPool_.pop_back();
+		} else {
+			copy = std::make_unique<bcm2835_isp_stats>();
+		}
+
+		*copy = *stats;
+		statsCounters_.copies++;
+
+		return RPi::StatisticsPtr(copy.release(),
+					  [this](bcm2835_isp_stats *s) {
+			std::lock_guard<std::mutex> locker(statsMutex_);
+			statsPool_.emplace_back(s);
+		});
+	}
+
+	statsHeld_[bufferId] = { utils::clock::now(), false };
+
+	return RPi::StatisticsPtr(stats,
+				  [this, bufferId](bcm2835_isp_stats *s) {
+		releaseStats(bufferId, s);
+	});
+}
+
+void IPARPi::releaseStats(unsigned int bufferId, void *memory)
+{
+	std::lock_guard<std::mutex> lock(statsMutex_);
+
+	/* Unmap the buffers orphaned by stop() once the pipeline freed them. */
+	auto orphan = statsOrphaned_.find(memory);
+	if (orphan != statsOrphaned_.end()) {
+		if (orphan->second)
+			munmap(memory, orphan->second);
+		statsOrphaned_.erase(orphan);
+		return;
+	}
+
+	auto it = statsHeld_.find(bufferId);
+	if (it == statsHeld_.end())
+		return;
+
+	utils::duration holdTime = utils::clock::now() - it->second.start;
+	statsCounters_.holdTime += holdTime;
+	statsCounters_.maxHoldTime = std::max(statsCounters_.maxHoldTime, holdTime);
+
+	/*
+	 * Buffers released during processStats() are returned with the
+	 * metadata, the other ones by returnStats().
+	 */
+	if (it->second.deferred)
+		statsReturned_.push_back(bufferId);
+
+	statsHeld_.erase(it);
+	statsReleased_.notify_all();
+}
+
+void IPARPi::returnStats()
+{
+	std::vector<unsigned int> ids;
+
+	{
+		std::lock_guard<std::mutex> lock(statsMutex_);
+		ids.swap(statsReturned_);
+	}
+
+	for (unsigned int id : ids) {
+		IPAOperationData op;
+		op.operation = RPI_IPA_ACTION_STATS_RELEASE;
+		op.data = { id & RPiIpaMask::ID };
+		queueFrameAction.emit(0, op);
+	}
 }
 
 void IPARPi::applyAWB(const struct AwbStatus *awbStatus, ControlList &ctrls)
@@ -8,8 +8,12 @@
 #include <libcamera/buffer.h>
 #include "libcamera/internal/buffer.h"
 
+#include <algorithm>
 #include <errno.h>
+#include <linux/dma-buf.h>
+#include <map>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -131,18 +135,19 @@ LOG_DEFINE_CATEGORY(Buffer)
  *
  * Planar pixel formats use multiple memory regions to store the different
  * colour components of a frame. The Plane structure describes such a memory
- * region by a dmabuf file descriptor and a length. A FrameBuffer then
- * contains one or multiple planes, depending on the pixel format of the
- * frames it is meant to store.
+ * region by a dmabuf file descriptor, an offset within the dmabuf and a
+ * length. A FrameBuffer then contains one or multiple planes, depending on the
+ * pixel format of the frames it is meant to store.
  *
  * To support DMA access, planes are associated with dmabuf objects represented
  * by FileDescriptor handles. The Plane class doesn't handle mapping of the
  * memory to the CPU, but applications and IPAs may use the dmabuf file
  * descriptors to map the plane memory with mmap() and access its contents.
  *
- * \todo Once we have a Kernel API which can express offsets within a plane
- * this structure shall be extended to contain this information. See commit
- * 83148ce8be55e for initial documentation of this feature.
+ * Multiple planes may be stored in a single dmabuf, as is common for buffers
+ * allocated by external allocators such as DRM, gralloc or video encoders. In
+ * that case all planes share the same file descriptor, and each plane is
+ * located at its own offset in the dmabuf.
  */
 
 /**
@@ -150,6 +155,11 @@ LOG_DEFINE_CATEGORY(Buffer)
  * \brief The dmabuf file descriptor
  */
 
+/**
+ * \var FrameBuffer::Plane::offset
+ * \brief The plane offset in bytes from the start of the dmabuf
+ */
+
 /**
  * \var FrameBuffer::Plane::length
  * \brief The plane length in bytes
@@ -274,12 +284,18 @@ int FrameBuffer::copyFrom(const FrameBuffer *src)
 		return -EINVAL;
 	}
 
+	source.beginAccess(MappedFrameBuffer::SyncRead);
+	destination.beginAccess(MappedFrameBuffer::SyncWrite);
+
 	for (unsigned int i = 0; i < planes_.size(); i++) {
-		memcpy(destination.maps()[i].data(),
-		       source.maps()[i].data(),
-		       source.maps()[i].size());
+		memcpy(destination.planes()[i].data(),
+		       source.planes()[i].data(),
+		       source.planes()[i].size());
 	}
 
+	destination.endAccess();
+	source.endAccess();
+
 	metadata_ = src->metadata_;
 
 	return 0;
@@ -338,12 +354,21 @@ MappedBuffer::MappedBuffer(MappedBuffer &&other)
  * Moving a MappedBuffer moves the mappings contained in the \a other to the new
  * MappedBuffer and invalidates the \a other.
  *
- * No mappings are unmapped or destroyed in this process.
+ * The mappings previously held by this MappedBuffer are unmapped.
  */
 MappedBuffer &MappedBuffer::operator=(MappedBuffer &&other)
 {
+	if (this == &other)
+		return *this;
+
+	for (Plane &map : maps_)
+		munmap(map.data(), map.size());
+
 	error_ = other.error_;
 	maps_ = std::move(other.maps_);
+	planes_ = std::move(other.planes_);
+	other.maps_.clear();
+	other.planes_.clear();
 	other.error_ = -ENOENT;
 
 	return *this;
@@ -374,10 +399,24 @@ MappedBuffer::~MappedBuffer()
 
 /**
  * \fn MappedBuffer::maps()
+ * \brief Retrieve the memory mappings
+ *
+ * This function retrieves the successful memory mappings stored as a vector
+ * of Span<uint8_t> to provide access to the mapped memory. A single mapping
+ * may cover multiple planes, use planes() to access the memory of a
+ * particular plane.
+ *
+ * \return A vector of the memory mappings
+ */
+
+/**
+ * \fn MappedBuffer::planes()
  * \brief Retrieve the mapped planes
  *
- * This function retrieves the successfully mapped planes stored as a vector
- * of Span<uint8_t> to provide access to the mapped memory.
+ * This function retrieves the mapped planes, one for each plane of the
+ * buffer. Planes that share a dmabuf are backed by a single memory mapping,
+ * and their spans point at their respective offset within that mapping.
+ * Unlike maps(), the returned vector is thus always indexed by plane.
  *
  * \return A vector of the mapped planes
  */
@@ -399,9 +438,35 @@ MappedBuffer::~MappedBuffer()
  * completed successfully.
  */
 
+/**
+ * \var MappedBuffer::planes_
+ * \brief Stores the mapped planes
+ *
+ * MappedBuffer derived classes shall store one span per buffer plane in this
+ * vector, pointing to memory within the mappings stored in maps_.
+ */
+
 /**
  * \class MappedFrameBuffer
  * \brief Map a FrameBuffer using the MappedBuffer interface
+ *
+ * CPU access to the mapped memory shall be bracketed by calls to
+ * beginAccess() and endAccess(). This allows dmabuf exporters to provide
+ * cacheable mappings and perform the cache maintenance operations required for
+ * coherency with devices only when needed, instead of resorting to slow
+ * uncached or write-combined mappings. Buffers that are not dmabufs (such as
+ * memfd-backed buffers) are handled transparently.
+ */
+
+/**
+ * \enum MappedFrameBuffer::SyncFlag
+ * \brief Direction of CPU access to the mapped memory
+ * \var MappedFrameBuffer::SyncRead
+ * \brief The CPU reads from the buffer
+ * \var MappedFrameBuffer::SyncWrite
+ * \brief The CPU writes to the buffer
+ * \var MappedFrameBuffer::SyncReadWrite
+ * \brief The CPU reads from and writes to the buffer
  */
 
 /**
@@ -412,22 +477,223 @@ MappedBuffer::~MappedBuffer()
  * Construct an object to map a frame buffer for CPU access.
  * The flags are passed directly to mmap and should be either PROT_READ,
  * PROT_WRITE, or a bitwise-or combination of both.
+ *
+ * Each distinct dmabuf of the \a buffer is mapped once, large enough to cover
+ * all the planes it stores.
  */
 MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, int flags)
 {
-	maps_.reserve(buffer->planes().size());
-
-	for (const FrameBuffer::Plane &plane : buffer->planes()) {
-		void *address = mmap(nullptr, plane.length, flags,
-				     MAP_SHARED, plane.fd.fd(), 0);
-		if (address == MAP_FAILED) {
-			error_ = -errno;
-			LOG(Buffer, Error) << "Failed to mmap plane";
-			break;
+	struct MappingInfo {
+		uint8_t *address;
+		size_t mapLength;
+	};
+
+	const std::vector<FrameBuffer::Plane> &planes = buffer->planes();
+	std::map<int, MappingInfo> mappingInfo;
+	std::map<int, unsigned int> mapIndices;
+
+	for (const FrameBuffer::Plane &plane : planes) {
+		MappingInfo &info = mappingInfo[plane.fd.fd()];
+		info.mapLength = std::max<size_t>(info.mapLength,
+						  plane.offset + plane.length);
+	}
+
+	planes_.reserve(planes.size());
+
+	for (const FrameBuffer::Plane &plane : planes) {
+		MappingInfo &info = mappingInfo[plane.fd.fd()];
+		if (!info.address) {
+			void *address = mmap(nullptr, info.mapLength, flags,
+					     MAP_SHARED, plane.fd.fd(), 0);
+			if (address == MAP_FAILED) {
+				error_ = -errno;
+				LOG(Buffer, Error) << "Failed to mmap plane";
+				break;
+			}
+
+			info.address = static_cast<uint8_t *>(address);
+			mapIndices[plane.fd.fd()] = maps_.size();
+			maps_.emplace_back(info.address, info.mapLength);
+			dmabufs_.push_back(plane.fd);
 		}
 
-		maps_.emplace_back(static_cast<uint8_t *>(address), plane.length);
+		planes_.emplace_back(info.address + plane.offset, plane.length);
+		planeMaps_.push_back(mapIndices[plane.fd.fd()]);
 	}
+
+	accessFlags_.resize(maps_.size(), 0);
+}
+
+MappedFrameBuffer::~MappedFrameBuffer()
+{
+	endAccess();
+}
+
+/**
+ * \brief Move constructor, construct the MappedFrameBuffer with the contents
+ * of \a other using move semantics
+ * \param[in] other The other MappedFrameBuffer
+ *
+ * The mappings and the CPU access in progress, if any, are transferred from
+ * \a other to the new MappedFrameBuffer, and \a other is invalidated.
+ */
+MappedFrameBuffer::MappedFrameBuffer(MappedFrameBuffer &&other)
+	: MappedBuffer()
+{
+	*this = std::move(other);
+}
+
+/**
+ * \brief Move assignment operator, replace the mappings with those of \a other
+ * \param[in] other The other MappedFrameBuffer
+ *
+ * The CPU access in progress on this MappedFrameBuffer, if any, is ended and
+ * its mappings are unmapped. The mappings and the CPU access in progress of
+ * \a other are then transferred to this MappedFrameBuffer, and \a other is
+ * invalidated.
+ *
+ * \return A reference to this MappedFrameBuffer
+ */
+MappedFrameBuffer &MappedFrameBuffer::operator=(MappedFrameBuffer &&other)
+{
+	if (this == &other)
+		return *this;
+
+	endAccess();
+
+	MappedBuffer::operator=(std::move(other));
+	dmabufs_ = std::move(other.dmabufs_);
+	planeMaps_ = std::move(other.planeMaps_);
+	accessFlags_ = std::move(other.accessFlags_);
+
+	/* Make sure the destructor of other doesn't end the transferred access. */
+	other.dmabufs_.clear();
+	other.planeMaps_.clear();
+	other.accessFlags_.clear();
+
+	return *this;
+}
+
+/**
+ * \brief Begin CPU access to all planes of the buffer
+ * \param[in] flags The access direction, as a bitwise OR of SyncFlag values
+ *
+ * This function shall be called before the CPU accesses the mapped memory. It
+ * synchronizes the CPU view of the memory with the devices, and must be paired
+ * with a call to endAccess() once the CPU access is complete.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MappedFrameBuffer::beginAccess(unsigned int flags)
+{
+	for (unsigned int map = 0; map < maps_.size(); ++map) {
+		int ret = beginMapAccess(map, flags);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Begin CPU access to a single plane of the buffer
+ * \param[in] flags The access direction, as a bitwise OR of SyncFlag values
+ * \param[in] plane The index of the plane to access
+ *
+ * This function restricts synchronization to the dmabuf that stores \a plane,
+ * and thus avoids the cost of cache maintenance for planes that the CPU
+ * doesn't access. Other planes stored in the same dmabuf are synchronized as
+ * well, as the dmabuf API doesn't support finer-grained synchronization.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MappedFrameBuffer::beginAccess(unsigned int flags, unsigned int plane)
+{
+	if (plane >= planeMaps_.size())
+		return -EINVAL;
+
+	return beginMapAccess(planeMaps_[plane], flags);
+}
+
+/**
+ * \brief End CPU access to the buffer
+ *
+ * End all CPU accesses started with beginAccess(). The CPU shall not access
+ * the mapped memory after this function returns until a new access is started.
+ * Pending accesses are ended automatically when the MappedFrameBuffer is
+ * destroyed.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MappedFrameBuffer::endAccess()
+{
+	int ret = 0;
+
+	for (unsigned int map = 0; map < accessFlags_.size(); ++map) {
+		if (!accessFlags_[map])
+			continue;
+
+		int err = sync(map, DMA_BUF_SYNC_END | accessFlags_[map]);
+		if (err < 0)
+			ret = err;
+
+		accessFlags_[map] = 0;
+	}
+
+	return ret;
+}
+
+int MappedFrameBuffer::beginMapAccess(unsigned int map, unsigned int flags)
+{
+	uint64_t syncFlags = 0;
+	if (flags & SyncRead)
+		syncFlags |= DMA_BUF_SYNC_READ;
+	if (flags & SyncWrite)
+		syncFlags |= DMA_BUF_SYNC_WRITE;
+
+	if (!syncFlags)
+		return -EINVAL;
+
+	if (accessFlags_[map] == syncFlags)
+		return 0;
+
+	/* Accesses can't be nested, end the previous one first. */
+	if (accessFlags_[map]) {
+		sync(map, DMA_BUF_SYNC_END | accessFlags_[map]);
+		accessFlags_[map] = 0;
+	}
+
+	int ret = sync(map, DMA_BUF_SYNC_START | syncFlags);
+	if (ret < 0)
+		return ret;
+
+	accessFlags_[map] = syncFlags;
+	return 0;
+}
+
+int MappedFrameBuffer::sync(unsigned int map, uint64_t flags)
+{
+	struct dma_buf_sync sync = {};
+	sync.flags = flags;
+
+	int ret;
+	do {
+		ret = ioctl(dmabufs_[map].fd(), DMA_BUF_IOCTL_SYNC, &sync);
+	} while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+	if (ret < 0) {
+		ret = -errno;
+
+		/* Buffers that are not dmabufs need no synchronization. */
+		if (ret == -ENOTTY)
+			return 0;
+
+		LOG(Buffer, Error) << "Failed to sync buffer: "
+				   << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
 }
 
 } /* namespace libcamera */
@@ -10,12 +10,14 @@
 #include <atomic>
 #include <iomanip>
 
+#include <libcamera/completion_queue.h>
 #include <libcamera/framebuffer_allocator.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 
 /**
@@ -276,10 +278,15 @@ public:
 	void disconnect();
 	void setState(State state);
 
+	int validateRequest(const Request *request) const;
+
 	std::shared_ptr<PipelineHandler> pipe_;
 	std::string id_;
 	std::set<Stream *> streams_;
 	std::set<const Stream *> activeStreams_;
+	CompletionOrder completionOrder_;
+	QueueingPolicy queueingPolicy_;
+	CompletionQueue *completionQueue_;
 
 private:
 	bool disconnected_;
@@ -289,7 +296,10 @@ private:
 Camera::Private::Private(PipelineHandler *pipe, const std::string &id,
 			 const std::set<Stream *> &streams)
 	: pipe_(pipe->shared_from_this()), id_(id), streams_(streams),
-	  disconnected_(false), state_(CameraAvailable)
+	  completionOrder_(CompletionInOrder), queueingPolicy_(QueueingFifo),
+	  completionQueue_(nullptr),
+	  disconnected_(false),
+	  state_(CameraAvailable)
 {
 }
 
@@ -363,6 +373,108 @@ void Camera::Private::setState(State state)
 	state_.store(state, std::memory_order_release);
 }
 
+int Camera::Private::validateRequest(const Request *request) const
+{
+	if (request->buffers().empty()) {
+		LOG(Camera, Error) << "Request contains no buffers";
+		return -EINVAL;
+	}
+
+	for (auto const &it : request->buffers()) {
+		const Stream *stream = it.first;
+
+		if (activeStreams_.find(stream) == activeStreams_.end()) {
+			LOG(Camera, Error) << "Invalid request";
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \struct CameraStatistics
+ * \brief Runtime statistics of a camera
+ *
+ * The CameraStatistics structure stores a snapshot of the counters collected
+ * by a camera while it runs, as returned by Camera::statistics(). All counters
+ * are reset when the camera is configured.
+ */
+
+/**
+ * \struct CameraStatistics::Latency
+ * \brief Minimum, average and maximum of a latency
+ *
+ * \var CameraStatistics::Latency::min
+ * \brief The minimum latency
+ *
+ * \var CameraStatistics::Latency::average
+ * \brief The average latency
+ *
+ * \var CameraStatistics::Latency::max
+ * \brief The maximum latency
+ *
+ * \var CameraStatistics::Latency::samples
+ * \brief The number of samples the latency is computed from, the other fields
+ * are zero if no sample has been recorded
+ */
+
+/**
+ * \struct CameraStatistics::StreamStatistics
+ * \brief Frame counters for a stream
+ *
+ * \var CameraStatistics::StreamStatistics::framesCaptured
+ * \brief The number of buffers completed successfully
+ *
+ * \var CameraStatistics::StreamStatistics::framesFailed
+ * \brief The number of buffers completed with FrameMetadata::FrameError
+ *
+ * \var CameraStatistics::StreamStatistics::framesCancelled
+ * \brief The number of buffers completed with FrameMetadata::FrameCancelled
+ *
+ * \var CameraStatistics::StreamStatistics::framesDropped
+ * \brief The number of frames skipped by the device, computed from the gaps
+ * in the sequence numbers of successfully captured buffers
+ */
+
+/**
+ * \var CameraStatistics::requestsQueued
+ * \brief The number of requests queued to the camera
+ *
+ * \var CameraStatistics::requestsCompleted
+ * \brief The number of requests completed successfully
+ *
+ * \var CameraStatistics::requestsCancelled
+ * \brief The number of requests cancelled when stopping the camera
+ *
+ * \var CameraStatistics::requestsDropped
+ * \brief The number of completed requests that have been requeued instead of
+ * being delivered to the application, as selected by
+ * Camera::QueueingDropOldest
+ *
+ * \var CameraStatistics::queueDepth
+ * \brief The number of requests currently in flight in the camera
+ *
+ * \var CameraStatistics::completionLatency
+ * \brief The time between queueing of a request to the pipeline handler and
+ * its completion, for requests that haven't been cancelled
+ *
+ * \var CameraStatistics::ipaLatency
+ * \brief The IPA processing time per frame, only reported by pipeline handlers
+ * that use an IPA
+ *
+ * \var CameraStatistics::bufferCacheHits
+ * \brief The number of request buffers queued to a V4L2 buffer previously
+ * used with the same memory
+ *
+ * \var CameraStatistics::bufferCacheMisses
+ * \brief The number of request buffers that required a new association with
+ * a V4L2 buffer, causing the kernel to map the buffer memory again
+ *
+ * \var CameraStatistics::streams
+ * \brief Per-stream frame counters for all active streams
+ */
+
 /**
  * \class Camera
  * \brief Camera device
@@ -557,8 +669,7 @@ void Camera::disconnect()
 	disconnected.emit(this);
 }
 
-int Camera::exportFrameBuffers(Stream *stream,
-			       std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+int Camera::validateAllocation(Stream *stream) const
 {
 	int ret = p_->isAccessAllowed(Private::CameraConfigured);
 	if (ret < 0)
@@ -570,6 +681,16 @@ int Camera::exportFrameBuffers(Stream *stream,
 	if (p_->activeStreams_.find(stream) == p_->activeStreams_.end())
 		return -EINVAL;
 
+	return 0;
+}
+
+int Camera::exportFrameBuffers(Stream *stream,
+			       std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	int ret = validateAllocation(stream);
+	if (ret < 0)
+		return ret;
+
 	return p_->pipe_->invokeMethod(&PipelineHandler::exportFrameBuffers,
 				       ConnectionTypeBlocking, this, stream,
 				       buffers);
@@ -643,6 +764,7 @@ int Camera::release()
 
 	p_->pipe_->unlock();
 
+	p_->completionQueue_ = nullptr;
 	p_->setState(Private::CameraAvailable);
 
 	return 0;
@@ -811,11 +933,214 @@ int Camera::configure(CameraConfiguration *config)
 		p_->activeStreams_.insert(stream);
 	}
 
+	p_->pipe_->resetStatistics(this, p_->activeStreams_);
+
 	p_->setState(Private::CameraConfigured);
 
 	return 0;
 }
 
+/**
+ * \enum Camera::CompletionOrder
+ * \brief Order in which completed requests are delivered to the application
+ * \var Camera::CompletionInOrder
+ * Requests are delivered in the order they have been queued. A request that
+ * completes early is held back until all the requests queued before it have
+ * completed
+ * \var Camera::CompletionOutOfOrder
+ * Requests are delivered as soon as they complete, regardless of the order in
+ * which they have been queued
+ */
+
+/**
+ * \brief Select the order in which completed requests are delivered
+ * \param[in] order The request completion order
+ *
+ * By default requests complete in the order they have been queued, which
+ * guarantees that the \ref requestCompleted signal is emitted in submission
+ * order. A request that takes longer to process than the requests queued after
+ * it, for instance because it contains a buffer for a stream that requires
+ * additional processing, then delays the completion of all subsequent
+ * requests.
+ *
+ * Applications that don't depend on the submission order can select
+ * CompletionOutOfOrder to receive each request as soon as it completes. The
+ * Request::sequence() can then be used to restore the submission order when
+ * needed.
+ *
+ * \context This function may only be called when the camera is in the Acquired
+ * or Configured state as defined in \ref camera_operation, and shall be
+ * synchronized by the caller with other functions that affect the camera
+ * state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in a state where the completion order can
+ * be changed
+ */
+int Camera::setCompletionOrder(CompletionOrder order)
+{
+	int ret = p_->isAccessAllowed(Private::CameraAcquired,
+				      Private::CameraConfigured);
+	if (ret < 0)
+		return ret;
+
+	p_->completionOrder_ = order;
+
+	return 0;
+}
+
+/**
+ * \brief Retrieve the order in which completed requests are delivered
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The request completion order
+ */
+Camera::CompletionOrder Camera::completionOrder() const
+{
+	return p_->completionOrder_;
+}
+
+/**
+ * \enum Camera::QueueingPolicy
+ * \brief Policy applied to completed requests that the application hasn't
+ * consumed yet when newer requests complete
+ * \var Camera::QueueingFifo
+ * All completed requests are delivered to the application
+ * \var Camera::QueueingDropOldest
+ * Completed requests that are older than a request already delivered, or
+ * waiting to be consumed by the application when a newer request completes,
+ * are dropped and queued again for capture
+ */
+
+/**
+ * \brief Select the policy applied to stale completed requests
+ * \param[in] policy The queueing policy
+ *
+ * By default all requests are delivered to the application once completed. An
+ * application that can't keep up with the frame rate then consumes frames
+ * that get older and older, and the latency between capture and processing
+ * grows with the number of requests it keeps queued.
+ *
+ * Applications that only care about the most recent frame, such as live
+ * viewfinders or machine vision, can select QueueingDropOldest to bound that
+ * latency to a single frame. With this policy, when a request completes:
+ *
+ * - Requests queued before it that are still in flight are delivered to the
+ *   application as soon as they complete, without waiting for older requests,
+ *   unless a more recent request has already been delivered. Such stale
+ *   requests are queued to the camera again instead.
+ * - If the camera delivers requests through a completion queue, a request of
+ *   the camera that is still waiting in the queue for the application to reap
+ *   it is removed from the queue and queued to the camera again. The queue
+ *   thus holds at most one completed request for the camera.
+ *
+ * Dropped requests keep their buffers and controls, and are delivered again
+ * once they complete with a new frame. Their Request::sequence() is updated
+ * when they are queued again. They are accounted for in
+ * CameraStatistics::requestsDropped. Cancelled requests are never dropped.
+ * Completed requests are thus always delivered in submission order,
+ * regardless of the order selected by setCompletionOrder().
+ *
+ * When requests are delivered through a completion queue, the latest completed
+ * request of the camera is held separately from the other requests, and
+ * CompletionQueue::reap() returns it after all the other requests available
+ * in the queue. Requests cancelled when the camera is stopped may thus be
+ * reaped before the latest completed request, even if they have been queued
+ * after it.
+ *
+ * \context This function may only be called when the camera is in the Acquired
+ * or Configured state as defined in \ref camera_operation, and shall be
+ * synchronized by the caller with other functions that affect the camera
+ * state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in a state where the queueing policy can
+ * be changed
+ */
+int Camera::setQueueingPolicy(QueueingPolicy policy)
+{
+	int ret = p_->isAccessAllowed(Private::CameraAcquired,
+				      Private::CameraConfigured);
+	if (ret < 0)
+		return ret;
+
+	p_->queueingPolicy_ = policy;
+
+	return 0;
+}
+
+/**
+ * \brief Retrieve the policy applied to stale completed requests
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The queueing policy
+ */
+Camera::QueueingPolicy Camera::queueingPolicy() const
+{
+	return p_->queueingPolicy_;
+}
+
+/**
+ * \brief Deliver completed requests through a completion queue
+ * \param[in] queue The completion queue, or nullptr to use the
+ * \ref requestCompleted signal
+ *
+ * By default completed requests are delivered through the \ref
+ * requestCompleted signal, emitted from libcamera's internal thread, and are
+ * deleted when the signal returns. When a completion \a queue is set, completed
+ * requests are instead added to the \a queue, from which the application
+ * retrieves them in its own thread with CompletionQueue::reap(). The
+ * \ref requestCompleted signal is not emitted in that case, and ownership of
+ * the requests is transferred to the application once they are reaped.
+ *
+ * The \a queue shall remain valid until it is replaced or the camera is
+ * released. Requests cancelled by stop() are added to the \a queue before
+ * stop() returns.
+ *
+ * \context This function may only be called when the camera is in the Acquired
+ * or Configured state as defined in \ref camera_operation, and shall be
+ * synchronized by the caller with other functions that affect the camera
+ * state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in a state where the completion queue can
+ * be changed
+ */
+int Camera::setCompletionQueue(CompletionQueue *queue)
+{
+	int ret = p_->isAccessAllowed(Private::CameraAcquired,
+				      Private::CameraConfigured);
+	if (ret < 0)
+		return ret;
+
+	p_->completionQueue_ = queue;
+
+	return 0;
+}
+
+/**
+ * \brief Retrieve a snapshot of the camera runtime statistics
+ *
+ * The statistics are accumulated while the camera is running without locking,
+ * and can be retrieved at any time. They are reset when the camera is
+ * configured. The individual counters of a snapshot taken while the camera is
+ * running may be slightly out of sync with each other.
+ *
+ * \context This function is \threadsafe, except concurrently with
+ * configure().
+ *
+ * \return The camera statistics
+ */
+CameraStatistics Camera::statistics() const
+{
+	return p_->pipe_->statistics(this);
+}
+
 /**
  * \brief Create a request object for the camera
  * \param[in] cookie Opaque cookie for application use
@@ -857,10 +1182,12 @@ Request *Camera::createRequest(uint64_t cookie)
  * contain no buffers are invalid and are rejected without being queued.
  *
  * Once the request has been queued, the camera will notify its completion
- * through the \ref requestCompleted signal.
+ * through the \ref requestCompleted signal, or through the completion queue
+ * set with setCompletionQueue().
  *
  * Ownership of the request is transferred to the camera. It will be deleted
- * automatically after it completes.
+ * automatically after it completes, unless it is delivered through a
+ * completion queue.
  *
  * \context This function is \threadsafe. It may only be called when the camera
  * is in the Running state as defined in \ref camera_operation.
@@ -883,24 +1210,63 @@ int Camera::queueRequest(Request *request)
 	 * this.
 	 */
 
-	if (request->buffers().empty()) {
-		LOG(Camera, Error) << "Request contains no buffers";
-		return -EINVAL;
-	}
-
-	for (auto const &it : request->buffers()) {
-		const Stream *stream = it.first;
+	ret = p_->validateRequest(request);
+	if (ret < 0)
+		return ret;
 
-		if (p_->activeStreams_.find(stream) == p_->activeStreams_.end()) {
-			LOG(Camera, Error) << "Invalid request";
-			return -EINVAL;
-		}
-	}
+	Tracer::instant("Camera::queueRequest", request);
 
 	return p_->pipe_->invokeMethod(&PipelineHandler::queueRequest,
 				       ConnectionTypeQueued, this, request);
 }
 
+/**
+ * \brief Queue multiple requests to the camera
+ * \param[in] requests The requests to queue to the camera
+ *
+ * This method queues a batch of \a requests to the camera for capture, in
+ * order. It behaves as calling queueRequest() for each request in turn, but
+ * delivers all the requests to the pipeline handler at once, which lowers the
+ * submission overhead when queuing many requests, for instance when starting
+ * capture.
+ *
+ * All requests are validated before any of them is queued. If any request is
+ * invalid, no request is queued and ownership of all \a requests stays with
+ * the caller.
+ *
+ * \context This function is \threadsafe. It may only be called when the camera
+ * is in the Running state as defined in \ref camera_operation.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not running so requests can't be queued
+ * \retval -EINVAL One of the requests is invalid
+ */
+int Camera::queueRequests(Span<Request *const> requests)
+{
+	int ret = p_->isAccessAllowed(Private::CameraRunning);
+	if (ret < 0)
+		return ret;
+
+	for (const Request *request : requests) {
+		ret = p_->validateRequest(request);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (requests.empty())
+		return 0;
+
+	for (Request *request : requests)
+		Tracer::instant("Camera::queueRequest", request);
+
+	p_->pipe_->invokeMethod(&PipelineHandler::queueRequests,
+				ConnectionTypeQueued, this,
+				std::vector<Request *>(requests.begin(), requests.end()));
+
+	return 0;
+}
+
 /**
  * \brief Start capture from camera
  *
@@ -962,21 +1328,58 @@ int Camera::stop()
 	p_->pipe_->invokeMethod(&PipelineHandler::stop, ConnectionTypeBlocking,
 				this);
 
+	/*
+	 * Requests dropped by the QueueingDropOldest policy are queued again
+	 * asynchronously. Flush them to deliver them before returning.
+	 */
+	p_->pipe_->invokeMethod(&PipelineHandler::requeueRequests,
+				ConnectionTypeBlocking, this);
+
 	return 0;
 }
 
+/**
+ * \brief Check if the camera is running
+ *
+ * This function is called by the pipeline handler to check whether requests
+ * can be queued to the camera on behalf of the application.
+ *
+ * \return True if the camera is in the Running state, false otherwise
+ */
+bool Camera::isRunning() const
+{
+	return p_->isAccessAllowed(Private::CameraRunning) == 0;
+}
+
 /**
  * \brief Handle request completion and notify application
  * \param[in] request The request that has completed
  *
  * This function is called by the pipeline handler to notify the camera that
  * the request has completed. It emits the requestCompleted signal and deletes
- * the request.
+ * the request, or adds it to the completion queue.
+ *
+ * With the QueueingDropOldest policy, a request of this camera that is still
+ * waiting in the completion queue is replaced by \a request. The replaced
+ * request is returned to the pipeline handler to be queued again.
+ *
+ * \return The stale request removed from the completion queue, or nullptr
  */
-void Camera::requestComplete(Request *request)
+Request *Camera::requestComplete(Request *request)
 {
+	if (p_->completionQueue_) {
+		if (p_->queueingPolicy_ == QueueingDropOldest &&
+		    request->status() == Request::RequestComplete)
+			return p_->completionQueue_->replace(this, request);
+
+		p_->completionQueue_->push(request);
+		return nullptr;
+	}
+
 	requestCompleted.emit(request);
 	delete request;
+
+	return nullptr;
 }
 
 } /* namespace libcamera */
@@ -19,6 +19,7 @@
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/thread.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 
 /**
@@ -72,6 +73,7 @@ private:
 CameraManager::Private::Private(CameraManager *cm)
 	: cm_(cm), initialized_(false)
 {
+	setRole(ThreadPolicy::RolePipeline);
 }
 
 int CameraManager::Private::start()
@@ -303,11 +305,16 @@ int CameraManager::start()
  * After the manager has been stopped no resource provided by the camera
  * manager should be consider valid or functional even if they for one
  * reason or another have yet to be deleted.
+ *
+ * If request tracing has been enabled with the LIBCAMERA_TRACE environment
+ * variable, the trace is written when the camera manager is stopped.
  */
 void CameraManager::stop()
 {
 	p_->exit();
 	p_->wait();
+
+	Tracer::dump();
 }
 
 /**
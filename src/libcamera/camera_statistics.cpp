@@ -0,0 +1,280 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * camera_statistics.cpp - Camera runtime statistics collection
+ */
+
+#include "libcamera/internal/camera_statistics.h"
+
+#include <limits>
+#include <tuple>
+
+#include <libcamera/buffer.h>
+
+/**
+ * \file camera_statistics.h
+ * \brief Camera runtime statistics collection
+ */
+
+namespace libcamera {
+
+/**
+ * \class LatencyCounter
+ * \brief Lock-free accumulator of minimum, average and maximum latencies
+ *
+ * The LatencyCounter accumulates latency samples from a single writer thread
+ * and can be read concurrently from any thread without locking. A snapshot
+ * taken while a sample is being added may not account for the sample in all
+ * its fields.
+ */
+
+LatencyCounter::LatencyCounter()
+{
+	reset();
+}
+
+/**
+ * \brief Add a latency sample
+ * \param[in] latency The latency
+ */
+void LatencyCounter::add(utils::duration latency)
+{
+	int64_t value = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+
+	if (value < min_.load(std::memory_order_relaxed))
+		min_.store(value, std::memory_order_relaxed);
+	if (value > max_.load(std::memory_order_relaxed))
+		max_.store(value, std::memory_order_relaxed);
+
+	sum_.fetch_add(value, std::memory_order_relaxed);
+	samples_.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * \brief Reset the counter to its initial state without any sample
+ */
+void LatencyCounter::reset()
+{
+	min_ = std::numeric_limits<int64_t>::max();
+	max_ = 0;
+	sum_ = 0;
+	samples_ = 0;
+}
+
+/**
+ * \brief Retrieve the accumulated latencies
+ * \return The minimum, average and maximum latencies, all zero if no sample
+ * has been added
+ */
+CameraStatistics::Latency LatencyCounter::snapshot() const
+{
+	CameraStatistics::Latency latency = {};
+
+	latency.samples = samples_.load(std::memory_order_acquire);
+	if (!latency.samples)
+		return latency;
+
+	latency.min = std::chrono::nanoseconds(min_.load(std::memory_order_relaxed));
+	latency.max = std::chrono::nanoseconds(max_.load(std::memory_order_relaxed));
+	latency.average = std::chrono::nanoseconds(sum_.load(std::memory_order_relaxed) /
+						   static_cast<int64_t>(latency.samples));
+
+	return latency;
+}
+
+/**
+ * \class CameraStatisticsCollector
+ * \brief Collect the runtime statistics of a camera
+ *
+ * The CameraStatisticsCollector accumulates the counters exposed to
+ * applications through Camera::statistics(). The counters are updated by the
+ * PipelineHandler base class as requests and buffers flow through it, and by
+ * pipeline handlers for the pipeline-specific statistics such as the IPA
+ * turnaround time.
+ *
+ * All updates shall be performed from the pipeline handler thread. Snapshots
+ * can be taken from any thread without locking, except concurrently with
+ * reset(), which is called when the camera is configured.
+ */
+
+CameraStatisticsCollector::CameraStatisticsCollector()
+{
+	reset({});
+}
+
+/**
+ * \brief Reset all counters
+ * \param[in] streams The streams for which to collect per-stream statistics
+ */
+void CameraStatisticsCollector::reset(const std::set<const Stream *> &streams)
+{
+	requestsQueued_ = 0;
+	requestsCompleted_ = 0;
+	requestsCancelled_ = 0;
+	requestsDropped_ = 0;
+	queueDepth_ = 0;
+
+	completionLatency_.reset();
+	ipaLatency_.reset();
+
+	bufferCacheHits_ = 0;
+	bufferCacheMisses_ = 0;
+
+	streams_.clear();
+	for (const Stream *stream : streams) {
+		StreamCounters &counters =
+			streams_.emplace(std::piecewise_construct,
+					 std::forward_as_tuple(stream),
+					 std::forward_as_tuple()).first->second;
+		counters.framesCaptured = 0;
+		counters.framesFailed = 0;
+		counters.framesCancelled = 0;
+		counters.framesDropped = 0;
+		counters.sequenceValid = false;
+		counters.lastSequence = 0;
+	}
+}
+
+/**
+ * \brief Account for a request queued to the pipeline handler
+ * \param[in] queueDepth The number of requests in flight, including this one
+ */
+void CameraStatisticsCollector::requestQueued(unsigned int queueDepth)
+{
+	requestsQueued_.fetch_add(1, std::memory_order_relaxed);
+	queueDepth_.store(queueDepth, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Account for a completed request
+ * \param[in] cancelled True if the request has been cancelled
+ * \param[in] latency The time elapsed since the request has been queued
+ * \param[in] cacheHits The number of request buffers found in V4L2 buffer
+ * caches
+ * \param[in] cacheMisses The number of request buffers not found in V4L2
+ * buffer caches
+ *
+ * The completion latency is only accounted for requests that have not been
+ * cancelled.
+ */
+void CameraStatisticsCollector::requestCompleted(bool cancelled,
+						 utils::duration latency,
+						 unsigned int cacheHits,
+						 unsigned int cacheMisses)
+{
+	if (cancelled) {
+		requestsCancelled_.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		requestsCompleted_.fetch_add(1, std::memory_order_relaxed);
+		completionLatency_.add(latency);
+	}
+
+	bufferCacheHits_.fetch_add(cacheHits, std::memory_order_relaxed);
+	bufferCacheMisses_.fetch_add(cacheMisses, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Account for a completed request dropped by the drop-oldest policy
+ *
+ * \sa Camera::QueueingDropOldest
+ */
+void CameraStatisticsCollector::requestDropped()
+{
+	requestsDropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Update the number of requests in flight
+ * \param[in] queueDepth The number of requests in flight
+ */
+void CameraStatisticsCollector::setQueueDepth(unsigned int queueDepth)
+{
+	queueDepth_.store(queueDepth, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Account for a completed buffer
+ * \param[in] stream The stream the buffer belongs to
+ * \param[in] metadata The buffer metadata
+ *
+ * Update the per-stream counters based on the \a metadata status. Gaps
+ * in the sequence numbers of successfully captured buffers are accounted for
+ * as dropped frames.
+ */
+void CameraStatisticsCollector::bufferCompleted(const Stream *stream,
+						const FrameMetadata &metadata)
+{
+	auto iter = streams_.find(stream);
+	if (iter == streams_.end())
+		return;
+
+	StreamCounters &counters = iter->second;
+
+	switch (metadata.status) {
+	case FrameMetadata::FrameSuccess:
+		counters.framesCaptured.fetch_add(1, std::memory_order_relaxed);
+
+		if (counters.sequenceValid &&
+		    metadata.sequence > counters.lastSequence + 1)
+			counters.framesDropped.fetch_add(metadata.sequence - counters.lastSequence - 1,
+							 std::memory_order_relaxed);
+
+		counters.sequenceValid = true;
+		counters.lastSequence = metadata.sequence;
+		break;
+
+	case FrameMetadata::FrameError:
+		counters.framesFailed.fetch_add(1, std::memory_order_relaxed);
+		break;
+
+	case FrameMetadata::FrameCancelled:
+		counters.framesCancelled.fetch_add(1, std::memory_order_relaxed);
+		/* Sequence numbers restart when capture restarts. */
+		counters.sequenceValid = false;
+		break;
+	}
+}
+
+/**
+ * \brief Account for the IPA turnaround time of a frame
+ * \param[in] latency The time spent by the IPA processing the frame
+ */
+void CameraStatisticsCollector::ipaCompleted(utils::duration latency)
+{
+	ipaLatency_.add(latency);
+}
+
+/**
+ * \brief Retrieve a snapshot of the statistics
+ * \return The current value of all counters
+ */
+CameraStatistics CameraStatisticsCollector::snapshot() const
+{
+	CameraStatistics stats;
+
+	stats.requestsQueued = requestsQueued_.load(std::memory_order_relaxed);
+	stats.requestsCompleted = requestsCompleted_.load(std::memory_order_relaxed);
+	stats.requestsCancelled = requestsCancelled_.load(std::memory_order_relaxed);
+	stats.requestsDropped = requestsDropped_.load(std::memory_order_relaxed);
+	stats.queueDepth = queueDepth_.load(std::memory_order_relaxed);
+
+	stats.completionLatency = completionLatency_.snapshot();
+	stats.ipaLatency = ipaLatency_.snapshot();
+
+	stats.bufferCacheHits = bufferCacheHits_.load(std::memory_order_relaxed);
+	stats.bufferCacheMisses = bufferCacheMisses_.load(std::memory_order_relaxed);
+
+	for (const auto &it : streams_) {
+		const StreamCounters &counters = it.second;
+		CameraStatistics::StreamStatistics &streamStats = stats.streams[it.first];
+		streamStats.framesCaptured = counters.framesCaptured.load(std::memory_order_relaxed);
+		streamStats.framesFailed = counters.framesFailed.load(std::memory_order_relaxed);
+		streamStats.framesCancelled = counters.framesCancelled.load(std::memory_order_relaxed);
+		streamStats.framesDropped = counters.framesDropped.load(std::memory_order_relaxed);
+	}
+
+	return stats;
+}
+
+} /* namespace libcamera */
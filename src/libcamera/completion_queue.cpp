@@ -0,0 +1,326 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * completion_queue.cpp - Request completion queue
+ */
+
+#include <libcamera/completion_queue.h>
+
+#include <atomic>
+#include <errno.h>
+#include <map>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <libcamera/file_descriptor.h>
+#include <libcamera/request.h>
+
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/thread.h"
+
+/**
+ * \file completion_queue.h
+ * \brief Request completion queue
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(CompletionQueue)
+
+class CompletionQueue::Private
+{
+public:
+	Private(unsigned int size);
+
+	bool pushRing(Request *request);
+	size_t popRing(std::vector<Request *> *requests);
+	void notify();
+
+	FileDescriptor eventfd_;
+
+	/*
+	 * Single-producer single-consumer ring. The head is only written by
+	 * the consumer and the tail by the producer. The size is a power of
+	 * two.
+	 */
+	std::vector<Request *> ring_;
+	unsigned int mask_;
+	std::atomic<unsigned int> head_;
+	std::atomic<unsigned int> tail_;
+
+	/*
+	 * Requests that didn't fit in the ring. Once the ring overflows all
+	 * requests are added to the overflow list until the consumer drains it,
+	 * to preserve ordering.
+	 */
+	Mutex mutex_;
+	std::vector<Request *> overflow_;
+	std::atomic<bool> overflowing_;
+
+	/*
+	 * The latest completed request of each camera that uses the
+	 * drop-oldest queueing policy, protected by the mutex. The flag is set
+	 * when at least one of them hasn't been reaped yet.
+	 */
+	std::map<const Camera *, Request *> latest_;
+	std::atomic<bool> hasLatest_;
+
+	/* Set when the eventfd has been signalled and not read yet. */
+	std::atomic<bool> notified_;
+};
+
+CompletionQueue::Private::Private(unsigned int size)
+	: head_(0), tail_(0), overflowing_(false), hasLatest_(false),
+	  notified_(false)
+{
+	unsigned int ringSize = 1;
+	while (ringSize < size)
+		ringSize <<= 1;
+
+	ring_.resize(ringSize);
+	mask_ = ringSize - 1;
+
+	int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (fd < 0) {
+		int ret = errno;
+		LOG(CompletionQueue, Error)
+			<< "Failed to create eventfd: " << strerror(ret);
+		return;
+	}
+
+	eventfd_ = FileDescriptor(std::move(fd));
+}
+
+bool CompletionQueue::Private::pushRing(Request *request)
+{
+	unsigned int tail = tail_.load(std::memory_order_relaxed);
+	if (tail - head_.load(std::memory_order_acquire) > mask_)
+		return false;
+
+	ring_[tail & mask_] = request;
+	tail_.store(tail + 1, std::memory_order_release);
+
+	return true;
+}
+
+size_t CompletionQueue::Private::popRing(std::vector<Request *> *requests)
+{
+	unsigned int head = head_.load(std::memory_order_relaxed);
+	unsigned int tail = tail_.load(std::memory_order_acquire);
+
+	for (unsigned int i = head; i != tail; ++i)
+		requests->push_back(ring_[i & mask_]);
+
+	head_.store(tail, std::memory_order_release);
+
+	return tail - head;
+}
+
+void CompletionQueue::Private::notify()
+{
+	if (notified_.exchange(true, std::memory_order_acq_rel))
+		return;
+
+	uint64_t value = 1;
+	ssize_t ret = ::write(eventfd_.fd(), &value, sizeof(value));
+	if (ret < 0)
+		LOG(CompletionQueue, Error)
+			<< "Failed to signal eventfd: " << strerror(errno);
+}
+
+/**
+ * \class CompletionQueue
+ * \brief Deliver completed requests to the application's own event loop
+ *
+ * The Camera::requestCompleted signal is emitted from libcamera's internal
+ * thread, which forces applications to bounce completed requests to their own
+ * thread and to synchronize with libcamera. The CompletionQueue offers an
+ * alternative delivery mechanism. When a completion queue is set on a camera
+ * with Camera::setCompletionQueue(), completed requests are pushed to the
+ * queue instead of being signalled, and no application code runs in
+ * libcamera's internal thread.
+ *
+ * Applications monitor the file descriptor returned by fd() for read events
+ * in their event loop (poll(), epoll, glib, Qt socket notifiers, ...), and
+ * retrieve completed requests in batches with reap(). The file descriptor
+ * becomes readable when requests are added to an empty queue, and is reset by
+ * reap().
+ *
+ * Completed requests are stored in a lock-free ring buffer sized at
+ * construction time. The queue never loses requests: completions that don't
+ * fit in the ring are stored in a slower overflow list, the ring should thus
+ * be sized to hold the number of requests the application keeps queued to the
+ * cameras that use the completion queue.
+ *
+ * A single completion queue may be shared by multiple cameras. Completed
+ * requests are delivered in the order in which they complete, and each
+ * camera's requests are ordered as selected by Camera::setCompletionOrder().
+ *
+ * Cameras that use the Camera::QueueingDropOldest policy don't add their
+ * successfully completed requests to the ring. The queue instead stores the
+ * latest completed request of each of those cameras, and hands the request it
+ * replaces back to the camera. Those requests are returned by reap() after all
+ * the requests stored in the ring.
+ *
+ * Ownership of requests retrieved through reap() is transferred to the
+ * application, which shall delete them once it has processed them. Requests
+ * left in the queue are deleted when the queue is destroyed.
+ */
+
+/**
+ * \brief Construct a completion queue
+ * \param[in] size The number of requests that the queue holds without
+ * overflowing, rounded up to a power of two
+ */
+CompletionQueue::CompletionQueue(unsigned int size)
+	: p_(new Private(size))
+{
+}
+
+CompletionQueue::~CompletionQueue()
+{
+	std::vector<Request *> requests;
+	reap(&requests);
+
+	for (Request *request : requests)
+		delete request;
+}
+
+/**
+ * \brief Check if the completion queue has been successfully created
+ * \return True if the queue is valid, false otherwise
+ */
+bool CompletionQueue::isValid() const
+{
+	return p_->eventfd_.isValid();
+}
+
+/**
+ * \brief Retrieve the file descriptor that signals completed requests
+ *
+ * The file descriptor is readable when completed requests are available. It
+ * shall only be polled, and shall not be read or closed by the application.
+ *
+ * \return The file descriptor
+ */
+int CompletionQueue::fd() const
+{
+	return p_->eventfd_.fd();
+}
+
+/**
+ * \brief Retrieve all completed requests
+ * \param[out] requests The vector to append the completed requests to
+ *
+ * This function appends all completed requests to \a requests, in completion
+ * order, and resets the readiness of fd().
+ *
+ * \context This function shall not be called concurrently from multiple
+ * threads.
+ *
+ * \return The number of requests appended to \a requests
+ */
+size_t CompletionQueue::reap(std::vector<Request *> *requests)
+{
+	/*
+	 * Clear the notification before popping requests, any request pushed
+	 * afterwards will signal the eventfd again. The exchange synchronizes
+	 * with the producer's notification.
+	 */
+	if (p_->notified_.exchange(false, std::memory_order_acq_rel)) {
+		uint64_t value;
+		ssize_t ret = ::read(p_->eventfd_.fd(), &value, sizeof(value));
+		if (ret < 0 && errno != EAGAIN)
+			LOG(CompletionQueue, Error)
+				<< "Failed to read eventfd: " << strerror(errno);
+	}
+
+	size_t count = p_->popRing(requests);
+
+	if (p_->overflowing_.load(std::memory_order_acquire)) {
+		/*
+		 * The producer stops using the ring when it overflows. Drain
+		 * it again to catch requests pushed before the overflow, then
+		 * take the overflow list and resume normal operation.
+		 */
+		count += p_->popRing(requests);
+
+		MutexLocker locker(p_->mutex_);
+		requests->insert(requests->end(), p_->overflow_.begin(),
+				 p_->overflow_.end());
+		count += p_->overflow_.size();
+		p_->overflow_.clear();
+		p_->overflowing_.store(false, std::memory_order_release);
+	}
+
+	if (p_->hasLatest_.load(std::memory_order_acquire)) {
+		MutexLocker locker(p_->mutex_);
+		for (auto &it : p_->latest_) {
+			if (!it.second)
+				continue;
+
+			requests->push_back(it.second);
+			it.second = nullptr;
+			count++;
+		}
+
+		p_->hasLatest_.store(false, std::memory_order_relaxed);
+	}
+
+	return count;
+}
+
+/**
+ * \brief Add a completed request to the queue
+ * \param[in] request The completed request
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void CompletionQueue::push(Request *request)
+{
+	if (p_->overflowing_.load(std::memory_order_acquire) ||
+	    !p_->pushRing(request)) {
+		MutexLocker locker(p_->mutex_);
+		if (p_->overflow_.empty())
+			LOG(CompletionQueue, Debug)
+				<< "Ring full, completions may be slower";
+		p_->overflow_.push_back(request);
+		p_->overflowing_.store(true, std::memory_order_release);
+	}
+
+	p_->notify();
+}
+
+/**
+ * \brief Replace the latest completed request of a camera
+ * \param[in] camera The camera that the request belongs to
+ * \param[in] request The completed request
+ *
+ * Store \a request as the latest completed request of \a camera, replacing
+ * the previous one if the application hasn't reaped it yet.
+ *
+ * \context This function is called from the CameraManager thread.
+ *
+ * \return The replaced request, or nullptr if the application has already
+ * reaped all the requests of \a camera
+ */
+Request *CompletionQueue::replace(const Camera *camera, Request *request)
+{
+	Request *stale;
+
+	{
+		MutexLocker locker(p_->mutex_);
+		Request *&latest = p_->latest_[camera];
+		stale = latest;
+		latest = request;
+		p_->hasLatest_.store(true, std::memory_order_release);
+	}
+
+	p_->notify();
+
+	return stale;
+}
+
+} /* namespace libcamera */
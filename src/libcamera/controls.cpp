@@ -7,8 +7,11 @@
 
 #include <libcamera/controls.h>
 
+#include <algorithm>
 #include <iomanip>
+#include <limits.h>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string.h>
 
@@ -86,10 +89,22 @@ static constexpr size_t ControlValueSize[] = {
 /**
  * \class ControlValue
  * \brief Abstract type representing the value of a control
+ *
+ * Values whose size doesn't exceed kInlineStorageSize bytes, including short
+ * arrays such as colour gains, colour correction matrices, rectangles or short
+ * strings, are stored inline in the ControlValue instance. Only larger values
+ * require a heap allocation. Setting, copying and moving small values is thus
+ * allocation-free.
+ */
+
+/**
+ * \var ControlValue::kInlineStorageSize
+ * \brief The maximum size in bytes of values stored without heap allocation
  */
 
 /** \todo Revisit the ControlValue layout when stabilizing the ABI */
-static_assert(sizeof(ControlValue) == 16, "Invalid size of ControlValue class");
+static_assert(sizeof(ControlValue) == 8 + ControlValue::kInlineStorageSize,
+	      "Invalid size of ControlValue class");
 
 /**
  * \brief Construct an empty ControlValue.
@@ -149,6 +164,55 @@ ControlValue &ControlValue::operator=(const ControlValue &other)
 	return *this;
 }
 
+/**
+ * \brief Construct a ControlValue by moving the content of \a other
+ * \param[in] other The ControlValue to move content from
+ *
+ * The \a other value is left empty, as if default-constructed.
+ */
+ControlValue::ControlValue(ControlValue &&other) noexcept
+	: type_(ControlTypeNone), isArray_(false), numElements_(0)
+{
+	moveFrom(other);
+}
+
+/**
+ * \brief Replace the content of the ControlValue by moving the content of
+ * \a other
+ * \param[in] other The ControlValue to move content from
+ *
+ * The \a other value is left empty, as if default-constructed.
+ *
+ * \return The ControlValue with its content replaced with the one of \a other
+ */
+ControlValue &ControlValue::operator=(ControlValue &&other) noexcept
+{
+	if (this != &other) {
+		release();
+		moveFrom(other);
+	}
+
+	return *this;
+}
+
+void ControlValue::moveFrom(ControlValue &other)
+{
+	std::size_t size = other.numElements_ * ControlValueSize[other.type_];
+
+	type_ = other.type_;
+	isArray_ = other.isArray_;
+	numElements_ = other.numElements_;
+
+	if (size > sizeof(value_))
+		storage_ = other.storage_;
+	else
+		memcpy(value_, other.value_, size);
+
+	other.type_ = ControlTypeNone;
+	other.isArray_ = false;
+	other.numElements_ = 0;
+}
+
 /**
  * \fn ControlValue::type()
  * \brief Retrieve the data type of the value
@@ -187,7 +251,7 @@ Span<const uint8_t> ControlValue::data() const
 	std::size_t size = numElements_ * ControlValueSize[type_];
 	const uint8_t *data = size > sizeof(value_)
 			    ? reinterpret_cast<const uint8_t *>(storage_)
-			    : reinterpret_cast<const uint8_t *>(&value_);
+			    : value_;
 	return { data, size };
 }
 
@@ -566,6 +630,11 @@ std::string ControlInfo::toString() const
  * provides access to the mapped elements using numerical ID keys. It maintains
  * an internal map of numerical ID to ControlId for this purpose, and exposes it
  * through the idmap() method to help construction of ControlList instances.
+ *
+ * When the numerical IDs of the controls are compact, as is the case for the
+ * libcamera controls and properties, the map additionally maintains a dense
+ * index of its elements by numerical ID. Lookups by numerical ID then reduce to
+ * array indexing.
  */
 
 /**
@@ -574,10 +643,14 @@ std::string ControlInfo::toString() const
  */
 
 /**
- * \fn ControlInfoMap::ControlInfoMap(const ControlInfoMap &other)
  * \brief Copy constructor, construct a ControlInfoMap from a copy of \a other
  * \param[in] other The other ControlInfoMap
  */
+ControlInfoMap::ControlInfoMap(const ControlInfoMap &other)
+	: Map(other), idmap_(other.idmap_)
+{
+	generateIndex();
+}
 
 /**
  * \brief Construct a ControlInfoMap from an initializer list
@@ -603,11 +676,20 @@ ControlInfoMap::ControlInfoMap(Map &&info)
 }
 
 /**
- * \fn ControlInfoMap &ControlInfoMap::operator=(const ControlInfoMap &other)
  * \brief Copy assignment operator, replace the contents with a copy of \a other
  * \param[in] other The other ControlInfoMap
  * \return A reference to the ControlInfoMap
  */
+ControlInfoMap &ControlInfoMap::operator=(const ControlInfoMap &other)
+{
+	if (this == &other)
+		return *this;
+
+	Map::operator=(other);
+	idmap_ = other.idmap_;
+	generateIndex();
+	return *this;
+}
 
 /**
  * \brief Replace the contents with those from the initializer list
@@ -644,6 +726,13 @@ ControlInfoMap &ControlInfoMap::operator=(Map &&info)
  */
 ControlInfoMap::mapped_type &ControlInfoMap::at(unsigned int id)
 {
+	if (!index_.empty()) {
+		iterator iter = lookup(id);
+		if (iter == end())
+			throw std::out_of_range("ControlInfoMap::at");
+		return iter->second;
+	}
+
 	return at(idmap_.at(id));
 }
 
@@ -654,7 +743,7 @@ ControlInfoMap::mapped_type &ControlInfoMap::at(unsigned int id)
  */
 const ControlInfoMap::mapped_type &ControlInfoMap::at(unsigned int id) const
 {
-	return at(idmap_.at(id));
+	return const_cast<ControlInfoMap *>(this)->at(id);
 }
 
 /**
@@ -669,6 +758,9 @@ ControlInfoMap::size_type ControlInfoMap::count(unsigned int id) const
 	 * entries, we can thus just count the matching entries in idmap to
 	 * avoid an additional lookup.
 	 */
+	if (!index_.empty())
+		return const_cast<ControlInfoMap *>(this)->lookup(id) != end() ? 1 : 0;
+
 	return idmap_.count(id);
 }
 
@@ -680,6 +772,9 @@ ControlInfoMap::size_type ControlInfoMap::count(unsigned int id) const
  */
 ControlInfoMap::iterator ControlInfoMap::find(unsigned int id)
 {
+	if (!index_.empty())
+		return lookup(id);
+
 	auto iter = idmap_.find(id);
 	if (iter == idmap_.end())
 		return end();
@@ -695,11 +790,7 @@ ControlInfoMap::iterator ControlInfoMap::find(unsigned int id)
  */
 ControlInfoMap::const_iterator ControlInfoMap::find(unsigned int id) const
 {
-	auto iter = idmap_.find(id);
-	if (iter == idmap_.end())
-		return end();
-
-	return find(iter->second);
+	return const_cast<ControlInfoMap *>(this)->find(id);
 }
 
 /**
@@ -733,11 +824,53 @@ void ControlInfoMap::generateIdmap()
 				<< " type and info type mismatch";
 			idmap_.clear();
 			clear();
+			generateIndex();
 			return;
 		}
 
 		idmap_[ctrl.first->id()] = ctrl.first;
 	}
+
+	generateIndex();
+}
+
+void ControlInfoMap::generateIndex()
+{
+	index_.clear();
+	indexBase_ = 0;
+
+	if (empty())
+		return;
+
+	unsigned int minId = UINT_MAX;
+	unsigned int maxId = 0;
+	for (const auto &ctrl : *this) {
+		minId = std::min(minId, ctrl.first->id());
+		maxId = std::max(maxId, ctrl.first->id());
+	}
+
+	/*
+	 * Only index maps with compact IDs, such as libcamera controls. Maps
+	 * of V4L2 controls, whose IDs span multiple control classes, keep
+	 * using the hash-based idmap.
+	 */
+	if (maxId - minId >= 2 * size() + 16)
+		return;
+
+	indexBase_ = minId;
+	index_.resize(maxId - minId + 1, end());
+
+	for (iterator iter = begin(); iter != end(); ++iter)
+		index_[iter->first->id() - indexBase_] = iter;
+}
+
+ControlInfoMap::iterator ControlInfoMap::lookup(unsigned int id)
+{
+	unsigned int slot = id - indexBase_;
+	if (id < indexBase_ || slot >= index_.size())
+		return end();
+
+	return index_[slot];
 }
 
 /**
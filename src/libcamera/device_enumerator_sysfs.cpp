@@ -46,10 +46,14 @@ int DeviceEnumeratorSysfs::enumerate()
 			break;
 	}
 
+	/*
+	 * A kernel without media controller support has no media devices,
+	 * but cameras that don't depend on any device can still be provided.
+	 */
 	if (!dir) {
-		LOG(DeviceEnumerator, Error)
+		LOG(DeviceEnumerator, Warning)
 			<< "No valid sysfs media device directory";
-		return -ENODEV;
+		return 0;
 	}
 
 	while ((ent = readdir(dir)) != nullptr) {
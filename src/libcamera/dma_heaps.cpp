@@ -0,0 +1,365 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Limited
+ *
+ * dma_heaps.cpp - Helper class for dma-heap allocations.
+ */
+
+#include "libcamera/internal/dma_heaps.h"
+
+#include <array>
+#include <fcntl.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <linux/udmabuf.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "libcamera/internal/log.h"
+
+/**
+ * \file dma_heaps.h
+ * \brief dma-buf allocation from dma-heaps and udmabuf
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(DmaHeap)
+
+namespace {
+
+struct DmaHeapInfo {
+	DmaHeap::DmaHeapFlag flag;
+	const char *name;
+};
+
+/*
+ * /dev/dma-heap/linux,cma is the dma-heap allocator, which allows dmaheap-cma
+ * to only have to worry about importing.
+ *
+ * Annoyingly, should the cma heap size be specified on the kernel command line
+ * instead of DT, the heap gets named "reserved" instead.
+ */
+constexpr std::array<DmaHeapInfo, 3> heapInfos = { {
+	{ DmaHeap::DmaHeapFlagCma, "/dev/dma_heap/linux,cma" },
+	{ DmaHeap::DmaHeapFlagCma, "/dev/dma_heap/reserved" },
+	{ DmaHeap::DmaHeapFlagSystem, "/dev/dma_heap/system" },
+} };
+
+constexpr const char *udmabufName = "/dev/udmabuf";
+
+/* Buffers larger than twice the requested size are not reused. */
+constexpr unsigned int kPoolMaxWasteFactor = 2;
+
+} /* namespace */
+
+/**
+ * \class DmaHeap
+ * \brief Helper class for dma-buf allocations
+ *
+ * The DmaHeap class allocates dma-buf instances from the first available
+ * allocator selected by the flags passed to the constructor. The dma-heaps
+ * are tried first, in the CMA then system heap order, and the udmabuf driver
+ * is used as a fallback if no heap is available. The udmabuf driver wraps a
+ * sealed memfd in a dma-buf, and thus only provides non-contiguous memory.
+ */
+
+/**
+ * \enum DmaHeap::DmaHeapFlag
+ * \brief Type of the dma-buf allocator
+ * \var DmaHeap::DmaHeapFlagCma
+ * \brief Allocate from a CMA dma-heap, providing physically contiguous memory
+ * \var DmaHeap::DmaHeapFlagSystem
+ * \brief Allocate from the system dma-heap
+ * \var DmaHeap::DmaHeapFlagUDmaBuf
+ * \brief Allocate from memfd, exported as dma-buf through the udmabuf driver
+ */
+
+/**
+ * \brief Construct a DmaHeap from a set of allowed allocators
+ * \param[in] flags The allowed allocators, as a bitwise OR of DmaHeapFlag
+ */
+DmaHeap::DmaHeap(unsigned int flags)
+	: dmaHeapHandle_(-1), udmabufHandle_(-1)
+{
+	for (const DmaHeapInfo &info : heapInfos) {
+		if (!(flags & info.flag))
+			continue;
+
+		int ret = ::open(info.name, O_RDWR | O_CLOEXEC, 0);
+		if (ret < 0) {
+			ret = errno;
+			LOG(DmaHeap, Debug) << "Failed to open " << info.name
+					    << ": " << strerror(ret);
+			continue;
+		}
+
+		dmaHeapHandle_ = ret;
+		return;
+	}
+
+	if (flags & DmaHeapFlagUDmaBuf) {
+		int ret = ::open(udmabufName, O_RDWR | O_CLOEXEC, 0);
+		if (ret < 0) {
+			ret = errno;
+			LOG(DmaHeap, Debug) << "Failed to open " << udmabufName
+					    << ": " << strerror(ret);
+		} else {
+			udmabufHandle_ = ret;
+			return;
+		}
+	}
+
+	LOG(DmaHeap, Error) << "Could not open any dmaHeap device";
+}
+
+DmaHeap::~DmaHeap()
+{
+	if (dmaHeapHandle_ > -1)
+		::close(dmaHeapHandle_);
+	if (udmabufHandle_ > -1)
+		::close(udmabufHandle_);
+}
+
+/**
+ * \fn DmaHeap::isValid()
+ * \brief Check if the DmaHeap has an allocator available
+ * \return True if an allocator has been opened, false otherwise
+ */
+
+/**
+ * \brief Allocate a dma-buf
+ * \param[in] name The name to set for the allocated buffer
+ * \param[in] size The size of the buffer to allocate
+ *
+ * \return The FileDescriptor of the allocated buffer, or an invalid
+ * FileDescriptor on failure
+ */
+FileDescriptor DmaHeap::alloc(const char *name, std::size_t size)
+{
+	if (!name)
+		return FileDescriptor();
+
+	if (dmaHeapHandle_ > -1)
+		return allocFromHeap(name, size);
+	if (udmabufHandle_ > -1)
+		return allocFromUDmaBuf(name, size);
+
+	return FileDescriptor();
+}
+
+FileDescriptor DmaHeap::allocFromHeap(const char *name, std::size_t size)
+{
+	int ret;
+
+	struct dma_heap_allocation_data alloc = {};
+
+	alloc.len = size;
+	alloc.fd_flags = O_CLOEXEC | O_RDWR;
+
+	ret = ::ioctl(dmaHeapHandle_, DMA_HEAP_IOCTL_ALLOC, &alloc);
+
+	if (ret < 0) {
+		LOG(DmaHeap, Error) << "dmaHeap allocation failure for "
+				    << name;
+		return FileDescriptor();
+	}
+
+	ret = ::ioctl(alloc.fd, DMA_BUF_SET_NAME, name);
+	if (ret < 0) {
+		LOG(DmaHeap, Error) << "dmaHeap naming failure for "
+				    << name;
+		::close(alloc.fd);
+		return FileDescriptor();
+	}
+
+	return FileDescriptor(std::move(alloc.fd));
+}
+
+FileDescriptor DmaHeap::allocFromUDmaBuf(const char *name, std::size_t size)
+{
+	/* udmabuf requires page-aligned sizes. */
+	long pageSize = sysconf(_SC_PAGESIZE);
+	size = (size + pageSize - 1) / pageSize * pageSize;
+
+	int memfd = memfd_create(name, MFD_ALLOW_SEALING | MFD_CLOEXEC);
+	if (memfd < 0) {
+		int ret = errno;
+		LOG(DmaHeap, Error) << "Failed to create memfd for " << name
+				    << ": " << strerror(ret);
+		return FileDescriptor();
+	}
+
+	int ret = ftruncate(memfd, size);
+	if (ret < 0) {
+		ret = errno;
+		LOG(DmaHeap, Error) << "Failed to resize memfd for " << name
+				    << ": " << strerror(ret);
+		::close(memfd);
+		return FileDescriptor();
+	}
+
+	/* udmabuf refuses memfds that can be shrunk. */
+	ret = fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK);
+	if (ret < 0) {
+		ret = errno;
+		LOG(DmaHeap, Error) << "Failed to seal memfd for " << name
+				    << ": " << strerror(ret);
+		::close(memfd);
+		return FileDescriptor();
+	}
+
+	struct udmabuf_create create = {};
+	create.memfd = memfd;
+	create.flags = UDMABUF_FLAGS_CLOEXEC;
+	create.offset = 0;
+	create.size = size;
+
+	int fd = ::ioctl(udmabufHandle_, UDMABUF_CREATE, &create);
+	ret = errno;
+
+	/* The dma-buf holds a reference to the memfd pages. */
+	::close(memfd);
+
+	if (fd < 0) {
+		LOG(DmaHeap, Error) << "udmabuf allocation failure for "
+				    << name << ": " << strerror(ret);
+		return FileDescriptor();
+	}
+
+	return FileDescriptor(std::move(fd));
+}
+
+/**
+ * \class DmaBufPool
+ * \brief Pool of dma-buf instances shared by buffer allocators
+ *
+ * The DmaBufPool allocates dma-bufs from any available dma-heap or from
+ * udmabuf, and caches the buffers released by its users for later reuse. This
+ * allows buffers to be recycled across stream reconfigurations and between
+ * streams of different cameras without going back to the kernel allocator.
+ *
+ * A cached buffer is reused for an allocation request if its size is large
+ * enough, and not more than twice the requested size. Cached buffers are freed
+ * when the pool is destroyed, or explicitly with trim().
+ *
+ * A process-wide pool is available through instance(). It lives as long as
+ * one of its users holds a reference to it.
+ */
+
+/**
+ * \brief Retrieve the process-wide dma-buf pool
+ * \return The process-wide pool, created if no other user holds it
+ */
+std::shared_ptr<DmaBufPool> DmaBufPool::instance()
+{
+	static Mutex mutex;
+	static std::weak_ptr<DmaBufPool> pool;
+
+	MutexLocker locker(mutex);
+
+	std::shared_ptr<DmaBufPool> instance = pool.lock();
+	if (!instance) {
+		instance = std::make_shared<DmaBufPool>();
+		pool = instance;
+	}
+
+	return instance;
+}
+
+/**
+ * \brief Construct an empty DmaBufPool
+ */
+DmaBufPool::DmaBufPool()
+	: heap_(DmaHeap::DmaHeapFlagCma | DmaHeap::DmaHeapFlagSystem |
+		DmaHeap::DmaHeapFlagUDmaBuf)
+{
+}
+
+DmaBufPool::~DmaBufPool()
+{
+	trim();
+}
+
+/**
+ * \fn DmaBufPool::isValid()
+ * \brief Check if the pool has an allocator available
+ * \return True if dma-bufs can be allocated, false otherwise
+ */
+
+/**
+ * \brief Allocate a dma-buf from the pool
+ * \param[in] name The name to set for newly allocated buffers
+ * \param[in] size The minimum size of the buffer
+ *
+ * Reuse the smallest suitable cached buffer if any, or allocate a new buffer
+ * otherwise. The size of the returned buffer may be larger than \a size.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The FileDescriptor of the buffer, or an invalid FileDescriptor on
+ * failure
+ */
+FileDescriptor DmaBufPool::alloc(const char *name, std::size_t size)
+{
+	{
+		MutexLocker locker(mutex_);
+
+		auto iter = freeBuffers_.lower_bound(size);
+		if (iter != freeBuffers_.end() &&
+		    iter->first <= size * kPoolMaxWasteFactor) {
+			FileDescriptor fd = std::move(iter->second);
+			freeBuffers_.erase(iter);
+			return fd;
+		}
+	}
+
+	return heap_.alloc(name, size);
+}
+
+/**
+ * \brief Return a buffer to the pool
+ * \param[in] fd The buffer file descriptor
+ *
+ * The buffer is cached for reuse by later calls to alloc(). The caller shall
+ * not use the buffer after releasing it.
+ *
+ * \context This function is \threadsafe.
+ */
+void DmaBufPool::release(const FileDescriptor &fd)
+{
+	if (!fd.isValid())
+		return;
+
+	off_t size = lseek(fd.fd(), 0, SEEK_END);
+	if (size <= 0)
+		return;
+
+	MutexLocker locker(mutex_);
+	freeBuffers_.emplace(size, fd);
+}
+
+/**
+ * \brief Retrieve the number of buffers cached in the pool
+ * \context This function is \threadsafe.
+ * \return The number of buffers available for reuse
+ */
+std::size_t DmaBufPool::cachedBuffers()
+{
+	MutexLocker locker(mutex_);
+	return freeBuffers_.size();
+}
+
+/**
+ * \brief Free all buffers cached in the pool
+ * \context This function is \threadsafe.
+ */
+void DmaBufPool::trim()
+{
+	MutexLocker locker(mutex_);
+	freeBuffers_.clear();
+}
+
+} /* namespace libcamera */
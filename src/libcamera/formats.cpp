@@ -9,6 +9,8 @@
 
 #include <algorithm>
 #include <errno.h>
+#include <string.h>
+#include <vector>
 
 #include <libcamera/formats.h>
 
@@ -658,6 +660,42 @@ const std::map<PixelFormat, PixelFormatInfo> pixelFormatInfo{
 	} },
 };
 
+/*
+ * Sorted views of the pixelFormatInfo table, to look up entries by V4L2 pixel
+ * format and by name with a binary search. The views are built once on first
+ * use. Entries sharing the same key are kept in the pixelFormatInfo order, so
+ * lookups return the same entry as a linear search would.
+ */
+struct PixelFormatInfoIndex {
+	std::vector<const PixelFormatInfo *> byV4L2Format;
+	std::vector<const PixelFormatInfo *> byName;
+};
+
+const PixelFormatInfoIndex &pixelFormatInfoIndex()
+{
+	static const PixelFormatInfoIndex index = []() {
+		PixelFormatInfoIndex idx;
+
+		for (const auto &entry : pixelFormatInfo) {
+			idx.byV4L2Format.push_back(&entry.second);
+			idx.byName.push_back(&entry.second);
+		}
+
+		std::stable_sort(idx.byV4L2Format.begin(), idx.byV4L2Format.end(),
+				 [](const PixelFormatInfo *a, const PixelFormatInfo *b) {
+					 return a->v4l2Format.fourcc() < b->v4l2Format.fourcc();
+				 });
+		std::stable_sort(idx.byName.begin(), idx.byName.end(),
+				 [](const PixelFormatInfo *a, const PixelFormatInfo *b) {
+					 return strcmp(a->name, b->name) < 0;
+				 });
+
+		return idx;
+	}();
+
+	return index;
+}
+
 } /* namespace */
 
 /**
@@ -693,14 +731,17 @@ const PixelFormatInfo &PixelFormatInfo::info(const PixelFormat &format)
  */
 const PixelFormatInfo &PixelFormatInfo::info(const V4L2PixelFormat &format)
 {
-	const auto &info = std::find_if(pixelFormatInfo.begin(), pixelFormatInfo.end(),
-					[format](auto pair) {
-						return pair.second.v4l2Format == format;
-					});
-	if (info == pixelFormatInfo.end())
+	const std::vector<const PixelFormatInfo *> &infos =
+		pixelFormatInfoIndex().byV4L2Format;
+
+	auto iter = std::lower_bound(infos.begin(), infos.end(), format.fourcc(),
+				     [](const PixelFormatInfo *info, uint32_t fourcc) {
+					     return info->v4l2Format.fourcc() < fourcc;
+				     });
+	if (iter == infos.end() || (*iter)->v4l2Format != format)
 		return pixelFormatInfoInvalid;
 
-	return info->second;
+	return **iter;
 }
 
 /**
@@ -711,12 +752,17 @@ const PixelFormatInfo &PixelFormatInfo::info(const V4L2PixelFormat &format)
  */
 const PixelFormatInfo &PixelFormatInfo::info(const std::string &name)
 {
-	for (const auto &info : pixelFormatInfo) {
-		if (info.second.name == name)
-			return info.second;
-	}
+	const std::vector<const PixelFormatInfo *> &infos =
+		pixelFormatInfoIndex().byName;
+
+	auto iter = std::lower_bound(infos.begin(), infos.end(), name,
+				     [](const PixelFormatInfo *info, const std::string &key) {
+					     return strcmp(info->name, key.c_str()) < 0;
+				     });
+	if (iter == infos.end() || (*iter)->name != name)
+		return pixelFormatInfoInvalid;
 
-	return pixelFormatInfoInvalid;
+	return **iter;
 }
 
 /**
@@ -13,6 +13,8 @@
 #include <libcamera/camera.h>
 #include <libcamera/stream.h>
 
+#include "libcamera/internal/dma_heaps.h"
+#include "libcamera/internal/formats.h"
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/pipeline_handler.h"
 
@@ -51,19 +53,47 @@ LOG_DEFINE_CATEGORY(Allocator)
  *
  * Usage of the FrameBufferAllocator is optional, if all buffers for a camera
  * are provided externally applications shall not use this class.
+ *
+ * Buffers are allocated by the backend selected at construction time. The
+ * default BackendDevice backend exports buffers from the camera devices, while
+ * the BackendDmaHeap backend allocates them from the system dma-heaps, or from
+ * memfd through the udmabuf driver when no dma-heap is available. The latter
+ * doesn't tie buffers to a device, and the pipeline handler imports them in
+ * the same way as externally provided buffers. Memory allocated by the
+ * BackendDmaHeap backend is recycled through a process-wide pool shared by all
+ * allocators: buffers freed with free() are reused by subsequent allocations,
+ * for the same stream after reconfiguration as well as for other streams and
+ * cameras. The pool is released when the last allocator using it is destroyed.
+ * The BackendDmaHeap backend only supports single-plane pixel formats.
+ */
+
+/**
+ * \enum FrameBufferAllocator::Backend
+ * \brief The memory allocator backing a FrameBufferAllocator
+ * \var FrameBufferAllocator::BackendDevice
+ * \brief Export buffers from the devices of the camera pipeline
+ * \var FrameBufferAllocator::BackendDmaHeap
+ * \brief Allocate buffers from dma-heaps or udmabuf, through a shared pool
  */
 
 /**
  * \brief Construct a FrameBufferAllocator serving a camera
  * \param[in] camera The camera
+ * \param[in] backend The allocation backend
  */
-FrameBufferAllocator::FrameBufferAllocator(std::shared_ptr<Camera> camera)
-	: camera_(camera)
+FrameBufferAllocator::FrameBufferAllocator(std::shared_ptr<Camera> camera,
+					   Backend backend)
+	: camera_(camera), backend_(backend)
 {
+	if (backend_ == BackendDmaHeap)
+		pool_ = DmaBufPool::instance();
 }
 
 FrameBufferAllocator::~FrameBufferAllocator()
 {
+	for (auto &iter : buffers_)
+		releaseToPool(&iter.second);
+
 	buffers_.clear();
 }
 
@@ -84,6 +114,8 @@ FrameBufferAllocator::~FrameBufferAllocator()
  * \retval -EINVAL The \a stream does not belong to the camera or the stream is
  * not part of the active camera configuration
  * \retval -EBUSY Buffers are already allocated for the \a stream
+ * \retval -ENOTSUP The BackendDmaHeap backend doesn't support the multi-planar
+ * pixel format of the \a stream
  */
 int FrameBufferAllocator::allocate(Stream *stream)
 {
@@ -92,7 +124,15 @@ int FrameBufferAllocator::allocate(Stream *stream)
 		return -EBUSY;
 	}
 
-	int ret = camera_->exportFrameBuffers(stream, &buffers_[stream]);
+	int ret;
+	if (backend_ == BackendDmaHeap)
+		ret = allocateFromPool(stream, &buffers_[stream]);
+	else
+		ret = camera_->exportFrameBuffers(stream, &buffers_[stream]);
+
+	if (ret < 0)
+		buffers_.erase(stream);
+
 	if (ret == -EINVAL)
 		LOG(Allocator, Error)
 			<< "Stream is not part of " << camera_->id()
@@ -119,12 +159,19 @@ int FrameBufferAllocator::free(Stream *stream)
 		return -EINVAL;
 
 	std::vector<std::unique_ptr<FrameBuffer>> &buffers = iter->second;
+	releaseToPool(&buffers);
 	buffers.clear();
 	buffers_.erase(iter);
 
 	return 0;
 }
 
+/**
+ * \fn FrameBufferAllocator::backend()
+ * \brief Retrieve the allocation backend
+ * \return The backend selected at construction time
+ */
+
 /**
  * \fn FrameBufferAllocator::allocated()
  * \brief Check if the allocator has allocated buffers for any stream
@@ -154,4 +201,70 @@ FrameBufferAllocator::buffers(Stream *stream) const
 	return iter->second;
 }
 
+int FrameBufferAllocator::allocateFromPool(Stream *stream,
+					   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	int ret = camera_->validateAllocation(stream);
+	if (ret < 0)
+		return ret;
+
+	if (!pool_->isValid()) {
+		LOG(Allocator, Error) << "No dma-buf allocator available";
+		return -ENODEV;
+	}
+
+	const StreamConfiguration &cfg = stream->configuration();
+	const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+
+	/*
+	 * \todo Allocate one buffer per plane for multi-planar formats. Only
+	 * single-plane buffers are allocated for now.
+	 */
+	if (info.isValid() && info.numPlanes() > 1) {
+		LOG(Allocator, Error)
+			<< "Multi-planar format " << cfg.pixelFormat.toString()
+			<< " not supported";
+		return -ENOTSUP;
+	}
+
+	unsigned int frameSize = cfg.frameSize;
+	if (!frameSize && info.isValid())
+		frameSize = info.frameSize(cfg.size);
+
+	if (!frameSize || !cfg.bufferCount) {
+		LOG(Allocator, Error)
+			<< "Invalid buffer size or count for " << cfg.toString();
+		return -EINVAL;
+	}
+
+	for (unsigned int i = 0; i < cfg.bufferCount; ++i) {
+		FrameBuffer::Plane plane;
+		plane.fd = pool_->alloc("libcamera-frame", frameSize);
+		plane.length = frameSize;
+
+		if (!plane.fd.isValid()) {
+			LOG(Allocator, Error) << "Failed to allocate buffer " << i;
+			releaseToPool(buffers);
+			buffers->clear();
+			return -ENOMEM;
+		}
+
+		buffers->push_back(std::make_unique<FrameBuffer>(
+			std::vector<FrameBuffer::Plane>{ plane }));
+	}
+
+	return buffers->size();
+}
+
+void FrameBufferAllocator::releaseToPool(std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	if (!pool_)
+		return;
+
+	for (std::unique_ptr<FrameBuffer> &buffer : *buffers) {
+		for (const FrameBuffer::Plane &plane : buffer->planes())
+			pool_->release(plane.fd);
+	}
+}
+
 } /* namespace libcamera */
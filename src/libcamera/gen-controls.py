@@ -37,6 +37,7 @@ ${description}
     ctrls_doc = []
     ctrls_def = []
     ctrls_map = []
+    ctrls_index = ['\tnullptr,']
 
     for ctrl in controls:
         name, ctrl = ctrl.popitem()
@@ -75,11 +76,13 @@ ${description}
         ctrls_doc.append(doc_template.substitute(info))
         ctrls_def.append(def_template.substitute(info))
         ctrls_map.append('\t{ ' + id_name + ', &' + name + ' },')
+        ctrls_index.append('\t&' + name + ',')
 
     return {
         'controls_doc': '\n\n'.join(ctrls_doc),
         'controls_def': '\n'.join(ctrls_def),
         'controls_map': '\n'.join(ctrls_map),
+        'controls_index': '\n'.join(ctrls_index),
     }
 
 
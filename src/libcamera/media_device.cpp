@@ -7,6 +7,7 @@
 
 #include "libcamera/internal/media_device.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
@@ -64,7 +65,7 @@ LOG_DEFINE_CATEGORY(MediaDevice)
  */
 MediaDevice::MediaDevice(const std::string &deviceNode)
 	: deviceNode_(deviceNode), fd_(-1), valid_(false), acquired_(false),
-	  lockOwner_(false)
+	  lockOwner_(false), linksSynced_(false), linkCounters_{}
 {
 }
 
@@ -134,6 +135,10 @@ void MediaDevice::release()
  * they provide at all times, while still allowing an instance to lock a
  * resource while it prepares to actively use a camera from the resource.
  *
+ * Locking the device refreshes the state of all links from the device. The link
+ * state is then tracked until the device is unlocked, which allows skipping
+ * link setup operations that wouldn't change the state of a link.
+ *
  * This method shall not be called from a pipeline handler implementation
  * directly, as the base PipelineHandler implementation handles this on the
  * behalf of the specified implementation.
@@ -155,6 +160,13 @@ bool MediaDevice::lock()
 
 	lockOwner_ = true;
 
+	/*
+	 * Other users may have modified the links while the device was
+	 * unlocked. Refresh the link state, it will then be kept up to date
+	 * until the device is unlocked.
+	 */
+	linksSynced_ = syncLinks() == 0;
+
 	return true;
 }
 
@@ -176,6 +188,7 @@ void MediaDevice::unlock()
 		return;
 
 	lockOwner_ = false;
+	linksSynced_ = false;
 
 	lockf(fd_, F_ULOCK, 0);
 }
@@ -452,6 +465,96 @@ int MediaDevice::disableLinks()
 	return 0;
 }
 
+/**
+ * \brief Enable a set of links and disable all other links
+ * \param[in] links The links to enable
+ *
+ * Configure the media graph to enable exactly the links in \a links, and
+ * disable all the other links that are not flagged as IMMUTABLE. Links are
+ * disabled first, to release sink pads that don't allow multiple enabled
+ * links, and the links in \a links are then enabled.
+ *
+ * Only the links whose state changes are updated in the device, making this
+ * function cheap when the graph is already configured as requested. If the
+ * device isn't locked, the state of the links is refreshed from the device
+ * first.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MediaDevice::setupLinks(const std::vector<MediaLink *> &links)
+{
+	bool synced = linksSynced_;
+	if (!linksSynced_)
+		linksSynced_ = syncLinks() == 0;
+
+	int ret = applyLinks(links);
+
+	linksSynced_ = synced;
+
+	return ret;
+}
+
+/**
+ * \brief Apply a set of enabled links to the media graph
+ * \param[in] links The links to enable
+ *
+ * \sa setupLinks()
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MediaDevice::applyLinks(const std::vector<MediaLink *> &links)
+{
+	for (MediaEntity *entity : entities_) {
+		for (MediaPad *pad : entity->pads()) {
+			if (!(pad->flags() & MEDIA_PAD_FL_SOURCE))
+				continue;
+
+			for (MediaLink *link : pad->links()) {
+				if (link->flags() & MEDIA_LNK_FL_IMMUTABLE)
+					continue;
+
+				if (std::find(links.begin(), links.end(), link) != links.end())
+					continue;
+
+				int ret = link->setEnabled(false);
+				if (ret)
+					return ret;
+			}
+		}
+	}
+
+	for (MediaLink *link : links) {
+		int ret = link->setEnabled(true);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \struct MediaDevice::LinkCounters
+ * \brief Counters of link setup operations
+ *
+ * \var MediaDevice::LinkCounters::applied
+ * \brief The number of link setup operations applied to the device
+ *
+ * \var MediaDevice::LinkCounters::skipped
+ * \brief The number of link setup operations skipped as the link was already
+ * in the requested state
+ */
+
+/**
+ * \fn MediaDevice::linkCounters()
+ * \brief Retrieve the link setup counters
+ *
+ * The counters track the link setup operations performed through
+ * MediaLink::setEnabled(), disableLinks() and setupLinks() over the lifetime of
+ * the media device.
+ *
+ * \return The link setup counters
+ */
+
 /**
  * \var MediaDevice::disconnected
  * \brief Signal emitted when the media device is disconnected from the system
@@ -786,6 +889,15 @@ int MediaDevice::setupLink(const MediaLink *link, unsigned int flags)
 	MediaPad *source = link->source();
 	MediaPad *sink = link->sink();
 
+	/*
+	 * The link flags reflect the device state while the device is locked,
+	 * skip the ioctl if the state doesn't change.
+	 */
+	if (linksSynced_ && link->flags() == flags) {
+		linkCounters_.skipped++;
+		return 0;
+	}
+
 	linkDesc.source.entity = source->entity()->id();
 	linkDesc.source.index = source->index();
 	linkDesc.source.flags = MEDIA_PAD_FL_SOURCE;
@@ -805,6 +917,8 @@ int MediaDevice::setupLink(const MediaLink *link, unsigned int flags)
 		return ret;
 	}
 
+	linkCounters_.applied++;
+
 	LOG(MediaDevice, Debug)
 		<< source->entity()->name() << "["
 		<< source->index() << "] -> "
@@ -814,4 +928,52 @@ int MediaDevice::setupLink(const MediaLink *link, unsigned int flags)
 	return 0;
 }
 
+/**
+ * \brief Update the link flags from the device
+ *
+ * Retrieve the state of all links from the device and update the flags of the
+ * corresponding MediaLink instances.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MediaDevice::syncLinks()
+{
+	struct media_v2_topology topology = {};
+	std::vector<struct media_v2_link> links;
+
+	int ret = ioctl(fd_, MEDIA_IOC_G_TOPOLOGY, &topology);
+	if (ret < 0)
+		goto error;
+
+	links.resize(topology.num_links);
+	topology.ptr_links = reinterpret_cast<uintptr_t>(links.data());
+
+	ret = ioctl(fd_, MEDIA_IOC_G_TOPOLOGY, &topology);
+	if (ret < 0)
+		goto error;
+
+	for (const struct media_v2_link &mediaLink : links) {
+		if ((mediaLink.flags & MEDIA_LNK_FL_LINK_TYPE) ==
+		    MEDIA_LNK_FL_INTERFACE_LINK)
+			continue;
+
+		MediaLink *link = dynamic_cast<MediaLink *>(object(mediaLink.id));
+		if (!link) {
+			LOG(MediaDevice, Warning)
+				<< "Link " << mediaLink.id << " not found";
+			return -ENODEV;
+		}
+
+		link->flags_ = mediaLink.flags;
+	}
+
+	return 0;
+
+error:
+	ret = -errno;
+	LOG(MediaDevice, Error)
+		<< "Failed to retrieve links: " << strerror(-ret);
+	return ret;
+}
+
 } /* namespace libcamera */
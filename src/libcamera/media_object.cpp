@@ -109,7 +109,8 @@ LOG_DECLARE_CATEGORY(MediaDevice)
  * disable it is.
  *
  * Enabling a link establishes a data connection between two pads, while
- * disabling it interrupts that connection.
+ * disabling it interrupts that connection. When the media device is locked,
+ * setting a link to its current state is a no-op.
  *
  * \return 0 on success or a negative error code otherwise
  */
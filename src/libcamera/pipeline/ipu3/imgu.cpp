@@ -639,58 +639,59 @@ int ImgUDevice::stop()
 }
 
 /**
- * \brief Enable or disable a single link on the ImgU instance
+ * \brief Retrieve a media link of the ImgU instance
  *
  * This method assumes the media device associated with the ImgU instance
  * is open.
  *
- * \return 0 on success or a negative error code otherwise
+ * \return The media link, or nullptr if the link doesn't exist
  */
-int ImgUDevice::linkSetup(const std::string &source, unsigned int sourcePad,
-			  const std::string &sink, unsigned int sinkPad,
-			  bool enable)
+MediaLink *ImgUDevice::link(const std::string &source, unsigned int sourcePad,
+			    const std::string &sink, unsigned int sinkPad) const
 {
 	MediaLink *link = media_->link(source, sourcePad, sink, sinkPad);
-	if (!link) {
+	if (!link)
 		LOG(IPU3, Error)
 			<< "Failed to get link: '" << source << "':"
 			<< sourcePad << " -> '" << sink << "':" << sinkPad;
-		return -ENODEV;
-	}
 
-	return link->setEnabled(enable);
+	return link;
 }
 
 /**
- * \brief Enable or disable all media links in the ImgU instance to prepare
- * for capture operations
+ * \brief Retrieve the media links needed by the ImgU instance for capture
+ * operations
+ * \param[out] links The media links
+ *
+ * The links are added to \a links, to be enabled with
+ * MediaDevice::setupLinks().
  *
- * \todo This method will probably be removed or changed once links will be
- * enabled or disabled selectively.
+ * \todo Select the links based on the requested streams.
  *
  * \return 0 on success or a negative error code otherwise
  */
-int ImgUDevice::enableLinks(bool enable)
+int ImgUDevice::captureLinks(std::vector<MediaLink *> *links) const
 {
 	std::string viewfinderName = name_ + " viewfinder";
 	std::string outputName = name_ + " output";
 	std::string statName = name_ + " 3a stat";
 	std::string inputName = name_ + " input";
-	int ret;
 
-	ret = linkSetup(inputName, 0, name_, PAD_INPUT, enable);
-	if (ret)
-		return ret;
+	MediaLink *imguLinks[] = {
+		link(inputName, 0, name_, PAD_INPUT),
+		link(name_, PAD_OUTPUT, outputName, 0),
+		link(name_, PAD_VF, viewfinderName, 0),
+		link(name_, PAD_STAT, statName, 0),
+	};
 
-	ret = linkSetup(name_, PAD_OUTPUT, outputName, 0, enable);
-	if (ret)
-		return ret;
+	for (MediaLink *imguLink : imguLinks) {
+		if (!imguLink)
+			return -ENODEV;
 
-	ret = linkSetup(name_, PAD_VF, viewfinderName, 0, enable);
-	if (ret)
-		return ret;
+		links->push_back(imguLink);
+	}
 
-	return linkSetup(name_, PAD_STAT, statName, 0, enable);
+	return 0;
 }
 
 } /* namespace libcamera */
@@ -21,6 +21,7 @@
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 #include "libcamera/internal/v4l2_controls.h"
 
@@ -428,9 +429,9 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 	 * would be 'stop()', but the Camera class state machine allows
 	 * start()<->stop() sequences without any configure() in between.
 	 *
-	 * As of now, disable all links in the ImgU media graph before
-	 * configuring the device, to allow alternate the usage of the two
-	 * ImgU pipes.
+	 * As of now, enable the links of the ImgU in use and disable all other
+	 * links in the ImgU media graph before configuring the device, to
+	 * allow alternate the usage of the two ImgU pipes.
 	 *
 	 * As a consequence, a Camera using an ImgU shall be configured before
 	 * any start()/stop() sequence. An application that wants to
@@ -438,10 +439,6 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 	 * without going through any re-configuration (a sequence that is
 	 * allowed by the Camera state machine) would now fail on the IPU3.
 	 */
-	ret = imguMediaDev_->disableLinks();
-	if (ret)
-		return ret;
-
 	/*
 	 * \todo: Enable links selectively based on the requested streams.
 	 * As of now, enable all links unconditionally.
@@ -449,7 +446,12 @@ int PipelineHandlerIPU3::configure(Camera *camera, CameraConfiguration *c)
 	 * stream which is for raw capture, in which case no buffers will
 	 * ever be queued to the ImgU.
 	 */
-	ret = data->imgu_->enableLinks(true);
+	std::vector<MediaLink *> links;
+	ret = data->imgu_->captureLinks(&links);
+	if (ret)
+		return ret;
+
+	ret = imguMediaDev_->setupLinks(links);
 	if (ret)
 		return ret;
 
@@ -721,10 +723,10 @@ bool PipelineHandlerIPU3::match(DeviceEnumerator *enumerator)
 	 * Disable all links that are enabled by default on CIO2, as camera
 	 * creation enables all valid links it finds.
 	 */
-	if (cio2MediaDev_->disableLinks())
+	if (cio2MediaDev_->setupLinks({}))
 		return false;
 
-	ret = imguMediaDev_->disableLinks();
+	ret = imguMediaDev_->setupLinks({});
 	if (ret)
 		return ret;
 
@@ -870,6 +872,7 @@ void IPU3CameraData::cio2BufferReady(FrameBuffer *buffer)
 		}
 	}
 
+	Tracer::instant("IPU3::queueImguInput", request);
 	imgu_->input_->queueBuffer(buffer);
 }
 
@@ -25,14 +25,15 @@
 
 #include "libcamera/internal/camera_sensor.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/dma_heaps.h"
 #include "libcamera/internal/ipa_manager.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 #include "libcamera/internal/v4l2_controls.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
-#include "dma_heaps.h"
 #include "staggered_ctrl.h"
 
 namespace libcamera {
@@ -282,12 +283,63 @@ public:
 	}
 };
 
+/*
+ * Maximum number of bayer frames that can be in flight at any time. Only one
+ * of them can occupy the ISP, the others are waiting for the IPA to process
+ * their statistics or for their request to complete.
+ */
+static constexpr unsigned int kMaxFramesInFlight = 3;
+
+/*
+ * Per-frame context, tracking a bayer frame from the time it is handed to the
+ * IPA for ISP preparation until its request is completed.
+ */
+struct RPiFrameContext {
+	Request *request;
+	FrameBuffer *bayerBuffer;
+	bool dropFrame;
+	unsigned int ispOutputCount;
+	bool inputComplete;
+	bool ispComplete;
+	bool ipaComplete;
+	utils::time_point ispStart;
+	utils::time_point ipaStart;
+};
+
+/*
+ * Occupancy accounting for the stages of the pipeline, used to measure how
+ * much the ISP and IPA stages overlap.
+ */
+struct RPiPipelineOccupancy {
+	void reset(utils::time_point now)
+	{
+		*this = {};
+		start = now;
+		lastChange = now;
+	}
+
+	void framesInFlightChanged(utils::time_point now, unsigned int count)
+	{
+		inFlight += (now - lastChange) * framesInFlight;
+		lastChange = now;
+		framesInFlight = count;
+	}
+
+	utils::time_point start;
+	utils::time_point lastChange;
+	unsigned int framesInFlight;
+	unsigned int frames;
+	utils::duration isp;
+	utils::duration ipa;
+	utils::duration inFlight;
+};
+
 class RPiCameraData : public CameraData
 {
 public:
 	RPiCameraData(PipelineHandler *pipe)
 		: CameraData(pipe), sensor_(nullptr), state_(State::Stopped),
-		  dropFrame_(false), ispOutputCount_(0)
+		  maxFramesInFlight_(1), framesHead_(0), framesCount_(0)
 	{
 	}
 
@@ -304,9 +356,13 @@ public:
 	void ispOutputDequeue(FrameBuffer *buffer);
 
 	void clearIncompleteRequests();
-	void handleStreamBuffer(FrameBuffer *buffer, const RPiStream *stream);
+	void handleStreamBuffer(FrameBuffer *buffer, const RPiStream *stream,
+				const RPiFrameContext *frame);
 	void handleState();
 
+	void resetFrames();
+	void reportOccupancy() const;
+
 	CameraSensor *sensor_;
 	/* Array of Unicam and ISP device streams and associated buffers/streams. */
 	RPiDevice<Unicam, 2> unicam_;
@@ -317,7 +373,7 @@ public:
 	std::vector<IPABuffer> ipaBuffers_;
 
 	/* DMAHEAP allocation helper. */
-	RPi::DmaHeap dmaHeap_;
+	DmaHeap dmaHeap_;
 	FileDescriptor lsTable_;
 
 	RPi::StaggeredCtrl staggeredCtrl_;
@@ -328,21 +384,46 @@ public:
 	 * All the functions in this class are called from a single calling
 	 * thread. So, we do not need to have any mutex to protect access to any
 	 * of the variables below.
+	 *
+	 * The state tracks the ISP only: it is Busy from the time a bayer frame
+	 * is handed to the IPA for preparation until all ISP outputs for that
+	 * frame have been dequeued. Frames then stay in the frames_ ring until
+	 * the IPA has processed their statistics and their request completes.
 	 */
-	enum class State { Stopped, Idle, Busy, IpaComplete };
+	enum class State { Stopped, Idle, Busy };
 	State state_;
 	std::queue<FrameBuffer *> bayerQueue_;
 	std::queue<FrameBuffer *> embeddedQueue_;
 	std::deque<Request *> requestQueue_;
 
+	/*
+	 * Number of frames allowed in flight. A value of 1 serialises frames
+	 * completely, higher values let the next bayer frame enter the ISP
+	 * while the previous frames are still being completed.
+	 */
+	unsigned int maxFramesInFlight_;
+
 private:
+	RPiFrameContext &frame(unsigned int index)
+	{
+		return frames_[(framesHead_ + index) % kMaxFramesInFlight];
+	}
+	RPiFrameContext *ispFrame();
+	RPiFrameContext *ipaFrame();
+	RPiFrameContext *findFrame(const FrameBuffer *bayerBuffer);
+	void pushFrame(const RPiFrameContext &frame);
+	void popFrame();
+
 	void checkRequestCompleted();
 	void tryRunPipeline();
 	void tryFlushQueues();
 	FrameBuffer *updateQueue(std::queue<FrameBuffer *> &q, uint64_t timestamp, V4L2VideoDevice *dev);
 
-	bool dropFrame_;
-	int ispOutputCount_;
+	std::array<RPiFrameContext, kMaxFramesInFlight> frames_;
+	unsigned int framesHead_;
+	unsigned int framesCount_;
+
+	RPiPipelineOccupancy occupancy_;
 };
 
 class RPiCameraConfiguration : public CameraConfiguration
@@ -823,6 +904,23 @@ int PipelineHandlerRPi::start(Camera *camera)
 	data->staggeredCtrl_.write();
 	data->expectedSequence_ = 0;
 
+	/*
+	 * By default frames are processed one at a time. Pipelined operation,
+	 * where the next bayer frame enters the ISP while the previous frames
+	 * are still being processed by the IPA and completed, can be selected
+	 * through the environment.
+	 */
+	const char *framesInFlight = utils::secure_getenv("LIBCAMERA_RPI_FRAMES_IN_FLIGHT");
+	data->maxFramesInFlight_ = 1;
+	if (framesInFlight)
+		data->maxFramesInFlight_ =
+			std::clamp(std::atoi(framesInFlight), 1,
+				   static_cast<int>(kMaxFramesInFlight));
+
+	LOG(RPI, Debug) << "Up to " << data->maxFramesInFlight_
+			<< " frame(s) in flight";
+
+	data->resetFrames();
 	data->state_ = RPiCameraData::State::Idle;
 
 	/* Start all streams. */
@@ -851,6 +949,9 @@ void PipelineHandlerRPi::stop(Camera *camera)
 	data->bayerQueue_ = {};
 	data->embeddedQueue_ = {};
 
+	data->reportOccupancy();
+	data->resetFrames();
+
 	/* Stop the IPA. */
 	data->ipa_->stop();
 
@@ -1218,17 +1319,44 @@ void RPiCameraData::queueFrameAction([[maybe_unused]] unsigned int frame,
 		unsigned int bufferId = action.data[0];
 		FrameBuffer *buffer = isp_[Isp::Stats].getBuffers()->at(bufferId).get();
 
-		handleStreamBuffer(buffer, &isp_[Isp::Stats]);
+		/*
+		 * The IPA processes statistics in frame order, the metadata
+		 * thus belongs to the oldest frame still waiting for it.
+		 */
+		RPiFrameContext *frame = ipaFrame();
+		ASSERT(frame);
+
+		/*
+		 * The IPA hands the statistics buffer to its algorithms
+		 * without copying it, and returns it later with a
+		 * RPI_IPA_ACTION_STATS_RELEASE action if still in use.
+		 */
+		if (action.data[1])
+			handleStreamBuffer(buffer, &isp_[Isp::Stats], frame);
+
 		/* Fill the Request metadata buffer with what the IPA has provided */
-		requestQueue_.front()->metadata() = std::move(action.controls[0]);
-		state_ = State::IpaComplete;
+		if (!frame->dropFrame)
+			frame->request->metadata() = std::move(action.controls[0]);
+
+		frame->ipaComplete = true;
+		Tracer::instant("RPi::statsMetadataComplete", frame->request);
+		utils::duration ipaTime = utils::clock::now() - frame->ipaStart;
+		occupancy_.ipa += ipaTime;
+		statistics_.ipaCompleted(ipaTime);
+		break;
+	}
+
+	case RPI_IPA_ACTION_STATS_RELEASE: {
+		unsigned int bufferId = action.data[0];
+		FrameBuffer *buffer = isp_[Isp::Stats].getBuffers()->at(bufferId).get();
+		handleStreamBuffer(buffer, &isp_[Isp::Stats], nullptr);
 		break;
 	}
 
 	case RPI_IPA_ACTION_EMBEDDED_COMPLETE: {
 		unsigned int bufferId = action.data[0];
 		FrameBuffer *buffer = unicam_[Unicam::Embedded].getBuffers()->at(bufferId).get();
-		handleStreamBuffer(buffer, &unicam_[Unicam::Embedded]);
+		handleStreamBuffer(buffer, &unicam_[Unicam::Embedded], nullptr);
 		break;
 	}
 
@@ -1240,9 +1368,15 @@ void RPiCameraData::queueFrameAction([[maybe_unused]] unsigned int frame,
 		LOG(RPI, Debug) << "Input re-queue to ISP, buffer id " << buffer->cookie()
 				<< ", timestamp: " << buffer->metadata().timestamp;
 
+		RPiFrameContext *frame = ispFrame();
+		ASSERT(frame && frame->bayerBuffer == buffer);
+
+		Tracer::instant("RPi::runIsp", frame->request);
+
 		isp_[Isp::Input].dev()->queueBuffer(buffer);
-		dropFrame_ = (action.operation == RPI_IPA_ACTION_RUN_ISP_AND_DROP_FRAME) ? true : false;
-		ispOutputCount_ = 0;
+		frame->dropFrame = action.operation == RPI_IPA_ACTION_RUN_ISP_AND_DROP_FRAME;
+		frame->ispOutputCount = 0;
+		frame->ispStart = utils::clock::now();
 		break;
 	}
 
@@ -1312,7 +1446,23 @@ void RPiCameraData::ispInputDequeue(FrameBuffer *buffer)
 	if (state_ == State::Stopped)
 		return;
 
-	handleStreamBuffer(buffer, &unicam_[Unicam::Image]);
+	/*
+	 * The frame is only retired once its input buffer has been dequeued,
+	 * but guard against buffers that don't belong to any frame in flight
+	 * by simply requeueing them.
+	 */
+	RPiFrameContext *frame = findFrame(buffer);
+	if (!frame) {
+		LOG(RPI, Warning)
+			<< "ISP input buffer " << buffer->cookie()
+			<< " doesn't match any frame";
+		handleStreamBuffer(buffer, &unicam_[Unicam::Image], nullptr);
+		return;
+	}
+
+	frame->inputComplete = true;
+
+	handleStreamBuffer(buffer, &unicam_[Unicam::Image], frame);
 	handleState();
 }
 
@@ -1337,20 +1487,50 @@ void RPiCameraData::ispOutputDequeue(FrameBuffer *buffer)
 			<< ", buffer id " << buffer->cookie()
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
-	handleStreamBuffer(buffer, stream);
+	RPiFrameContext *frame = ispFrame();
+	ASSERT(frame);
 
 	/*
-	 * Increment the number of ISP outputs generated.
-	 * This is needed to track dropped frames.
+	 * If this is a stats output, hand it to the IPA now. The buffer will
+	 * be returned once the IPA has signalled it is done with it, any other
+	 * ISP output can be handed back straight away.
 	 */
-	ispOutputCount_++;
-
-	/* If this is a stats output, hand it to the IPA now. */
 	if (stream == &isp_[Isp::Stats]) {
+		frame->ipaStart = utils::clock::now();
+
 		IPAOperationData op;
 		op.operation = RPI_IPA_EVENT_SIGNAL_STAT_READY;
 		op.data = { RPiIpaMask::STATS | buffer->cookie() };
+		Tracer::instant("RPi::ipaSignalStatReady", frame->request);
 		ipa_->processEvent(op);
+	} else {
+		handleStreamBuffer(buffer, stream, frame);
+	}
+
+	/*
+	 * Once all the ISP outputs have been generated for the frame the ISP
+	 * is free to process the next one.
+	 */
+	if (++frame->ispOutputCount == 3) {
+		utils::duration ispTime = utils::clock::now() - frame->ispStart;
+		occupancy_.isp += ispTime;
+		frame->ispComplete = true;
+
+		LOG(RPI, Debug)
+			<< "ISP pass complete in "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(ispTime).count()
+			<< "us, " << framesCount_ << " frame(s) in flight";
+
+		/*
+		 * The request of a dropped frame has not been used, give it
+		 * back to the request queue for the next frame.
+		 */
+		if (frame->dropFrame) {
+			requestQueue_.push_front(frame->request);
+			frame->request = nullptr;
+		}
+
+		state_ = State::Idle;
 	}
 
 	handleState();
@@ -1361,7 +1541,8 @@ void RPiCameraData::clearIncompleteRequests()
 	/*
 	 * Queue up any buffers passed in the request.
 	 * This is needed because streamOff() will then mark the buffers as
-	 * cancelled.
+	 * cancelled. Requests of frames in flight have had their buffers
+	 * queued already.
 	 */
 	for (auto const request : requestQueue_) {
 		for (auto const stream : streams_) {
@@ -1374,6 +1555,17 @@ void RPiCameraData::clearIncompleteRequests()
 	for (auto const stream : streams_)
 		stream->dev()->streamOff();
 
+	/*
+	 * Requests of the frames in flight are older than the ones in the
+	 * request queue, move them back to the front of the queue to cancel
+	 * them in order.
+	 */
+	for (unsigned int i = framesCount_; i > 0; --i) {
+		Request *request = frame(i - 1).request;
+		if (request)
+			requestQueue_.push_front(request);
+	}
+
 	/*
 	 * All outstanding requests (and associated buffers) must be returned
 	 * back to the pipeline. The buffers would have been marked as
@@ -1404,10 +1596,13 @@ void RPiCameraData::clearIncompleteRequests()
 	}
 }
 
-void RPiCameraData::handleStreamBuffer(FrameBuffer *buffer, const RPiStream *stream)
+void RPiCameraData::handleStreamBuffer(FrameBuffer *buffer, const RPiStream *stream,
+				       const RPiFrameContext *frame)
 {
+	bool dropFrame = frame && frame->dropFrame;
+
 	if (stream->isExternal()) {
-		if (!dropFrame_) {
+		if (!dropFrame) {
 			Request *request = buffer->request();
 			pipe_->completeBuffer(camera_, request, buffer);
 		}
@@ -1419,9 +1614,9 @@ void RPiCameraData::handleStreamBuffer(FrameBuffer *buffer, const RPiStream *str
 		 * simply memcpy to the Request buffer and requeue back to the
 		 * device.
 		 */
-		if (stream == &unicam_[Unicam::Image] && !dropFrame_) {
+		if (stream == &unicam_[Unicam::Image] && frame && !dropFrame) {
 			const Stream *rawStream = static_cast<const Stream *>(&isp_[Isp::Input]);
-			Request *request = requestQueue_.front();
+			Request *request = frame->request;
 			FrameBuffer *raw = request->findBuffer(const_cast<Stream *>(rawStream));
 			if (raw) {
 				raw->copyFrom(buffer);
@@ -1438,55 +1633,124 @@ void RPiCameraData::handleState()
 {
 	switch (state_) {
 	case State::Stopped:
-	case State::Busy:
 		break;
 
-	case State::IpaComplete:
-		/* If the request is completed, we will switch to Idle state. */
+	case State::Busy:
 		checkRequestCompleted();
-		/*
-		 * No break here, we want to try running the pipeline again.
-		 * The fallthrough clause below suppresses compiler warnings.
-		 */
-		/* Fall through */
+		break;
 
 	case State::Idle:
+		checkRequestCompleted();
 		tryRunPipeline();
 		tryFlushQueues();
 		break;
 	}
 }
 
-void RPiCameraData::checkRequestCompleted()
+void RPiCameraData::resetFrames()
 {
-	bool requestCompleted = false;
-	/*
-	 * If we are dropping this frame, do not touch the request, simply
-	 * change the state to IDLE when ready.
-	 */
-	if (!dropFrame_) {
-		Request *request = requestQueue_.front();
-		if (request->hasPendingBuffers())
-			return;
+	frames_ = {};
+	framesHead_ = 0;
+	framesCount_ = 0;
+	occupancy_.reset(utils::clock::now());
+}
 
-		/* Must wait for metadata to be filled in before completing. */
-		if (state_ != State::IpaComplete)
-			return;
+void RPiCameraData::reportOccupancy() const
+{
+	if (!occupancy_.frames)
+		return;
 
-		pipe_->completeRequest(camera_, request);
-		requestQueue_.pop_front();
-		requestCompleted = true;
+	utils::duration elapsed = occupancy_.lastChange - occupancy_.start;
+	if (elapsed.count() <= 0)
+		return;
+
+	auto percent = [&](const utils::duration &busy) {
+		return 100.0 * busy.count() / elapsed.count();
+	};
+
+	LOG(RPI, Info)
+		<< "Pipeline occupancy over " << occupancy_.frames << " frames: "
+		<< "ISP " << percent(occupancy_.isp) << "%, "
+		<< "IPA " << percent(occupancy_.ipa) << "%, "
+		<< "average frames in flight "
+		<< static_cast<double>(occupancy_.inFlight.count()) / elapsed.count();
+}
+
+RPiFrameContext *RPiCameraData::ispFrame()
+{
+	if (state_ != State::Busy || !framesCount_)
+		return nullptr;
+
+	return &frame(framesCount_ - 1);
+}
+
+RPiFrameContext *RPiCameraData::ipaFrame()
+{
+	for (unsigned int i = 0; i < framesCount_; ++i) {
+		RPiFrameContext &f = frame(i);
+		if (!f.ipaComplete)
+			return &f;
 	}
 
+	return nullptr;
+}
+
+RPiFrameContext *RPiCameraData::findFrame(const FrameBuffer *bayerBuffer)
+{
+	for (unsigned int i = framesCount_; i > 0; --i) {
+		RPiFrameContext &f = frame(i - 1);
+		if (f.bayerBuffer == bayerBuffer)
+			return &f;
+	}
+
+	return nullptr;
+}
+
+void RPiCameraData::pushFrame(const RPiFrameContext &context)
+{
+	ASSERT(framesCount_ < kMaxFramesInFlight);
+
+	frame(framesCount_++) = context;
+	occupancy_.framesInFlightChanged(utils::clock::now(), framesCount_);
+}
+
+void RPiCameraData::popFrame()
+{
+	ASSERT(framesCount_);
+
+	framesHead_ = (framesHead_ + 1) % kMaxFramesInFlight;
+	framesCount_--;
+	occupancy_.frames++;
+	occupancy_.framesInFlightChanged(utils::clock::now(), framesCount_);
+}
+
+void RPiCameraData::checkRequestCompleted()
+{
 	/*
-	 * Make sure we have three outputs completed in the case of a dropped
-	 * frame.
+	 * Frames complete in order. A frame is done once the ISP has consumed
+	 * its input buffer and produced all its outputs, and the IPA has
+	 * provided its metadata. This applies to dropped frames too, as the
+	 * input buffer is looked up in the frames in flight when dequeued.
 	 */
-	if (state_ == State::IpaComplete &&
-	    ((ispOutputCount_ == 3 && dropFrame_) || requestCompleted)) {
-		state_ = State::Idle;
-		if (dropFrame_)
+	while (framesCount_) {
+		RPiFrameContext &f = frame(0);
+		if (!f.inputComplete || !f.ispComplete || !f.ipaComplete)
+			break;
+
+		/*
+		 * If we are dropping this frame, do not touch the request, it
+		 * has been given back to the request queue already.
+		 */
+		if (!f.dropFrame) {
+			if (f.request->hasPendingBuffers())
+				break;
+
+			pipe_->completeRequest(camera_, f.request);
+		} else {
 			LOG(RPI, Info) << "Dropping frame at the request of the IPA";
+		}
+
+		popFrame();
 	}
 }
 
@@ -1495,9 +1759,12 @@ void RPiCameraData::tryRunPipeline()
 	FrameBuffer *bayerBuffer, *embeddedBuffer;
 	IPAOperationData op;
 
-	/* If any of our request or buffer queues are empty, we cannot proceed. */
-	if (state_ != State::Idle || requestQueue_.empty() ||
-	    bayerQueue_.empty() || embeddedQueue_.empty())
+	/*
+	 * If the ISP is busy, the frame ring is full, or any of our request or
+	 * buffer queues are empty, we cannot proceed.
+	 */
+	if (state_ != State::Idle || framesCount_ >= maxFramesInFlight_ ||
+	    requestQueue_.empty() || bayerQueue_.empty() || embeddedQueue_.empty())
 		return;
 
 	/* Start with the front of the bayer buffer queue. */
@@ -1550,6 +1817,7 @@ void RPiCameraData::tryRunPipeline()
 	 */
 	op.operation = RPI_IPA_EVENT_QUEUE_REQUEST;
 	op.controls = { request->controls() };
+	Tracer::instant("RPi::ipaQueueRequest", request);
 	ipa_->processEvent(op);
 
 	/* Queue up any ISP buffers passed into the request. */
@@ -1561,8 +1829,15 @@ void RPiCameraData::tryRunPipeline()
 	/* Ready to use the buffers, pop them off the queue. */
 	bayerQueue_.pop();
 	embeddedQueue_.pop();
+	requestQueue_.pop_front();
+
+	/* Track the frame until its request completes. */
+	RPiFrameContext context = {};
+	context.request = request;
+	context.bayerBuffer = bayerBuffer;
+	pushFrame(context);
 
-	/* Set our state to say the pipeline is active. */
+	/* Set our state to say the ISP is active. */
 	state_ = State::Busy;
 
 	LOG(RPI, Debug) << "Signalling RPI_IPA_EVENT_SIGNAL_ISP_PREPARE:"
@@ -1572,6 +1847,7 @@ void RPiCameraData::tryRunPipeline()
 	op.operation = RPI_IPA_EVENT_SIGNAL_ISP_PREPARE;
 	op.data = { RPiIpaMask::EMBEDDED_DATA | embeddedBuffer->cookie(),
 		    RPiIpaMask::BAYER_DATA | bayerBuffer->cookie() };
+	Tracer::instant("RPi::ipaSignalIspPrepare", request);
 	ipa_->processEvent(op);
 }
 
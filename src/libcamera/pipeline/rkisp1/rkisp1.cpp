@@ -27,6 +27,7 @@
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 #include "libcamera/internal/v4l2_subdevice.h"
 #include "libcamera/internal/v4l2_videodevice.h"
@@ -57,6 +58,8 @@ struct RkISP1FrameInfo {
 	bool paramFilled;
 	bool paramDequeued;
 	bool metadataProcessed;
+
+	utils::time_point ipaStart;
 };
 
 class RkISP1Frames
@@ -423,8 +426,10 @@ void RkISP1CameraData::queueFrameAction(unsigned int frame,
 	}
 	case RKISP1_IPA_ACTION_PARAM_FILLED: {
 		RkISP1FrameInfo *info = frameInfo_.find(frame);
-		if (info)
+		if (info) {
 			info->paramFilled = true;
+			Tracer::instant("RkISP1::paramFilled", info->request);
+		}
 		break;
 	}
 	case RKISP1_IPA_ACTION_METADATA:
@@ -448,6 +453,9 @@ void RkISP1CameraData::metadataReady(unsigned int frame, const ControlList &meta
 	info->request->metadata() = metadata;
 	info->metadataProcessed = true;
 
+	statistics_.ipaCompleted(utils::clock::now() - info->ipaStart);
+	Tracer::instant("RkISP1::metadataReady", info->request);
+
 	pipe->tryCompleteRequest(info->request);
 }
 
@@ -908,6 +916,7 @@ int PipelineHandlerRkISP1::queueRequestDevice(Camera *camera,
 	op.operation = RKISP1_IPA_EVENT_QUEUE_REQUEST;
 	op.data = { data->frame_, info->paramBuffer->cookie() };
 	op.controls = { request->controls() };
+	Tracer::instant("RkISP1::ipaQueueRequest", request);
 	data->ipa_->processEvent(op);
 
 	data->timeline_.scheduleAction(std::make_unique<RkISP1ActionQueueBuffers>(data->frame_,
@@ -925,22 +934,11 @@ int PipelineHandlerRkISP1::queueRequestDevice(Camera *camera,
 
 int PipelineHandlerRkISP1::initLinks()
 {
-	MediaLink *link;
-	int ret;
-
-	ret = media_->disableLinks();
-	if (ret < 0)
-		return ret;
-
-	link = media_->link("rkisp1_isp", 2, "rkisp1_resizer_mainpath", 0);
+	MediaLink *link = media_->link("rkisp1_isp", 2, "rkisp1_resizer_mainpath", 0);
 	if (!link)
 		return -ENODEV;
 
-	ret = link->setEnabled(true);
-	if (ret < 0)
-		return ret;
-
-	return 0;
+	return media_->setupLinks({ link });
 }
 
 int PipelineHandlerRkISP1::createCamera(MediaEntity *sensor)
@@ -1115,6 +1113,8 @@ void PipelineHandlerRkISP1::statReady(FrameBuffer *buffer)
 	IPAOperationData op;
 	op.operation = RKISP1_IPA_EVENT_SIGNAL_STAT_BUFFER;
 	op.data = { info->frame, info->statBuffer->cookie() };
+	info->ipaStart = utils::clock::now();
+	Tracer::instant("RkISP1::ipaSignalStatBuffer", info->request);
 	data->ipa_->processEvent(op);
 }
 
@@ -29,6 +29,7 @@
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/v4l2_subdevice.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
@@ -911,6 +912,7 @@ void SimplePipelineHandler::bufferReady(FrameBuffer *buffer)
 		FrameBuffer *output = converterQueue_.front();
 		converterQueue_.pop();
 
+		Tracer::instant("Simple::queueConverter", output->request());
 		converter_->queueBuffers(buffer, output);
 		return;
 	}
@@ -929,6 +931,7 @@ void SimplePipelineHandler::converterDone(FrameBuffer *input,
 
 	/* Complete the request. */
 	Request *request = output->request();
+	Tracer::instant("Simple::converterDone", request);
 	completeBuffer(activeCamera_, request, output);
 	completeRequest(activeCamera_, request);
 
@@ -448,15 +448,11 @@ int VimcCameraData::init()
 {
 	int ret;
 
-	ret = media_->disableLinks();
-	if (ret < 0)
-		return ret;
-
 	MediaLink *link = media_->link("Debayer B", 1, "Scaler", 0);
 	if (!link)
 		return -ENODEV;
 
-	ret = link->setEnabled(true);
+	ret = media_->setupLinks({ link });
 	if (ret < 0)
 		return ret;
 
@@ -0,0 +1,786 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * virtual.cpp - Pipeline handler for virtual cameras
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/camera.h>
+#include <libcamera/camera_manager.h>
+#include <libcamera/formats.h>
+#include <libcamera/property_ids.h>
+#include <libcamera/request.h>
+#include <libcamera/stream.h>
+#include <libcamera/timer.h>
+
+#include "libcamera/internal/buffer.h"
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/thread.h"
+#include "libcamera/internal/tracer.h"
+#include "libcamera/internal/utils.h"
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Virtual)
+
+namespace {
+
+constexpr unsigned int kMaxCameras = 16;
+constexpr unsigned int kMaxStreams = 4;
+constexpr Size kMinSize{ 16, 16 };
+constexpr Size kMaxSize{ 8192, 8192 };
+
+/*
+ * Virtual cameras are configured through the LIBCAMERA_VIRTUAL environment
+ * variable, as a comma-separated list of key=value pairs:
+ *
+ * - cameras: number of cameras (default 1)
+ * - streams: number of streams per camera (default 1)
+ * - size: default stream resolution, as WxH (default 1280x720)
+ * - fps: frame rate (default 30)
+ * - ipa-latency: simulated IPA processing time per frame in ms (default 0)
+ */
+struct VirtualConfig {
+	unsigned int cameras = 1;
+	unsigned int streams = 1;
+	Size size{ 1280, 720 };
+	unsigned int fps = 30;
+	unsigned int ipaLatency = 0;
+};
+
+bool parseUInt(const std::string &value, unsigned int min, unsigned int max,
+	       unsigned int *result)
+{
+	char *end;
+
+	errno = 0;
+	unsigned long number = strtoul(value.c_str(), &end, 10);
+	if (errno || value.empty() || *end != '\0' || number < min || number > max)
+		return false;
+
+	*result = number;
+	return true;
+}
+
+bool parseConfig(const std::string &config, VirtualConfig *result)
+{
+	for (const std::string &option : utils::split(config, ",")) {
+		if (option.empty())
+			continue;
+
+		std::string::size_type pos = option.find('=');
+		std::string key = option.substr(0, pos);
+		std::string value = pos != std::string::npos ? option.substr(pos + 1) : "";
+		bool valid;
+
+		if (key == "cameras") {
+			valid = parseUInt(value, 1, kMaxCameras, &result->cameras);
+		} else if (key == "streams") {
+			valid = parseUInt(value, 1, kMaxStreams, &result->streams);
+		} else if (key == "size") {
+			pos = value.find('x');
+			valid = pos != std::string::npos &&
+				parseUInt(value.substr(0, pos), kMinSize.width,
+					  kMaxSize.width, &result->size.width) &&
+				parseUInt(value.substr(pos + 1), kMinSize.height,
+					  kMaxSize.height, &result->size.height);
+			result->size = result->size.alignedDownTo(2, 2);
+		} else if (key == "fps") {
+			valid = parseUInt(value, 1, 1000, &result->fps);
+		} else if (key == "ipa-latency") {
+			valid = parseUInt(value, 0, 1000, &result->ipaLatency);
+		} else {
+			LOG(Virtual, Error) << "Unknown option '" << key << "'";
+			return false;
+		}
+
+		if (!valid) {
+			LOG(Virtual, Error)
+				<< "Invalid value '" << value << "' for option '"
+				<< key << "'";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void formatLayout(const StreamConfiguration &cfg, unsigned int *stride,
+		  unsigned int *frameSize)
+{
+	if (cfg.pixelFormat == formats::NV12) {
+		*stride = cfg.size.width;
+		*frameSize = *stride * cfg.size.height * 3 / 2;
+	} else {
+		*stride = cfg.size.width * 4;
+		*frameSize = *stride * cfg.size.height;
+	}
+}
+
+} /* namespace */
+
+class PipelineHandlerVirtual;
+class VirtualCameraData;
+
+/*
+ * Precomputed test pattern for a stream. Each plane stores a single line of
+ * colour bars, twice the width of the image, from which all rows of a frame
+ * are copied at a horizontal offset that moves with the frame sequence.
+ */
+struct VirtualPattern {
+	const Stream *stream;
+	PixelFormat pixelFormat;
+	Size size;
+	unsigned int stride;
+	std::vector<std::vector<uint8_t>> lines;
+};
+
+class VirtualFrameGenerator : public Object
+{
+public:
+	VirtualFrameGenerator(PipelineHandlerVirtual *pipe,
+			      VirtualCameraData *data);
+
+	void start(unsigned int epoch);
+	void stop();
+
+	void queueRequest(Request *request);
+	void queueRequests(const std::vector<Request *> &requests);
+
+private:
+	void createPattern(const Stream *stream);
+	void render(const VirtualPattern &pattern, FrameBuffer *buffer);
+	void frame(Timer *timer);
+
+	PipelineHandlerVirtual *pipe_;
+	VirtualCameraData *data_;
+
+	Timer timer_;
+	std::chrono::steady_clock::time_point next_;
+	std::chrono::nanoseconds interval_;
+
+	unsigned int epoch_;
+	uint32_t sequence_;
+
+	std::deque<Request *> requests_;
+	std::vector<VirtualPattern> patterns_;
+	std::map<const FrameBuffer *, std::unique_ptr<MappedFrameBuffer>> mappings_;
+};
+
+class VirtualIPA : public Object
+{
+public:
+	VirtualIPA(PipelineHandlerVirtual *pipe, VirtualCameraData *data,
+		   std::chrono::milliseconds latency)
+		: pipe_(pipe), data_(data), latency_(latency)
+	{
+	}
+
+	void processFrame(Request *request, unsigned int epoch,
+			  uint32_t sequence, uint64_t timestamp);
+
+private:
+	PipelineHandlerVirtual *pipe_;
+	VirtualCameraData *data_;
+	std::chrono::milliseconds latency_;
+};
+
+class VirtualCameraData : public CameraData
+{
+public:
+	VirtualCameraData(PipelineHandlerVirtual *pipe, const VirtualConfig &config);
+	~VirtualCameraData();
+
+	VirtualConfig config_;
+	std::vector<Stream> streams_;
+	std::vector<const Stream *> activeStreams_;
+
+	/* Incremented on start and stop to discard frames from past sessions. */
+	unsigned int epoch_;
+	std::deque<Request *> inflight_;
+
+	Thread thread_;
+	VirtualFrameGenerator *generator_;
+
+	Thread ipaThread_;
+	VirtualIPA *ipa_;
+};
+
+class VirtualCameraConfiguration : public CameraConfiguration
+{
+public:
+	VirtualCameraConfiguration(VirtualCameraData *data);
+
+	Status validate() override;
+
+private:
+	VirtualCameraData *data_;
+};
+
+class PipelineHandlerVirtual : public PipelineHandler
+{
+public:
+	PipelineHandlerVirtual(CameraManager *manager);
+
+	CameraConfiguration *generateConfiguration(Camera *camera,
+		const StreamRoles &roles) override;
+	int configure(Camera *camera, CameraConfiguration *config) override;
+
+	int exportFrameBuffers(Camera *camera, Stream *stream,
+			       std::vector<std::unique_ptr<FrameBuffer>> *buffers) override;
+
+	int start(Camera *camera) override;
+	void stop(Camera *camera) override;
+
+	int queueRequestDevice(Camera *camera, Request *request) override;
+	unsigned int queueRequestsDevice(Camera *camera,
+					 Span<Request *const> requests) override;
+
+	bool match(DeviceEnumerator *enumerator) override;
+
+	void frameComplete(VirtualCameraData *data, Request *request,
+			   unsigned int epoch, uint32_t sequence,
+			   uint64_t timestamp, utils::duration ipaLatency);
+
+private:
+	VirtualCameraData *cameraData(const Camera *camera)
+	{
+		return static_cast<VirtualCameraData *>(
+			PipelineHandler::cameraData(camera));
+	}
+};
+
+VirtualFrameGenerator::VirtualFrameGenerator(PipelineHandlerVirtual *pipe,
+					     VirtualCameraData *data)
+	: pipe_(pipe), data_(data), timer_(this), epoch_(0), sequence_(0)
+{
+	timer_.timeout.connect(this, &VirtualFrameGenerator::frame);
+}
+
+void VirtualFrameGenerator::start(unsigned int epoch)
+{
+	epoch_ = epoch;
+	sequence_ = 0;
+
+	patterns_.clear();
+	for (const Stream *stream : data_->activeStreams_)
+		createPattern(stream);
+
+	interval_ = std::chrono::nanoseconds(std::chrono::seconds(1)) / data_->config_.fps;
+	next_ = std::chrono::steady_clock::now() + interval_;
+	timer_.start(next_);
+}
+
+void VirtualFrameGenerator::stop()
+{
+	timer_.stop();
+	requests_.clear();
+	mappings_.clear();
+}
+
+void VirtualFrameGenerator::queueRequest(Request *request)
+{
+	requests_.push_back(request);
+}
+
+void VirtualFrameGenerator::queueRequests(const std::vector<Request *> &requests)
+{
+	requests_.insert(requests_.end(), requests.begin(), requests.end());
+}
+
+void VirtualFrameGenerator::createPattern(const Stream *stream)
+{
+	/* 75% colour bars: white, yellow, cyan, green, magenta, red, blue, black. */
+	static constexpr std::array<std::array<unsigned int, 3>, 8> bars{ {
+		{ 191, 191, 191 }, { 191, 191, 0 }, { 0, 191, 191 }, { 0, 191, 0 },
+		{ 191, 0, 191 }, { 191, 0, 0 }, { 0, 0, 191 }, { 0, 0, 0 },
+	} };
+
+	const StreamConfiguration &cfg = stream->configuration();
+
+	VirtualPattern pattern;
+	pattern.stream = stream;
+	pattern.pixelFormat = cfg.pixelFormat;
+	pattern.size = cfg.size;
+	pattern.stride = cfg.stride;
+
+	unsigned int width = cfg.size.width;
+
+	if (cfg.pixelFormat == formats::NV12) {
+		std::vector<uint8_t> luma(width * 2);
+		std::vector<uint8_t> chroma(width * 2);
+
+		for (unsigned int x = 0; x < width * 2; ++x) {
+			const auto &rgb = bars[(x % width) * bars.size() / width];
+			int r = rgb[0], g = rgb[1], b = rgb[2];
+
+			/* BT.601 limited range. */
+			luma[x] = 16 + ((66 * r + 129 * g + 25 * b + 128) >> 8);
+			if (x % 2 == 0)
+				chroma[x] = 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+			else
+				chroma[x] = 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+		}
+
+		pattern.lines.push_back(std::move(luma));
+		pattern.lines.push_back(std::move(chroma));
+	} else {
+		std::vector<uint8_t> line(width * 2 * 4);
+
+		for (unsigned int x = 0; x < width * 2; ++x) {
+			const auto &rgb = bars[(x % width) * bars.size() / width];
+			line[x * 4 + 0] = rgb[2];
+			line[x * 4 + 1] = rgb[1];
+			line[x * 4 + 2] = rgb[0];
+			line[x * 4 + 3] = 0xff;
+		}
+
+		pattern.lines.push_back(std::move(line));
+	}
+
+	patterns_.push_back(std::move(pattern));
+}
+
+void VirtualFrameGenerator::render(const VirtualPattern &pattern,
+				   FrameBuffer *buffer)
+{
+	auto iter = mappings_.find(buffer);
+	if (iter == mappings_.end()) {
+		/*
+		 * Buffers are mapped once per capture session. Virtual buffers
+		 * are memfds or dmabufs not written by any device, no cache
+		 * synchronization is needed.
+		 */
+		auto mapped = std::make_unique<MappedFrameBuffer>(buffer, PROT_READ | PROT_WRITE);
+		if (!mapped->isValid()) {
+			LOG(Virtual, Error) << "Failed to map buffer";
+			return;
+		}
+
+		iter = mappings_.emplace(buffer, std::move(mapped)).first;
+	}
+
+	const std::vector<MappedBuffer::Plane> &planes = iter->second->planes();
+	const unsigned int bpp = pattern.pixelFormat == formats::NV12 ? 1 : 4;
+	const unsigned int width = pattern.size.width;
+
+	/* Scroll the bars by 4 pixels per frame, keeping chroma aligned. */
+	const unsigned int offset = ((sequence_ * 4) % width) & ~1U;
+
+	/*
+	 * Externally allocated NV12 buffers may store both planes
+	 * contiguously in a single FrameBuffer plane.
+	 */
+	Span<uint8_t> mem = planes[0];
+
+	for (unsigned int i = 0; i < pattern.lines.size(); ++i) {
+		const uint8_t *src = pattern.lines[i].data() + offset * bpp;
+		unsigned int rows = i == 0 ? pattern.size.height : pattern.size.height / 2;
+		size_t size = pattern.stride * (rows - 1) + width * bpp;
+
+		if (i && i < planes.size())
+			mem = planes[i];
+
+		if (mem.size() < size) {
+			LOG(Virtual, Error) << "Buffer too small";
+			return;
+		}
+
+		for (unsigned int y = 0; y < rows; ++y)
+			memcpy(mem.data() + y * pattern.stride, src, width * bpp);
+
+		if (pattern.stride * rows < mem.size())
+			mem = mem.subspan(pattern.stride * rows);
+	}
+}
+
+void VirtualFrameGenerator::frame([[maybe_unused]] Timer *timer)
+{
+	auto now = std::chrono::steady_clock::now();
+
+	/*
+	 * Frames whose deadline has been missed are skipped and accounted for
+	 * as sequence gaps, as a sensor would drop them.
+	 */
+	while (next_ + interval_ <= now) {
+		next_ += interval_;
+		sequence_++;
+	}
+
+	uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		next_.time_since_epoch()).count();
+	uint32_t sequence = sequence_++;
+
+	next_ += interval_;
+	timer_.start(next_);
+
+	/* Without a queued request the frame is dropped. */
+	if (requests_.empty())
+		return;
+
+	Request *request = requests_.front();
+	requests_.pop_front();
+
+	Tracer::instant("Virtual::frame", request);
+
+	for (const VirtualPattern &pattern : patterns_) {
+		FrameBuffer *buffer = request->findBuffer(pattern.stream);
+		if (buffer)
+			render(pattern, buffer);
+	}
+
+	if (data_->ipa_)
+		data_->ipa_->invokeMethod(&VirtualIPA::processFrame,
+					  ConnectionTypeQueued, request, epoch_,
+					  sequence, timestamp);
+	else
+		pipe_->invokeMethod(&PipelineHandlerVirtual::frameComplete,
+				    ConnectionTypeQueued, data_, request, epoch_,
+				    sequence, timestamp, utils::duration::zero());
+}
+
+void VirtualIPA::processFrame(Request *request, unsigned int epoch,
+			      uint32_t sequence, uint64_t timestamp)
+{
+	utils::time_point start = utils::clock::now();
+
+	/* Simulate the processing time of statistics and algorithms. */
+	std::this_thread::sleep_for(latency_);
+
+	pipe_->invokeMethod(&PipelineHandlerVirtual::frameComplete,
+			    ConnectionTypeQueued, data_, request, epoch,
+			    sequence, timestamp, utils::clock::now() - start);
+}
+
+VirtualCameraData::VirtualCameraData(PipelineHandlerVirtual *pipe,
+				     const VirtualConfig &config)
+	: CameraData(pipe), config_(config), streams_(config.streams),
+	  epoch_(0), ipa_(nullptr)
+{
+	generator_ = new VirtualFrameGenerator(pipe, this);
+	generator_->moveToThread(&thread_);
+	thread_.setRole(ThreadPolicy::RolePipeline);
+	thread_.start();
+
+	if (config_.ipaLatency) {
+		ipa_ = new VirtualIPA(pipe, this,
+				      std::chrono::milliseconds(config_.ipaLatency));
+		ipa_->moveToThread(&ipaThread_);
+		ipaThread_.setRole(ThreadPolicy::RoleIPA);
+		ipaThread_.start();
+	}
+
+	properties_.set(properties::Location, properties::CameraLocationExternal);
+	properties_.set(properties::PixelArraySize, config_.size);
+}
+
+VirtualCameraData::~VirtualCameraData()
+{
+	generator_->invokeMethod(&VirtualFrameGenerator::stop,
+				 ConnectionTypeBlocking);
+
+	thread_.exit();
+	thread_.wait();
+	delete generator_;
+
+	if (ipa_) {
+		ipaThread_.exit();
+		ipaThread_.wait();
+		delete ipa_;
+	}
+}
+
+VirtualCameraConfiguration::VirtualCameraConfiguration(VirtualCameraData *data)
+	: CameraConfiguration(), data_(data)
+{
+}
+
+CameraConfiguration::Status VirtualCameraConfiguration::validate()
+{
+	Status status = Valid;
+
+	if (config_.empty())
+		return Invalid;
+
+	/* Cap the number of entries to the available streams. */
+	if (config_.size() > data_->streams_.size()) {
+		config_.resize(data_->streams_.size());
+		status = Adjusted;
+	}
+
+	for (StreamConfiguration &cfg : config_) {
+		if (cfg.pixelFormat != formats::NV12 &&
+		    cfg.pixelFormat != formats::ARGB8888) {
+			LOG(Virtual, Debug) << "Adjusting format to NV12";
+			cfg.pixelFormat = formats::NV12;
+			status = Adjusted;
+		}
+
+		const Size size = cfg.size;
+		cfg.size = cfg.size.boundedTo(kMaxSize).expandedTo(kMinSize)
+				  .alignedDownTo(2, 2);
+		if (cfg.size != size) {
+			LOG(Virtual, Debug)
+				<< "Adjusting size to " << cfg.size.toString();
+			status = Adjusted;
+		}
+
+		if (!cfg.bufferCount)
+			cfg.bufferCount = 4;
+
+		formatLayout(cfg, &cfg.stride, &cfg.frameSize);
+	}
+
+	return status;
+}
+
+PipelineHandlerVirtual::PipelineHandlerVirtual(CameraManager *manager)
+	: PipelineHandler(manager)
+{
+}
+
+CameraConfiguration *PipelineHandlerVirtual::generateConfiguration(Camera *camera,
+	const StreamRoles &roles)
+{
+	VirtualCameraData *data = cameraData(camera);
+	CameraConfiguration *config = new VirtualCameraConfiguration(data);
+
+	if (roles.empty())
+		return config;
+
+	std::map<PixelFormat, std::vector<SizeRange>> formats;
+	for (const PixelFormat &format : { formats::NV12, formats::ARGB8888 })
+		formats[format] = { SizeRange{ kMinSize, kMaxSize } };
+
+	for (const StreamRole role : roles) {
+		StreamConfiguration cfg(formats);
+		cfg.pixelFormat = role == StreamRole::Viewfinder
+				? formats::ARGB8888 : formats::NV12;
+		cfg.size = data->config_.size;
+		cfg.bufferCount = 4;
+
+		config->addConfiguration(cfg);
+	}
+
+	config->validate();
+
+	return config;
+}
+
+int PipelineHandlerVirtual::configure(Camera *camera, CameraConfiguration *config)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	data->activeStreams_.clear();
+
+	for (unsigned int i = 0; i < config->size(); ++i) {
+		config->at(i).setStream(&data->streams_[i]);
+		data->activeStreams_.push_back(&data->streams_[i]);
+	}
+
+	return 0;
+}
+
+int PipelineHandlerVirtual::exportFrameBuffers([[maybe_unused]] Camera *camera,
+					       Stream *stream,
+					       std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	const StreamConfiguration &cfg = stream->configuration();
+	unsigned int count = cfg.bufferCount;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		int fd = memfd_create("libcamera-virtual", MFD_CLOEXEC);
+		if (fd < 0) {
+			int ret = -errno;
+			LOG(Virtual, Error)
+				<< "Failed to create memfd: " << strerror(-ret);
+			return ret;
+		}
+
+		FileDescriptor memfd(std::move(fd));
+
+		if (ftruncate(memfd.fd(), cfg.frameSize) < 0) {
+			int ret = -errno;
+			LOG(Virtual, Error)
+				<< "Failed to resize memfd: " << strerror(-ret);
+			return ret;
+		}
+
+		std::vector<FrameBuffer::Plane> planes;
+		if (cfg.pixelFormat == formats::NV12) {
+			unsigned int lumaSize = cfg.stride * cfg.size.height;
+
+			FrameBuffer::Plane plane;
+			plane.fd = memfd;
+			plane.offset = 0;
+			plane.length = lumaSize;
+			planes.push_back(plane);
+
+			plane.offset = lumaSize;
+			plane.length = cfg.frameSize - lumaSize;
+			planes.push_back(plane);
+		} else {
+			FrameBuffer::Plane plane;
+			plane.fd = memfd;
+			plane.offset = 0;
+			plane.length = cfg.frameSize;
+			planes.push_back(plane);
+		}
+
+		buffers->push_back(std::make_unique<FrameBuffer>(planes));
+	}
+
+	return count;
+}
+
+int PipelineHandlerVirtual::start(Camera *camera)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	data->epoch_++;
+	data->generator_->invokeMethod(&VirtualFrameGenerator::start,
+				       ConnectionTypeBlocking, data->epoch_);
+
+	return 0;
+}
+
+void PipelineHandlerVirtual::stop(Camera *camera)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	data->generator_->invokeMethod(&VirtualFrameGenerator::stop,
+				       ConnectionTypeBlocking);
+
+	/* Frames still in flight in the IPA or message queues are now stale. */
+	data->epoch_++;
+
+	while (!data->inflight_.empty()) {
+		Request *request = data->inflight_.front();
+		data->inflight_.pop_front();
+
+		for (auto it : request->buffers()) {
+			FrameBuffer *buffer = it.second;
+			buffer->metadata_.status = FrameMetadata::FrameCancelled;
+			completeBuffer(camera, request, buffer);
+		}
+
+		completeRequest(camera, request);
+	}
+}
+
+int PipelineHandlerVirtual::queueRequestDevice(Camera *camera, Request *request)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	data->inflight_.push_back(request);
+	data->generator_->invokeMethod(&VirtualFrameGenerator::queueRequest,
+				       ConnectionTypeQueued, request);
+
+	return 0;
+}
+
+unsigned int PipelineHandlerVirtual::queueRequestsDevice(Camera *camera,
+							Span<Request *const> requests)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	/* Hand the whole batch to the generator thread in a single message. */
+	data->inflight_.insert(data->inflight_.end(), requests.begin(),
+			       requests.end());
+	data->generator_->invokeMethod(&VirtualFrameGenerator::queueRequests,
+				       ConnectionTypeQueued,
+				       std::vector<Request *>(requests.begin(),
+							      requests.end()));
+
+	return requests.size();
+}
+
+void PipelineHandlerVirtual::frameComplete(VirtualCameraData *data,
+					   Request *request, unsigned int epoch,
+					   uint32_t sequence, uint64_t timestamp,
+					   utils::duration ipaLatency)
+{
+	/* The request has been cancelled by stop(). */
+	if (epoch != data->epoch_)
+		return;
+
+	auto iter = std::find(data->inflight_.begin(), data->inflight_.end(),
+			      request);
+	if (iter == data->inflight_.end())
+		return;
+	data->inflight_.erase(iter);
+
+	if (data->ipa_)
+		data->statistics_.ipaCompleted(ipaLatency);
+
+	for (auto it : request->buffers()) {
+		FrameBuffer *buffer = it.second;
+		FrameMetadata &metadata = buffer->metadata_;
+
+		metadata.status = FrameMetadata::FrameSuccess;
+		metadata.sequence = sequence;
+		metadata.timestamp = timestamp;
+		metadata.planes.clear();
+		for (const FrameBuffer::Plane &plane : buffer->planes())
+			metadata.planes.push_back({ plane.length });
+
+		completeBuffer(data->camera_, request, buffer);
+	}
+
+	completeRequest(data->camera_, request);
+}
+
+bool PipelineHandlerVirtual::match([[maybe_unused]] DeviceEnumerator *enumerator)
+{
+	const char *env = utils::secure_getenv("LIBCAMERA_VIRTUAL");
+	if (!env)
+		return false;
+
+	/*
+	 * Virtual cameras don't depend on any device, create them once only,
+	 * when the pipeline handlers are first matched.
+	 */
+	if (manager_->get("virtual/0"))
+		return false;
+
+	VirtualConfig config;
+	if (!parseConfig(env, &config))
+		return false;
+
+	for (unsigned int i = 0; i < config.cameras; ++i) {
+		std::unique_ptr<VirtualCameraData> data =
+			std::make_unique<VirtualCameraData>(this, config);
+
+		std::set<Stream *> streams;
+		for (Stream &stream : data->streams_)
+			streams.insert(&stream);
+
+		std::shared_ptr<Camera> camera =
+			Camera::create(this, "virtual/" + std::to_string(i), streams);
+		registerCamera(std::move(camera), std::move(data));
+	}
+
+	LOG(Virtual, Info)
+		<< "Created " << config.cameras << " virtual camera(s) with "
+		<< config.streams << " stream(s) at " << config.fps << " fps";
+
+	return true;
+}
+
+REGISTER_PIPELINE_HANDLER(PipelineHandlerVirtual);
+
+} /* namespace libcamera */
@@ -7,6 +7,7 @@
 
 #include "libcamera/internal/pipeline_handler.h"
 
+#include <string.h>
 #include <sys/sysmacros.h>
 
 #include <libcamera/buffer.h>
@@ -16,6 +17,7 @@
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 
 /**
@@ -81,15 +83,46 @@ LOG_DEFINE_CATEGORY(Pipeline)
 
 /**
  * \var CameraData::queuedRequests_
- * \brief The list of queued and not yet completed request
+ * \brief The queued and not yet delivered requests, indexed by sequence
  *
- * The list of queued request is used to track requests queued in order to
- * ensure completion of all requests when the pipeline handler is stopped.
+ * The queued requests are used to track requests queued in order to ensure
+ * completion of all requests when the pipeline handler is stopped, and to
+ * deliver them to the application in submission order.
+ *
+ * Requests are stored by increasing sequence number, the entry for a request
+ * is located at the index computed as the difference between its sequence
+ * number and the sequence number of the request at the front. When requests
+ * are delivered out of order, the entries of the delivered requests are set to
+ * nullptr until all the entries before them have been released.
  *
  * \sa PipelineHandler::queueRequest(), PipelineHandler::stop(),
  * PipelineHandler::completeRequest()
  */
 
+/**
+ * \var CameraData::recycledRequests_
+ * \brief The completed requests dropped by the Camera::QueueingDropOldest
+ * policy and waiting to be queued again
+ *
+ * \sa PipelineHandler::requeueRequests()
+ */
+
+/**
+ * \var CameraData::requestSequence_
+ * \brief The sequence number to assign to the next queued request
+ *
+ * \sa Request::sequence()
+ */
+
+/**
+ * \var CameraData::deliveredSequence_
+ * \brief The sequence number following the last request delivered to the
+ * application with the Camera::QueueingDropOldest policy
+ *
+ * Completed requests with a lower sequence number are stale and are queued
+ * again instead of being delivered.
+ */
+
 /**
  * \var CameraData::controlInfo_
  * \brief The set of controls supported by the camera
@@ -274,6 +307,33 @@ const ControlList &PipelineHandler::properties(const Camera *camera) const
 	return data->properties_;
 }
 
+/**
+ * \brief Retrieve a snapshot of the runtime statistics of a camera
+ * \param[in] camera The camera
+ * \context This function is \threadsafe, except concurrently with
+ * resetStatistics().
+ * \return The statistics of \a camera
+ */
+CameraStatistics PipelineHandler::statistics(const Camera *camera) const
+{
+	const CameraData *data = cameraData(camera);
+	return data->statistics_.snapshot();
+}
+
+/**
+ * \brief Reset the runtime statistics of a camera
+ * \param[in] camera The camera
+ * \param[in] streams The streams for which to collect per-stream statistics
+ *
+ * This function shall not be called while the camera is running.
+ */
+void PipelineHandler::resetStatistics(const Camera *camera,
+				      const std::set<const Stream *> &streams)
+{
+	CameraData *data = cameraData(camera);
+	data->statistics_.reset(streams);
+}
+
 /**
  * \fn PipelineHandler::generateConfiguration()
  * \brief Generate a camera configuration for a specified camera
@@ -380,8 +440,9 @@ const ControlList &PipelineHandler::properties(const Camera *camera) const
  * \param[in] request The request to queue
  *
  * This method queues a capture request to the pipeline handler for processing.
- * The request is first added to the internal list of queued requests, and
- * then passed to the pipeline handler with a call to queueRequestDevice().
+ * The request is first assigned a sequence number and added to the internal
+ * list of queued requests, and then passed to the pipeline handler with a call
+ * to queueRequestDevice().
  *
  * Keeping track of queued requests ensures automatic completion of all requests
  * when the pipeline handler is stopped with stop(). Request completion shall be
@@ -394,15 +455,84 @@ const ControlList &PipelineHandler::properties(const Camera *camera) const
 int PipelineHandler::queueRequest(Camera *camera, Request *request)
 {
 	CameraData *data = cameraData(camera);
+
+	request->sequence_ = data->requestSequence_++;
+	request->queueTime_ = utils::clock::now();
 	data->queuedRequests_.push_back(request);
 
+	Tracer::begin("Request", request);
+
 	int ret = queueRequestDevice(camera, request);
-	if (ret)
-		data->queuedRequests_.remove(request);
+	if (ret) {
+		Tracer::end("Request", request);
+
+		/*
+		 * The request is the last one that has been queued, drop it
+		 * from the back and release its sequence number.
+		 */
+		ASSERT(data->queuedRequests_.back() == request);
+		data->queuedRequests_.pop_back();
+		data->requestSequence_--;
+	} else {
+		data->statistics_.requestQueued(data->queuedRequests_.size());
+	}
 
 	return ret;
 }
 
+/**
+ * \brief Queue a batch of requests to the camera
+ * \param[in] camera The camera to queue the requests to
+ * \param[in] requests The requests to queue, in submission order
+ *
+ * This method queues multiple capture requests to the pipeline handler at
+ * once. The requests are assigned sequence numbers and added to the internal
+ * list of queued requests in order, and are then passed to the pipeline
+ * handler with a single call to queueRequestsDevice().
+ *
+ * Requests that the pipeline handler fails to queue are dropped, along with
+ * all the requests that follow them in the batch.
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void PipelineHandler::queueRequests(Camera *camera,
+				    const std::vector<Request *> &requests)
+{
+	CameraData *data = cameraData(camera);
+	utils::time_point now = utils::clock::now();
+	unsigned int depth = data->queuedRequests_.size();
+
+	for (Request *request : requests) {
+		request->sequence_ = data->requestSequence_++;
+		request->queueTime_ = now;
+		data->queuedRequests_.push_back(request);
+
+		Tracer::begin("Request", request);
+	}
+
+	unsigned int queued = queueRequestsDevice(camera, requests);
+
+	if (queued < requests.size())
+		LOG(Pipeline, Error)
+			<< "Failed to queue " << requests.size() - queued
+			<< " of " << requests.size() << " requests";
+
+	/* Drop the requests that haven't been queued, from the back. */
+	for (unsigned int i = requests.size(); i > queued; --i) {
+		Request *request = requests[i - 1];
+
+		Tracer::end("Request", request);
+
+		ASSERT(data->queuedRequests_.back() == request);
+		data->queuedRequests_.pop_back();
+		data->requestSequence_--;
+	}
+
+	/* Account for the queue depth after each request has been queued. */
+	for (unsigned int i = 0; i < queued; ++i)
+		data->statistics_.requestQueued(depth + i + 1);
+}
+
 /**
  * \fn PipelineHandler::queueRequestDevice()
  * \brief Queue a request to the device
@@ -420,6 +550,36 @@ int PipelineHandler::queueRequest(Camera *camera, Request *request)
  * \return 0 on success or a negative error code otherwise
  */
 
+/**
+ * \brief Queue a batch of requests to the device
+ * \param[in] camera The camera to queue the requests to
+ * \param[in] requests The requests to queue, in submission order
+ *
+ * This method queues multiple capture requests to the device for processing.
+ * It is called by queueRequests() to give pipeline handlers an opportunity to
+ * process a batch of requests at once, for instance to queue all their buffers
+ * to the devices back to back. Pipeline handlers shall queue the requests in
+ * order, and stop at the first request that fails to be queued.
+ *
+ * The default implementation calls queueRequestDevice() for each request.
+ *
+ * \context This function is called from the CameraManager thread.
+ *
+ * \return The number of requests successfully queued, starting from the
+ * beginning of \a requests
+ */
+unsigned int PipelineHandler::queueRequestsDevice(Camera *camera,
+						  Span<Request *const> requests)
+{
+	for (unsigned int i = 0; i < requests.size(); ++i) {
+		int ret = queueRequestDevice(camera, requests[i]);
+		if (ret)
+			return i;
+	}
+
+	return requests.size();
+}
+
 /**
  * \brief Complete a buffer for a request
  * \param[in] camera The camera the request belongs to
@@ -441,6 +601,19 @@ int PipelineHandler::queueRequest(Camera *camera, Request *request)
 bool PipelineHandler::completeBuffer(Camera *camera, Request *request,
 				     FrameBuffer *buffer)
 {
+	const Stream *stream = nullptr;
+	for (const auto &it : request->buffers()) {
+		if (it.second == buffer) {
+			stream = it.first;
+			break;
+		}
+	}
+
+	Tracer::instant("PipelineHandler::completeBuffer", request, stream);
+
+	CameraData *data = cameraData(camera);
+	data->statistics_.bufferCompleted(stream, buffer->metadata());
+
 	camera->bufferCompleted.emit(request, buffer);
 	return request->completeBuffer(buffer);
 }
@@ -454,27 +627,151 @@ bool PipelineHandler::completeBuffer(Camera *camera, Request *request,
  * request has completed. The request is deleted and shall not be accessed once
  * this method returns.
  *
- * This method ensures that requests will be returned to the application in
- * submission order, the pipeline handler may call it on any complete request
- * without any ordering constraint.
+ * Unless the camera has been set to deliver requests out of order with
+ * Camera::setCompletionOrder(), this method ensures that requests will be
+ * returned to the application in submission order. In either case the
+ * pipeline handler may call it on any complete request without any ordering
+ * constraint.
+ *
+ * When the camera uses the Camera::QueueingDropOldest policy, requests are
+ * delivered as soon as they complete, and stale requests are queued again
+ * instead of being delivered. The pipeline handler shall thus be prepared to
+ * receive the request again through queueRequestDevice().
  *
  * \context This function shall be called from the CameraManager thread.
  */
 void PipelineHandler::completeRequest(Camera *camera, Request *request)
 {
+	Tracer::instant("PipelineHandler::completeRequest", request);
+
 	request->complete();
 
 	CameraData *data = cameraData(camera);
+	std::deque<Request *> &queue = data->queuedRequests_;
+
+	data->statistics_.requestCompleted(request->status() == Request::RequestCancelled,
+					   utils::clock::now() - request->queueTime_,
+					   request->bufferCacheHits_,
+					   request->bufferCacheMisses_);
+
+	if (camera->completionOrder() == Camera::CompletionOutOfOrder ||
+	    camera->queueingPolicy() == Camera::QueueingDropOldest) {
+		ASSERT(!queue.empty());
 
-	while (!data->queuedRequests_.empty()) {
-		Request *req = data->queuedRequests_.front();
+		unsigned int index = request->sequence() - queue.front()->sequence();
+		ASSERT(index < queue.size() && queue[index] == request);
+
+		queue[index] = nullptr;
+		Tracer::end("Request", request);
+
+		while (!queue.empty() && !queue.front())
+			queue.pop_front();
+
+		deliverRequest(camera, request);
+
+		data->statistics_.setQueueDepth(queue.size());
+		return;
+	}
+
+	while (!queue.empty()) {
+		Request *req = queue.front();
 		if (req->status() == Request::RequestPending)
 			break;
 
 		ASSERT(!req->hasPendingBuffers());
-		data->queuedRequests_.pop_front();
+		queue.pop_front();
+		Tracer::end("Request", req);
 		camera->requestComplete(req);
 	}
+
+	data->statistics_.setQueueDepth(queue.size());
+}
+
+/*
+ * Deliver a completed request to the application, applying the camera
+ * queueing policy. With Camera::QueueingDropOldest, a request older than the
+ * last delivered one is recycled instead of being delivered, and so is the
+ * request it replaces in the completion queue, if any.
+ */
+void PipelineHandler::deliverRequest(Camera *camera, Request *request)
+{
+	CameraData *data = cameraData(camera);
+
+	if (camera->queueingPolicy() == Camera::QueueingDropOldest &&
+	    request->status() == Request::RequestComplete) {
+		int32_t age = request->sequence() - data->deliveredSequence_;
+		if (age < 0) {
+			recycleRequest(camera, request);
+			return;
+		}
+
+		data->deliveredSequence_ = request->sequence() + 1;
+	}
+
+	Request *stale = camera->requestComplete(request);
+	if (stale)
+		recycleRequest(camera, stale);
+}
+
+/*
+ * Recycle a completed request dropped by the Camera::QueueingDropOldest
+ * policy. This is called from the request completion path, queuing the request
+ * to the device synchronously would re-enter the pipeline handler. Defer it to
+ * requeueRequests() instead, to run after the completion handler returns.
+ */
+void PipelineHandler::recycleRequest(Camera *camera, Request *request)
+{
+	CameraData *data = cameraData(camera);
+
+	Tracer::instant("PipelineHandler::recycleRequest", request);
+	data->statistics_.requestDropped();
+
+	request->reuse();
+
+	data->recycledRequests_.push_back(request);
+	if (data->recycledRequests_.size() == 1)
+		invokeMethod(&PipelineHandler::requeueRequests,
+			     ConnectionTypeQueued, camera);
+}
+
+/**
+ * \brief Queue the requests dropped by the Camera::QueueingDropOldest policy
+ * again
+ * \param[in] camera The camera
+ *
+ * Completed requests dropped by the Camera::QueueingDropOldest policy are
+ * queued again to capture new frames in their buffers. The requeue is deferred
+ * to this method to avoid re-entering queueRequestDevice() from the request
+ * completion path. If the camera is stopped or a request can't be queued, the
+ * request is cancelled and delivered to the application.
+ *
+ * The Camera class calls this method after stopping the pipeline handler, to
+ * ensure that all dropped requests are delivered before Camera::stop()
+ * returns.
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void PipelineHandler::requeueRequests(Camera *camera)
+{
+	CameraData *data = cameraData(camera);
+	std::deque<Request *> requests = std::move(data->recycledRequests_);
+	data->recycledRequests_.clear();
+
+	for (Request *request : requests) {
+		if (camera->isRunning()) {
+			int ret = queueRequest(camera, request);
+			if (!ret)
+				continue;
+
+			LOG(Pipeline, Warning)
+				<< "Failed to queue dropped request: "
+				<< strerror(-ret);
+		}
+
+		request->cancel();
+		data->statistics_.requestCompleted(true, {}, 0, 0);
+		camera->requestComplete(request);
+	}
 }
 
 /**
@@ -496,13 +793,10 @@ void PipelineHandler::registerCamera(std::shared_ptr<Camera> camera,
 	cameraData_[camera.get()] = std::move(data);
 	cameras_.push_back(camera);
 
-	if (mediaDevices_.empty())
-		LOG(Pipeline, Fatal)
-			<< "Registering camera with no media devices!";
-
 	/*
 	 * Walk the entity list and map the devnums of all capture video nodes
-	 * to the camera.
+	 * to the camera. Virtual cameras have no media device, and thus no
+	 * devnum.
 	 */
 	std::vector<dev_t> devnums;
 	for (const std::shared_ptr<MediaDevice> &media : mediaDevices_) {
@@ -90,6 +90,7 @@ IPAProxyThread::IPAProxyThread(IPAModule *ipam)
 
 	ipa_ = std::make_unique<IPAContextWrapper>(ctx);
 	proxy_.setIPA(ipa_.get());
+	thread_.setRole(ThreadPolicy::RoleIPA);
 
 	/*
 	 * Proxy the queueFrameAction signal to dispatch it in the caller's
@@ -79,6 +79,9 @@ int main(int argc, char **argv)
 
 	LOG(IPAProxyLinuxWorker, Debug) << "Proxy worker successfully started";
 
+	/* The IPA runs in the main thread of the isolated process. */
+	ThreadPolicy::apply(ThreadPolicy::RoleIPA);
+
 	/* \todo upgrade listening loop */
 	EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
 	while (1)
@@ -62,8 +62,9 @@ LOG_DEFINE_CATEGORY(Request)
  *
  */
 Request::Request(Camera *camera, uint64_t cookie)
-	: camera_(camera), cookie_(cookie), status_(RequestPending),
-	  cancelled_(false)
+	: camera_(camera), cookie_(cookie), sequence_(0),
+	  status_(RequestPending), cancelled_(false), bufferCacheHits_(0),
+	  bufferCacheMisses_(0)
 {
 	/**
 	 * \todo Should the Camera expose a validator instance, to avoid
@@ -185,6 +186,21 @@ FrameBuffer *Request::findBuffer(const Stream *stream) const
  * \return The request cookie
  */
 
+/**
+ * \fn Request::sequence()
+ * \brief Retrieve the sequence number of the request
+ *
+ * Requests are assigned a sequence number when they are queued to the camera.
+ * The sequence number starts at 0 for the first request queued to the camera,
+ * and increases by one for every request successfully queued. When the camera
+ * delivers requests out of order (see Camera::setCompletionOrder()),
+ * applications can use the sequence number to restore the submission order.
+ *
+ * The value is undefined until the request has been queued.
+ *
+ * \return The request sequence number
+ */
+
 /**
  * \fn Request::status()
  * \brief Retrieve the request completion status
@@ -220,9 +236,62 @@ void Request::complete()
 
 	LOG(Request, Debug)
 		<< "Request has completed - cookie: " << cookie_
+		<< ", sequence: " << sequence_
 		<< (cancelled_ ? " [Cancelled]" : "");
 }
 
+/**
+ * \brief Prepare a completed request to be queued again
+ *
+ * Reset the request status, metadata and buffer tracking, as well as the
+ * metadata of its buffers, keeping its buffers and controls, to queue it again
+ * to the camera. This is used by the pipeline handler to recycle requests
+ * dropped by the Camera::QueueingDropOldest policy.
+ */
+void Request::reuse()
+{
+	ASSERT(status_ != RequestPending);
+
+	pending_.clear();
+	for (const auto &it : bufferMap_) {
+		FrameBuffer *buffer = it.second;
+		buffer->request_ = this;
+		pending_.insert(buffer);
+
+		/* Don't let the previous frame leak into the next completion. */
+		FrameMetadata &metadata = buffer->metadata_;
+		metadata.status = FrameMetadata::FrameSuccess;
+		metadata.sequence = 0;
+		metadata.timestamp = 0;
+		for (FrameMetadata::Plane &plane : metadata.planes)
+			plane.bytesused = 0;
+	}
+
+	metadata_->clear();
+	status_ = RequestPending;
+	cancelled_ = false;
+	bufferCacheHits_ = 0;
+	bufferCacheMisses_ = 0;
+}
+
+/**
+ * \brief Cancel a request that hasn't been queued to the device
+ *
+ * Mark all pending buffers as cancelled and complete the request with the
+ * RequestCancelled status.
+ */
+void Request::cancel()
+{
+	for (FrameBuffer *buffer : pending_) {
+		buffer->metadata_.status = FrameMetadata::FrameCancelled;
+		buffer->request_ = nullptr;
+	}
+
+	pending_.clear();
+	cancelled_ = true;
+	complete();
+}
+
 /**
  * \brief Complete a buffer for the request
  * \param[in] buffer The buffer that has completed
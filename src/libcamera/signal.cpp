@@ -19,14 +19,38 @@ namespace libcamera {
 namespace {
 
 /*
- * Mutex to protect the SignalBase::slots_ and Object::signals_ lists. If lock
- * contention needs to be decreased, this could be replaced with locks in
- * Object and SignalBase, or with a mutex pool.
+ * Mutex to serialize updates of the SignalBase::slots_ and Object::signals_
+ * lists, and to protect the lists of retired slots. Signal emission doesn't
+ * take the lock.
  */
 Mutex signalsLock;
 
 } /* namespace */
 
+/*
+ * The slots list of a signal is never modified once published. Connecting or
+ * disconnecting a slot publishes a new list, and emit() accesses the current
+ * list without locking or allocating memory, bracketed by acquireSlots() and
+ * releaseSlots() that count the readers of the signal.
+ *
+ * A replaced list, and the slots it was the last one to reference, can only
+ * be freed when no reader is active, as readers may still be iterating over
+ * it. If readers are active when the list is replaced, it is retired and
+ * freed by the last reader. Readers that start after the list has been replaced
+ * can't access it.
+ */
+
+SignalBase::SignalBase()
+	: slots_(nullptr), readers_(0), reclaimPending_(false)
+{
+}
+
+SignalBase::~SignalBase()
+{
+	delete slots_.load();
+	freeRetired();
+}
+
 void SignalBase::connect(BoundMethodBase *slot)
 {
 	MutexLocker locker(signalsLock);
@@ -34,38 +58,98 @@ void SignalBase::connect(BoundMethodBase *slot)
 	Object *object = slot->object();
 	if (object)
 		object->connect(this);
-	slots_.push_back(slot);
+
+	const SlotList *current = slots_.load(std::memory_order_relaxed);
+	SlotList *slots = current ? new SlotList(*current) : new SlotList();
+	slots->push_back(slot);
+
+	update(slots, {});
 }
 
 void SignalBase::disconnect(Object *object)
 {
-	disconnect([object](SlotList::iterator &iter) {
-		return (*iter)->match(object);
+	disconnect([object](BoundMethodBase *slot) {
+		return slot->match(object);
 	});
 }
 
-void SignalBase::disconnect(std::function<bool(SlotList::iterator &)> match)
+void SignalBase::disconnect(std::function<bool(BoundMethodBase *)> match)
 {
 	MutexLocker locker(signalsLock);
 
-	for (auto iter = slots_.begin(); iter != slots_.end(); ) {
-		if (match(iter)) {
-			Object *object = (*iter)->object();
+	const SlotList *current = slots_.load(std::memory_order_relaxed);
+	if (!current)
+		return;
+
+	SlotList slots;
+	SlotList removed;
+
+	for (BoundMethodBase *slot : *current) {
+		if (match(slot)) {
+			Object *object = slot->object();
 			if (object)
 				object->disconnect(this);
 
-			delete *iter;
-			iter = slots_.erase(iter);
+			removed.push_back(slot);
 		} else {
-			++iter;
+			slots.push_back(slot);
 		}
 	}
+
+	if (removed.empty())
+		return;
+
+	update(slots.empty() ? nullptr : new SlotList(std::move(slots)),
+	       std::move(removed));
 }
 
-SignalBase::SlotList SignalBase::slots()
+/*
+ * Publish a new slots list and free the previous one along with the removed
+ * slots, or retire them if readers are active. Shall be called with the
+ * signalsLock held.
+ */
+void SignalBase::update(SlotList *slots, SlotList &&removed)
+{
+	SlotList *old = slots_.exchange(slots, std::memory_order_seq_cst);
+
+	if (old)
+		retiredLists_.push_back(old);
+	retiredSlots_.insert(retiredSlots_.end(), removed.begin(), removed.end());
+
+	/*
+	 * Flag the pending reclaim before checking for readers, to ensure that
+	 * either this function or the last reader frees the retired lists.
+	 */
+	reclaimPending_.store(true, std::memory_order_seq_cst);
+	if (!readers_.load(std::memory_order_seq_cst))
+		freeRetired();
+}
+
+/*
+ * Free the retired lists and slots if no reader is active anymore. This is
+ * called by the last reader when lists have been retired.
+ */
+void SignalBase::reclaim()
 {
 	MutexLocker locker(signalsLock);
-	return slots_;
+
+	if (!reclaimPending_.load(std::memory_order_relaxed) ||
+	    readers_.load(std::memory_order_seq_cst))
+		return;
+
+	freeRetired();
+}
+
+void SignalBase::freeRetired()
+{
+	for (SlotList *list : retiredLists_)
+		delete list;
+	for (BoundMethodBase *slot : retiredSlots_)
+		delete slot;
+
+	retiredLists_.clear();
+	retiredSlots_.clear();
+	reclaimPending_.store(false, std::memory_order_relaxed);
 }
 
 /**
@@ -172,6 +256,11 @@ SignalBase::SlotList SignalBase::slots()
  * of the arguments (when passed by pointer or reference), the modification is
  * thus visible to all subsequently called slots.
  *
+ * The slots are called from a snapshot of the connected slots list, taken
+ * without locking or allocating memory. Slots connected or disconnected while
+ * the signal is being emitted, including by the slots themselves, don't affect
+ * the current emission.
+ *
  * This function is not \threadsafe, but thread-safety is guaranteed against
  * concurrent connect() and disconnect() calls.
  */
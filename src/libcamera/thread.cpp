@@ -9,7 +9,13 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <errno.h>
 #include <list>
+#include <sched.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -138,7 +144,8 @@ class ThreadData
 {
 public:
 	ThreadData()
-		: thread_(nullptr), running_(false), dispatcher_(nullptr)
+		: thread_(nullptr), running_(false), role_(ThreadPolicy::RoleDefault),
+		  dispatcher_(nullptr)
 	{
 	}
 
@@ -151,6 +158,7 @@ private:
 	Thread *thread_;
 	bool running_;
 	pid_t tid_;
+	ThreadPolicy::Role role_;
 
 	Mutex mutex_;
 
@@ -213,6 +221,365 @@ ThreadData *ThreadData::current()
  * \brief An alias for std::unique_lock<std::mutex>
  */
 
+namespace {
+
+const char *const threadRoleNames[] = {
+	"default",
+	"pipeline",
+	"ipa",
+	"ipa-worker",
+	"post-processing",
+};
+
+constexpr unsigned int threadRoleCount = ARRAY_SIZE(threadRoleNames);
+
+int parseCpuList(const std::string &list, std::vector<unsigned int> *cpus)
+{
+	for (const std::string &range : utils::split(list, ",")) {
+		const char *str = range.c_str();
+		char *end;
+
+		unsigned long first = strtoul(str, &end, 10);
+		unsigned long last = first;
+		if (end == str)
+			return -EINVAL;
+
+		if (*end == '-') {
+			str = end + 1;
+			last = strtoul(str, &end, 10);
+			if (end == str)
+				return -EINVAL;
+		}
+
+		if (*end != '\0' || first > last || last >= CPU_SETSIZE)
+			return -EINVAL;
+
+		for (unsigned long cpu = first; cpu <= last; ++cpu)
+			cpus->push_back(cpu);
+	}
+
+	return 0;
+}
+
+/*
+ * The per-role thread policies, initialized from the LIBCAMERA_THREAD_POLICY
+ * environment variable on first use.
+ */
+class ThreadPolicies
+{
+public:
+	ThreadPolicies();
+
+	Mutex mutex_;
+	ThreadPolicy policies_[threadRoleCount];
+};
+
+ThreadPolicies::ThreadPolicies()
+{
+	const char *env = utils::secure_getenv("LIBCAMERA_THREAD_POLICY");
+	if (!env)
+		return;
+
+	for (const std::string &entry : utils::split(env, ";")) {
+		if (entry.empty())
+			continue;
+
+		size_t colon = entry.find(':');
+		std::string name = entry.substr(0, colon);
+		std::string options = colon != std::string::npos
+				    ? entry.substr(colon + 1) : "";
+
+		unsigned int role;
+		for (role = ThreadPolicy::RolePipeline; role < threadRoleCount; ++role) {
+			if (name == threadRoleNames[role])
+				break;
+		}
+
+		if (role == threadRoleCount) {
+			LOG(Thread, Warning) << "Unknown thread role '" << name << "'";
+			continue;
+		}
+
+		if (policies_[role].parse(options) < 0)
+			LOG(Thread, Warning)
+				<< "Invalid policy '" << options << "' for "
+				<< name << " threads";
+	}
+}
+
+ThreadPolicies &threadPolicies()
+{
+	static ThreadPolicies policies;
+	return policies;
+}
+
+} /* namespace */
+
+/**
+ * \class ThreadPolicy
+ * \brief CPU affinity and scheduling policy for a role of threads
+ *
+ * libcamera runs its internal processing in several threads: the CameraManager
+ * thread that runs pipeline handlers, the threads that run IPA modules, and
+ * worker threads created by IPA modules for asynchronous computation. On
+ * systems with heterogeneous or heavily loaded CPUs, the latency of those
+ * threads can be reduced by pinning them to a set of CPUs and by raising their
+ * scheduling priority.
+ *
+ * A ThreadPolicy groups the CPU affinity and scheduling settings for all
+ * threads of a given Role. Policies are initialized from the
+ * LIBCAMERA_THREAD_POLICY environment variable, and can be overridden with
+ * set(). The environment variable contains a list of policies separated by
+ * semicolons (';'), each made of a role name (\a pipeline, \a ipa,
+ * \a ipa-worker or \a post-processing) followed by options separated by colons
+ * (':'), as parsed by parse(). For instance
+ *
+ * \code{.sh}
+ * LIBCAMERA_THREAD_POLICY="pipeline:cpus=2-3:fifo=10;ipa-worker:cpus=0-1:nice=5"
+ * \endcode
+ *
+ * Threads apply the policy of their role with apply() when they start.
+ * Instances of the Thread class do so automatically based on the role set with
+ * Thread::setRole(), other threads shall call apply() explicitly. Changes to a
+ * policy only affect threads started after the change.
+ *
+ * Failure to apply a setting, typically due to a lack of CAP_SYS_NICE
+ * privileges for real-time scheduling or negative nice values, is reported
+ * with a warning and doesn't prevent the thread from running.
+ */
+
+/**
+ * \enum ThreadPolicy::Role
+ * \brief The role of a thread
+ * \var ThreadPolicy::RoleDefault
+ * \brief A thread without a specific role, its settings are inherited from its
+ * creator
+ * \var ThreadPolicy::RolePipeline
+ * \brief The thread running the pipeline handlers (the CameraManager thread)
+ * \var ThreadPolicy::RoleIPA
+ * \brief A thread running an IPA module
+ * \var ThreadPolicy::RoleIPAWorker
+ * \brief A worker thread created by an IPA module for asynchronous processing
+ * \var ThreadPolicy::RolePostProcessing
+ * \brief A thread processing captured frames in software, such as the Android
+ * HAL post-processing threads
+ */
+
+/**
+ * \brief Construct a default policy that leaves the thread settings unchanged
+ */
+ThreadPolicy::ThreadPolicy()
+	: realtime(false), priority(0), nice(0)
+{
+}
+
+/**
+ * \brief Check if the policy leaves the thread settings unchanged
+ * \return True if the policy is the default policy, false otherwise
+ */
+bool ThreadPolicy::isDefault() const
+{
+	return cpus.empty() && !realtime && !nice;
+}
+
+/**
+ * \brief Parse policy options from a string
+ * \param[in] options The options string
+ *
+ * The \a options string contains a list of options separated by colons (':').
+ * The following options are supported:
+ *
+ * - cpus=\<list\> sets the CPU affinity to a comma-separated list of CPU
+ *   numbers or ranges (for instance "0,2-3")
+ * - fifo=\<priority\> selects the SCHED_FIFO scheduling policy with a priority
+ *   in the range [1, 99]
+ * - nice=\<value\> sets the nice value in the range [-20, 19]
+ *
+ * \return 0 on success, or -EINVAL if the string is invalid, in which case the
+ * policy is left unmodified
+ */
+int ThreadPolicy::parse(const std::string &options)
+{
+	ThreadPolicy policy;
+
+	for (const std::string &option : utils::split(options, ":")) {
+		if (option.empty())
+			continue;
+
+		size_t equal = option.find('=');
+		if (equal == std::string::npos)
+			return -EINVAL;
+
+		std::string key = option.substr(0, equal);
+		std::string value = option.substr(equal + 1);
+		char *end;
+
+		if (key == "cpus") {
+			if (parseCpuList(value, &policy.cpus) < 0)
+				return -EINVAL;
+		} else if (key == "fifo") {
+			long prio = strtol(value.c_str(), &end, 10);
+			if (value.empty() || *end != '\0' || prio < 1 || prio > 99)
+				return -EINVAL;
+
+			policy.realtime = true;
+			policy.priority = prio;
+		} else if (key == "nice") {
+			long nice = strtol(value.c_str(), &end, 10);
+			if (value.empty() || *end != '\0' || nice < -20 || nice > 19)
+				return -EINVAL;
+
+			policy.nice = nice;
+		} else {
+			return -EINVAL;
+		}
+	}
+
+	*this = policy;
+	return 0;
+}
+
+/**
+ * \brief Retrieve the policy for a thread role
+ * \param[in] role The thread role
+ * \context This function is \threadsafe.
+ * \return The policy for \a role
+ */
+ThreadPolicy ThreadPolicy::get(Role role)
+{
+	ThreadPolicies &policies = threadPolicies();
+	MutexLocker locker(policies.mutex_);
+	return policies.policies_[role];
+}
+
+/**
+ * \brief Set the policy for a thread role
+ * \param[in] role The thread role
+ * \param[in] policy The policy
+ *
+ * The \a policy overrides the one specified in the LIBCAMERA_THREAD_POLICY
+ * environment variable. It applies to threads started after this call.
+ *
+ * \context This function is \threadsafe.
+ */
+void ThreadPolicy::set(Role role, const ThreadPolicy &policy)
+{
+	if (role == RoleDefault)
+		return;
+
+	ThreadPolicies &policies = threadPolicies();
+	MutexLocker locker(policies.mutex_);
+	policies.policies_[role] = policy;
+}
+
+/**
+ * \brief Apply the policy for a thread role to the calling thread
+ * \param[in] role The thread role
+ *
+ * The effective CPU affinity and scheduling settings of the thread are logged
+ * once the policy has been applied. This function does nothing if the policy
+ * for \a role is the default policy.
+ *
+ * \context This function is \threadsafe.
+ */
+void ThreadPolicy::apply(Role role)
+{
+	ThreadPolicy policy = get(role);
+	if (policy.isDefault())
+		return;
+
+	const char *name = threadRoleNames[role];
+	pid_t tid = syscall(SYS_gettid);
+	cpu_set_t cpuset;
+	int ret;
+
+	if (!policy.cpus.empty()) {
+		CPU_ZERO(&cpuset);
+		for (unsigned int cpu : policy.cpus)
+			CPU_SET(cpu, &cpuset);
+
+		ret = sched_setaffinity(tid, sizeof(cpuset), &cpuset);
+		if (ret < 0) {
+			ret = errno;
+			LOG(Thread, Warning)
+				<< "Failed to set CPU affinity of " << name
+				<< " thread: " << strerror(ret);
+		}
+	}
+
+	if (policy.realtime) {
+		struct sched_param param = {};
+		param.sched_priority = policy.priority;
+
+		ret = sched_setscheduler(tid, SCHED_FIFO, &param);
+		if (ret < 0) {
+			ret = errno;
+			LOG(Thread, Warning)
+				<< "Failed to set real-time scheduling of " << name
+				<< " thread: " << strerror(ret);
+		}
+	}
+
+	/* On Linux, setpriority() applies to a single thread. */
+	if (policy.nice) {
+		ret = setpriority(PRIO_PROCESS, tid, policy.nice);
+		if (ret < 0) {
+			ret = errno;
+			LOG(Thread, Warning)
+				<< "Failed to set nice value of " << name
+				<< " thread: " << strerror(ret);
+		}
+	}
+
+	/* Log the effective settings, which may differ from the policy. */
+	std::stringstream settings;
+
+	settings << "cpus ";
+	if (sched_getaffinity(tid, sizeof(cpuset), &cpuset) == 0) {
+		const char *sep = "";
+		for (unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (!CPU_ISSET(cpu, &cpuset))
+				continue;
+
+			settings << sep << cpu;
+			sep = ",";
+		}
+	} else {
+		settings << "unknown";
+	}
+
+	struct sched_param param = {};
+	if (sched_getscheduler(tid) == SCHED_FIFO &&
+	    sched_getparam(tid, &param) == 0)
+		settings << ", fifo priority " << param.sched_priority;
+	else
+		settings << ", nice " << getpriority(PRIO_PROCESS, tid);
+
+	LOG(Thread, Info)
+		<< "Thread " << tid << " (" << name << "): " << settings.str();
+}
+
+/**
+ * \var ThreadPolicy::cpus
+ * \brief The CPUs the thread is allowed to run on, or empty to leave the CPU
+ * affinity unchanged
+ */
+
+/**
+ * \var ThreadPolicy::realtime
+ * \brief Whether to use the SCHED_FIFO real-time scheduling policy
+ */
+
+/**
+ * \var ThreadPolicy::priority
+ * \brief The SCHED_FIFO priority, when \ref realtime is true
+ */
+
+/**
+ * \var ThreadPolicy::nice
+ * \brief The nice value, or 0 to leave it unchanged
+ */
+
 /**
  * \class Thread
  * \brief A thread of execution
@@ -285,6 +652,8 @@ void Thread::startThread()
 	data_->tid_ = syscall(SYS_gettid);
 	currentThreadData = data_;
 
+	ThreadPolicy::apply(data_->role_);
+
 	run();
 }
 
@@ -407,6 +776,19 @@ bool Thread::isRunning()
 	return data_->running_;
 }
 
+/**
+ * \brief Set the role of the thread
+ * \param[in] role The thread role
+ *
+ * The thread applies the ThreadPolicy of its \a role when it starts. The role
+ * shall be set before calling start().
+ */
+void Thread::setRole(ThreadPolicy::Role role)
+{
+	MutexLocker locker(data_->mutex_);
+	data_->role_ = role;
+}
+
 /**
  * \var Thread::finished
  * \brief Signal the end of thread execution
@@ -0,0 +1,267 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * tracer.cpp - Request lifecycle tracing
+ */
+
+#include "libcamera/internal/tracer.h"
+
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/request.h>
+
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/thread.h"
+#include "libcamera/internal/utils.h"
+
+/**
+ * \file tracer.h
+ * \brief Request lifecycle tracing
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Tracer)
+
+namespace {
+
+/* Number of events kept per thread, older events are overwritten. */
+constexpr unsigned int kRingSize = 16384;
+
+struct TraceEvent {
+	uint64_t timestamp;
+	const char *name;
+	Tracer::Phase phase;
+	const Request *request;
+	uint64_t cookie;
+	uint32_t sequence;
+	const Stream *stream;
+};
+
+struct TraceRing {
+	pid_t tid;
+	std::atomic<uint64_t> count;
+	std::array<TraceEvent, kRingSize> events;
+};
+
+class TraceRegistry
+{
+public:
+	TraceRing *registerThread()
+	{
+		std::unique_ptr<TraceRing> ring = std::make_unique<TraceRing>();
+		ring->tid = syscall(SYS_gettid);
+		ring->count = 0;
+
+		MutexLocker locker(mutex_);
+		rings_.push_back(std::move(ring));
+		return rings_.back().get();
+	}
+
+	void dump(std::ostream &stream);
+
+	std::string path_;
+
+private:
+	Mutex mutex_;
+	std::vector<std::unique_ptr<TraceRing>> rings_;
+};
+
+void TraceRegistry::dump(std::ostream &stream)
+{
+	MutexLocker locker(mutex_);
+	pid_t pid = getpid();
+	bool first = true;
+
+	stream << "{\"traceEvents\":[";
+
+	for (const std::unique_ptr<TraceRing> &ring : rings_) {
+		uint64_t count = ring->count.load(std::memory_order_acquire);
+		uint64_t start = count > kRingSize ? count - kRingSize : 0;
+
+		for (uint64_t i = start; i < count; ++i) {
+			const TraceEvent &event = ring->events[i % kRingSize];
+
+			if (!first)
+				stream << ",";
+			first = false;
+
+			stream << "\n{\"name\":\"" << event.name << "\""
+			       << ",\"cat\":\"libcamera\""
+			       << ",\"ph\":\"" << static_cast<char>(event.phase) << "\""
+			       << ",\"ts\":" << event.timestamp / 1000 << "."
+			       << std::setw(3) << std::setfill('0')
+			       << event.timestamp % 1000
+			       << ",\"pid\":" << pid
+			       << ",\"tid\":" << ring->tid;
+
+			if (event.phase == Tracer::PhaseInstant)
+				stream << ",\"s\":\"t\"";
+			else
+				stream << ",\"id\":\"" << event.request << "\"";
+
+			stream << ",\"args\":{";
+			if (event.request)
+				stream << "\"cookie\":" << event.cookie
+				       << ",\"sequence\":" << event.sequence;
+			if (event.stream)
+				stream << (event.request ? "," : "")
+				       << "\"stream\":\"" << event.stream << "\"";
+			stream << "}}";
+		}
+	}
+
+	stream << "\n]}\n";
+}
+
+TraceRegistry &registry()
+{
+	/* Never destroyed, threads may record events until process exit. */
+	static TraceRegistry *registry = new TraceRegistry();
+	return *registry;
+}
+
+thread_local TraceRing *currentRing = nullptr;
+
+} /* namespace */
+
+/**
+ * \class Tracer
+ * \brief Record the lifecycle of requests for offline analysis
+ *
+ * The Tracer records timestamped events at the key points of the request
+ * lifecycle: queueing by the application, submission to the device, buffer
+ * completion and request completion, as well as the pipeline handler-specific
+ * steps in between (IPA processing, sensor controls application, ...). Events
+ * carry the request cookie and sequence number, and the stream for buffer
+ * events, and are stored in a fixed-size ring buffer for each thread.
+ *
+ * Tracing is compiled in but disabled by default, in which case the cost of
+ * each trace point is a single test of a global flag. It is enabled by setting
+ * the LIBCAMERA_TRACE environment variable to the path of the trace file. The
+ * events are written to that file in the Chrome trace event JSON format when
+ * the CameraManager is stopped, and can be loaded in chrome://tracing or in
+ * the Perfetto UI.
+ *
+ * The request lifetime, from Camera::queueRequest() to the completion of the
+ * request, is recorded as an asynchronous slice identified by the request, and
+ * all other events as instant events.
+ */
+
+/**
+ * \enum Tracer::Phase
+ * \brief Type of a trace event, using the Chrome trace event phase values
+ * \var Tracer::PhaseInstant
+ * \brief An event without duration
+ * \var Tracer::PhaseAsyncBegin
+ * \brief The start of an asynchronous slice
+ * \var Tracer::PhaseAsyncEnd
+ * \brief The end of an asynchronous slice
+ */
+
+bool Tracer::enabled_ = Tracer::initialize();
+
+/**
+ * \fn Tracer::enabled()
+ * \brief Check if tracing is enabled
+ * \return True if the LIBCAMERA_TRACE environment variable is set
+ */
+
+/**
+ * \fn Tracer::instant()
+ * \brief Record an instant event
+ * \param[in] name The event name, shall be a string literal
+ * \param[in] request The request the event relates to, if any
+ * \param[in] stream The stream the event relates to, if any
+ */
+
+/**
+ * \fn Tracer::begin()
+ * \brief Record the start of the lifetime of \a request
+ * \param[in] name The slice name, shall be a string literal
+ * \param[in] request The request
+ */
+
+/**
+ * \fn Tracer::end()
+ * \brief Record the end of the lifetime of \a request
+ * \param[in] name The slice name, shall match the name passed to begin()
+ * \param[in] request The request
+ */
+
+bool Tracer::initialize()
+{
+	const char *path = utils::secure_getenv("LIBCAMERA_TRACE");
+	if (!path || !*path)
+		return false;
+
+	registry().path_ = path;
+	return true;
+}
+
+void Tracer::record(Phase phase, const char *name, const Request *request,
+		    const Stream *stream)
+{
+	if (!currentRing)
+		currentRing = registry().registerThread();
+
+	uint64_t index = currentRing->count.load(std::memory_order_relaxed);
+	TraceEvent &event = currentRing->events[index % kRingSize];
+
+	event.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		utils::clock::now().time_since_epoch()).count();
+	event.name = name;
+	event.phase = phase;
+	event.request = request;
+	event.cookie = request ? request->cookie() : 0;
+	event.sequence = request ? request->sequence() : 0;
+	event.stream = stream;
+
+	currentRing->count.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * \brief Write the recorded events to the trace file
+ *
+ * The trace file is the path set in the LIBCAMERA_TRACE environment variable.
+ * This function does nothing if tracing is disabled.
+ */
+void Tracer::dump()
+{
+	if (!enabled_)
+		return;
+
+	const std::string &path = registry().path_;
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		LOG(Tracer, Error) << "Failed to open trace file " << path;
+		return;
+	}
+
+	dump(file);
+
+	LOG(Tracer, Info) << "Trace written to " << path;
+}
+
+/**
+ * \brief Write the recorded events to \a stream
+ * \param[in] stream The output stream
+ *
+ * The events are written in the Chrome trace event JSON format. Events
+ * recorded concurrently with this call may be partially written, the caller
+ * should ensure that no request is in flight.
+ */
+void Tracer::dump(std::ostream &stream)
+{
+	registry().dump(stream);
+}
+
+} /* namespace libcamera */
@@ -22,10 +22,12 @@
 
 #include <libcamera/event_notifier.h>
 #include <libcamera/file_descriptor.h>
+#include <libcamera/request.h>
 
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 
 /**
@@ -193,6 +195,8 @@ V4L2BufferCache::~V4L2BufferCache()
 /**
  * \brief Find the best V4L2 buffer for a FrameBuffer
  * \param[in] buffer The FrameBuffer
+ * \param[out] hit Set to true if \a buffer was found in the cache, false
+ * otherwise (optional)
  *
  * Find the best V4L2 buffer index to be used for the FrameBuffer \a buffer
  * based on previous mappings of frame buffers to V4L2 buffers. If a free V4L2
@@ -203,9 +207,9 @@ V4L2BufferCache::~V4L2BufferCache()
  * \return The index of the best V4L2 buffer, or -ENOENT if no free V4L2 buffer
  * is available
  */
-int V4L2BufferCache::get(const FrameBuffer &buffer)
+int V4L2BufferCache::get(const FrameBuffer &buffer, bool *hit)
 {
-	bool hit = false;
+	bool found = false;
 	int use = -1;
 	uint64_t oldest = UINT64_MAX;
 
@@ -217,7 +221,7 @@ int V4L2BufferCache::get(const FrameBuffer &buffer)
 
 		/* Try to find a cache hit by comparing the planes. */
 		if (entry == buffer) {
-			hit = true;
+			found = true;
 			use = index;
 			break;
 		}
@@ -228,9 +232,12 @@ int V4L2BufferCache::get(const FrameBuffer &buffer)
 		}
 	}
 
-	if (!hit)
+	if (!found)
 		missCounter_++;
 
+	if (hit)
+		*hit = found;
+
 	if (use < 0)
 		return -ENOENT;
 
@@ -272,6 +279,7 @@ bool V4L2BufferCache::Entry::operator==(const FrameBuffer &buffer) const
 
 	for (unsigned int i = 0; i < planes.size(); i++)
 		if (planes_[i].fd != planes[i].fd.fd() ||
+		    planes_[i].offset != planes[i].offset ||
 		    planes_[i].length != planes[i].length)
 			return false;
 	return true;
@@ -1380,7 +1388,11 @@ int V4L2VideoDevice::releaseBuffers()
  * The best available V4L2 buffer is picked for \a buffer using the V4L2 buffer
  * cache.
  *
+ * Plane offsets are only supported for output video devices using the
+ * multi-planar API. Capture buffers with non-zero plane offsets are rejected.
+ *
  * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The \a buffer plane offsets are not supported
  */
 int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 {
@@ -1388,7 +1400,8 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 	struct v4l2_buffer buf = {};
 	int ret;
 
-	ret = cache_->get(*buffer);
+	bool hit;
+	ret = cache_->get(*buffer, &hit);
 	if (ret < 0)
 		return ret;
 
@@ -1401,10 +1414,41 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 	const std::vector<FrameBuffer::Plane> &planes = buffer->planes();
 
 	if (buf.memory == V4L2_MEMORY_DMABUF) {
+		/*
+		 * vb2 only honours data_offset for output buffers, and resets
+		 * it for capture buffers, which would then be written at the
+		 * start of the dmabuf. Reject plane offsets for capture.
+		 */
+		if (!V4L2_TYPE_IS_OUTPUT(buf.type)) {
+			for (const FrameBuffer::Plane &plane : planes) {
+				if (!plane.offset)
+					continue;
+
+				LOG(V4L2, Error)
+					<< "Plane offsets are not supported for capture";
+				cache_->put(buf.index);
+				return -EINVAL;
+			}
+		}
+
 		if (multiPlanar) {
-			for (unsigned int p = 0; p < planes.size(); ++p)
+			for (unsigned int p = 0; p < planes.size(); ++p) {
 				v4l2Planes[p].m.fd = planes[p].fd.fd();
+				v4l2Planes[p].data_offset = planes[p].offset;
+			}
 		} else {
+			/*
+			 * The single-planar API can't express data offsets,
+			 * additional planes are expected to be stored
+			 * contiguously after the first one in the same dmabuf.
+			 */
+			if (planes[0].offset) {
+				LOG(V4L2, Error)
+					<< "Plane offsets require the multi-planar API";
+				cache_->put(buf.index);
+				return -EINVAL;
+			}
+
 			buf.m.fd = planes[0].fd.fd();
 		}
 	}
@@ -1420,8 +1464,10 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 		if (multiPlanar) {
 			unsigned int nplane = 0;
 			for (const FrameMetadata::Plane &plane : metadata.planes) {
-				v4l2Planes[nplane].bytesused = plane.bytesused;
-				v4l2Planes[nplane].length = buffer->planes()[nplane].length;
+				v4l2Planes[nplane].bytesused = planes[nplane].offset
+							     + plane.bytesused;
+				v4l2Planes[nplane].length = planes[nplane].offset
+							  + planes[nplane].length;
 				nplane++;
 			}
 		} else {
@@ -1449,6 +1495,16 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 
 	queuedBuffers_[buf.index] = buffer;
 
+	Request *request = buffer->request();
+	if (request) {
+		if (hit)
+			request->bufferCacheHits_++;
+		else
+			request->bufferCacheMisses_++;
+	}
+
+	Tracer::instant("V4L2VideoDevice::queueBuffer", buffer->request());
+
 	return 0;
 }
 
@@ -1468,6 +1524,8 @@ void V4L2VideoDevice::bufferAvailable([[maybe_unused]] EventNotifier *notifier)
 	if (!buffer)
 		return;
 
+	Tracer::instant("V4L2VideoDevice::dequeueBuffer", buffer->request());
+
 	/* Notify anyone listening to the device. */
 	bufferReady.emit(buffer);
 }
@@ -1523,8 +1581,14 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 
 	buffer->metadata_.planes.clear();
 	if (multiPlanar) {
-		for (unsigned int nplane = 0; nplane < buf.length; nplane++)
-			buffer->metadata_.planes.push_back({ planes[nplane].bytesused });
+		/* The payload starts at data_offset, which bytesused includes. */
+		for (unsigned int nplane = 0; nplane < buf.length; nplane++) {
+			const struct v4l2_plane &plane = planes[nplane];
+			unsigned int bytesused = plane.bytesused > plane.data_offset
+					       ? plane.bytesused - plane.data_offset
+					       : 0;
+			buffer->metadata_.planes.push_back({ bytesused });
+		}
 	} else {
 		buffer->metadata_.planes.push_back({ buf.bytesused });
 	}
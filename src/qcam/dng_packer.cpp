@@ -0,0 +1,322 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Ltd.
+ *
+ * dng_packer.cpp - DNG raw data packing
+ */
+
+#include "dng_packer.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <endian.h>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/*
+ * Precomputed positions of the LSBs of the CSI-2 packed formats in the output
+ * pixel groups, indexed by the value of the byte that stores the LSBs.
+ */
+constexpr std::array<uint64_t, 256> lsbTable10()
+{
+	std::array<uint64_t, 256> table{};
+
+	for (unsigned int lsbs = 0; lsbs < 256; lsbs++)
+		table[lsbs] = static_cast<uint64_t>(lsbs & 0x03) << 30 |
+			      static_cast<uint64_t>(lsbs & 0x0c) << 18 |
+			      static_cast<uint64_t>(lsbs & 0x30) << 6 |
+			      static_cast<uint64_t>(lsbs & 0xc0) >> 6;
+
+	return table;
+}
+
+constexpr std::array<uint32_t, 256> lsbTable12()
+{
+	std::array<uint32_t, 256> table{};
+
+	for (unsigned int lsbs = 0; lsbs < 256; lsbs++)
+		table[lsbs] = (lsbs & 0x0f) << 12 | lsbs >> 4;
+
+	return table;
+}
+
+constexpr std::array<uint64_t, 256> kLsbTable10 = lsbTable10();
+constexpr std::array<uint32_t, 256> kLsbTable12 = lsbTable12();
+
+/* Store the 8 bytes of \a value in big-endian order, with a single store. */
+inline void storeBE64(uint8_t *output, uint64_t value)
+{
+	value = htobe64(value);
+	memcpy(output, &value, sizeof(value));
+}
+
+} /* namespace */
+
+/*
+ * The scanline packing functions assemble complete pixel groups in 64-bit
+ * words, and write them with a single store without per-pixel branches. They
+ * may write up to 8 bytes past the end of the output row.
+ */
+
+/*
+ * Repack the CSI-2 10-bit format, which stores the 8 MSBs of 4 pixels
+ * followed by a byte containing their 2 LSBs, to the contiguous MSB-first
+ * 10-bit packing used by DNG.
+ */
+void packScanlineSBGGR10P(void *output, const void *input, unsigned int width)
+{
+	const uint8_t *in = static_cast<const uint8_t *>(input);
+	uint8_t *out = static_cast<uint8_t *>(output);
+
+	for (unsigned int x = 0; x < width; x += 4) {
+		uint64_t group = static_cast<uint64_t>(in[0]) << 32 |
+				 static_cast<uint64_t>(in[1]) << 22 |
+				 static_cast<uint64_t>(in[2]) << 12 |
+				 static_cast<uint64_t>(in[3]) << 2 |
+				 kLsbTable10[in[4]];
+
+		storeBE64(out, group << 24);
+
+		in += 5;
+		out += 5;
+	}
+}
+
+/*
+ * Repack the CSI-2 12-bit format, which stores the 8 MSBs of 2 pixels
+ * followed by a byte containing their 4 LSBs, to the contiguous MSB-first
+ * 12-bit packing used by DNG. Two groups are processed at a time.
+ */
+void packScanlineSBGGR12P(void *output, const void *input, unsigned int width)
+{
+	const uint8_t *in = static_cast<const uint8_t *>(input);
+	uint8_t *out = static_cast<uint8_t *>(output);
+	unsigned int x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		uint64_t groups = static_cast<uint64_t>(in[0]) << 40 |
+				  static_cast<uint64_t>(in[1]) << 28 |
+				  static_cast<uint64_t>(kLsbTable12[in[2]]) << 24 |
+				  static_cast<uint64_t>(in[3]) << 16 |
+				  static_cast<uint64_t>(in[4]) << 4 |
+				  kLsbTable12[in[5]];
+
+		storeBE64(out, groups << 16);
+
+		in += 6;
+		out += 6;
+	}
+
+	if (x < width) {
+		uint64_t group = static_cast<uint64_t>(in[0]) << 16 |
+				 static_cast<uint64_t>(in[1]) << 4 |
+				 kLsbTable12[in[2]];
+
+		storeBE64(out, group << 40);
+	}
+}
+
+/*
+ * Upscale the IPU3 10-bit format to 16-bit as it's not trivial to pack it as
+ * 10-bit without gaps. The IPU3 format stores 25 pixels in 32-byte blocks,
+ * packed contiguously in little-endian order, with the 6 last bits unused.
+ *
+ * \todo Improve packing to keep the 10-bit sample size.
+ */
+void packScanlineIPU3(void *output, const void *input, unsigned int width)
+{
+	const uint8_t *in = static_cast<const uint8_t *>(input);
+	uint16_t *out = static_cast<uint16_t *>(output);
+	unsigned int x = 0;
+
+	/* Process complete blocks as 6 groups of 4 pixels and a last pixel. */
+	for (; x + 25 <= width; x += 25) {
+		for (unsigned int i = 0; i < 6; i++) {
+			uint64_t group = static_cast<uint64_t>(in[0]) |
+					 (static_cast<uint64_t>(in[1]) << 8) |
+					 (static_cast<uint64_t>(in[2]) << 16) |
+					 (static_cast<uint64_t>(in[3]) << 24) |
+					 (static_cast<uint64_t>(in[4]) << 32);
+
+			out[0] = (group & 0x3ff) << 6;
+			out[1] = ((group >> 10) & 0x3ff) << 6;
+			out[2] = ((group >> 20) & 0x3ff) << 6;
+			out[3] = ((group >> 30) & 0x3ff) << 6;
+
+			in += 5;
+			out += 4;
+		}
+
+		*out++ = ((in[1] & 0x03) << 8 | in[0]) << 6;
+		in += 2;
+	}
+
+	/* Process the pixels of the last incomplete block, if any. */
+	for (unsigned int pixel = 0; x < width; x++, pixel++) {
+		unsigned int bit = pixel * 10;
+		const uint8_t *p = in + bit / 8;
+		unsigned int value = ((p[0] | p[1] << 8) >> (bit % 8)) & 0x3ff;
+
+		*out++ = value << 6;
+	}
+}
+
+/* Pad the strip buffers for the packing functions that write past the row end. */
+static constexpr size_t kStripPadding = 8;
+
+DNGPacker::DNGPacker(PackScanline packScanline, unsigned int bitsPerSample,
+		     unsigned int width, unsigned int height,
+		     unsigned int stride)
+	: packScanline_(packScanline), width_(width), height_(height),
+	  stride_(stride), rowSize_((width * bitsPerSample + 7) / 8),
+	  rowsPerStrip_(64), threads_(std::thread::hardware_concurrency())
+{
+}
+
+/*
+ * The strip height is the unit of work for the packing threads, and the unit
+ * of output. It is rounded up to an even number of rows to keep the CFA
+ * pattern identical in all strips.
+ */
+void DNGPacker::setRowsPerStrip(unsigned int rows)
+{
+	rowsPerStrip_ = std::max((rows + 1) & ~1U, 2U);
+}
+
+/*
+ * Set the number of threads used to pack the strips. The strips are packed on
+ * the calling thread when set to 0 or 1.
+ */
+void DNGPacker::setThreads(unsigned int threads)
+{
+	threads_ = threads;
+}
+
+unsigned int DNGPacker::strips() const
+{
+	return (height_ + rowsPerStrip_ - 1) / rowsPerStrip_;
+}
+
+unsigned int DNGPacker::stripRows(unsigned int strip) const
+{
+	return std::min(rowsPerStrip_, height_ - strip * rowsPerStrip_);
+}
+
+void DNGPacker::packStrip(unsigned int strip, const uint8_t *input,
+			  uint8_t *output) const
+{
+	const uint8_t *row = input + static_cast<size_t>(strip) * rowsPerStrip_ * stride_;
+	unsigned int rows = stripRows(strip);
+
+	for (unsigned int y = 0; y < rows; y++) {
+		packScanline_(output, row, width_);
+		output += rowSize_;
+		row += stride_;
+	}
+}
+
+/*
+ * Pack the raw image in strips of rowsPerStrip() rows, and call \a write for
+ * each of them in order. The strips are packed in parallel by a pool of
+ * threads, while the calling thread writes them out as soon as they complete.
+ * The number of strips packed ahead of the writer is bounded, to limit memory
+ * usage.
+ *
+ * Return 0 on success, or the first negative error code returned by \a write,
+ * in which case packing is aborted.
+ */
+int DNGPacker::pack(const void *input, const WriteStrip &write) const
+{
+	const uint8_t *data = static_cast<const uint8_t *>(input);
+	unsigned int count = strips();
+	unsigned int threads = std::min(threads_, count);
+
+	if (threads <= 1) {
+		std::vector<uint8_t> buffer(rowsPerStrip_ * rowSize_ + kStripPadding);
+
+		for (unsigned int strip = 0; strip < count; ++strip) {
+			packStrip(strip, data, buffer.data());
+
+			int ret = write(strip, buffer.data(),
+					stripRows(strip) * rowSize_);
+			if (ret < 0)
+				return ret;
+		}
+
+		return 0;
+	}
+
+	/* Strip s is packed to buffer s % window once strip s - window is written. */
+	unsigned int window = std::min(threads * 2, count);
+	std::vector<std::vector<uint8_t>> buffers(window);
+	std::vector<int> packed(window, -1);
+
+	for (std::vector<uint8_t> &buffer : buffers)
+		buffer.resize(rowsPerStrip_ * rowSize_ + kStripPadding);
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	unsigned int next = 0;
+	unsigned int written = 0;
+	bool abort = false;
+
+	auto worker = [&]() {
+		std::unique_lock<std::mutex> locker(mutex);
+
+		while (true) {
+			cond.wait(locker, [&]() {
+				return abort || next >= count || next < written + window;
+			});
+			if (abort || next >= count)
+				return;
+
+			unsigned int strip = next++;
+			locker.unlock();
+
+			packStrip(strip, data, buffers[strip % window].data());
+
+			locker.lock();
+			packed[strip % window] = strip;
+			cond.notify_all();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < threads; ++i)
+		workers.emplace_back(worker);
+
+	int ret = 0;
+
+	for (unsigned int strip = 0; strip < count; ++strip) {
+		unsigned int index = strip % window;
+
+		std::unique_lock<std::mutex> locker(mutex);
+		cond.wait(locker, [&]() {
+			return packed[index] == static_cast<int>(strip);
+		});
+		locker.unlock();
+
+		ret = write(strip, buffers[index].data(),
+			    stripRows(strip) * rowSize_);
+
+		locker.lock();
+		if (ret < 0)
+			abort = true;
+		else
+			written++;
+		cond.notify_all();
+
+		if (ret < 0)
+			break;
+	}
+
+	for (std::thread &thread : workers)
+		thread.join();
+
+	return ret;
+}
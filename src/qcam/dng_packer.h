@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Ltd.
+ *
+ * dng_packer.h - DNG raw data packing
+ */
+#ifndef __QCAM_DNG_PACKER_H__
+#define __QCAM_DNG_PACKER_H__
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+void packScanlineSBGGR10P(void *output, const void *input, unsigned int width);
+void packScanlineSBGGR12P(void *output, const void *input, unsigned int width);
+void packScanlineIPU3(void *output, const void *input, unsigned int width);
+
+class DNGPacker
+{
+public:
+	using PackScanline = void (*)(void *output, const void *input,
+				      unsigned int width);
+	using WriteStrip = std::function<int(unsigned int strip, const void *data,
+					     size_t size)>;
+
+	DNGPacker(PackScanline packScanline, unsigned int bitsPerSample,
+		  unsigned int width, unsigned int height, unsigned int stride);
+
+	void setRowsPerStrip(unsigned int rows);
+	void setThreads(unsigned int threads);
+
+	unsigned int rowsPerStrip() const { return rowsPerStrip_; }
+	unsigned int strips() const;
+	size_t rowSize() const { return rowSize_; }
+
+	int pack(const void *input, const WriteStrip &write) const;
+
+private:
+	void packStrip(unsigned int strip, const uint8_t *input,
+		       uint8_t *output) const;
+	unsigned int stripRows(unsigned int strip) const;
+
+	PackScanline packScanline_;
+	unsigned int width_;
+	unsigned int height_;
+	unsigned int stride_;
+	size_t rowSize_;
+
+	unsigned int rowsPerStrip_;
+	unsigned int threads_;
+};
+
+#endif /* __QCAM_DNG_PACKER_H__ */
@@ -8,14 +8,18 @@
 #include "dng_writer.h"
 
 #include <algorithm>
+#include <errno.h>
 #include <iostream>
 #include <map>
+#include <vector>
 
 #include <tiffio.h>
 
 #include <libcamera/control_ids.h>
 #include <libcamera/formats.h>
 
+#include "dng_packer.h"
+
 using namespace libcamera;
 
 enum CFAPatternColour : uint8_t {
@@ -125,36 +129,6 @@ struct Matrix3d {
 	float m[9];
 };
 
-void packScanlineSBGGR10P(void *output, const void *input, unsigned int width)
-{
-	const uint8_t *in = static_cast<const uint8_t *>(input);
-	uint8_t *out = static_cast<uint8_t *>(output);
-
-	/* \todo Can this be made more efficient? */
-	for (unsigned int x = 0; x < width; x += 4) {
-		*out++ = in[0];
-		*out++ = (in[4] & 0x03) << 6 | in[1] >> 2;
-		*out++ = (in[1] & 0x03) << 6 | (in[4] & 0x0c) << 2 | in[2] >> 4;
-		*out++ = (in[2] & 0x0f) << 4 | (in[4] & 0x30) >> 2 | in[3] >> 6;
-		*out++ = (in[3] & 0x3f) << 2 | (in[4] & 0xc0) >> 6;
-		in += 5;
-	}
-}
-
-void packScanlineSBGGR12P(void *output, const void *input, unsigned int width)
-{
-	const uint8_t *in = static_cast<const uint8_t *>(input);
-	uint8_t *out = static_cast<uint8_t *>(output);
-
-	/* \todo Can this be made more efficient? */
-	for (unsigned int i = 0; i < width; i += 2) {
-		*out++ = in[0];
-		*out++ = (in[2] & 0x0f) << 4 | in[1] >> 4;
-		*out++ = (in[1] & 0x0f) << 4 | in[2] >> 4;
-		in += 3;
-	}
-}
-
 void thumbScanlineSBGGRxxP(const FormatInfo &info, void *output,
 			   const void *input, unsigned int width,
 			   unsigned int stride)
@@ -174,47 +148,6 @@ void thumbScanlineSBGGRxxP(const FormatInfo &info, void *output,
 	}
 }
 
-void packScanlineIPU3(void *output, const void *input, unsigned int width)
-{
-	const uint8_t *in = static_cast<const uint8_t *>(input);
-	uint16_t *out = static_cast<uint16_t *>(output);
-
-	/*
-	 * Upscale the 10-bit format to 16-bit as it's not trivial to pack it
-	 * as 10-bit without gaps.
-	 *
-	 * \todo Improve packing to keep the 10-bit sample size.
-	 */
-	unsigned int x = 0;
-	while (true) {
-		for (unsigned int i = 0; i < 6; i++) {
-			*out++ = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
-			if (++x >= width)
-				return;
-
-			*out++ = (in[2] & 0x0f) << 12 | (in[1] & 0xfc) << 4;
-			if (++x >= width)
-				return;
-
-			*out++ = (in[3] & 0x3f) << 10 | (in[2] & 0xf0) << 2;
-			if (++x >= width)
-				return;
-
-			*out++ = (in[4] & 0xff) <<  8 | (in[3] & 0xc0) << 0;
-			if (++x >= width)
-				return;
-
-			in += 5;
-		}
-
-		*out++ = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
-		if (++x >= width)
-			return;
-
-		in += 2;
-	}
-}
-
 void thumbScanlineIPU3([[maybe_unused]] const FormatInfo &info, void *output,
 		       const void *input, unsigned int width,
 		       unsigned int stride)
@@ -366,12 +299,8 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 		return -EINVAL;
 	}
 
-	/*
-	 * Scanline buffer, has to be large enough to store both a RAW scanline
-	 * or a thumbnail scanline. The latter will always be much smaller than
-	 * the former as we downscale by 16 in both directions.
-	 */
-	uint8_t scanline[(config.size.width * info->bitsPerSample + 7) / 8];
+	/* Thumbnail scanline buffer, downscaled by 16 in both directions. */
+	std::vector<uint8_t> scanline(config.size.width / 16 * 3);
 
 	toff_t rawIFDOffset = 0;
 	toff_t exifIFDOffset = 0;
@@ -466,10 +395,10 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	/* Write the thumbnail. */
 	const uint8_t *row = static_cast<const uint8_t *>(data);
 	for (unsigned int y = 0; y < config.size.height / 16; y++) {
-		info->thumbScanline(*info, &scanline, row,
+		info->thumbScanline(*info, scanline.data(), row,
 				    config.size.width / 16, config.stride);
 
-		if (TIFFWriteScanline(tif, &scanline, y, 0) != 1) {
+		if (TIFFWriteScanline(tif, scanline.data(), y, 0) != 1) {
 			std::cerr << "Failed to write thumbnail scanline"
 				  << std::endl;
 			TIFFClose(tif);
@@ -545,19 +474,25 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_BLACKLEVEL, 4, &blackLevel);
 	TIFFSetField(tif, TIFFTAG_WHITELEVEL, 1, &whiteLevel);
 
-	/* Write RAW content. */
-	row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height; y++) {
-		info->packScanline(&scanline, row, config.size.width);
-
-		if (TIFFWriteScanline(tif, &scanline, y, 0) != 1) {
-			std::cerr << "Failed to write RAW scanline"
-				  << std::endl;
-			TIFFClose(tif);
-			return -EINVAL;
-		}
-
-		row += config.stride;
+	/*
+	 * Write RAW content. The image is packed in strips by multiple
+	 * threads, and the strips are written as they complete.
+	 */
+	DNGPacker packer(info->packScanline, info->bitsPerSample,
+			 config.size.width, config.size.height, config.stride);
+	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, packer.rowsPerStrip());
+
+	int ret = packer.pack(data, [&](unsigned int strip, const void *stripData,
+					size_t size) {
+		if (TIFFWriteEncodedStrip(tif, strip, const_cast<void *>(stripData),
+					  size) < 0)
+			return -EIO;
+		return 0;
+	});
+	if (ret < 0) {
+		std::cerr << "Failed to write RAW strip" << std::endl;
+		TIFFClose(tif);
+		return ret;
 	}
 
 	/* Checkpoint the IFD to retrieve its offset, and write it out. */
@@ -608,3 +543,27 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 
 	return 0;
 }
+
+/*
+ * Write the DNG file in a separate thread. The \a camera, \a buffer and \a
+ * data must stay valid until the returned future becomes ready. The \a
+ * complete function, if set, is called from the writing thread with the
+ * result of the operation.
+ */
+std::future<int> DNGWriter::writeAsync(const std::string &filename,
+				       const Camera *camera,
+				       const StreamConfiguration &config,
+				       const ControlList &metadata,
+				       const FrameBuffer *buffer,
+				       const void *data,
+				       std::function<void(int)> complete)
+{
+	return std::async(std::launch::async,
+			  [=]() {
+				  int ret = write(filename.c_str(), camera, config,
+						  metadata, buffer, data);
+				  if (complete)
+					  complete(ret);
+				  return ret;
+			  });
+}
@@ -10,6 +10,10 @@
 #ifdef HAVE_TIFF
 #define HAVE_DNG
 
+#include <functional>
+#include <future>
+#include <string>
+
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
 #include <libcamera/controls.h>
@@ -24,6 +28,14 @@ public:
 			 const StreamConfiguration &config,
 			 const ControlList &metadata,
 			 const FrameBuffer *buffer, const void *data);
+
+	static std::future<int> writeAsync(const std::string &filename,
+					   const Camera *camera,
+					   const StreamConfiguration &config,
+					   const ControlList &metadata,
+					   const FrameBuffer *buffer,
+					   const void *data,
+					   std::function<void(int)> complete = nullptr);
 };
 
 #endif /* HAVE_TIFF */
@@ -19,6 +19,7 @@
 #include <QInputDialog>
 #include <QMutexLocker>
 #include <QStandardPaths>
+#include <QStatusBar>
 #include <QTimer>
 #include <QToolBar>
 #include <QToolButton>
@@ -91,10 +92,13 @@ private:
 
 MainWindow::MainWindow(CameraManager *cm, const OptionsParser::Options &options)
 	: saveRaw_(nullptr), options_(options), cm_(cm), allocator_(nullptr),
-	  isCapturing_(false), captureRaw_(false)
+	  isCapturing_(false), captureRaw_(false), captureSession_(0)
 {
 	int ret;
 
+	/* Raw buffers are passed to rawSaved() through queued invocations. */
+	qRegisterMetaType<libcamera::FrameBuffer *>();
+
 	/*
 	 * Initialize the UI: Create the toolbar, set the window title and
 	 * create the viewfinder widget.
@@ -225,6 +229,14 @@ void MainWindow::updateTitle()
 	previousFrames_ = framesCaptured_;
 
 	setWindowTitle(title_ + " : " + QString::number(fps, 'f', 2) + " fps");
+
+	/*
+	 * Frames converted for display are rendered in a separate thread,
+	 * which skips the frames it can't keep up with.
+	 */
+	statusBar()->showMessage(QString::number(framesCaptured_) + " frames captured, "
+				 + QString::number(viewfinder_->framesDropped())
+				 + " dropped for display");
 }
 
 /* -----------------------------------------------------------------------------
@@ -482,6 +494,7 @@ int MainWindow::startCapture()
 	previousFrames_ = 0;
 	framesCaptured_ = 0;
 	lastBufferTime_ = 0;
+	captureSession_++;
 
 	ret = camera_->start();
 	if (ret) {
@@ -548,6 +561,10 @@ void MainWindow::stopCapture()
 
 	camera_->requestCompleted.disconnect(this, &MainWindow::requestComplete);
 
+	/* Wait for the raw file being saved, if any, before freeing buffers. */
+	if (rawSave_.valid())
+		rawSave_.wait();
+
 	for (auto &iter : mappedBuffers_) {
 		const MappedBuffer &buffer = iter.second;
 		munmap(buffer.memory, buffer.size);
@@ -570,6 +587,7 @@ void MainWindow::stopCapture()
 
 	titleTimer_.stop();
 	setWindowTitle(title_);
+	statusBar()->clearMessage();
 }
 
 /* -----------------------------------------------------------------------------
@@ -646,13 +664,45 @@ void MainWindow::processRaw(FrameBuffer *buffer,
 							"DNG Files (*.dng)");
 
 	if (!filename.isEmpty()) {
+		/*
+		 * Save the file in the background, and hold the buffer until
+		 * the save completes. Tag the save with the capture session,
+		 * as the buffer is freed if capture stops in the meantime.
+		 */
 		const MappedBuffer &mapped = mappedBuffers_[buffer];
-		DNGWriter::write(filename.toStdString().c_str(), camera_.get(),
-				 rawStream_->configuration(), metadata, buffer,
-				 mapped.memory);
+		unsigned int session = captureSession_;
+		saveRaw_->setEnabled(false);
+		rawSave_ = DNGWriter::writeAsync(filename.toStdString(), camera_.get(),
+						 rawStream_->configuration(), metadata,
+						 buffer, mapped.memory,
+						 [this, buffer, session](int ret) {
+			QMetaObject::invokeMethod(this, "rawSaved", Qt::QueuedConnection,
+						  Q_ARG(libcamera::FrameBuffer *, buffer),
+						  Q_ARG(int, ret),
+						  Q_ARG(unsigned int, session));
+		});
+		return;
 	}
 #endif
 
+	rawSaved(buffer, 0, captureSession_);
+}
+
+void MainWindow::rawSaved(FrameBuffer *buffer, int ret, unsigned int session)
+{
+	/*
+	 * The buffer has been freed if capture has stopped since the save
+	 * started, even if it has been restarted since then.
+	 */
+	if (!isCapturing_ || session != captureSession_)
+		return;
+
+	if (ret < 0)
+		qWarning() << "Failed to save DNG file:" << ret;
+
+	if (saveRaw_)
+		saveRaw_->setEnabled(true);
+
 	{
 		QMutexLocker locker(&mutex_);
 		freeBuffers_[rawStream_].enqueue(buffer);
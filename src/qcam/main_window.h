@@ -7,11 +7,13 @@
 #ifndef __QCAM_MAIN_WINDOW_H__
 #define __QCAM_MAIN_WINDOW_H__
 
+#include <future>
 #include <memory>
 
 #include <QElapsedTimer>
 #include <QIcon>
 #include <QMainWindow>
+#include <QMetaType>
 #include <QMutex>
 #include <QObject>
 #include <QQueue>
@@ -77,6 +79,8 @@ private Q_SLOTS:
 	void saveImageAs();
 	void captureRaw();
 	void processRaw(FrameBuffer *buffer, const ControlList &metadata);
+	void rawSaved(libcamera::FrameBuffer *buffer, int ret,
+		      unsigned int session);
 
 	void queueRequest(FrameBuffer *buffer);
 
@@ -124,11 +128,13 @@ private:
 	/* Capture state, buffers queue and statistics */
 	bool isCapturing_;
 	bool captureRaw_;
+	unsigned int captureSession_;
 	Stream *vfStream_;
 	Stream *rawStream_;
 	std::map<const Stream *, QQueue<FrameBuffer *>> freeBuffers_;
 	QQueue<CaptureRequest> doneQueue_;
 	QMutex mutex_; /* Protects freeBuffers_ and doneQueue_ */
+	std::future<int> rawSave_;
 
 	uint64_t lastBufferTime_;
 	QElapsedTimer frameRateInterval_;
@@ -136,4 +142,6 @@ private:
 	uint32_t framesCaptured_;
 };
 
+Q_DECLARE_METATYPE(libcamera::FrameBuffer *)
+
 #endif /* __QCAM_MAIN_WINDOW__ */
@@ -7,7 +7,6 @@
 
 #include "viewfinder.h"
 
-#include <stdint.h>
 #include <utility>
 
 #include <QImage>
@@ -15,10 +14,13 @@
 #include <QMap>
 #include <QMutexLocker>
 #include <QPainter>
+#include <QThread>
 #include <QtDebug>
 
+#include <libcamera/buffer.h>
 #include <libcamera/formats.h>
 
+#include "../cam/buffer_sync.h"
 #include "format_converter.h"
 
 static const QMap<libcamera::PixelFormat, QImage::Format> nativeFormats
@@ -33,14 +35,45 @@ static const QMap<libcamera::PixelFormat, QImage::Format> nativeFormats
 	{ libcamera::formats::BGR888, QImage::Format_RGB888 },
 };
 
+class RenderThread : public QThread
+{
+public:
+	RenderThread(ViewFinder *viewfinder)
+		: viewfinder_(viewfinder)
+	{
+	}
+
+protected:
+	void run() override
+	{
+		viewfinder_->renderLoop();
+	}
+
+private:
+	ViewFinder *viewfinder_;
+};
+
 ViewFinder::ViewFinder(QWidget *parent)
-	: QWidget(parent), buffer_(nullptr)
+	: QWidget(parent), buffer_(nullptr), renderExit_(false),
+	  rendering_(false), inFlight_(nullptr), pending_(nullptr),
+	  pendingMap_(nullptr), framesDropped_(0)
 {
 	icon_ = QIcon(":camera-off.svg");
+
+	renderThread_ = new RenderThread(this);
+	renderThread_->start();
 }
 
 ViewFinder::~ViewFinder()
 {
+	{
+		QMutexLocker locker(&mutex_);
+		renderExit_ = true;
+		renderCond_.wakeAll();
+	}
+
+	renderThread_->wait();
+	delete renderThread_;
 }
 
 const QList<libcamera::PixelFormat> &ViewFinder::nativeFormats() const
@@ -52,7 +85,11 @@ const QList<libcamera::PixelFormat> &ViewFinder::nativeFormats() const
 int ViewFinder::setFormat(const libcamera::PixelFormat &format,
 			  const QSize &size)
 {
+	QMutexLocker locker(&mutex_);
+
 	image_ = QImage();
+	renderImage_ = QImage();
+	framesDropped_ = 0;
 
 	/*
 	 * If format conversion is needed, configure the converter and allocate
@@ -64,6 +101,7 @@ int ViewFinder::setFormat(const libcamera::PixelFormat &format,
 			return ret;
 
 		image_ = QImage(size, QImage::Format_RGB32);
+		renderImage_ = QImage(size, QImage::Format_RGB32);
 
 		qInfo() << "Using software format conversion from"
 			<< format.toString().c_str();
@@ -74,6 +112,8 @@ int ViewFinder::setFormat(const libcamera::PixelFormat &format,
 	format_ = format;
 	size_ = size;
 
+	locker.unlock();
+
 	updateGeometry();
 	return 0;
 }
@@ -102,16 +142,26 @@ void ViewFinder::render(libcamera::FrameBuffer *buffer, MappedBuffer *map)
 			 * \todo Get the stride from the buffer instead of
 			 * computing it naively
 			 */
+			syncBuffer(buffer, DMA_BUF_SYNC_START);
 			image_ = QImage(memory, size_.width(), size_.height(),
 					size / size_.height(),
 					::nativeFormats[format_]);
 			std::swap(buffer, buffer_);
+			if (buffer)
+				syncBuffer(buffer, DMA_BUF_SYNC_END);
 		} else {
 			/*
-			 * Otherwise, convert the format and release the frame
-			 * buffer immediately.
+			 * Otherwise, hand the buffer to the render thread for
+			 * conversion. If the previous buffer hasn't been picked
+			 * up yet, it is superseded and released immediately
+			 * without being displayed.
 			 */
-			converter_.convert(memory, size, &image_);
+			std::swap(buffer, pending_);
+			pendingMap_ = map;
+			if (buffer)
+				framesDropped_++;
+
+			renderCond_.wakeOne();
 		}
 	}
 
@@ -121,11 +171,103 @@ void ViewFinder::render(libcamera::FrameBuffer *buffer, MappedBuffer *map)
 		renderComplete(buffer);
 }
 
+void ViewFinder::renderLoop()
+{
+	QMutexLocker locker(&mutex_);
+
+	while (true) {
+		/* Wait for the previous buffer to be handed back. */
+		while ((!pending_ || inFlight_) && !renderExit_)
+			renderCond_.wait(&mutex_);
+
+		if (renderExit_)
+			break;
+
+		libcamera::FrameBuffer *buffer = pending_;
+		unsigned char *memory = static_cast<unsigned char *>(pendingMap_->memory);
+		size_t size = buffer->metadata().planes[0].bytesused;
+		pending_ = nullptr;
+		inFlight_ = buffer;
+		rendering_ = true;
+
+		/* Convert without holding the lock, and publish the result. */
+		locker.unlock();
+
+		syncBuffer(buffer, DMA_BUF_SYNC_START);
+		converter_.convert(memory, size, &renderImage_);
+		syncBuffer(buffer, DMA_BUF_SYNC_END);
+
+		locker.relock();
+
+		std::swap(image_, renderImage_);
+		rendering_ = false;
+		renderCond_.wakeAll();
+
+		locker.unlock();
+
+		/*
+		 * The buffer is handed back to the application from the GUI
+		 * thread, unless stop() has returned it in the meantime.
+		 */
+		QMetaObject::invokeMethod(this, "renderDone", Qt::QueuedConnection);
+
+		locker.relock();
+	}
+}
+
+void ViewFinder::renderDone()
+{
+	libcamera::FrameBuffer *buffer;
+
+	{
+		QMutexLocker locker(&mutex_);
+
+		/*
+		 * A notification queued before stop() may arrive while the
+		 * next buffer is being converted, leave that buffer alone.
+		 */
+		if (rendering_)
+			return;
+
+		buffer = inFlight_;
+		inFlight_ = nullptr;
+		renderCond_.wakeAll();
+	}
+
+	update();
+
+	if (buffer)
+		renderComplete(buffer);
+}
+
 void ViewFinder::stop()
 {
-	image_ = QImage();
+	libcamera::FrameBuffer *pending;
+	libcamera::FrameBuffer *inFlight;
+
+	{
+		QMutexLocker locker(&mutex_);
+
+		/* Wait for the conversion in progress, if any, to complete. */
+		while (rendering_)
+			renderCond_.wait(&mutex_);
+
+		pending = pending_;
+		pending_ = nullptr;
+		inFlight = inFlight_;
+		inFlight_ = nullptr;
+
+		image_ = QImage();
+	}
+
+	if (inFlight)
+		renderComplete(inFlight);
+
+	if (pending)
+		renderComplete(pending);
 
 	if (buffer_) {
+		syncBuffer(buffer_, DMA_BUF_SYNC_END);
 		renderComplete(buffer_);
 		buffer_ = nullptr;
 	}
@@ -140,14 +282,25 @@ QImage ViewFinder::getCurrentImage()
 	return image_.copy();
 }
 
+unsigned int ViewFinder::framesDropped()
+{
+	QMutexLocker locker(&mutex_);
+
+	return framesDropped_;
+}
+
 void ViewFinder::paintEvent(QPaintEvent *)
 {
 	QPainter painter(this);
 
 	/* If we have an image, draw it. */
-	if (!image_.isNull()) {
-		painter.drawImage(rect(), image_, image_.rect());
-		return;
+	{
+		QMutexLocker locker(&mutex_);
+
+		if (!image_.isNull()) {
+			painter.drawImage(rect(), image_, image_.rect());
+			return;
+		}
 	}
 
 	/*
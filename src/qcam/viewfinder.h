@@ -14,6 +14,7 @@
 #include <QImage>
 #include <QMutex>
 #include <QSize>
+#include <QWaitCondition>
 #include <QWidget>
 
 #include <libcamera/buffer.h>
@@ -22,6 +23,7 @@
 #include "format_converter.h"
 
 class QImage;
+class RenderThread;
 
 struct MappedBuffer {
 	void *memory;
@@ -43,6 +45,7 @@ public:
 	void stop();
 
 	QImage getCurrentImage();
+	unsigned int framesDropped();
 
 Q_SIGNALS:
 	void renderComplete(libcamera::FrameBuffer *buffer);
@@ -51,7 +54,14 @@ protected:
 	void paintEvent(QPaintEvent *) override;
 	QSize sizeHint() const override;
 
+private Q_SLOTS:
+	void renderDone();
+
 private:
+	friend class RenderThread;
+
+	void renderLoop();
+
 	FormatConverter converter_;
 
 	libcamera::PixelFormat format_;
@@ -65,7 +75,23 @@ private:
 	/* Buffer and render image */
 	libcamera::FrameBuffer *buffer_;
 	QImage image_;
-	QMutex mutex_; /* Prevent concurrent access to image_ */
+	QMutex mutex_; /* Protects image_ and the render thread state */
+
+	/*
+	 * Format conversion runs in the render thread, which converts the
+	 * most recent pending buffer to renderImage_ and then swaps it with
+	 * image_. The converted buffer stays in flight until it is handed
+	 * back by the GUI thread, or by stop().
+	 */
+	RenderThread *renderThread_;
+	QWaitCondition renderCond_;
+	bool renderExit_;
+	bool rendering_;
+	libcamera::FrameBuffer *inFlight_;
+	libcamera::FrameBuffer *pending_;
+	MappedBuffer *pendingMap_;
+	QImage renderImage_;
+	unsigned int framesDropped_;
 };
 
 #endif /* __QCAM_VIEWFINDER__ */
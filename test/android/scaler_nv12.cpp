@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * scaler_nv12.cpp - NV12 software scaler test
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/geometry.h>
+
+#include "scaler_nv12.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+/* Value stored outside of the crop rectangle and in the line padding. */
+constexpr uint8_t kPoison = 0xa5;
+
+/* Value written outside of the crop rectangle to check the edge taps. */
+constexpr uint8_t kNoise = 0x5a;
+
+/* Maximum difference with the reference, due to the 8-bit fixed-point weights. */
+constexpr int kTolerance = 2;
+
+struct ScalingCase {
+	Size input;
+	Size output;
+	unsigned int threads;
+};
+
+const ScalingCase scalingCases[] = {
+	{ { 640, 480 }, { 320, 240 }, 1 },
+	{ { 640, 480 }, { 640, 480 }, 2 },
+	{ { 1920, 1080 }, { 640, 480 }, 4 },
+	{ { 1280, 720 }, { 176, 144 }, 8 },
+	{ { 640, 480 }, { 640, 360 }, 3 },
+	{ { 480, 640 }, { 240, 240 }, 2 },
+	{ { 4, 4 }, { 2, 2 }, 1 },
+};
+
+struct Frame {
+	Frame(const Size &s, unsigned int padding)
+		: size(s), stride(s.width + padding),
+		  data(stride * s.height * 3 / 2, kPoison)
+	{
+	}
+
+	ScalerNV12::Image image()
+	{
+		return { data.data(), data.data() + stride * size.height,
+			 stride, stride };
+	}
+
+	uint8_t &luma(unsigned int x, unsigned int y)
+	{
+		return data[y * stride + x];
+	}
+
+	uint8_t &chroma(unsigned int x, unsigned int y)
+	{
+		return data[stride * size.height + y * stride + x];
+	}
+
+	Size size;
+	unsigned int stride;
+	vector<uint8_t> data;
+};
+
+/*
+ * Interpolate one plane component bilinearly, using floating point
+ * arithmetic. Output samples are centered on the corresponding area of the
+ * crop rectangle, and clamped to its edges.
+ */
+double reference(Frame &frame, bool chroma, unsigned int component,
+		 const Rectangle &crop, unsigned int x, unsigned int y,
+		 const Size &output)
+{
+	unsigned int div = chroma ? 2 : 1;
+	double cropX = crop.x / div, cropY = crop.y / div;
+	double cropWidth = crop.width / div, cropHeight = crop.height / div;
+
+	double sx = cropX + (x + 0.5) * cropWidth / (output.width / div) - 0.5;
+	double sy = cropY + (y + 0.5) * cropHeight / (output.height / div) - 0.5;
+	sx = clamp(sx, cropX, cropX + cropWidth - 1);
+	sy = clamp(sy, cropY, cropY + cropHeight - 1);
+
+	unsigned int x0 = min<unsigned int>(sx, cropX + cropWidth - 2);
+	unsigned int y0 = min<unsigned int>(sy, cropY + cropHeight - 2);
+	double fx = sx - x0, fy = sy - y0;
+
+	auto sample = [&](unsigned int px, unsigned int py) -> double {
+		if (chroma)
+			return frame.chroma(px * 2 + component, py);
+		return frame.luma(px, py);
+	};
+
+	double top = sample(x0, y0) * (1 - fx) + sample(x0 + 1, y0) * fx;
+	double bottom = sample(x0, y0 + 1) * (1 - fx) + sample(x0 + 1, y0 + 1) * fx;
+
+	return top * (1 - fy) + bottom * fy;
+}
+
+} /* namespace */
+
+class ScalerNV12Test : public Test
+{
+protected:
+	int checkCrop(const ScalingCase &test, const Rectangle &crop)
+	{
+		const Size &input = test.input;
+		const Size &output = test.output;
+
+		/* The crop rectangle must be aligned to chroma samples. */
+		if (crop.x % 2 || crop.y % 2 || crop.width % 2 || crop.height % 2) {
+			cerr << "Crop " << crop.toString() << " not aligned" << endl;
+			return TestFail;
+		}
+
+		/* It must cover the input in one direction, and be centered. */
+		if ((crop.width != input.width && crop.height != input.height) ||
+		    crop.x + crop.width > input.width ||
+		    crop.y + crop.height > input.height ||
+		    abs(static_cast<int>(input.width - crop.width) - 2 * crop.x) > 2 ||
+		    abs(static_cast<int>(input.height - crop.height) - 2 * crop.y) > 2) {
+			cerr << "Crop " << crop.toString() << " not centered in "
+			     << input.toString() << endl;
+			return TestFail;
+		}
+
+		/* And match the output aspect ratio. */
+		int64_t error = static_cast<int64_t>(crop.width) * output.height -
+				static_cast<int64_t>(crop.height) * output.width;
+		if (abs(error) > 2 * max(output.width, output.height)) {
+			cerr << "Crop " << crop.toString() << " doesn't match "
+			     << output.toString() << " aspect ratio" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testScaling(const ScalingCase &test)
+	{
+		const Size &outputSize = test.output;
+		string name = test.input.toString() + " to " + outputSize.toString();
+
+		ScalerNV12 scaler;
+		if (scaler.configure(test.input, outputSize, test.threads)) {
+			cerr << name << ": failed to configure scaler" << endl;
+			return TestFail;
+		}
+
+		const Rectangle &crop = scaler.crop();
+		int ret = checkCrop(test, crop);
+		if (ret != TestPass)
+			return ret;
+
+		/* Fill the crop rectangle with random data, leave the rest poisoned. */
+		Frame input(test.input, 32);
+		mt19937 gen(42);
+		uniform_int_distribution<unsigned int> dist(0, 255);
+
+		for (unsigned int y = 0; y < crop.height; ++y) {
+			for (unsigned int x = 0; x < crop.width; ++x) {
+				input.luma(crop.x + x, crop.y + y) = dist(gen);
+				input.chroma(crop.x + x, (crop.y + y) / 2) = dist(gen);
+			}
+		}
+
+		Frame output(outputSize, 16);
+		ret = scaler.scale(input.image(), output.image());
+		if (ret) {
+			cerr << name << ": scaling failed" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int y = 0; y < outputSize.height; ++y) {
+			for (unsigned int x = 0; x < output.stride; ++x) {
+				/* The line padding must not be written. */
+				if (x >= outputSize.width) {
+					if (output.luma(x, y) != kPoison ||
+					    output.chroma(x, y / 2) != kPoison) {
+						cerr << name << ": padding overwritten"
+						     << endl;
+						return TestFail;
+					}
+					continue;
+				}
+
+				double expected = reference(input, false, 0, crop,
+							    x, y, outputSize);
+				if (abs(output.luma(x, y) - lround(expected)) > kTolerance) {
+					cerr << name << ": luma (" << x << ", " << y
+					     << ") is " << static_cast<int>(output.luma(x, y))
+					     << ", expected " << expected << endl;
+					return TestFail;
+				}
+
+				if (y % 2)
+					continue;
+
+				expected = reference(input, true, x % 2, crop,
+						     x / 2, y / 2, outputSize);
+				if (abs(output.chroma(x, y / 2) - lround(expected)) > kTolerance) {
+					cerr << name << ": chroma (" << x << ", " << y / 2
+					     << ") is " << static_cast<int>(output.chroma(x, y / 2))
+					     << ", expected " << expected << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		/*
+		 * The edge taps must stay within the crop rectangle. Change all
+		 * the data outside of it, the output must not change.
+		 */
+		vector<uint8_t> result = output.data;
+
+		for (unsigned int y = 0; y < test.input.height; ++y) {
+			for (unsigned int x = 0; x < input.stride; ++x) {
+				int px = x, py = y;
+				if (px >= crop.x && px < crop.x + static_cast<int>(crop.width) &&
+				    py >= crop.y && py < crop.y + static_cast<int>(crop.height))
+					continue;
+
+				input.luma(x, y) = kNoise;
+				input.chroma(x, y / 2) = kNoise;
+			}
+		}
+
+		/* Scale again with multiple threads, the output must be identical. */
+		ScalerNV12 threaded;
+		if (threaded.configure(test.input, outputSize, 4)) {
+			cerr << name << ": failed to configure scaler" << endl;
+			return TestFail;
+		}
+
+		ret = threaded.scale(input.image(), output.image());
+		if (ret || output.data != result) {
+			cerr << name << ": output depends on data outside of the crop"
+			     << " rectangle or on the number of threads" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		for (const ScalingCase &test : scalingCases) {
+			int ret = testScaling(test);
+			if (ret != TestPass)
+				return ret;
+		}
+
+		/* Upscaling and odd sizes are not supported. */
+		ScalerNV12 scaler;
+		if (!scaler.configure({ 640, 480 }, { 1280, 720 }, 1) ||
+		    !scaler.configure({ 640, 480 }, { 321, 240 }, 1)) {
+			cerr << "Invalid scaling accepted" << endl;
+			return TestFail;
+		}
+
+		/* Strides smaller than the image width must be rejected. */
+		if (scaler.configure({ 640, 480 }, { 320, 240 }, 2)) {
+			cerr << "Failed to configure scaler" << endl;
+			return TestFail;
+		}
+
+		Frame input({ 640, 480 }, 0);
+		Frame output({ 320, 240 }, 0);
+		ScalerNV12::Image image = output.image();
+		image.chromaStride = 160;
+		if (!scaler.scale(input.image(), image)) {
+			cerr << "Invalid stride accepted" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ScalerNV12Test)
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * camera-statistics.cpp - Camera statistics collector test
+ */
+
+#include <iostream>
+#include <memory>
+
+#include <libcamera/buffer.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/camera_statistics.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class CameraStatisticsTest : public Test
+{
+protected:
+	int run() override
+	{
+		Stream stream;
+		CameraStatisticsCollector collector;
+
+		collector.reset({ &stream });
+
+		/* Check the initial state. */
+		CameraStatistics stats = collector.snapshot();
+		if (stats.requestsQueued || stats.completionLatency.samples ||
+		    stats.completionLatency.min.count() ||
+		    stats.streams.size() != 1) {
+			cout << "Invalid initial statistics" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Complete frames 0, 1 and 4 successfully, frame 5 with an
+		 * error, and cancel frame 6. Frames 2 and 3 have been dropped.
+		 */
+		static const struct {
+			unsigned int sequence;
+			FrameMetadata::Status status;
+		} frames[] = {
+			{ 0, FrameMetadata::FrameSuccess },
+			{ 1, FrameMetadata::FrameSuccess },
+			{ 4, FrameMetadata::FrameSuccess },
+			{ 5, FrameMetadata::FrameError },
+			{ 6, FrameMetadata::FrameCancelled },
+		};
+
+		for (unsigned int i = 0; i < std::size(frames); ++i) {
+			const auto &frame = frames[i];
+
+			collector.requestQueued(i + 1);
+
+			FrameMetadata metadata = {};
+			metadata.sequence = frame.sequence;
+			metadata.status = frame.status;
+			collector.bufferCompleted(&stream, metadata);
+
+			bool cancelled = frame.status == FrameMetadata::FrameCancelled;
+			collector.requestCompleted(cancelled, (i + 1) * 10ms, 1, 0);
+		}
+
+		collector.setQueueDepth(2);
+		collector.ipaCompleted(3ms);
+
+		stats = collector.snapshot();
+
+		if (stats.requestsQueued != 5 || stats.requestsCompleted != 4 ||
+		    stats.requestsCancelled != 1 || stats.queueDepth != 2) {
+			cout << "Invalid request counters" << endl;
+			return TestFail;
+		}
+
+		if (stats.completionLatency.samples != 4 ||
+		    stats.completionLatency.min != 10ms ||
+		    stats.completionLatency.max != 40ms ||
+		    stats.completionLatency.average != 25ms) {
+			cout << "Invalid completion latency" << endl;
+			return TestFail;
+		}
+
+		if (stats.ipaLatency.samples != 1 || stats.ipaLatency.average != 3ms) {
+			cout << "Invalid IPA latency" << endl;
+			return TestFail;
+		}
+
+		if (stats.bufferCacheHits != 5 || stats.bufferCacheMisses != 0) {
+			cout << "Invalid buffer cache counters" << endl;
+			return TestFail;
+		}
+
+		const CameraStatistics::StreamStatistics &streamStats =
+			stats.streams[&stream];
+		if (streamStats.framesCaptured != 3 ||
+		    streamStats.framesFailed != 1 ||
+		    streamStats.framesCancelled != 1 ||
+		    streamStats.framesDropped != 2) {
+			cout << "Invalid stream counters" << endl;
+			return TestFail;
+		}
+
+		/* Reconfiguring the camera resets the statistics. */
+		collector.reset({});
+		stats = collector.snapshot();
+		if (stats.requestsQueued || !stats.streams.empty()) {
+			cout << "Statistics not reset" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+} /* namespace */
+
+TEST_REGISTER(CameraStatisticsTest)
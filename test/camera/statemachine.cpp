@@ -42,6 +42,9 @@ protected:
 		if (camera_->stop() != -EACCES)
 			return TestFail;
 
+		if (camera_->setCompletionOrder(Camera::CompletionOutOfOrder) != -EACCES)
+			return TestFail;
+
 		/* Test operations which should pass. */
 		if (camera_->release())
 			return TestFail;
@@ -72,6 +75,16 @@ protected:
 		if (camera_->stop() != -EACCES)
 			return TestFail;
 
+		/* Test operations which should pass. */
+		if (camera_->setCompletionOrder(Camera::CompletionOutOfOrder))
+			return TestFail;
+
+		if (camera_->completionOrder() != Camera::CompletionOutOfOrder)
+			return TestFail;
+
+		if (camera_->setCompletionOrder(Camera::CompletionInOrder))
+			return TestFail;
+
 		/* Test valid state transitions, end in Configured state. */
 		if (camera_->release())
 			return TestFail;
@@ -143,6 +156,9 @@ protected:
 		if (camera_->start() != -EACCES)
 			return TestFail;
 
+		if (camera_->setCompletionOrder(Camera::CompletionOutOfOrder) != -EACCES)
+			return TestFail;
+
 		/* Test operations which should pass. */
 		Request *request = camera_->createRequest();
 		if (!request)
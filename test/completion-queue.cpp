@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * completion-queue.cpp - Request completion queue test
+ */
+
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <vector>
+
+#include <libcamera/camera.h>
+#include <libcamera/completion_queue.h>
+#include <libcamera/framebuffer_allocator.h>
+#include <libcamera/request.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+class CompletionQueueTest : public VirtualCameraTest, public Test
+{
+public:
+	CompletionQueueTest()
+		: VirtualCameraTest("fps=200")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		return status_;
+	}
+
+	int run() override
+	{
+		static constexpr unsigned int kFrames = 50;
+
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		unique_ptr<CameraConfiguration> config =
+			camera_->generateConfiguration({ StreamRole::VideoRecording });
+		config->at(0).bufferCount = 8;
+		if (camera_->configure(config.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config->at(0).stream();
+		FrameBufferAllocator allocator(camera_);
+		if (allocator.allocate(stream) < 0) {
+			cout << "Failed to allocate buffers" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Use a queue smaller than the number of requests in flight to
+		 * exercise the overflow path.
+		 */
+		CompletionQueue queue(2);
+		if (!queue.isValid()) {
+			cout << "Failed to create completion queue" << endl;
+			return TestFail;
+		}
+
+		camera_->setCompletionQueue(&queue);
+
+		signalled_ = false;
+		camera_->requestCompleted.connect(this, &CompletionQueueTest::requestComplete);
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (const unique_ptr<FrameBuffer> &buffer : allocator.buffers(stream)) {
+			Request *request = camera_->createRequest();
+			request->addBuffer(stream, buffer.get());
+			camera_->queueRequest(request);
+		}
+
+		/* Reap completed requests from this thread and requeue them. */
+		unsigned int completed = 0;
+		unsigned int expectedSequence = 0;
+		vector<Request *> requests;
+
+		while (completed < kFrames) {
+			struct pollfd pfd = { queue.fd(), POLLIN, 0 };
+			int ret = poll(&pfd, 1, 1000);
+			if (ret != 1) {
+				cout << "Completion queue not signalled" << endl;
+				return TestFail;
+			}
+
+			requests.clear();
+			if (!queue.reap(&requests)) {
+				cout << "Completion queue signalled without requests" << endl;
+				return TestFail;
+			}
+
+			for (Request *request : requests) {
+				if (request->status() != Request::RequestComplete ||
+				    request->sequence() != expectedSequence) {
+					cout << "Unexpected request " << request->sequence()
+					     << ", expected " << expectedSequence << endl;
+					return TestFail;
+				}
+
+				expectedSequence++;
+				completed++;
+
+				Request *next = camera_->createRequest();
+				next->addBuffer(stream, request->buffers().begin()->second);
+				camera_->queueRequest(next);
+
+				delete request;
+			}
+		}
+
+		/*
+		 * All requests in flight, cancelled by stop() or completed
+		 * since the last reap, are available when stop() returns.
+		 */
+		camera_->stop();
+
+		requests.clear();
+		queue.reap(&requests);
+		if (requests.size() != allocator.buffers(stream).size()) {
+			cout << "Expected " << allocator.buffers(stream).size()
+			     << " requests after stop, got " << requests.size() << endl;
+			return TestFail;
+		}
+
+		for (Request *request : requests)
+			delete request;
+
+		struct pollfd pfd = { queue.fd(), POLLIN, 0 };
+		if (poll(&pfd, 1, 0) != 0) {
+			cout << "Completion queue still signalled" << endl;
+			return TestFail;
+		}
+
+		if (signalled_) {
+			cout << "Request completion signal emitted" << endl;
+			return TestFail;
+		}
+
+		camera_->requestCompleted.disconnect(this, &CompletionQueueTest::requestComplete);
+		camera_->release();
+
+		return TestPass;
+	}
+
+private:
+	void requestComplete([[maybe_unused]] Request *request)
+	{
+		signalled_ = true;
+	}
+
+	bool signalled_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(CompletionQueueTest)
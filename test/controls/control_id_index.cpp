@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * control_id_index.cpp - Dense control ID index tests
+ */
+
+#include <iostream>
+#include <stdexcept>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+#include <libcamera/property_ids.h>
+
+#include "libcamera/internal/control_id_tables.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class ControlIdIndexTest : public Test
+{
+protected:
+	int checkTable(const ControlIdMap &idmap, const ControlIdMap &byId,
+		       Span<const ControlId *const> table)
+	{
+		size_t size = table.size();
+
+		if (table[0] != nullptr || size != idmap.size() + 1) {
+			cerr << "Invalid ID table size" << endl;
+			return TestFail;
+		}
+
+		for (const auto &entry : idmap) {
+			if (entry.first >= size || table[entry.first] != entry.second) {
+				cerr << "ID table mismatch for " << entry.second->name()
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		/* The byId map shall throw for unknown IDs. */
+		if (&byId != &idmap) {
+			cerr << "byId doesn't reference the ID map" << endl;
+			return TestFail;
+		}
+
+		try {
+			byId.at(size);
+			cerr << "Lookup of unknown ID " << size << " succeeded"
+			     << endl;
+			return TestFail;
+		} catch (const std::out_of_range &) {
+		}
+
+		return TestPass;
+	}
+
+	int checkMap(const ControlInfoMap &infoMap, unsigned int invalidId)
+	{
+		for (const auto &entry : infoMap) {
+			unsigned int id = entry.first->id();
+
+			if (infoMap.count(id) != 1 || infoMap.find(id) == infoMap.end() ||
+			    infoMap.find(id)->first != entry.first ||
+			    &infoMap.at(id) != &entry.second) {
+				cerr << "Lookup of ID " << id << " failed" << endl;
+				return TestFail;
+			}
+		}
+
+		if (infoMap.count(invalidId) != 0 ||
+		    infoMap.find(invalidId) != infoMap.end()) {
+			cerr << "Lookup of invalid ID " << invalidId << " succeeded"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		/* The generated tables shall match the ID maps. */
+		if (checkTable(controls::controls, controls::byId,
+			       controls::idTable) != TestPass)
+			return TestFail;
+
+		if (checkTable(properties::properties, properties::byId,
+			       properties::idTable) != TestPass)
+			return TestFail;
+
+		/* Compact IDs, looked up through the dense index. */
+		ControlInfoMap dense({
+			{ &controls::Brightness, ControlInfo(-1.0f, 1.0f) },
+			{ &controls::Contrast, ControlInfo(0.0f, 2.0f) },
+			{ &controls::Saturation, ControlInfo(0.0f, 2.0f) },
+		});
+
+		if (checkMap(dense, controls::AE_ENABLE) != TestPass ||
+		    checkMap(dense, 12345) != TestPass)
+			return TestFail;
+
+		/* Copies shall index their own elements. */
+		ControlInfoMap copy(dense);
+		if (checkMap(copy, controls::AE_ENABLE) != TestPass)
+			return TestFail;
+
+		ControlInfoMap assigned;
+		assigned = dense;
+		if (checkMap(assigned, controls::AE_ENABLE) != TestPass)
+			return TestFail;
+
+		/* Sparse IDs, looked up through the hash-based idmap. */
+		ControlId sparseId(0x00980900, "Sparse", ControlTypeInteger32);
+		ControlInfoMap sparse({
+			{ &controls::AeEnable, ControlInfo(false, true) },
+			{ &sparseId, ControlInfo(0, 255) },
+		});
+
+		if (checkMap(sparse, 0x00980901) != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ControlIdIndexTest)
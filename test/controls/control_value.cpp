@@ -6,7 +6,10 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <new>
+#include <stdlib.h>
 
 #include <libcamera/controls.h>
 
@@ -15,6 +18,34 @@
 using namespace std;
 using namespace libcamera;
 
+/*
+ * Count heap allocations to verify that small values are stored inline. The
+ * replacement operators are global, and thus also cover allocations performed
+ * by libcamera.
+ */
+static std::atomic<unsigned int> allocations{ 0 };
+
+void *operator new(std::size_t size)
+{
+	allocations++;
+
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, [[maybe_unused]] std::size_t size) noexcept
+{
+	free(ptr);
+}
+
 class ControlValueTest : public Test
 {
 protected:
@@ -257,6 +288,58 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Inline storage. Small arrays, such as a colour correction
+		 * matrix, shall be set, copied and moved without allocation.
+		 */
+		std::array<float, 9> ccm{};
+		unsigned int count = allocations;
+
+		value.set(Span<const float>(ccm));
+		ControlValue copy(value);
+		ControlValue moved(std::move(copy));
+		copy = moved;
+		moved = std::move(copy);
+
+		if (allocations != count) {
+			cerr << "Small array values caused "
+			     << allocations - count << " allocations" << endl;
+			return TestFail;
+		}
+
+		if (!copy.isNone() || moved.numElements() != ccm.size() ||
+		    moved != value) {
+			cerr << "Control value mismatch after move" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Heap storage. Large arrays shall be allocated once when set
+		 * or copied, and moved without allocation.
+		 */
+		std::array<int32_t, 32> large{};
+		count = allocations;
+
+		value.set(Span<const int32_t>(large));
+		if (allocations != count + 1) {
+			cerr << "Large array value not allocated once" << endl;
+			return TestFail;
+		}
+
+		ControlValue largeCopy(value);
+		if (allocations != count + 2 || largeCopy != value) {
+			cerr << "Large array value not copied correctly" << endl;
+			return TestFail;
+		}
+
+		ControlValue largeMoved(std::move(largeCopy));
+		largeCopy = std::move(largeMoved);
+		if (allocations != count + 2 || !largeMoved.isNone() ||
+		    largeCopy != value) {
+			cerr << "Large array value not moved correctly" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
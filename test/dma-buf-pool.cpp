@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * dma-buf-pool.cpp - DmaBufPool test
+ */
+
+#include <iostream>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "libcamera/internal/dma_heaps.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+class DmaBufPoolTest : public Test
+{
+protected:
+	int init()
+	{
+		pool_ = DmaBufPool::instance();
+		if (!pool_->isValid()) {
+			cout << "No dma-buf allocator available" << endl;
+			return TestSkip;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		/* The process-wide pool must be shared by all users. */
+		if (DmaBufPool::instance() != pool_) {
+			cerr << "Pool instance not shared" << endl;
+			return TestFail;
+		}
+
+		const size_t size = 64 * 1024;
+
+		FileDescriptor fd = pool_->alloc("test", size);
+		if (!fd.isValid()) {
+			cerr << "Failed to allocate buffer" << endl;
+			return TestFail;
+		}
+
+		if (lseek(fd.fd(), 0, SEEK_END) < static_cast<off_t>(size)) {
+			cerr << "Buffer too small" << endl;
+			return TestFail;
+		}
+
+		void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+				 MAP_SHARED, fd.fd(), 0);
+		if (mem == MAP_FAILED) {
+			cerr << "Failed to map buffer" << endl;
+			return TestFail;
+		}
+
+		memset(mem, 0xa5, size);
+		munmap(mem, size);
+
+		int fdNum = fd.fd();
+		pool_->release(fd);
+		fd = FileDescriptor();
+
+		if (pool_->cachedBuffers() != 1) {
+			cerr << "Released buffer not cached" << endl;
+			return TestFail;
+		}
+
+		/* A much smaller allocation must not reuse the cached buffer. */
+		FileDescriptor small = pool_->alloc("test", size / 4);
+		if (!small.isValid() || pool_->cachedBuffers() != 1) {
+			cerr << "Cached buffer reused for small allocation" << endl;
+			return TestFail;
+		}
+
+		/* A same size allocation must reuse it. */
+		fd = pool_->alloc("test", size);
+		if (fd.fd() != fdNum || pool_->cachedBuffers() != 0) {
+			cerr << "Cached buffer not reused" << endl;
+			return TestFail;
+		}
+
+		pool_->release(fd);
+		pool_->release(small);
+		pool_->trim();
+		if (pool_->cachedBuffers() != 0) {
+			cerr << "Pool not trimmed" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	std::shared_ptr<DmaBufPool> pool_;
+};
+
+TEST_REGISTER(DmaBufPoolTest)
@@ -6,6 +6,7 @@
  */
 
 #include <iostream>
+#include <stdlib.h>
 
 #include "camera_test.h"
 #include "test.h"
@@ -50,3 +51,25 @@ CameraTest::~CameraTest()
 	cm_->stop();
 	delete cm_;
 }
+
+/*
+ * Capture from the virtual camera, configured with \a options, to run tests
+ * without any hardware.
+ */
+VirtualCameraTest::VirtualCameraTest(const char *options)
+	: CameraTest(setup(options))
+{
+}
+
+VirtualCameraTest::~VirtualCameraTest()
+{
+	unsetenv("LIBCAMERA_VIRTUAL");
+}
+
+const char *VirtualCameraTest::setup(const char *options)
+{
+	/* The options must be set before the camera manager starts. */
+	setenv("LIBCAMERA_VIRTUAL", options, 1);
+
+	return "virtual/0";
+}
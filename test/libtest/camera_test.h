@@ -23,4 +23,14 @@ protected:
 	int status_;
 };
 
+class VirtualCameraTest : public CameraTest
+{
+public:
+	VirtualCameraTest(const char *options);
+	~VirtualCameraTest();
+
+private:
+	static const char *setup(const char *options);
+};
+
 #endif /* __LIBCAMERA_CAMERA_TEST_H__ */
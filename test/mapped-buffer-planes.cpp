@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * mapped-buffer-planes.cpp - MappedFrameBuffer multi-planar single dmabuf test
+ */
+
+#include <errno.h>
+#include <iostream>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <libcamera/buffer.h>
+
+#include "libcamera/internal/buffer.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+class MappedBufferPlanesTest : public Test
+{
+protected:
+	static constexpr unsigned int kLumaSize = 64 * 48;
+	static constexpr unsigned int kChromaSize = kLumaSize / 2;
+
+	int init() override
+	{
+		int fd = memfd_create("mapped-buffer-planes", MFD_CLOEXEC);
+		if (fd < 0) {
+			cout << "Failed to create memfd" << endl;
+			return TestSkip;
+		}
+
+		fd_ = FileDescriptor(std::move(fd));
+
+		if (ftruncate(fd_.fd(), kLumaSize + kChromaSize) < 0)
+			return TestFail;
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		/* Describe an NV12 frame stored in a single buffer. */
+		std::vector<FrameBuffer::Plane> planes(2);
+		planes[0].fd = fd_;
+		planes[0].offset = 0;
+		planes[0].length = kLumaSize;
+		planes[1].fd = fd_;
+		planes[1].offset = kLumaSize;
+		planes[1].length = kChromaSize;
+
+		FrameBuffer buffer(planes);
+
+		{
+			MappedFrameBuffer map(&buffer, PROT_READ | PROT_WRITE);
+			if (!map.isValid()) {
+				cout << "Failed to map buffer" << endl;
+				return TestFail;
+			}
+
+			if (map.maps().size() != 1 || map.planes().size() != 2) {
+				cout << "Shared dmabuf not mapped once" << endl;
+				return TestFail;
+			}
+
+			if (map.planes()[1].data() != map.planes()[0].data() + kLumaSize ||
+			    map.planes()[1].size() != kChromaSize) {
+				cout << "Invalid chroma plane mapping" << endl;
+				return TestFail;
+			}
+
+			if (map.beginAccess(MappedFrameBuffer::SyncWrite) < 0) {
+				cout << "Failed to begin CPU access" << endl;
+				return TestFail;
+			}
+
+			memset(map.planes()[0].data(), 0x10, kLumaSize);
+			memset(map.planes()[1].data(), 0x80, kChromaSize);
+
+			if (map.endAccess() < 0) {
+				cout << "Failed to end CPU access" << endl;
+				return TestFail;
+			}
+
+			if (map.beginAccess(MappedFrameBuffer::SyncRead, 2) != -EINVAL) {
+				cout << "Access to invalid plane not rejected" << endl;
+				return TestFail;
+			}
+		}
+
+		/* Verify the data landed at the expected offsets. */
+		uint8_t data[2];
+		if (pread(fd_.fd(), &data[0], 1, kLumaSize - 1) != 1 ||
+		    pread(fd_.fd(), &data[1], 1, kLumaSize) != 1)
+			return TestFail;
+
+		if (data[0] != 0x10 || data[1] != 0x80) {
+			cout << "Plane data written at wrong offset" << endl;
+			return TestFail;
+		}
+
+		/* Copying between buffers must honour the plane offsets. */
+		int fd = memfd_create("mapped-buffer-planes-copy", MFD_CLOEXEC);
+		if (fd < 0 || ftruncate(fd, kLumaSize + kChromaSize) < 0)
+			return TestFail;
+
+		FileDescriptor copyFd(std::move(fd));
+		for (FrameBuffer::Plane &plane : planes)
+			plane.fd = copyFd;
+
+		FrameBuffer copy(planes);
+		if (copy.copyFrom(&buffer) < 0) {
+			cout << "Failed to copy buffer" << endl;
+			return TestFail;
+		}
+
+		if (pread(copyFd.fd(), &data[1], 1, kLumaSize) != 1 ||
+		    data[1] != 0x80) {
+			cout << "Plane data copied at wrong offset" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	FileDescriptor fd_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(MappedBufferPlanesTest)
@@ -100,6 +100,23 @@ protected:
 			return TestFail;
 		}
 
+		/* Moving a MappedFrameBuffer transfers the CPU access in progress. */
+		if (rw_map.beginAccess(MappedFrameBuffer::SyncRead) < 0) {
+			cout << "Failed to begin CPU access" << endl;
+			return TestFail;
+		}
+
+		MappedFrameBuffer moved_map(std::move(rw_map));
+		if (rw_map.isValid() || !moved_map.isValid()) {
+			cout << "Failed to move MappedFrameBuffer" << endl;
+			return TestFail;
+		}
+
+		if (moved_map.endAccess() < 0) {
+			cout << "Failed to end CPU access" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
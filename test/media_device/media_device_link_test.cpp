@@ -210,6 +210,45 @@ class MediaDeviceLinkTest : public MediaDeviceTest
 			return TestFail;
 		}
 
+		/*
+		 * Enable the link through setupLinks() with the device locked,
+		 * and verify that setting up the same links again doesn't touch
+		 * the device.
+		 */
+		if (!media_->lock()) {
+			cerr << "Failed to lock media device" << endl;
+			return TestFail;
+		}
+
+		MediaDevice::LinkCounters counters = media_->linkCounters();
+
+		if (media_->setupLinks({ link })) {
+			cerr << "Failed to setup link: " << linkName << endl;
+			return TestFail;
+		}
+
+		if (!(link->flags() & MEDIA_LNK_FL_ENABLED) ||
+		    media_->linkCounters().applied != counters.applied + 1) {
+			cerr << "Link " << linkName
+			     << " not enabled by setupLinks()" << endl;
+			return TestFail;
+		}
+
+		counters = media_->linkCounters();
+
+		if (media_->setupLinks({ link })) {
+			cerr << "Failed to setup link: " << linkName << endl;
+			return TestFail;
+		}
+
+		if (media_->linkCounters().applied != counters.applied ||
+		    media_->linkCounters().skipped == counters.skipped) {
+			cerr << "Redundant link setup not skipped" << endl;
+			return TestFail;
+		}
+
+		media_->unlock();
+
 		return 0;
 	}
 
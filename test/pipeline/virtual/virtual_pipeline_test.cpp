@@ -0,0 +1,224 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * virtual_pipeline_test.cpp - Virtual pipeline handler test
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/camera_manager.h>
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/framebuffer_allocator.h>
+#include <libcamera/request.h>
+#include <libcamera/timer.h>
+
+#include "libcamera/internal/buffer.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/*
+ * Verify that the virtual pipeline handler creates the cameras described by
+ * the LIBCAMERA_VIRTUAL environment variable, and that they capture frames on
+ * all streams without any kernel device.
+ */
+class VirtualPipelineTest : public Test
+{
+protected:
+	int init() override
+	{
+		setenv("LIBCAMERA_VIRTUAL",
+		       "cameras=2,streams=2,size=320x240,fps=100,ipa-latency=2", 1);
+
+		cm_ = make_unique<CameraManager>();
+		if (cm_->start()) {
+			cout << "Failed to start camera manager" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (!cm_->get("virtual/0") || !cm_->get("virtual/1") ||
+		    cm_->get("virtual/2")) {
+			cout << "Virtual cameras not enumerated correctly" << endl;
+			return TestFail;
+		}
+
+		camera_ = cm_->get("virtual/1");
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		unique_ptr<CameraConfiguration> config =
+			camera_->generateConfiguration({ StreamRole::Viewfinder,
+							 StreamRole::VideoRecording });
+		if (!config || config->size() != 2) {
+			cout << "Failed to generate configuration" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		FrameBufferAllocator allocator(camera_);
+
+		for (unsigned int i = 0; i < config->size(); ++i) {
+			Stream *stream = config->at(i).stream();
+			if (allocator.allocate(stream) < 0) {
+				cout << "Failed to allocate buffers" << endl;
+				return TestFail;
+			}
+		}
+
+		Stream *stream0 = config->at(0).stream();
+		Stream *stream1 = config->at(1).stream();
+		unsigned int count = allocator.buffers(stream0).size();
+
+		for (unsigned int i = 0; i < count; ++i) {
+			Request *request = camera_->createRequest();
+			request->addBuffer(stream0, allocator.buffers(stream0)[i].get());
+			request->addBuffer(stream1, allocator.buffers(stream1)[i].get());
+			pending_.push_back(request);
+		}
+
+		completed_ = 0;
+		cancelled_ = 0;
+		sequenceError_ = false;
+		patternError_ = false;
+		lastSequence_.clear();
+
+		camera_->requestCompleted.connect(this, &VirtualPipelineTest::requestComplete);
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		/* A batch containing an invalid request must be rejected. */
+		unique_ptr<Request> invalid(camera_->createRequest());
+		pending_.push_back(invalid.get());
+		if (camera_->queueRequests(pending_) != -EINVAL) {
+			cout << "Invalid request batch not rejected" << endl;
+			return TestFail;
+		}
+		pending_.pop_back();
+
+		if (camera_->queueRequests(pending_)) {
+			cout << "Failed to queue requests" << endl;
+			return TestFail;
+		}
+		pending_.clear();
+
+		EventDispatcher *dispatcher = cm_->eventDispatcher();
+
+		Timer timer;
+		timer.start(500);
+		while (timer.isRunning())
+			dispatcher->processEvents();
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completed_ < count * 2) {
+			cout << "Failed to capture enough frames (got " << completed_
+			     << " expected at least " << count * 2 << ")" << endl;
+			return TestFail;
+		}
+
+		if (!cancelled_) {
+			cout << "No request cancelled at stop time" << endl;
+			return TestFail;
+		}
+
+		if (sequenceError_ || patternError_) {
+			cout << "Invalid frame " << (sequenceError_ ? "sequence" : "content")
+			     << endl;
+			return TestFail;
+		}
+
+		camera_->requestCompleted.disconnect(this, &VirtualPipelineTest::requestComplete);
+		camera_->release();
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		camera_.reset();
+		cm_->stop();
+		unsetenv("LIBCAMERA_VIRTUAL");
+	}
+
+private:
+	void requestComplete(Request *request)
+	{
+		if (request->status() == Request::RequestCancelled) {
+			cancelled_++;
+			return;
+		}
+
+		completed_++;
+
+		for (auto it : request->buffers()) {
+			const FrameBuffer *buffer = it.second;
+			const FrameMetadata &metadata = buffer->metadata();
+
+			if (metadata.status != FrameMetadata::FrameSuccess) {
+				sequenceError_ = true;
+				continue;
+			}
+
+			auto last = lastSequence_.find(it.first);
+			if (last != lastSequence_.end() &&
+			    metadata.sequence <= last->second)
+				sequenceError_ = true;
+			lastSequence_[it.first] = metadata.sequence;
+
+			/* The first line contains a white bar, in RGB or YUV. */
+			MappedFrameBuffer mapped(buffer, PROT_READ);
+			if (!mapped.isValid()) {
+				patternError_ = true;
+				continue;
+			}
+
+			const MappedBuffer::Plane &plane = mapped.planes()[0];
+			unsigned int stride = it.first->configuration().stride;
+			if (*max_element(plane.begin(), plane.begin() + stride) < 150)
+				patternError_ = true;
+		}
+
+		Request *next = camera_->createRequest();
+		for (auto it : request->buffers())
+			next->addBuffer(it.first, it.second);
+		camera_->queueRequest(next);
+	}
+
+	unique_ptr<CameraManager> cm_;
+	shared_ptr<Camera> camera_;
+	vector<Request *> pending_;
+
+	unsigned int completed_;
+	unsigned int cancelled_;
+	bool sequenceError_;
+	bool patternError_;
+	map<const Stream *, unsigned int> lastSequence_;
+};
+
+TEST_REGISTER(VirtualPipelineTest)
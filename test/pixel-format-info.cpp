@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * pixel-format-info.cpp - PixelFormatInfo lookup tests
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <libcamera/formats.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/v4l2_pixelformat.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class PixelFormatInfoTest : public Test
+{
+protected:
+	int run()
+	{
+		const std::vector<PixelFormat> pixelFormats{
+			formats::R8,
+			formats::RGB565,
+			formats::RGB888,
+			formats::BGR888,
+			formats::XRGB8888,
+			formats::XBGR8888,
+			formats::RGBX8888,
+			formats::BGRX8888,
+			formats::ARGB8888,
+			formats::ABGR8888,
+			formats::RGBA8888,
+			formats::BGRA8888,
+			formats::YUYV,
+			formats::YVYU,
+			formats::UYVY,
+			formats::VYUY,
+			formats::NV12,
+			formats::NV21,
+			formats::NV16,
+			formats::NV61,
+			formats::NV24,
+			formats::NV42,
+			formats::YUV420,
+			formats::YVU420,
+			formats::YUV422,
+			formats::MJPEG,
+			formats::SRGGB8,
+			formats::SGRBG8,
+			formats::SGBRG8,
+			formats::SBGGR8,
+			formats::SRGGB10,
+			formats::SGRBG10,
+			formats::SGBRG10,
+			formats::SBGGR10,
+			formats::SRGGB12,
+			formats::SGRBG12,
+			formats::SGBRG12,
+			formats::SBGGR12,
+			formats::SRGGB16,
+			formats::SGRBG16,
+			formats::SGBRG16,
+			formats::SBGGR16,
+			formats::SRGGB10_CSI2P,
+			formats::SGRBG10_CSI2P,
+			formats::SGBRG10_CSI2P,
+			formats::SBGGR10_CSI2P,
+			formats::SRGGB12_CSI2P,
+			formats::SGRBG12_CSI2P,
+			formats::SGBRG12_CSI2P,
+			formats::SBGGR12_CSI2P,
+			formats::SRGGB10_IPU3,
+			formats::SGRBG10_IPU3,
+			formats::SGBRG10_IPU3,
+			formats::SBGGR10_IPU3,
+		};
+
+		std::vector<const PixelFormatInfo *> infos;
+
+		for (const PixelFormat &format : pixelFormats) {
+			const PixelFormatInfo &info = PixelFormatInfo::info(format);
+			if (!info.isValid())
+				continue;
+
+			infos.push_back(&info);
+
+			if (&PixelFormatInfo::info(std::string(info.name)) != &info) {
+				cerr << "Lookup by name failed for " << info.name
+				     << endl;
+				return TestFail;
+			}
+
+			const PixelFormatInfo &v4l2Info =
+				PixelFormatInfo::info(info.v4l2Format);
+			if (v4l2Info.v4l2Format != info.v4l2Format) {
+				cerr << "Lookup by V4L2 format failed for "
+				     << info.name << endl;
+				return TestFail;
+			}
+		}
+
+		if (infos.empty()) {
+			cerr << "No valid pixel format" << endl;
+			return TestFail;
+		}
+
+		if (PixelFormatInfo::info(std::string("INVALID")).isValid() ||
+		    PixelFormatInfo::info(V4L2PixelFormat(0x20202020)).isValid()) {
+			cerr << "Lookup of invalid format succeeded" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(PixelFormatInfoTest)
@@ -0,0 +1,258 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * dng_packer.cpp - DNG raw data packing test
+ */
+
+#include <algorithm>
+#include <errno.h>
+#include <iostream>
+#include <random>
+#include <string.h>
+#include <vector>
+
+#include "dng_packer.h"
+
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+/* Reference scanline packing implementations, processing one pixel at a time. */
+void refPackScanlineSBGGR10P(void *output, const void *input, unsigned int width)
+{
+	const uint8_t *in = static_cast<const uint8_t *>(input);
+	uint8_t *out = static_cast<uint8_t *>(output);
+
+	for (unsigned int x = 0; x < width; x += 4) {
+		*out++ = in[0];
+		*out++ = (in[4] & 0x03) << 6 | in[1] >> 2;
+		*out++ = (in[1] & 0x03) << 6 | (in[4] & 0x0c) << 2 | in[2] >> 4;
+		*out++ = (in[2] & 0x0f) << 4 | (in[4] & 0x30) >> 2 | in[3] >> 6;
+		*out++ = (in[3] & 0x3f) << 2 | (in[4] & 0xc0) >> 6;
+		in += 5;
+	}
+}
+
+void refPackScanlineSBGGR12P(void *output, const void *input, unsigned int width)
+{
+	const uint8_t *in = static_cast<const uint8_t *>(input);
+	uint8_t *out = static_cast<uint8_t *>(output);
+
+	for (unsigned int i = 0; i < width; i += 2) {
+		*out++ = in[0];
+		*out++ = (in[2] & 0x0f) << 4 | in[1] >> 4;
+		*out++ = (in[1] & 0x0f) << 4 | in[2] >> 4;
+		in += 3;
+	}
+}
+
+void refPackScanlineIPU3(void *output, const void *input, unsigned int width)
+{
+	const uint8_t *in = static_cast<const uint8_t *>(input);
+	uint16_t *out = static_cast<uint16_t *>(output);
+
+	unsigned int x = 0;
+	while (true) {
+		for (unsigned int i = 0; i < 6; i++) {
+			*out++ = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
+			if (++x >= width)
+				return;
+
+			*out++ = (in[2] & 0x0f) << 12 | (in[1] & 0xfc) << 4;
+			if (++x >= width)
+				return;
+
+			*out++ = (in[3] & 0x3f) << 10 | (in[2] & 0xf0) << 2;
+			if (++x >= width)
+				return;
+
+			*out++ = (in[4] & 0xff) <<  8 | (in[3] & 0xc0) << 0;
+			if (++x >= width)
+				return;
+
+			in += 5;
+		}
+
+		*out++ = (in[1] & 0x03) << 14 | (in[0] & 0xff) << 6;
+		if (++x >= width)
+			return;
+
+		in += 2;
+	}
+}
+
+struct PackedFormat {
+	const char *name;
+	unsigned int bitsPerSample;
+	DNGPacker::PackScanline pack;
+	DNGPacker::PackScanline reference;
+	unsigned int (*stride)(unsigned int width);
+};
+
+const PackedFormat packedFormats[] = {
+	{
+		"SBGGR10_CSI2P", 10, packScanlineSBGGR10P, refPackScanlineSBGGR10P,
+		[](unsigned int width) { return (width * 5 / 4 + 31) & ~31U; },
+	}, {
+		"SBGGR12_CSI2P", 12, packScanlineSBGGR12P, refPackScanlineSBGGR12P,
+		[](unsigned int width) { return (width * 3 / 2 + 31) & ~31U; },
+	}, {
+		"SBGGR10_IPU3", 16, packScanlineIPU3, refPackScanlineIPU3,
+		[](unsigned int width) { return ((width + 24) / 25 * 32 + 63) & ~63U; },
+	},
+};
+
+} /* namespace */
+
+class DNGPackerTest : public Test
+{
+protected:
+	int init()
+	{
+		/* Random input data, large enough for all formats. */
+		size_t size = 0;
+		for (const PackedFormat &format : packedFormats)
+			size = max<size_t>(size, format.stride(kWidth) * kHeight);
+
+		input_.resize(size);
+
+		mt19937 gen(42);
+		uniform_int_distribution<unsigned int> dist(0, 255);
+		for (uint8_t &byte : input_)
+			byte = dist(gen);
+
+		return TestPass;
+	}
+
+	/* Pack the image in a contiguous buffer. */
+	int pack(const DNGPacker &packer, vector<uint8_t> &output)
+	{
+		unsigned int expected = 0;
+
+		output.assign(packer.rowSize() * kHeight, 0);
+
+		return packer.pack(input_.data(),
+				   [&](unsigned int strip, const void *data, size_t size) {
+			if (strip != expected++)
+				return -EINVAL;
+
+			size_t offset = static_cast<size_t>(strip) *
+					packer.rowsPerStrip() * packer.rowSize();
+			if (offset + size > output.size())
+				return -EINVAL;
+
+			memcpy(output.data() + offset, data, size);
+			return 0;
+		});
+	}
+
+	int testScanlines(const PackedFormat &format)
+	{
+		/* Test widths that aren't multiples of the pixel group size. */
+		for (unsigned int width : { 24U, 25U, 26U, 49U, 50U, 100U, 4056U }) {
+			size_t rowSize = (width * format.bitsPerSample + 7) / 8;
+			vector<uint8_t> output(rowSize + 8);
+			vector<uint8_t> reference(rowSize + 8);
+
+			format.pack(output.data(), input_.data(), width);
+			format.reference(reference.data(), input_.data(), width);
+
+			/*
+			 * The CSI-2 references write complete groups, compare
+			 * complete bytes only.
+			 */
+			if (memcmp(output.data(), reference.data(),
+				   width * format.bitsPerSample / 8)) {
+				cerr << format.name << ": scanline of width "
+				     << width << " differs from reference" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int testFormat(const PackedFormat &format)
+	{
+		int ret = testScanlines(format);
+		if (ret != TestPass)
+			return ret;
+
+		unsigned int stride = format.stride(kWidth);
+
+		/* Pack the full image with the reference implementation. */
+		DNGPacker reference(format.reference, format.bitsPerSample,
+				    kWidth, kHeight, stride);
+		reference.setThreads(1);
+
+		vector<uint8_t> expected;
+		ret = pack(reference, expected);
+		if (ret < 0) {
+			cerr << format.name << ": reference packing failed" << endl;
+			return TestFail;
+		}
+
+		/* Pack with a single thread, and multiple threads. */
+		for (unsigned int threads : { 1U, 4U }) {
+			DNGPacker packer(format.pack, format.bitsPerSample,
+					 kWidth, kHeight, stride);
+			packer.setRowsPerStrip(30);
+			packer.setThreads(threads);
+
+			vector<uint8_t> output;
+			ret = pack(packer, output);
+			if (ret < 0) {
+				cerr << format.name << ": packing failed" << endl;
+				return TestFail;
+			}
+
+			if (output != expected) {
+				cerr << format.name << ": packed image with "
+				     << threads << " threads differs from reference"
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		/* Errors returned by the write function must abort packing. */
+		DNGPacker packer(format.pack, format.bitsPerSample, kWidth,
+				 kHeight, stride);
+		packer.setThreads(4);
+
+		unsigned int written = 0;
+		ret = packer.pack(input_.data(),
+				  [&](unsigned int strip, const void *, size_t) {
+			written++;
+			return strip == 2 ? -EIO : 0;
+		});
+		if (ret != -EIO || written != 3) {
+			cerr << format.name << ": write error not propagated" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		for (const PackedFormat &format : packedFormats) {
+			int ret = testFormat(format);
+			if (ret != TestPass)
+				return ret;
+		}
+
+		return TestPass;
+	}
+
+private:
+	/* Full resolution of a 12MP sensor. */
+	static constexpr unsigned int kWidth = 4056;
+	static constexpr unsigned int kHeight = 3040;
+
+	vector<uint8_t> input_;
+};
+
+TEST_REGISTER(DNGPackerTest)
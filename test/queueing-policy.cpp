@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * queueing-policy.cpp - Drop-oldest queueing policy test
+ */
+
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/camera.h>
+#include <libcamera/completion_queue.h>
+#include <libcamera/framebuffer_allocator.h>
+#include <libcamera/request.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+class QueueingPolicyTest : public VirtualCameraTest, public Test
+{
+public:
+	QueueingPolicyTest()
+		: VirtualCameraTest("fps=200")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		return status_;
+	}
+
+	int run() override
+	{
+		static constexpr unsigned int kIterations = 10;
+
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->setQueueingPolicy(Camera::QueueingDropOldest) ||
+		    camera_->queueingPolicy() != Camera::QueueingDropOldest) {
+			cout << "Failed to set the queueing policy" << endl;
+			return TestFail;
+		}
+
+		unique_ptr<CameraConfiguration> config =
+			camera_->generateConfiguration({ StreamRole::Viewfinder });
+		config->at(0).bufferCount = 6;
+		if (camera_->configure(config.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config->at(0).stream();
+		FrameBufferAllocator allocator(camera_);
+		if (allocator.allocate(stream) < 0) {
+			cout << "Failed to allocate buffers" << endl;
+			return TestFail;
+		}
+
+		unsigned int count = allocator.buffers(stream).size();
+
+		CompletionQueue queue;
+		if (!queue.isValid()) {
+			cout << "Failed to create completion queue" << endl;
+			return TestFail;
+		}
+
+		camera_->setCompletionQueue(&queue);
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (const unique_ptr<FrameBuffer> &buffer : allocator.buffers(stream)) {
+			Request *request = camera_->createRequest();
+			request->addBuffer(stream, buffer.get());
+			camera_->queueRequest(request);
+		}
+
+		/*
+		 * Consume frames slower than the camera produces them. Only the
+		 * latest completed request shall be waiting in the queue.
+		 */
+		uint64_t lastSequence = 0;
+		vector<Request *> requests;
+
+		for (unsigned int i = 0; i < kIterations; ++i) {
+			usleep(30000);
+
+			struct pollfd pfd = { queue.fd(), POLLIN, 0 };
+			if (poll(&pfd, 1, 1000) != 1) {
+				cout << "Completion queue not signalled" << endl;
+				return TestFail;
+			}
+
+			requests.clear();
+			queue.reap(&requests);
+			if (requests.size() != 1) {
+				cout << "Expected 1 completed request, got "
+				     << requests.size() << endl;
+				return TestFail;
+			}
+
+			Request *request = requests[0];
+			FrameBuffer *buffer = request->buffers().begin()->second;
+
+			if (request->status() != Request::RequestComplete) {
+				cout << "Unexpected request status" << endl;
+				return TestFail;
+			}
+
+			if (i && buffer->metadata().sequence <= lastSequence) {
+				cout << "Stale frame delivered" << endl;
+				return TestFail;
+			}
+			lastSequence = buffer->metadata().sequence;
+
+			Request *next = camera_->createRequest();
+			next->addBuffer(stream, buffer);
+			camera_->queueRequest(next);
+
+			delete request;
+		}
+
+		CameraStatistics stats = camera_->statistics();
+		if (!stats.requestsDropped) {
+			cout << "No request dropped" << endl;
+			return TestFail;
+		}
+
+		/* All requests are returned to the application by stop(). */
+		camera_->stop();
+
+		requests.clear();
+		queue.reap(&requests);
+		if (requests.size() != count) {
+			cout << "Expected " << count << " requests after stop, got "
+			     << requests.size() << endl;
+			return TestFail;
+		}
+
+		for (Request *request : requests)
+			delete request;
+
+		camera_->release();
+
+		return TestPass;
+	}
+};
+
+} /* namespace */
+
+TEST_REGISTER(QueueingPolicyTest)
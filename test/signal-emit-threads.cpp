@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * signal-emit-threads.cpp - Concurrent signal emission test and benchmark
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <libcamera/signal.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+namespace {
+
+class Counter
+{
+public:
+	Counter()
+		: count_(0)
+	{
+	}
+
+	void slot(unsigned int value)
+	{
+		count_.fetch_add(value, memory_order_relaxed);
+	}
+
+	unsigned int count() const { return count_.load(); }
+
+private:
+	atomic<unsigned int> count_;
+};
+
+class SignalEmitThreadsTest : public Test
+{
+protected:
+	static constexpr unsigned int kEmits = 200000;
+
+	int run()
+	{
+		unsigned int numThreads = std::thread::hardware_concurrency();
+		numThreads = std::max(2U, std::min(numThreads, 8U));
+
+		/*
+		 * Emit signals from multiple threads, each with its own signal
+		 * as pipeline handlers do for their devices, and measure the
+		 * emission throughput.
+		 */
+		vector<unique_ptr<Signal<unsigned int>>> signals;
+		vector<Counter> counters(numThreads);
+		for (unsigned int i = 0; i < numThreads; ++i) {
+			signals.push_back(make_unique<Signal<unsigned int>>());
+			signals.back()->connect(&counters[i], &Counter::slot);
+		}
+
+		auto start = chrono::steady_clock::now();
+
+		vector<thread> threads;
+		for (unsigned int i = 0; i < numThreads; ++i) {
+			threads.emplace_back([&signals, i]() {
+				for (unsigned int n = 0; n < kEmits; ++n)
+					signals[i]->emit(1);
+			});
+		}
+
+		for (thread &t : threads)
+			t.join();
+		threads.clear();
+
+		auto duration = chrono::steady_clock::now() - start;
+
+		for (unsigned int i = 0; i < numThreads; ++i) {
+			if (counters[i].count() != kEmits) {
+				cout << "Signal " << i << " received "
+				     << counters[i].count() << " emissions, expected "
+				     << kEmits << endl;
+				return TestFail;
+			}
+		}
+
+		cout << numThreads << " threads, "
+		     << chrono::duration_cast<chrono::nanoseconds>(duration).count()
+			/ kEmits << " ns per emission" << endl;
+
+		/*
+		 * Emit a shared signal from multiple threads while another
+		 * thread connects and disconnects a slot. The permanently
+		 * connected slot must receive all emissions.
+		 */
+		Signal<unsigned int> shared;
+		Counter permanent;
+		Counter transient;
+		shared.connect(&permanent, &Counter::slot);
+
+		atomic<bool> done(false);
+		thread updater([&]() {
+			while (!done.load(memory_order_relaxed)) {
+				shared.connect(&transient, &Counter::slot);
+				shared.disconnect(&transient, &Counter::slot);
+			}
+		});
+
+		for (unsigned int i = 0; i < numThreads; ++i) {
+			threads.emplace_back([&shared]() {
+				for (unsigned int n = 0; n < kEmits / 10; ++n)
+					shared.emit(1);
+			});
+		}
+
+		for (thread &t : threads)
+			t.join();
+
+		done = true;
+		updater.join();
+
+		if (permanent.count() != numThreads * (kEmits / 10)) {
+			cout << "Shared signal received " << permanent.count()
+			     << " emissions, expected " << numThreads * (kEmits / 10)
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+} /* namespace */
+
+TEST_REGISTER(SignalEmitThreadsTest)
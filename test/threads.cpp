@@ -6,8 +6,12 @@
  */
 
 #include <chrono>
+#include <errno.h>
 #include <iostream>
+#include <sched.h>
+#include <sys/resource.h>
 #include <thread>
+#include <vector>
 
 #include "libcamera/internal/thread.h"
 
@@ -34,6 +38,26 @@ private:
 	chrono::steady_clock::duration duration_;
 };
 
+class PolicyThread : public Thread
+{
+public:
+	PolicyThread()
+	{
+		CPU_ZERO(&cpus_);
+		nice_ = 0;
+	}
+
+	cpu_set_t cpus_;
+	int nice_;
+
+protected:
+	void run()
+	{
+		sched_getaffinity(0, sizeof(cpus_), &cpus_);
+		nice_ = getpriority(PRIO_PROCESS, 0);
+	}
+};
+
 class ThreadTest : public Test
 {
 protected:
@@ -121,6 +145,63 @@ protected:
 			return TestFail;
 		}
 
+		delete thread;
+
+		/* Test parsing of thread policies. */
+		ThreadPolicy policy;
+
+		for (const char *options : { "cpus=", "cpus=3-1", "fifo=0",
+					     "nice=20", "nice", "priority=1" }) {
+			if (policy.parse(options) != -EINVAL) {
+				cout << "Invalid thread policy '" << options
+				     << "' accepted" << endl;
+				return TestFail;
+			}
+		}
+
+		if (policy.parse("cpus=0,2-3:fifo=10:nice=5") ||
+		    policy.cpus != vector<unsigned int>{ 0, 2, 3 } ||
+		    !policy.realtime || policy.priority != 10 || policy.nice != 5) {
+			cout << "Failed to parse thread policy" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Test that threads apply the policy of their role. Pin the
+		 * thread to the last CPU the test can run on, and lower its
+		 * priority, which doesn't require any privilege.
+		 */
+		cpu_set_t cpus;
+		sched_getaffinity(0, sizeof(cpus), &cpus);
+
+		unsigned int cpu = CPU_SETSIZE;
+		while (!CPU_ISSET(cpu - 1, &cpus))
+			cpu--;
+		cpu--;
+
+		policy = ThreadPolicy();
+		policy.cpus = { cpu };
+		policy.nice = 19;
+		ThreadPolicy::set(ThreadPolicy::RoleIPAWorker, policy);
+
+		PolicyThread policyThread;
+		policyThread.setRole(ThreadPolicy::RoleIPAWorker);
+		policyThread.start();
+		policyThread.wait();
+
+		ThreadPolicy::set(ThreadPolicy::RoleIPAWorker, ThreadPolicy());
+
+		if (CPU_COUNT(&policyThread.cpus_) != 1 ||
+		    !CPU_ISSET(cpu, &policyThread.cpus_)) {
+			cout << "Thread CPU affinity not applied" << endl;
+			return TestFail;
+		}
+
+		if (policyThread.nice_ != 19) {
+			cout << "Thread nice value not applied" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * tracer.cpp - Request lifecycle tracing test
+ */
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "libcamera/internal/tracer.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+unsigned int countOccurrences(const string &str, const string &pattern)
+{
+	unsigned int count = 0;
+
+	for (size_t pos = str.find(pattern); pos != string::npos;
+	     pos = str.find(pattern, pos + pattern.size()))
+		count++;
+
+	return count;
+}
+
+class TracerTest : public Test
+{
+protected:
+	int init() override
+	{
+		/*
+		 * Tracing is enabled from the environment when libcamera is
+		 * loaded, re-execute the test with the variable set.
+		 */
+		if (!Tracer::enabled()) {
+			if (getenv("LIBCAMERA_TRACE")) {
+				cout << "Tracing not enabled by environment" << endl;
+				return TestFail;
+			}
+
+			path_ = "/tmp/libcamera-tracer-test-" + to_string(getpid()) + ".json";
+			setenv("LIBCAMERA_TRACE", path_.c_str(), 1);
+			execl("/proc/self/exe", "tracer", nullptr);
+
+			cout << "Failed to re-execute the test" << endl;
+			return TestSkip;
+		}
+
+		path_ = getenv("LIBCAMERA_TRACE");
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		static constexpr unsigned int kEvents = 100;
+
+		for (unsigned int i = 0; i < kEvents; ++i)
+			Tracer::instant("main");
+
+		std::thread thread([]() {
+			for (unsigned int i = 0; i < kEvents; ++i)
+				Tracer::instant("worker");
+		});
+		thread.join();
+
+		/* Events from a thread that has exited must be preserved. */
+		ostringstream trace;
+		Tracer::dump(trace);
+		const string json = trace.str();
+
+		if (json.compare(0, 16, "{\"traceEvents\":[") ||
+		    json.find("]}") == string::npos) {
+			cout << "Invalid trace format" << endl;
+			return TestFail;
+		}
+
+		if (countOccurrences(json, "\"name\":\"main\"") != kEvents ||
+		    countOccurrences(json, "\"name\":\"worker\"") != kEvents) {
+			cout << "Missing trace events" << endl;
+			return TestFail;
+		}
+
+		/* Test the dump to the file set in the environment. */
+		Tracer::dump();
+
+		ifstream file(path_);
+		string contents((istreambuf_iterator<char>(file)),
+				istreambuf_iterator<char>());
+		if (contents != json) {
+			cout << "Trace file doesn't match the recorded events" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		unlink(path_.c_str());
+	}
+
+private:
+	string path_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(TracerTest)
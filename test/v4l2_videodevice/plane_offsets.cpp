@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * libcamera V4L2 API tests
+ *
+ * Validate the handling of plane offsets when capturing to imported buffers.
+ */
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/timer.h>
+
+#include "libcamera/internal/thread.h"
+
+#include "v4l2_videodevice_test.h"
+
+class PlaneOffsetsTest : public V4L2VideoDeviceTest
+{
+public:
+	PlaneOffsetsTest()
+		: V4L2VideoDeviceTest("vimc", "Raw Capture 0"), frames_(0),
+		  error_(false)
+	{
+	}
+
+	void receiveBuffer(FrameBuffer *buffer)
+	{
+		const FrameMetadata &metadata = buffer->metadata();
+
+		if (metadata.status != FrameMetadata::FrameSuccess)
+			return;
+
+		/* The payload must fit in the planes of the buffer. */
+		for (unsigned int i = 0; i < metadata.planes.size(); ++i) {
+			if (metadata.planes[i].bytesused > buffer->planes()[i].length) {
+				std::cout << "Invalid bytesused "
+					  << metadata.planes[i].bytesused
+					  << " for plane " << i << std::endl;
+				error_ = true;
+			}
+		}
+
+		frames_++;
+		capture_->queueBuffer(buffer);
+	}
+
+protected:
+	int run()
+	{
+		const unsigned int bufferCount = 4;
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		Timer timeout;
+		int ret;
+
+		/* Export buffers to import them back with custom planes. */
+		ret = capture_->exportBuffers(bufferCount, &buffers_);
+		if (ret < 0) {
+			std::cout << "Failed to export buffers" << std::endl;
+			return TestFail;
+		}
+
+		ret = capture_->importBuffers(bufferCount);
+		if (ret < 0) {
+			std::cout << "Failed to import buffers" << std::endl;
+			return TestFail;
+		}
+
+		/*
+		 * The device can't honour plane offsets when capturing, queueing
+		 * a buffer with a non-zero offset must fail.
+		 */
+		std::vector<FrameBuffer::Plane> planes = buffers_[0]->planes();
+		planes[0].offset = 4096;
+		planes[0].length -= 4096;
+		FrameBuffer offsetBuffer(planes);
+
+		ret = capture_->queueBuffer(&offsetBuffer);
+		if (ret != -EINVAL) {
+			std::cout << "Capture buffer with plane offset accepted"
+				  << std::endl;
+			return TestFail;
+		}
+
+		/* Buffers without offsets must still capture correctly. */
+		capture_->bufferReady.connect(this, &PlaneOffsetsTest::receiveBuffer);
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : buffers_) {
+			if (capture_->queueBuffer(buffer.get())) {
+				std::cout << "Failed to queue buffer" << std::endl;
+				return TestFail;
+			}
+		}
+
+		ret = capture_->streamOn();
+		if (ret)
+			return TestFail;
+
+		timeout.start(10000);
+		while (timeout.isRunning()) {
+			dispatcher->processEvents();
+			if (frames_ > 10)
+				break;
+		}
+
+		ret = capture_->streamOff();
+		if (ret)
+			return TestFail;
+
+		if (frames_ < 10) {
+			std::cout << "Failed to capture 10 frames within timeout."
+				  << std::endl;
+			return TestFail;
+		}
+
+		if (error_)
+			return TestFail;
+
+		return TestPass;
+	}
+
+private:
+	unsigned int frames_;
+	bool error_;
+};
+
+TEST_REGISTER(PlaneOffsetsTest);